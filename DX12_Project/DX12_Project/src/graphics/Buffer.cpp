@@ -1,6 +1,7 @@
 #include <graphics/Buffer.hpp>
 #include <assert.h>
 #include <d3dx12.h>
+#include <utils/AllocationTracker.hpp>
 #include <utils/Utility.hpp>
 
 namespace dx
@@ -55,6 +56,7 @@ namespace dx
 				IID_PPV_ARGS(&buffer[i])));
 
 			buffer[i]->SetName(L"Constant Buffer Upload Resource Heap");
+			TrackResource(buffer[i]);
 
 			//Copy the data
 			CD3DX12_RANGE readRange(0, 0);
@@ -62,7 +64,7 @@ namespace dx
 		}
 	}
 
-	void Buffer::CreateConstantBufferForRootTable(const UINT & size, UINT8 ** bufferAddress, ID3D12Resource ** buffer, D3D12_CPU_DESCRIPTOR_HANDLE* handlers)
+	void Buffer::CreateConstantBufferForRootTable(const UINT64 & size, UINT8 ** bufferAddress, ID3D12Resource ** buffer, D3D12_CPU_DESCRIPTOR_HANDLE* handlers)
 	{
 		for (unsigned int i = 0; i < FRAME_BUFFERS; ++i)
 		{
@@ -76,10 +78,11 @@ namespace dx
 				IID_PPV_ARGS(&buffer[i])));
 
 			buffer[i]->SetName(L"Constant Buffer Upload Resource Heap");
+			TrackResource(buffer[i]);
 
 			D3D12_CONSTANT_BUFFER_VIEW_DESC view = { 0 };
 			view.BufferLocation = buffer[0]->GetGPUVirtualAddress();
-			view.SizeInBytes = (size + 255) & ~255;	//256-byte aligned CB.
+			view.SizeInBytes = static_cast<UINT>((size + 255) & ~UINT64(255));	//256-byte aligned CB.
 			m_device->CreateConstantBufferView(&view, handlers[i]);
 
 			//Set pointer to the buffer address
@@ -88,7 +91,7 @@ namespace dx
 		}
 	}
 
-	void Buffer::CreateUAVForRootTable(const void* data, const UINT & size, const UINT & stride, const UINT & numElements, ID3D12Resource** buffer, ID3D12Resource** uploadHeap, 
+	void Buffer::CreateUAVForRootTable(const void* data, const UINT64 & size, const UINT & stride, const UINT & numElements, ID3D12Resource** buffer, ID3D12Resource** uploadHeap, 
 										D3D12_CPU_DESCRIPTOR_HANDLE handle, D3D12_RESOURCE_STATES resourceState)
 	{
 		//Create the buffer
@@ -111,7 +114,7 @@ namespace dx
 		m_device->CreateUnorderedAccessView(buffer[0], nullptr, &view, handle);
 	}
 
-	void Buffer::CreateSRVForRootTable(const void * data, const UINT & size, const UINT & stride, const UINT & numElements, ID3D12Resource ** buffer, ID3D12Resource ** uploadHeap, 
+	void Buffer::CreateSRVForRootTable(const void * data, const UINT64 & size, const UINT & stride, const UINT & numElements, ID3D12Resource ** buffer, ID3D12Resource ** uploadHeap, 
 										D3D12_CPU_DESCRIPTOR_HANDLE handle, D3D12_RESOURCE_STATES resourceState)
 	{
 		//Create the buffer
@@ -134,7 +137,7 @@ namespace dx
 		m_device->CreateShaderResourceView(buffer[0], &view, handle);
 	}
 
-	void Buffer::CreateSharedSRVUAVForTable(const void * data, const UINT & size, const UINT & stride, const UINT & numElements, ID3D12Resource ** buffer, ID3D12Resource ** uploadHeap, D3D12_CPU_DESCRIPTOR_HANDLE handle1, D3D12_CPU_DESCRIPTOR_HANDLE handle2, D3D12_RESOURCE_STATES resourceState)
+	void Buffer::CreateSharedSRVUAVForTable(const void * data, const UINT64 & size, const UINT & stride, const UINT & numElements, ID3D12Resource ** buffer, ID3D12Resource ** uploadHeap, D3D12_CPU_DESCRIPTOR_HANDLE handle1, D3D12_CPU_DESCRIPTOR_HANDLE handle2, D3D12_RESOURCE_STATES resourceState)
 	{
 		//Create the buffer
 		CreateBuffer(data, size, buffer, uploadHeap, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
@@ -142,6 +145,11 @@ namespace dx
 		//Transition the data from copy state
 		SetResourceBarrier(buffer, D3D12_RESOURCE_STATE_COPY_DEST, resourceState);
 
+		CreateSharedSRVUAVViews(buffer[0], stride, numElements, handle1, handle2);
+	}
+
+	void Buffer::CreateSharedSRVUAVViews(ID3D12Resource * buffer, const UINT & stride, const UINT & numElements, D3D12_CPU_DESCRIPTOR_HANDLE handle1, D3D12_CPU_DESCRIPTOR_HANDLE handle2)
+	{
 		//Describe the view
 		D3D12_SHADER_RESOURCE_VIEW_DESC view = {};
 		view.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
@@ -163,10 +171,37 @@ namespace dx
 		view1.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 
 		//Create the SRV
-		m_device->CreateShaderResourceView(buffer[0], &view, handle1);
+		m_device->CreateShaderResourceView(buffer, &view, handle1);
 
 		//Create the UAV
-		m_device->CreateUnorderedAccessView(buffer[0], nullptr, &view1, handle2);
+		m_device->CreateUnorderedAccessView(buffer, nullptr, &view1, handle2);
+	}
+
+	void Buffer::CreateRootDescriptorBuffer(const void * data, const UINT64 & size, ID3D12Resource ** buffer, ID3D12Resource ** uploadHeap, D3D12_RESOURCE_STATES resourceState)
+	{
+		//Create the buffer, no views are needed since it is bound directly as a root SRV/UAV
+		CreateBuffer(data, size, buffer, uploadHeap, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+		//Transition the data from copy state
+		SetResourceBarrier(buffer, D3D12_RESOURCE_STATE_COPY_DEST, resourceState);
+	}
+
+	void Buffer::CreateScratchBuffer(const UINT64 & size, ID3D12Resource ** buffer, D3D12_RESOURCE_STATES resourceState)
+	{
+		//Only ever written by compute shaders, so there is nothing to upload
+		assert(!m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS), resourceState, nullptr, IID_PPV_ARGS(&buffer[0])));
+		buffer[0]->SetName(L"Scratch Resource Heap");
+		TrackResource(buffer[0]);
+	}
+
+	void Buffer::CreateIndirectArgumentBuffer(const void * data, const UINT64 & size, ID3D12Resource ** buffer, ID3D12Resource ** uploadHeap)
+	{
+		//Create the buffer, UAV access lets compute shaders write the arguments
+		CreateBuffer(data, size, buffer, uploadHeap, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+		//Transition the data from copy state
+		SetResourceBarrier(buffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
 	}
 
 	void Buffer::CreateDepthStencilBuffer(ID3D12Resource ** buffer, D3D12_DEPTH_STENCIL_VIEW_DESC & view, D3D12_CPU_DESCRIPTOR_HANDLE handle)
@@ -181,13 +216,14 @@ namespace dx
 		m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
 			&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, SCREEN_WIDTH, SCREEN_HEIGHT, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL),
 			D3D12_RESOURCE_STATE_DEPTH_WRITE, &depth, IID_PPV_ARGS(&buffer[0]));
+		TrackResource(buffer[0]);
 
 		m_device->CreateDepthStencilView(buffer[0], &view, handle);
 	}
 
-	void Buffer::SetConstantBufferData(const void * data, const UINT & size, const UINT & frameIndex, UINT8 ** bufferAddress)
+	void Buffer::SetConstantBufferData(const void * data, const UINT64 & size, const UINT & frameIndex, UINT8 ** bufferAddress, const UINT64 & offset)
 	{
-		memcpy(bufferAddress[frameIndex], data, size);
+		memcpy(bufferAddress[frameIndex] + offset, data, size);
 	}
 
 	void Buffer::BindVertexBuffer(const UINT & location, D3D12_VERTEX_BUFFER_VIEW & view)
@@ -205,9 +241,9 @@ namespace dx
 		m_commandList->SetGraphicsRootConstantBufferView(rootIndex, buffer[frameIndex]->GetGPUVirtualAddress());
 	}
 
-	void Buffer::BindConstantBufferComputeForRootDescriptor(const UINT & rootIndex, const UINT & frameIndex, ID3D12Resource ** buffer)
+	void Buffer::BindConstantBufferComputeForRootDescriptor(const UINT & rootIndex, const UINT & frameIndex, ID3D12Resource ** buffer, const UINT64 & offset)
 	{
-		m_commandList->SetComputeRootConstantBufferView(rootIndex, buffer[frameIndex]->GetGPUVirtualAddress());
+		m_commandList->SetComputeRootConstantBufferView(rootIndex, buffer[frameIndex]->GetGPUVirtualAddress() + offset);
 	}
 
 	void Buffer::SetResourceBarrier(ID3D12Resource ** buffer, D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter)
@@ -215,25 +251,57 @@ namespace dx
 		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(*buffer, stateBefore, stateAfter));
 	}
 
-	void Buffer::CreateBuffer(const void * data, const UINT & size, ID3D12Resource ** buffer, ID3D12Resource ** uploadHeap, D3D12_RESOURCE_FLAGS flags)
+	void Buffer::SetUAVBarrier(ID3D12Resource ** buffer)
+	{
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(*buffer));
+	}
+
+	void Buffer::CopyBufferRegion(ID3D12Resource ** destBuffer, ID3D12Resource ** srcBuffer, const UINT64 & size)
+	{
+		m_commandList->CopyBufferRegion(*destBuffer, 0, *srcBuffer, 0, size);
+	}
+
+	void Buffer::CreateBuffer(const void * data, const UINT64 & size, ID3D12Resource ** buffer, ID3D12Resource ** uploadHeap, D3D12_RESOURCE_FLAGS flags)
 	{
 		//Create default heap for buffer
 		assert(!m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
 			&CD3DX12_RESOURCE_DESC::Buffer(size, flags), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&buffer[0])));
 		buffer[0]->SetName(L"Buffer Resource Heap");
+		TrackResource(buffer[0]);
 
 		//Create the upload heap
 		assert(!m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
 			&CD3DX12_RESOURCE_DESC::Buffer(size), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&uploadHeap[0])));
 		uploadHeap[0]->SetName(L"Buffer Upload Resource Heap");
+		TrackResource(uploadHeap[0]);
 
 		//Store buffer in upload heap
 		D3D12_SUBRESOURCE_DATA subData = { 0 };
 		subData.pData = data;
-		subData.RowPitch = size;
-		subData.SlicePitch = size;
+		subData.RowPitch = static_cast<LONG_PTR>(size);
+		subData.SlicePitch = static_cast<LONG_PTR>(size);
 
 		//Copy data from upload heap to default heap
 		UpdateSubresources<1>(m_commandList, buffer[0], uploadHeap[0], 0, 0, 1, &subData);
 	}
+
+	void WINAPI Buffer::OnResourceDestroyed(void* bytes)
+	{
+		AllocationTracker::OnRelease(reinterpret_cast<uintptr_t>(bytes));
+	}
+
+	void Buffer::TrackResource(ID3D12Resource * resource)
+	{
+		//The runtime calls back when the last reference goes away, wherever that happens
+		ComPtr<ID3DDestructionNotifier> notifier;
+		if (!resource || FAILED(resource->QueryInterface(IID_PPV_ARGS(&notifier))))
+			return;
+
+		D3D12_RESOURCE_DESC desc = resource->GetDesc();
+		UINT64 bytes = m_device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+
+		UINT callbackID;
+		if (SUCCEEDED(notifier->RegisterDestructionCallback(OnResourceDestroyed, reinterpret_cast<void*>(static_cast<uintptr_t>(bytes)), &callbackID)))
+			AllocationTracker::OnAllocate(bytes);
+	}
 }
\ No newline at end of file
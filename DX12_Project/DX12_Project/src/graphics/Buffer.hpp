@@ -18,26 +18,37 @@ namespace dx
 		void CreateIndexBuffer(const void* data, const UINT & size, ID3D12Resource** buffer, ID3D12Resource** uploadHeap, D3D12_INDEX_BUFFER_VIEW & view);
 		void CreateDepthStencilBuffer(ID3D12Resource** buffer, D3D12_DEPTH_STENCIL_VIEW_DESC & view, D3D12_CPU_DESCRIPTOR_HANDLE handle);
 		void CreateConstantBuffer(ID3D12Resource** buffer, UINT8** bufferAddress);
-		void CreateConstantBufferForRootTable(const UINT & size, UINT8** bufferAddress, ID3D12Resource** buffer, D3D12_CPU_DESCRIPTOR_HANDLE* handlers);
-		void CreateUAVForRootTable(const void* data, const UINT & size, const UINT & stride, const UINT & numElements, ID3D12Resource** buffer, ID3D12Resource** uploadHeap,
+		void CreateConstantBufferForRootTable(const UINT64 & size, UINT8** bufferAddress, ID3D12Resource** buffer, D3D12_CPU_DESCRIPTOR_HANDLE* handlers);
+		void CreateUAVForRootTable(const void* data, const UINT64 & size, const UINT & stride, const UINT & numElements, ID3D12Resource** buffer, ID3D12Resource** uploadHeap,
 								   D3D12_CPU_DESCRIPTOR_HANDLE handle, D3D12_RESOURCE_STATES resourceState);
-		void CreateSRVForRootTable(const void* data, const UINT & size, const UINT & stride, const UINT & numElements, ID3D12Resource** buffer, ID3D12Resource** uploadHeap,
+		void CreateSRVForRootTable(const void* data, const UINT64 & size, const UINT & stride, const UINT & numElements, ID3D12Resource** buffer, ID3D12Resource** uploadHeap,
 								   D3D12_CPU_DESCRIPTOR_HANDLE handle, D3D12_RESOURCE_STATES resourceState);
-		void CreateSharedSRVUAVForTable(const void* data, const UINT & size, const UINT & stride, const UINT & numElements, ID3D12Resource** buffer, ID3D12Resource** uploadHeap,
+		void CreateSharedSRVUAVForTable(const void* data, const UINT64 & size, const UINT & stride, const UINT & numElements, ID3D12Resource** buffer, ID3D12Resource** uploadHeap,
 										D3D12_CPU_DESCRIPTOR_HANDLE handle1, D3D12_CPU_DESCRIPTOR_HANDLE handle2, D3D12_RESOURCE_STATES resourceState);
+		void CreateSharedSRVUAVViews(ID3D12Resource* buffer, const UINT & stride, const UINT & numElements, D3D12_CPU_DESCRIPTOR_HANDLE handle1,
+									 D3D12_CPU_DESCRIPTOR_HANDLE handle2);
+		void CreateRootDescriptorBuffer(const void* data, const UINT64 & size, ID3D12Resource** buffer, ID3D12Resource** uploadHeap, D3D12_RESOURCE_STATES resourceState);
+		void CreateIndirectArgumentBuffer(const void* data, const UINT64 & size, ID3D12Resource** buffer, ID3D12Resource** uploadHeap);
+		void CreateScratchBuffer(const UINT64 & size, ID3D12Resource** buffer, D3D12_RESOURCE_STATES resourceState);
 
 	public:
-		void SetConstantBufferData(const void* data, const UINT & size, const UINT & frameIndex, UINT8** bufferAddress);
+		void SetConstantBufferData(const void* data, const UINT64 & size, const UINT & frameIndex, UINT8** bufferAddress, const UINT64 & offset = 0);
 		void BindVertexBuffer(const UINT & location, D3D12_VERTEX_BUFFER_VIEW & view);
 		void BindIndexBuffer(D3D12_INDEX_BUFFER_VIEW & view);
 		void BindConstantBufferForRootDescriptor(const UINT & rootIndex, const UINT & frameIndex, ID3D12Resource** buffer);
-		void BindConstantBufferComputeForRootDescriptor(const UINT & rootIndex, const UINT & frameIndex, ID3D12Resource** buffer);
+		void BindConstantBufferComputeForRootDescriptor(const UINT & rootIndex, const UINT & frameIndex, ID3D12Resource** buffer, const UINT64 & offset = 0);
 
 	public:
 		void SetResourceBarrier(ID3D12Resource ** buffer, D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter);
+		void SetUAVBarrier(ID3D12Resource ** buffer);
+		void CopyBufferRegion(ID3D12Resource ** destBuffer, ID3D12Resource ** srcBuffer, const UINT64 & size);
 
 	private:
-		void CreateBuffer(const void* data, const UINT & size, ID3D12Resource** buffer, ID3D12Resource** uploadHeap, D3D12_RESOURCE_FLAGS flags);
+		void CreateBuffer(const void* data, const UINT64 & size, ID3D12Resource** buffer, ID3D12Resource** uploadHeap, D3D12_RESOURCE_FLAGS flags);
+
+		//Counts the resource in AllocationTracker until it is destroyed
+		void TrackResource(ID3D12Resource* resource);
+		static void WINAPI OnResourceDestroyed(void* bytes);
 
 	private:
 		ID3D12Device* m_device;
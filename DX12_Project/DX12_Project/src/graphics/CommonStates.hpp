@@ -1,5 +1,5 @@
 #pragma once
-#include <d3d12.h>
+#include <d3dx12.h>
 
 namespace dx
 {
@@ -42,7 +42,7 @@ namespace dx
 		for (UINT i = 0; i < 8; i++) 
 		{
 			blendDesc.RenderTarget[i].BlendEnable = false;
-			blendDesc.RenderTarget[i].SrcBlend = D3D12_BLEND_ONE;
+			blendDesc.RenderTarget[i].SrcBlend = D3D12_BLEND_BLEND_FACTOR;		//1 unless the bodies are weighted
 			blendDesc.RenderTarget[i].DestBlend = D3D12_BLEND_ONE;
 			blendDesc.RenderTarget[i].BlendOp = D3D12_BLEND_OP_ADD;
 			blendDesc.RenderTarget[i].SrcBlendAlpha = D3D12_BLEND_ZERO;
@@ -55,4 +55,25 @@ namespace dx
 		return blendDesc;
 	}
 
+	//Scales the render target by the blend factor, whatever the shader writes
+	static D3D12_BLEND_DESC GetFadeBlendState()
+	{
+		D3D12_BLEND_DESC blendDesc = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+		blendDesc.RenderTarget[0].BlendEnable = true;
+		blendDesc.RenderTarget[0].SrcBlend = D3D12_BLEND_ZERO;
+		blendDesc.RenderTarget[0].DestBlend = D3D12_BLEND_BLEND_FACTOR;
+		blendDesc.RenderTarget[0].SrcBlendAlpha = D3D12_BLEND_ZERO;
+		blendDesc.RenderTarget[0].DestBlendAlpha = D3D12_BLEND_BLEND_FACTOR;
+
+		return blendDesc;
+	}
+
+	static D3D12_DEPTH_STENCIL_DESC GetNoDepthStencilDesc()
+	{
+		D3D12_DEPTH_STENCIL_DESC depthDesc = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+		depthDesc.DepthEnable = false;
+		depthDesc.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+
+		return depthDesc;
+	}
 }
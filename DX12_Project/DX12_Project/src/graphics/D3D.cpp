@@ -6,6 +6,7 @@
 #include <graphics/RootParameter.hpp>
 #include <utils/Utility.hpp>
 #include <utils/Input.hpp>
+#include <utils/ResourceLimits.hpp>
 #include <assert.h>
 #include <DirectXColors.h>
 #include <iostream>
@@ -19,8 +20,21 @@ namespace dx
 {
 	void D3D::LoadShaders()
 	{
-		m_shaders->LoadShadersFromFile(Shaders::ID::NBody, "src/res/shaders/RenderParticles.hlsl", VS | GS | PS);
-		m_shaders->LoadShadersFromFile(Shaders::ID::NBodyCompute, "src/res/shaders/nBodyCS.hlsl", CS);
+		m_shaders->LoadShadersFromFile(Shaders::ID::NBody, "src/res/shaders/RenderParticles.hlsl", VS | GS | PS, NBody::GetShaderDefines());
+		m_shaders->LoadShadersFromFile(Shaders::ID::NBodyCompute, "src/res/shaders/nBodyCS.hlsl", CS, NBody::GetShaderDefines());
+#if SINGLE_STATE_UPDATE
+		m_shaders->LoadShadersFromFile(Shaders::ID::NBodyAccelerate, "src/res/shaders/nBodyCS.hlsl", CS, NBody::GetComputePassDefines(Shaders::ID::NBodyAccelerate));
+		m_shaders->LoadShadersFromFile(Shaders::ID::NBodyIntegrate, "src/res/shaders/nBodyCS.hlsl", CS, NBody::GetComputePassDefines(Shaders::ID::NBodyIntegrate));
+#endif
+#if ESCAPER_DETECTION
+		m_shaders->LoadShadersFromFile(Shaders::ID::NBodyGather, "src/res/shaders/nBodyCS.hlsl", CS, NBody::GetComputePassDefines(Shaders::ID::NBodyGather));
+#endif
+
+#if STOCHASTIC_RENDERING
+		const D3D_SHADER_MACRO fadeDefines[] = { { "FADE", "1" }, { nullptr, nullptr } };
+		m_shaders->LoadShadersFromFile(Shaders::ID::AccumulateFade, "src/res/shaders/Accumulate.hlsl", VS | PS, fadeDefines);
+		m_shaders->LoadShadersFromFile(Shaders::ID::AccumulateResolve, "src/res/shaders/Accumulate.hlsl", VS | PS);
+#endif
 	}
 
 	void D3D::LoadTextures()
@@ -36,6 +50,26 @@ namespace dx
 		m_buffer = std::make_unique<Buffer>(m_device.Get(), m_commandList.Get());
 		m_camera = std::make_unique<Camera>();
 		m_timer = std::make_unique<D3D12Timer>(m_device.Get());
+		m_flightRecorder = std::make_unique<FlightRecorder>();
+#if SOAK_MONITOR
+		m_soakMonitor = std::make_unique<SoakMonitor>();
+#endif
+
+#if STOCHASTIC_RENDERING
+		SubsetSettings subsetSettings;
+		subsetSettings.frameBudgetMs = SUBSET_FRAME_BUDGET_MS;
+		subsetSettings.maxStride = MAX_SUBSET_STRIDE;
+		m_subsetSchedule = std::make_unique<SubsetSchedule>(subsetSettings);
+		m_renderTimer = std::make_unique<D3D12Timer>(m_device.Get());
+		m_accumulator = std::make_unique<TemporalAccumulator>(m_device.Get(), m_commandList.Get(), SCREEN_WIDTH, SCREEN_HEIGHT);
+#endif
+
+#if FRAME_CAPTURE
+		EncoderSettings captureSettings;
+		captureSettings.format = FRAME_CAPTURE_RAW_VIDEO ? CaptureFormat::RawVideo : CaptureFormat::Png;
+		captureSettings.path = FRAME_CAPTURE_RAW_VIDEO ? FRAME_CAPTURE_PATH ".rgb" : FRAME_CAPTURE_PATH;
+		m_frameCapture = std::make_unique<FrameCapture>(m_device.Get(), m_backBufferRenderTarget[0].Get(), FRAME_CAPTURE_SLOTS, FRAME_CAPTURE_INTERVAL, captureSettings);
+#endif
 
 		//Descriptor heaps
 		m_depthStencilHeap = std::make_unique<DescriptorHeap>(m_device.Get(), m_commandList.Get(), 1);
@@ -64,7 +98,7 @@ namespace dx
 		LoadTextures();
 
 		//Init the NBody system
-		m_nBodySystem = std::make_unique<NBody>(m_device.Get(), m_commandList.Get(), m_buffer.get(), m_camera.get(), m_texture.get());
+		m_nBodySystem = std::make_unique<NBody>(m_device.Get(), m_commandQueue.Get(), m_commandList.Get(), m_buffer.get(), m_camera.get(), m_texture.get());
 
 		//--- Standard shader ---
 		//Desc range and root table for standard pipeline 
@@ -77,6 +111,9 @@ namespace dx
 		rootParams.AppendRootParameterCBV(0, D3D12_SHADER_VISIBILITY_ALL);
 		rootParams.AppendRootParameterDescTable(1, &graphicsRootDesc.GetDescRange()[0], D3D12_SHADER_VISIBILITY_ALL);
 		rootParams.AppendRootParameterDescTable(1, &graphicsRootDesc.GetDescRange()[1], D3D12_SHADER_VISIBILITY_ALL);
+#if TILE_RELATIVE_COORDINATES && !FUSED_RENDER_PREP
+		rootParams.AppendRootParameterSRV(2, D3D12_SHADER_VISIBILITY_ALL); //Cells
+#endif
 
 		//Create a standard root signature
 		m_rootSignature->CreateRootSignature((UINT)rootParams.GetRootParameters().size(), 1, &rootParams.GetRootParameters()[0], 
@@ -85,20 +122,47 @@ namespace dx
 		//--- Compute shader ---
 		RootDescriptor uavRootDesc;
 		uavRootDesc.AppendDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
-		uavRootDesc.AppendDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
+		uavRootDesc.AppendDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, NBody::GetNumSegments(), 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE); //Every body segment
 
 		RootParameter computeRootParams;
 		computeRootParams.AppendRootParameterCBV(0, D3D12_SHADER_VISIBILITY_ALL);
 		computeRootParams.AppendRootParameterDescTable(1, &uavRootDesc.GetDescRange()[0], D3D12_SHADER_VISIBILITY_ALL);
 		computeRootParams.AppendRootParameterDescTable(1, &uavRootDesc.GetDescRange()[1], D3D12_SHADER_VISIBILITY_ALL);
+#if FUSED_RENDER_PREP
+		computeRootParams.AppendRootParameterUAV(1, D3D12_SHADER_VISIBILITY_ALL); //Render records
+		computeRootParams.AppendRootParameterUAV(2, D3D12_SHADER_VISIBILITY_ALL); //Indirect draw arguments
+#elif SINGLE_STATE_UPDATE
+		computeRootParams.AppendRootParameterUAV(1, D3D12_SHADER_VISIBILITY_ALL); //Accelerations
+#endif
+#if TILE_RELATIVE_COORDINATES
+		computeRootParams.AppendRootParameterSRV(1, D3D12_SHADER_VISIBILITY_ALL); //Old cells
+		computeRootParams.AppendRootParameterUAV(3, D3D12_SHADER_VISIBILITY_ALL); //New cells
+#endif
+#if ESCAPER_DETECTION
+		computeRootParams.AppendRootParameterSRV(2, D3D12_SHADER_VISIBILITY_ALL); //Gather order
+#endif
+		assert(computeRootParams.GetRootParameters().size() == COMPUTE_ROOT_COUNT);
 
 		m_computeRootSignature->CreateRootSignature((UINT)computeRootParams.GetRootParameters().size(), 0, &computeRootParams.GetRootParameters()[0], nullptr, 
 													D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
 		//Fill in input layout and pipeline states for shaders
 		m_shaders->CreatePipelineStateForComputeShader(Shaders::ID::NBodyCompute, m_computeRootSignature->GetRootSignature());
+#if SINGLE_STATE_UPDATE
+		m_shaders->CreatePipelineStateForComputeShader(Shaders::ID::NBodyAccelerate, m_computeRootSignature->GetRootSignature());
+		m_shaders->CreatePipelineStateForComputeShader(Shaders::ID::NBodyIntegrate, m_computeRootSignature->GetRootSignature());
+#endif
+#if ESCAPER_DETECTION
+		m_shaders->CreatePipelineStateForComputeShader(Shaders::ID::NBodyGather, m_computeRootSignature->GetRootSignature());
+#endif
 		m_shaders->CreateInputLayoutAndPipelineState(Shaders::ID::NBody, m_rootSignature->GetRootSignature(), 
-													 GetNoCullRasterizerDesc(), GetParticleBlendState(), D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT);
+													 GetNoCullRasterizerDesc(), GetParticleBlendState(), D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT, NBody::GetRenderTargetFormat());
+#if STOCHASTIC_RENDERING
+		m_shaders->CreateInputLayoutAndPipelineState(Shaders::ID::AccumulateFade, m_rootSignature->GetRootSignature(), GetNoCullRasterizerDesc(), GetFadeBlendState(),
+													 D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE, TemporalAccumulator::Format, GetNoDepthStencilDesc());
+		m_shaders->CreateInputLayoutAndPipelineState(Shaders::ID::AccumulateResolve, m_rootSignature->GetRootSignature(), GetNoCullRasterizerDesc(), CD3DX12_BLEND_DESC(D3D12_DEFAULT),
+													 D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE, DXGI_FORMAT_R8G8B8A8_UNORM, GetNoDepthStencilDesc());
+#endif
 
 		//Create descriptor heaps and depth stencil buffer
 		m_depthStencilHeap->CreateDescriptorHeap(1, D3D12_DESCRIPTOR_HEAP_FLAG_NONE, D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
@@ -112,17 +176,77 @@ namespace dx
 		m_frameIndex = 0;
 
 		QueryPerformanceFrequency(&m_cpuFreq);
+		m_lastLimitRefresh = FlightRecorder::GetSteadyNanoseconds();
+
+		OutputDebugStringA(FormatResourceLimits(GetResourceLimits()).c_str());
 	}
 
 	void D3D::Render()
 	{
-		BeginScene(Colors::Black);
-	
-		//Set resources for normal pipeline
-		m_nBodySystem->RenderBodies(m_shaders.get(), m_rootSignature.get(), m_frameIndex);
-		
-		EndScene();
+		//Timed by the recorder itself, the step timer delta belongs to the previous frame and is clamped
+		m_flightRecorder->BeginFrame();
+		{
+			FLIGHT_SCOPE(m_flightRecorder.get(), "Frame");
+			BeginScene(Colors::Black);
+
+#if STOCHASTIC_RENDERING
+			//This frame's subset is added to the faded history, then the history is shown.
+			//Without reprojection a moving camera restarts the accumulation. The stride is
+			//adapted to the render passes alone, the update costs the same whatever it is.
+			Matrix viewProjection = m_camera->GetViewProjectionMatrix();
+			m_subsetSchedule->BeginFrame(m_renderMs, viewProjection != m_lastViewProjection);
+			m_lastViewProjection = viewProjection;
+
+			m_nBodySystem->SetRenderSubset(m_subsetSchedule->GetStride(), m_subsetSchedule->GetPhase(), m_subsetSchedule->GetSubsetWeight());
+			m_renderTimer->Start(m_commandList.Get());
+			m_accumulator->Begin(m_shaders.get(), m_rootSignature.get(), m_subsetSchedule->GetBlend(), m_depthStencilHeap->GetCPUIncrementHandle(0));
+#endif
+
+			//Set resources for normal pipeline
+			{
+				FLIGHT_SCOPE(m_flightRecorder.get(), "RenderBodies");
+				m_nBodySystem->RenderBodies(m_shaders.get(), m_rootSignature.get(), m_frameIndex);
+			}
+
+#if STOCHASTIC_RENDERING
+			m_accumulator->Resolve(m_shaders.get(), m_rootSignature.get(), GetBackBufferView(), m_depthStencilHeap->GetCPUIncrementHandle(0));
+			m_renderTimer->Stop(m_commandList.Get());
+			m_renderTimer->ResolveQuery(m_commandList.Get());
+#endif
+
+			EndScene();
+		}
+
+		//Dumps the last frames to a trace file when this one was a hitch
+		m_flightRecorder->EndFrame();
 
+		//Re-read the CPU and memory limits, e.g. after a pod resize. Parallel loops, the snapshot
+		//and video writers and the frame encoders pick up the new worker count on their own.
+		uint64_t now = FlightRecorder::GetSteadyNanoseconds();
+		if (now - m_lastLimitRefresh >= uint64_t(RESOURCE_REFRESH_SECONDS * 1e9))
+		{
+			m_lastLimitRefresh = now;
+			if (RefreshResourceLimits())
+				OutputDebugStringA(FormatResourceLimits(GetResourceLimits()).c_str());
+		}
+
+#if SOAK_MONITOR
+		//Leak and drift checks over the whole session on the frame the recorder just closed,
+		//unclamped, reported once when a trend fails
+		m_soakMonitor->RecordStep(m_flightRecorder->GetLastFrameMs() / 1000.0);
+		bool sampled = m_soakMonitor->Update();
+
+		if (sampled && !m_soakFailed)
+		{
+			SoakVerdict verdict = m_soakMonitor->Evaluate();
+			if (!verdict.passed)
+			{
+				OutputDebugStringA(FormatSoakVerdict(verdict).c_str());
+				m_soakMonitor->WriteCsv("soak.csv");
+				m_soakFailed = true;
+			}
+		}
+#endif
 	}
 
 	void D3D::BeginScene(const FLOAT* color)
@@ -137,6 +261,18 @@ namespace dx
 		if (Input::GetKeyDown(Keyboard::Keys::Escape))
 			PostQuitMessage(0);
 
+#if GROWABLE_BODY_BUFFERS
+		//+ appends a new shell of bodies, - removes as many from the end, both before the update records
+		UINT64 numBodies = m_nBodySystem->GetBodyCount();
+		if (Input::GetKeyDown(Keyboard::Keys::OemPlus))
+		{
+			if (!m_nBodySystem->AppendBodies(MAX_APPENDED_BODIES))
+				OutputDebugStringA("Could not append bodies, MAX_BODIES reached or the upload slots are busy\n");
+		}
+		else if (Input::GetKeyDown(Keyboard::Keys::OemMinus) && numBodies > MAX_APPENDED_BODIES)
+			m_nBodySystem->SetBodyCount(static_cast<UINT>(numBodies - MAX_APPENDED_BODIES), nullptr);
+#endif
+
 		//Reset resources
 		assert(!m_commandAllocator->Reset());
 		assert(!m_commandList->Reset(m_commandAllocator.Get(), nullptr));
@@ -144,7 +280,10 @@ namespace dx
 		m_timer->Start(m_commandList.Get());
 
 		//Run the compute shader
-		m_nBodySystem->UpdateBodies(m_shaders.get(), m_computeRootSignature.get(), m_frameIndex);
+		{
+			FLIGHT_SCOPE(m_flightRecorder.get(), "UpdateBodies");
+			m_nBodySystem->UpdateBodies(m_shaders.get(), m_computeRootSignature.get(), m_frameIndex);
+		}
 
 		m_commandList->RSSetViewports(1, &m_viewport);
 		m_commandList->RSSetScissorRects(1, &m_rect);
@@ -153,9 +292,7 @@ namespace dx
 		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_backBufferRenderTarget[m_frameIndex].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
 
 		//Get the render target view handle for the current back buffer.
-		D3D12_CPU_DESCRIPTOR_HANDLE renderTargetViewHandle = { 0 };
-		renderTargetViewHandle = m_renderTargetViewDescHeap->GetCPUDescriptorHandleForHeapStart();
-		renderTargetViewHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * m_frameIndex;
+		D3D12_CPU_DESCRIPTOR_HANDLE renderTargetViewHandle = GetBackBufferView();
 
 		//Record commands in the command list now.
 		m_commandList->OMSetRenderTargets(1, &renderTargetViewHandle, 0, &m_depthStencilHeap->GetCPUIncrementHandle(0));
@@ -165,6 +302,11 @@ namespace dx
 
 	void D3D::EndScene()
 	{
+#if FRAME_CAPTURE
+		//Copy the finished image while the back buffer is still a render target
+		m_frameCapture->Record(m_commandList.Get(), m_backBufferRenderTarget[m_frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+#endif
+
 		//Indicate that the backbuffer will now be used to present
 		CD3DX12_RESOURCE_BARRIER barrier = {};
 		barrier = barrier.Transition(m_backBufferRenderTarget[m_frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
@@ -173,13 +315,34 @@ namespace dx
 		m_timer->Stop(m_commandList.Get());
 		m_timer->ResolveQuery(m_commandList.Get());
 
-		ExecuteCommandList();
-		assert(!m_swapChain->Present(0, 0));
+		{
+			FLIGHT_SCOPE(m_flightRecorder.get(), "ExecuteCommandList");
+			ExecuteCommandList();
+			m_nBodySystem->OnFrameSubmitted();
+#if FRAME_CAPTURE
+			m_frameCapture->Submit(m_commandQueue.Get());
+#endif
+		}
 
-		WaitForPreviousFrame();
+		{
+			FLIGHT_SCOPE(m_flightRecorder.get(), "Present");
+			assert(!m_swapChain->Present(0, 0));
+		}
+
+		{
+			FLIGHT_SCOPE(m_flightRecorder.get(), "WaitForPreviousFrame");
+			WaitForPreviousFrame();
+		}
+		m_nBodySystem->OnFrameCompleted();
+
+#if FRAME_CAPTURE
+		//Hands the copies that finished to the encoders, never waits for them
+		m_frameCapture->Poll();
+#endif
 
 		CalculateRenderTime();
 		CalculateFrameTimeAndFPS();
+		RecordFrameTimings();
 
 		//Get the current back buffer
 		m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
@@ -191,6 +354,9 @@ namespace dx
 		WaitForPreviousFrame();
 		CloseHandle(m_fenceEvent);
 
+		//Encodes the frames still in flight
+		m_frameCapture.reset();
+
 		m_texture->Release();
 		/*m_device.Get()->Release();*/
 	}
@@ -298,6 +464,11 @@ namespace dx
 
 		m_averageDiffMs = m_end - m_begin;
 		m_averageDiffMs *= 1000.0;
+
+#if STOCHASTIC_RENDERING
+		m_renderTimer->CalculateTime();
+		m_renderMs = (m_renderTimer->GetEndTime() - m_renderTimer->GetBeginTime()) * 1000.0 / m_freq;
+#endif
 	}
 
 	void D3D::CalculateFrameTimeAndFPS()
@@ -325,6 +496,29 @@ namespace dx
 		++m_frameCount;
 	}
 
+	void D3D::RecordFrameTimings()
+	{
+		//GPU timestamps mapped through the clock calibration onto the QueryPerformanceCounter
+		//based steady clock the flight recorder converts from
+		double cpuCalibrationNs = m_CPUCalibration * 1e9 / m_cpuFreq.QuadPart;
+		auto toNanoseconds = [&](const UINT64 & gpuTicks)
+		{
+			double offset = (static_cast<double>(gpuTicks) - static_cast<double>(m_GPUCalibration)) * 1e9 / m_freq;
+			return static_cast<uint64_t>(cpuCalibrationNs + offset);
+		};
+
+		m_flightRecorder->RecordGpuScope("GPU frame", toNanoseconds(m_timer->GetBeginTime()), toNanoseconds(m_timer->GetEndTime()));
+		m_flightRecorder->RecordCounter("GPU ms", m_averageDiffMs);
+		m_flightRecorder->RecordQueueState("Direct queue", m_fenceValue - 1, m_fence->GetCompletedValue());
+	}
+
+	D3D12_CPU_DESCRIPTOR_HANDLE D3D::GetBackBufferView() const
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE renderTargetViewHandle = m_renderTargetViewDescHeap->GetCPUDescriptorHandleForHeapStart();
+		renderTargetViewHandle.ptr += m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * m_frameIndex;
+		return renderTargetViewHandle;
+	}
+
 	void D3D::CreateCommandsAndSwapChain(HWND hwnd)
 	{
 		D3D12_COMMAND_QUEUE_DESC commandQueueDesc;
@@ -11,9 +11,14 @@
 #include <graphics/RootSignature.hpp>
 #include <graphics/Shader.hpp>
 #include <graphics/Camera.hpp>
+#include <graphics/FrameCapture.hpp>
 #include <graphics/nbody/nBody.hpp>
+#include <graphics/TemporalAccumulator.hpp>
 #include <array>
 #include <D3D12Timer.hpp>
+#include <utils/FlightRecorder.hpp>
+#include <utils/SoakMonitor.hpp>
+#include <utils/SubsetSchedule.hpp>
 
 using namespace DirectX;
 
@@ -48,6 +53,8 @@ namespace dx
 		void WaitForPreviousFrame();
 		void CalculateRenderTime();
 		void CalculateFrameTimeAndFPS();
+		void RecordFrameTimings();
+		D3D12_CPU_DESCRIPTOR_HANDLE GetBackBufferView() const;
 
 	private:
 		std::unique_ptr<Texture> m_texture;
@@ -59,6 +66,12 @@ namespace dx
 		std::unique_ptr<Camera> m_camera;
 		std::unique_ptr<NBody> m_nBodySystem;
 		std::unique_ptr<D3D12Timer> m_timer;
+		std::unique_ptr<D3D12Timer> m_renderTimer;		//Sprite and accumulation passes only
+		std::unique_ptr<FlightRecorder> m_flightRecorder;
+		std::unique_ptr<SoakMonitor> m_soakMonitor;
+		std::unique_ptr<TemporalAccumulator> m_accumulator;
+		std::unique_ptr<SubsetSchedule> m_subsetSchedule;
+		std::unique_ptr<FrameCapture> m_frameCapture;
 
 	private:
 		ComPtr<ID3D12Device> m_device;
@@ -81,11 +94,15 @@ namespace dx
 		D3D12_DEPTH_STENCIL_VIEW_DESC m_depthViewDesc;
 		HWND m_hwnd;
 		int m_count = 0;
+		bool m_soakFailed = false;
+		uint64_t m_lastLimitRefresh = 0;
+		Matrix m_lastViewProjection;
 
 		UINT64 m_GPUCalibration;
 		UINT64 m_CPUCalibration;
 		UINT64 m_offset;
 		double m_averageDiffMs = 0.0;
+		double m_renderMs = 0.0;
 		double m_frame = 0.0;
 		double m_overlapp = 0.0;
 		int m_frameCount = 0;
@@ -0,0 +1,121 @@
+#include <graphics/FrameCapture.hpp>
+#include <assert.h>
+#include <d3dx12.h>
+#include <algorithm>
+
+namespace dx
+{
+	FrameCapture::FrameCapture(ID3D12Device* device, ID3D12Resource* backBuffer, const UINT & numSlots, const UINT & interval, const EncoderSettings & settings)
+		: m_ring(numSlots), m_encoders(settings), m_interval((std::max)(interval, 1u))
+	{
+		//Row pitch of the copy is aligned to 256 bytes, the encoders skip the padding
+		D3D12_RESOURCE_DESC desc = backBuffer->GetDesc();
+		UINT64 size = 0;
+		device->GetCopyableFootprints(&desc, 0, 1, 0, &m_footprint, nullptr, nullptr, &size);
+
+		m_readback.resize(numSlots);
+		m_addresses.resize(numSlots);
+		for (UINT i = 0; i < numSlots; ++i)
+		{
+			assert(!device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK), D3D12_HEAP_FLAG_NONE,
+				&CD3DX12_RESOURCE_DESC::Buffer(size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(m_readback[i].GetAddressOf())));
+			m_readback[i]->SetName(L"Frame Capture Readback Heap");
+
+			//Mapped for the lifetime of the capture, a slot is only read after its fence
+			CD3DX12_RANGE readRange(0, static_cast<SIZE_T>(size));
+			void* address = nullptr;
+			assert(!m_readback[i]->Map(0, &readRange, &address));
+			m_addresses[i] = static_cast<const unsigned char*>(address);
+		}
+
+		assert(!device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(m_fence.GetAddressOf())));
+		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		assert(m_fenceEvent);
+	}
+
+	FrameCapture::~FrameCapture()
+	{
+		Flush();
+
+		CD3DX12_RANGE writeRange(0, 0);
+		for (ComPtr<ID3D12Resource> & buffer : m_readback)
+			buffer->Unmap(0, &writeRange);
+		CloseHandle(m_fenceEvent);
+	}
+
+	void FrameCapture::Record(ID3D12GraphicsCommandList* commandList, ID3D12Resource* backBuffer, const D3D12_RESOURCE_STATES & state)
+	{
+		assert(m_pendingSlot == CaptureRing::NoSlot);
+		if (m_frame++ % m_interval != 0)
+			return;
+
+		m_pendingSlot = m_ring.Acquire();
+		if (m_pendingSlot == CaptureRing::NoSlot)
+			return;
+
+		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(backBuffer, state, D3D12_RESOURCE_STATE_COPY_SOURCE));
+
+		CD3DX12_TEXTURE_COPY_LOCATION destination(m_readback[m_pendingSlot].Get(), m_footprint);
+		CD3DX12_TEXTURE_COPY_LOCATION source(backBuffer, 0);
+		commandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+
+		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(backBuffer, D3D12_RESOURCE_STATE_COPY_SOURCE, state));
+	}
+
+	void FrameCapture::Submit(ID3D12CommandQueue* commandQueue)
+	{
+		if (m_pendingSlot == CaptureRing::NoSlot)
+			return;
+
+		assert(!commandQueue->Signal(m_fence.Get(), ++m_fenceValue));
+		m_ring.Submit(m_pendingSlot, m_frame - 1, m_fenceValue);
+		m_pendingSlot = CaptureRing::NoSlot;
+	}
+
+	void FrameCapture::Poll()
+	{
+		m_retired.clear();
+		m_ring.Retire(m_fence->GetCompletedValue(), m_retired);
+
+		for (const RetiredCapture & capture : m_retired)
+		{
+			CaptureImage image = { m_addresses[capture.slot], m_footprint.Footprint.Width, m_footprint.Footprint.Height, m_footprint.Footprint.RowPitch };
+			unsigned int slot = capture.slot;
+
+			if (m_encoders.Submit(capture.frame, image, [this, slot] { m_ring.Release(slot); }))
+				++m_numCaptured;
+			else
+			{
+				m_ring.Release(slot);
+				++m_numRejected;
+			}
+		}
+	}
+
+	void FrameCapture::Flush()
+	{
+		if (m_fence->GetCompletedValue() < m_fenceValue)
+		{
+			assert(!m_fence->SetEventOnCompletion(m_fenceValue, m_fenceEvent));
+			WaitForSingleObject(m_fenceEvent, INFINITE);
+		}
+
+		Poll();
+		m_encoders.Flush();
+	}
+
+	uint64_t FrameCapture::GetNumCaptured() const
+	{
+		return m_numCaptured;
+	}
+
+	uint64_t FrameCapture::GetNumDropped() const
+	{
+		return m_ring.GetNumDropped() + m_numRejected;
+	}
+
+	const FrameEncoderPool & FrameCapture::GetEncoders() const
+	{
+		return m_encoders;
+	}
+}
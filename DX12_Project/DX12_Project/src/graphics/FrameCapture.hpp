@@ -0,0 +1,58 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+#include <utils/CaptureRing.hpp>
+#include <utils/FrameEncoder.hpp>
+#include <vector>
+
+using namespace Microsoft::WRL;
+
+namespace dx
+{
+	//Copies back buffers into persistently mapped readback buffers and hands the finished
+	//copies to a FrameEncoderPool. Record adds the copy to the frame's command list when a
+	//slot is free, Submit signals the capture fence after the list was executed and Poll
+	//passes the slots the fence retired to the encoders, which release them once the pixels
+	//were read. The render thread never waits on the copy or the encoding.
+	class FrameCapture
+	{
+	public:
+		FrameCapture(ID3D12Device* device, ID3D12Resource* backBuffer, const UINT & numSlots, const UINT & interval, const EncoderSettings & settings);
+		~FrameCapture();
+
+	public:
+		//Copies the back buffer, which is in state and stays in it, skipped between intervals
+		//or when no slot is free
+		void Record(ID3D12GraphicsCommandList* commandList, ID3D12Resource* backBuffer, const D3D12_RESOURCE_STATES & state);
+
+		//Call after executing the command list Record was given
+		void Submit(ID3D12CommandQueue* commandQueue);
+
+		//Hands the finished copies to the encoders
+		void Poll();
+
+		//Waits for the queue and encodes everything captured so far
+		void Flush();
+
+		uint64_t GetNumCaptured() const;		//Frames handed to the encoders
+		uint64_t GetNumDropped() const;			//No free slot, or the encoders were saturated
+		const FrameEncoderPool & GetEncoders() const;
+
+	private:
+		ComPtr<ID3D12Fence> m_fence;
+		HANDLE m_fenceEvent;
+		UINT64 m_fenceValue = 0;
+		std::vector<ComPtr<ID3D12Resource>> m_readback;
+		std::vector<const unsigned char*> m_addresses;
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT m_footprint;
+
+		CaptureRing m_ring;
+		FrameEncoderPool m_encoders;
+		std::vector<RetiredCapture> m_retired;
+		UINT m_interval;
+		uint64_t m_frame = 0;
+		unsigned int m_pendingSlot = CaptureRing::NoSlot;
+		uint64_t m_numCaptured = 0;
+		uint64_t m_numRejected = 0;
+	};
+}
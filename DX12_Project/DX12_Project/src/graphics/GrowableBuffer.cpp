@@ -0,0 +1,107 @@
+#include <graphics/GrowableBuffer.hpp>
+#include <assert.h>
+#include <d3dx12.h>
+#include <string.h>
+
+namespace dx
+{
+	GrowableBuffer::GrowableBuffer(ID3D12Device* device, ID3D12CommandQueue* commandQueue, ID3D12GraphicsCommandList* commandList, const UINT64 & reservedBytes,
+								   D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initialState, const UINT64 & uploadBytes, const UINT & uploadSlots,
+								   const UINT & tilesPerHeap)
+		: m_device(device), m_commandQueue(commandQueue), m_commandList(commandList), m_tiles(reservedBytes, tilesPerHeap, 16, D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES),
+		  m_uploadRing(std::make_unique<UploadRing>(device, uploadBytes, uploadSlots))
+	{
+		//Buffers only need tier 1, unbound tiles are never read since shaders stop at the live count
+		D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+		m_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options));
+		assert(options.TiledResourcesTier != D3D12_TILED_RESOURCES_TIER_NOT_SUPPORTED);
+
+		//Reserves virtual address space only, no memory is committed
+		assert(!m_device->CreateReservedResource(&CD3DX12_RESOURCE_DESC::Buffer(m_tiles.GetReservedBytes(), flags), initialState, nullptr,
+			IID_PPV_ARGS(m_resource.GetAddressOf())));
+		m_resource->SetName(L"Growable Reserved Buffer");
+	}
+
+	bool GrowableBuffer::Resize(const UINT64 & bytes)
+	{
+		m_updates.clear();
+		if (!m_tiles.Resize(bytes, m_updates))
+			return false;
+
+		//One heap at a time as the tail crosses into it
+		while (m_heaps.size() < m_tiles.GetNumHeaps())
+		{
+			CD3DX12_HEAP_DESC desc(m_tiles.GetTilesPerHeap() * m_tiles.GetTileSize(), D3D12_HEAP_TYPE_DEFAULT, 0, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS);
+
+			ComPtr<ID3D12Heap> heap;
+			assert(!m_device->CreateHeap(&desc, IID_PPV_ARGS(heap.GetAddressOf())));
+			heap->SetName(L"Growable Buffer Tile Heap");
+			m_heaps.push_back(heap);
+		}
+
+		ApplyUpdates();
+		return true;
+	}
+
+	bool GrowableBuffer::Write(const UINT64 & offset, const void * data, const UINT64 & size, D3D12_RESOURCE_STATES state)
+	{
+		assert(offset + size <= m_tiles.GetBoundBytes());
+
+		if (!CanWrite(size))
+			return false;
+
+		UINT slot = m_uploadRing->Acquire();
+		memcpy(m_uploadRing->GetAddress(slot), data, static_cast<size_t>(size));
+		m_pendingSlots.push_back(slot);
+
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_resource.Get(), state, D3D12_RESOURCE_STATE_COPY_DEST));
+		m_commandList->CopyBufferRegion(m_resource.Get(), offset, m_uploadRing->GetResource(), m_uploadRing->GetOffset(slot), size);
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST, state));
+		return true;
+	}
+
+	bool GrowableBuffer::CanWrite(const UINT64 & size) const
+	{
+		//A slot not released yet still has to be read by the copy recorded into it
+		return size <= m_uploadRing->GetSlotSize() && m_pendingSlots.size() < m_uploadRing->GetNumSlots();
+	}
+
+	void GrowableBuffer::OnSubmitted()
+	{
+		for (const UINT & slot : m_pendingSlots)
+			m_uploadRing->Release(m_commandQueue, slot);
+		m_pendingSlots.clear();
+	}
+
+	void GrowableBuffer::ReleaseUnusedHeaps()
+	{
+		m_heaps.resize(m_heaps.size() - m_tiles.Trim());
+	}
+
+	ID3D12Resource * GrowableBuffer::GetResource() const
+	{
+		return m_resource.Get();
+	}
+
+	const TileMap & GrowableBuffer::GetTileMap() const
+	{
+		return m_tiles;
+	}
+
+	void GrowableBuffer::ApplyUpdates()
+	{
+		for (const TileRange & range : m_updates)
+		{
+			D3D12_TILED_RESOURCE_COORDINATE start = CD3DX12_TILED_RESOURCE_COORDINATE(range.virtualTile, 0, 0, 0);
+			D3D12_TILE_REGION_SIZE size = CD3DX12_TILE_REGION_SIZE(range.count, FALSE, 0, 0, 0);
+
+			bool bind = range.heap != TileRange::NullHeap;
+			D3D12_TILE_RANGE_FLAGS flags = bind ? D3D12_TILE_RANGE_FLAG_NONE : D3D12_TILE_RANGE_FLAG_NULL;
+			UINT heapStart = range.heapTile;
+			UINT count = range.count;
+
+			m_commandQueue->UpdateTileMappings(m_resource.Get(), 1, &start, &size, bind ? m_heaps[range.heap].Get() : nullptr, 1, &flags,
+				&heapStart, &count, D3D12_TILE_MAPPING_FLAG_NONE);
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+#include <memory>
+#include <vector>
+#include <graphics/UploadRing.hpp>
+#include <utils/TileMap.hpp>
+
+using namespace Microsoft::WRL;
+
+namespace dx
+{
+	//Buffer whose size can change without recreating it. A reserved resource spans the
+	//whole virtual range up front and physical 64 KB tiles from a pool of heaps are bound
+	//to its tail with UpdateTileMappings as it grows or shrinks. The resource, its GPU
+	//address and every view on it stay the same, and growing never copies existing data.
+	//Views should cover the reserved range, shaders bound their reads by the live count.
+	//Writes are staged in a persistent UploadRing of uploadSlots slots of uploadBytes, so
+	//growing on the render thread never creates a resource.
+	class GrowableBuffer
+	{
+	public:
+		GrowableBuffer(ID3D12Device* device, ID3D12CommandQueue* commandQueue, ID3D12GraphicsCommandList* commandList, const UINT64 & reservedBytes,
+					   D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initialState, const UINT64 & uploadBytes, const UINT & uploadSlots = 3,
+					   const UINT & tilesPerHeap = 256);
+
+	public:
+		//Queues the tile mapping changes on the command queue, so they land before the next
+		//ExecuteCommandLists. Returns false when bytes exceed the reserved range.
+		bool Resize(const UINT64 & bytes);
+
+		//Records a copy of data into the bound part of the buffer through the next slot of the
+		//upload ring, which may wait for the GPU to finish an older copy out of it. Returns
+		//false when size exceeds a slot or every slot already holds a write of this submission.
+		bool Write(const UINT64 & offset, const void* data, const UINT64 & size, D3D12_RESOURCE_STATES state);
+
+		//Whether a Write of size would find a free slot, so callers can check before resizing
+		bool CanWrite(const UINT64 & size) const;
+
+		//Call after submitting the command list the writes were recorded on
+		void OnSubmitted();
+
+		//Releases heaps no longer backing any tile, only safe once the GPU is idle
+		void ReleaseUnusedHeaps();
+
+		ID3D12Resource* GetResource() const;
+		const TileMap & GetTileMap() const;
+
+	private:
+		void ApplyUpdates();
+
+	private:
+		ID3D12Device* m_device;
+		ID3D12CommandQueue* m_commandQueue;
+		ID3D12GraphicsCommandList* m_commandList;
+
+		TileMap m_tiles;
+		std::vector<TileRange> m_updates;
+		ComPtr<ID3D12Resource> m_resource;
+		std::vector<ComPtr<ID3D12Heap>> m_heaps;
+		std::unique_ptr<UploadRing> m_uploadRing;
+		std::vector<UINT> m_pendingSlots;		//Written since the last OnSubmitted
+	};
+}
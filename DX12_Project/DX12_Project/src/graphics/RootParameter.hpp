@@ -29,6 +29,17 @@ namespace dx
 			m_rootParameters.push_back(param);
 		}
 
+		inline void AppendRootParameterSRV(const UINT & shaderRegister, D3D12_SHADER_VISIBILITY visibility)
+		{
+			D3D12_ROOT_PARAMETER1 param = {};
+			param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+			param.Descriptor = { 0, shaderRegister };
+			param.ShaderVisibility = visibility;
+
+			//Add the root parameter to the vector
+			m_rootParameters.push_back(param);
+		}
+
 		//Insert table directly
 		inline void AppendRootParameterDescTable(D3D12_ROOT_DESCRIPTOR_TABLE1 table, D3D12_SHADER_VISIBILITY visibility)
 		{
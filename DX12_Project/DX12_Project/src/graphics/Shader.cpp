@@ -9,7 +9,7 @@ namespace dx
 	{
 	}
 
-	void Shader::LoadShadersFromFile(const Shaders::ID & id, const std::string & shaderPath, ShaderType type)
+	void Shader::LoadShadersFromFile(const Shaders::ID & id, const std::string & shaderPath, ShaderType type, const D3D_SHADER_MACRO* defines)
 	{
 		ShaderData data;
 		data.type = type;
@@ -18,20 +18,20 @@ namespace dx
 		if (data.type == (VS | PS))
 		{
 			data.blobs.resize(2);
-			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), nullptr, nullptr, "VS_MAIN", "vs_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[0].GetAddressOf(), nullptr));
-			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), nullptr, nullptr, "PS_MAIN", "ps_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[1].GetAddressOf(), nullptr));
+			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), defines, nullptr, "VS_MAIN", "vs_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[0].GetAddressOf(), nullptr));
+			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), defines, nullptr, "PS_MAIN", "ps_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[1].GetAddressOf(), nullptr));
 		}
 		else if (data.type == (VS | GS | PS))
 		{
 			data.blobs.resize(3);
-			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), nullptr, nullptr, "VS_MAIN", "vs_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[0].GetAddressOf(), nullptr));
-			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), nullptr, nullptr, "PS_MAIN", "ps_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[1].GetAddressOf(), nullptr));
-			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), nullptr, nullptr, "GS_MAIN", "gs_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[2].GetAddressOf(), nullptr));
+			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), defines, nullptr, "VS_MAIN", "vs_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[0].GetAddressOf(), nullptr));
+			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), defines, nullptr, "PS_MAIN", "ps_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[1].GetAddressOf(), nullptr));
+			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), defines, nullptr, "GS_MAIN", "gs_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[2].GetAddressOf(), nullptr));
 		}
 		else if (data.type == CS)
 		{
 			data.blobs.resize(1);
-			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), nullptr, nullptr, "CS_MAIN", "cs_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[0].GetAddressOf(), nullptr));
+			assert(!D3DCompileFromFile(ToWChar(shaderPath).c_str(), defines, nullptr, "CS_MAIN", "cs_5_1", D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0, data.blobs[0].GetAddressOf(), nullptr));
 		}
 
 		auto inserted = m_shaders.insert(std::make_pair(id, std::move(data)));
@@ -39,11 +39,11 @@ namespace dx
 	}
 
 	void Shader::CreateInputLayoutAndPipelineState(const Shaders::ID & id, ID3D12RootSignature * signature, D3D12_RASTERIZER_DESC rasterDesc, D3D12_BLEND_DESC blendDesc,
-												   D3D12_PRIMITIVE_TOPOLOGY_TYPE topologyType)
+												   D3D12_PRIMITIVE_TOPOLOGY_TYPE topologyType, DXGI_FORMAT renderTargetFormat, D3D12_DEPTH_STENCIL_DESC depthStencilDesc)
 	{
 		auto found = m_shaders.find(id);
 
-		//Input layouts
+		//Input layouts, the fullscreen passes have none
 		std::vector<D3D12_INPUT_ELEMENT_DESC> inputElementDesc;
 
 		if (id == Shaders::ID::NBody)
@@ -56,7 +56,7 @@ namespace dx
 
 		D3D12_INPUT_LAYOUT_DESC inputLayoutDesc = {};
 		inputLayoutDesc.NumElements = (UINT)inputElementDesc.size();
-		inputLayoutDesc.pInputElementDescs = &inputElementDesc[0];
+		inputLayoutDesc.pInputElementDescs = inputElementDesc.data();
 
 		//Fill in the pipeline description
 		D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineStateDesc = { 0 };
@@ -67,8 +67,8 @@ namespace dx
 		if(found->second.type == (VS | GS | PS))
 			pipelineStateDesc.GS = CD3DX12_SHADER_BYTECODE(found->second.blobs[2].Get());
 		pipelineStateDesc.PrimitiveTopologyType = topologyType;
-		pipelineStateDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-		pipelineStateDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+		pipelineStateDesc.RTVFormats[0] = renderTargetFormat;
+		pipelineStateDesc.DepthStencilState = depthStencilDesc;
 		pipelineStateDesc.SampleDesc.Count = 1;
 		pipelineStateDesc.SampleDesc.Quality = 0;
 		pipelineStateDesc.SampleMask = 0xffffffff;
@@ -81,12 +81,8 @@ namespace dx
 		assert(!m_device->CreateGraphicsPipelineState(&pipelineStateDesc, IID_PPV_ARGS(found->second.pipelineState.GetAddressOf())));
 
 		//Release the blobs
-		if (found->second.type == (VS | GS | PS))
-		{
-			found->second.blobs[0].Reset();
-			found->second.blobs[1].Reset();
-			found->second.blobs[2].Reset();
-		}
+		for (auto & blob : found->second.blobs)
+			blob.Reset();
 	}
 
 	void Shader::CreatePipelineStateForComputeShader(const Shaders::ID & id, ID3D12RootSignature * signature)
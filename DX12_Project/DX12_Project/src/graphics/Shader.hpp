@@ -11,6 +11,11 @@ namespace Shaders
 	{
 		NBody,
 		NBodyCompute,
+		NBodyAccelerate,
+		NBodyIntegrate,
+		NBodyGather,
+		AccumulateFade,
+		AccumulateResolve,
 	};
 }
 
@@ -40,9 +45,10 @@ namespace dx
 
 	public:
 		Shader(ID3D12Device* device, ID3D12GraphicsCommandList* commandList);
-		void LoadShadersFromFile(const Shaders::ID & id, const std::string & shaderPath, ShaderType type);
+		void LoadShadersFromFile(const Shaders::ID & id, const std::string & shaderPath, ShaderType type, const D3D_SHADER_MACRO* defines = nullptr);
 		void CreateInputLayoutAndPipelineState(const Shaders::ID & id, ID3D12RootSignature* signature, D3D12_RASTERIZER_DESC rasterDesc, 
-											   D3D12_BLEND_DESC blendDesc, D3D12_PRIMITIVE_TOPOLOGY_TYPE topologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE);
+											   D3D12_BLEND_DESC blendDesc, D3D12_PRIMITIVE_TOPOLOGY_TYPE topologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE,
+											   DXGI_FORMAT renderTargetFormat = DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_DEPTH_STENCIL_DESC depthStencilDesc = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT));
 		void CreatePipelineStateForComputeShader(const Shaders::ID & id, ID3D12RootSignature* signature);
 
 	public:
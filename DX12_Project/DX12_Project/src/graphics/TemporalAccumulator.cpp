@@ -0,0 +1,63 @@
+#include <graphics/TemporalAccumulator.hpp>
+#include <assert.h>
+#include <d3dx12.h>
+
+namespace dx
+{
+	TemporalAccumulator::TemporalAccumulator(ID3D12Device* device, ID3D12GraphicsCommandList* commandList, const UINT & width, const UINT & height) : m_commandList(commandList)
+	{
+		D3D12_CLEAR_VALUE clear = {};
+		clear.Format = Format;
+
+		assert(!device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Tex2D(Format, width, height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET),
+			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &clear, IID_PPV_ARGS(m_target.GetAddressOf())));
+		m_target->SetName(L"Accumulation Target");
+
+		m_rtvHeap = std::make_unique<DescriptorHeap>(device, commandList, 1);
+		m_rtvHeap->CreateDescriptorHeap(1, D3D12_DESCRIPTOR_HEAP_FLAG_NONE, D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+		device->CreateRenderTargetView(m_target.Get(), nullptr, m_rtvHeap->GetCPUIncrementHandle(0));
+
+		m_srvHeap = std::make_unique<DescriptorHeap>(device, commandList, 1);
+		m_srvHeap->CreateDescriptorHeap(1, D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		device->CreateShaderResourceView(m_target.Get(), nullptr, m_srvHeap->GetCPUIncrementHandle(0));
+	}
+
+	void TemporalAccumulator::Begin(Shader* shader, RootSignature* signature, const float & blend, D3D12_CPU_DESCRIPTOR_HANDLE depthStencil)
+	{
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_target.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+		D3D12_CPU_DESCRIPTOR_HANDLE renderTarget = m_rtvHeap->GetCPUIncrementHandle(0);
+		m_commandList->OMSetRenderTargets(1, &renderTarget, FALSE, &depthStencil);
+
+		//The first frame has no history, a full blend would replace it anyway
+		if (!m_cleared)
+		{
+			const FLOAT black[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			m_commandList->ClearRenderTargetView(renderTarget, black, 0, nullptr);
+			m_cleared = true;
+		}
+
+		const FLOAT fade[] = { 1.0f - blend, 1.0f - blend, 1.0f - blend, 1.0f - blend };
+		m_commandList->OMSetBlendFactor(fade);
+		signature->SetRootSignature();
+		DrawFullscreen(shader, Shaders::ID::AccumulateFade);
+	}
+
+	void TemporalAccumulator::Resolve(Shader* shader, RootSignature* signature, D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, D3D12_CPU_DESCRIPTOR_HANDLE depthStencil)
+	{
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_target.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+		m_commandList->OMSetRenderTargets(1, &renderTarget, FALSE, &depthStencil);
+
+		signature->SetRootSignature();
+		m_srvHeap->SetRootDescriptorTable(2, m_srvHeap->GetGPUIncrementHandle(0)); //Root index 2, t1
+		DrawFullscreen(shader, Shaders::ID::AccumulateResolve);
+	}
+
+	void TemporalAccumulator::DrawFullscreen(Shader* shader, const Shaders::ID & id)
+	{
+		m_commandList->SetPipelineState(shader->GetShaders(id).pipelineState.Get());
+		shader->SetTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		m_commandList->DrawInstanced(3, 1, 0, 0);
+	}
+}
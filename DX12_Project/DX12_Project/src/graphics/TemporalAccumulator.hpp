@@ -0,0 +1,38 @@
+#pragma once
+#include <d3d12.h>
+#include <memory>
+#include <wrl.h>
+#include <graphics/DescriptorHeap.hpp>
+#include <graphics/RootSignature.hpp>
+#include <graphics/Shader.hpp>
+
+using namespace Microsoft::WRL;
+
+namespace dx
+{
+	//Floating point render target that keeps an image across frames for the stochastic
+	//subset rendering. Begin fades the history by 1 - blend and leaves the target bound, the
+	//caller then draws this frame's contribution into it additively; Resolve writes the
+	//result to the back buffer.
+	class TemporalAccumulator
+	{
+	public:
+		static const DXGI_FORMAT Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+
+		TemporalAccumulator(ID3D12Device* device, ID3D12GraphicsCommandList* commandList, const UINT & width, const UINT & height);
+
+	public:
+		void Begin(Shader* shader, RootSignature* signature, const float & blend, D3D12_CPU_DESCRIPTOR_HANDLE depthStencil);
+		void Resolve(Shader* shader, RootSignature* signature, D3D12_CPU_DESCRIPTOR_HANDLE renderTarget, D3D12_CPU_DESCRIPTOR_HANDLE depthStencil);
+
+	private:
+		void DrawFullscreen(Shader* shader, const Shaders::ID & id);
+
+	private:
+		ID3D12GraphicsCommandList* m_commandList;
+		ComPtr<ID3D12Resource> m_target;
+		std::unique_ptr<DescriptorHeap> m_rtvHeap;
+		std::unique_ptr<DescriptorHeap> m_srvHeap;
+		bool m_cleared = false;
+	};
+}
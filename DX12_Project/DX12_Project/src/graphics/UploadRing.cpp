@@ -0,0 +1,101 @@
+#include <graphics/UploadRing.hpp>
+#include <assert.h>
+#include <d3dx12.h>
+
+namespace dx
+{
+	UploadRing::UploadRing(ID3D12Device* device, const UINT64 & slotSize, const UINT & numSlots) : m_device(device), m_slotFenceValues(numSlots, 0)
+	{
+		//Slots start on placement boundaries, which also keeps them a whole number of elements apart
+		m_slotSize = (slotSize + D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1) & ~UINT64(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1);
+
+		assert(!m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(m_slotSize * numSlots), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(m_buffer.GetAddressOf())));
+		m_buffer->SetName(L"Upload Ring Resource Heap");
+
+		//Mapped for the lifetime of the ring, the CPU never reads it
+		CD3DX12_RANGE readRange(0, 0);
+		assert(!m_buffer->Map(0, &readRange, reinterpret_cast<void**>(&m_address)));
+
+		assert(!m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(m_fence.GetAddressOf())));
+		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		assert(m_fenceEvent);
+	}
+
+	UploadRing::~UploadRing()
+	{
+		//The owner has drained the queue, every slot value has been reached
+		m_buffer->Unmap(0, nullptr);
+		CloseHandle(m_fenceEvent);
+	}
+
+	UINT UploadRing::Acquire()
+	{
+		UINT slot = m_next;
+		m_next = (m_next + 1) % static_cast<UINT>(m_slotFenceValues.size());
+
+		if (m_fence->GetCompletedValue() < m_slotFenceValues[slot])
+		{
+			++m_numStalls;
+			assert(!m_fence->SetEventOnCompletion(m_slotFenceValues[slot], m_fenceEvent));
+			WaitForSingleObject(m_fenceEvent, INFINITE);
+		}
+
+		return slot;
+	}
+
+	void UploadRing::Release(ID3D12CommandQueue* commandQueue, const UINT & slot)
+	{
+		m_slotFenceValues[slot] = ++m_fenceValue;
+		assert(!commandQueue->Signal(m_fence.Get(), m_fenceValue));
+	}
+
+	void UploadRing::CreateSRV(const UINT & slot, const UINT & stride, D3D12_CPU_DESCRIPTOR_HANDLE handle)
+	{
+		D3D12_SHADER_RESOURCE_VIEW_DESC view = {};
+		view.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		view.Format = DXGI_FORMAT_UNKNOWN;
+		view.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+		view.Buffer.FirstElement = slot * m_slotSize / stride;
+		view.Buffer.NumElements = static_cast<UINT>(m_slotSize / stride);
+		view.Buffer.StructureByteStride = stride;
+		view.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
+		m_device->CreateShaderResourceView(m_buffer.Get(), &view, handle);
+	}
+
+	void* UploadRing::GetAddress(const UINT & slot) const
+	{
+		return m_address + slot * m_slotSize;
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS UploadRing::GetGPUAddress(const UINT & slot) const
+	{
+		return m_buffer->GetGPUVirtualAddress() + slot * m_slotSize;
+	}
+
+	ID3D12Resource* UploadRing::GetResource() const
+	{
+		return m_buffer.Get();
+	}
+
+	UINT64 UploadRing::GetOffset(const UINT & slot) const
+	{
+		return slot * m_slotSize;
+	}
+
+	UINT64 UploadRing::GetSlotSize() const
+	{
+		return m_slotSize;
+	}
+
+	UINT UploadRing::GetNumSlots() const
+	{
+		return static_cast<UINT>(m_slotFenceValues.size());
+	}
+
+	UINT64 UploadRing::GetNumStalls() const
+	{
+		return m_numStalls;
+	}
+}
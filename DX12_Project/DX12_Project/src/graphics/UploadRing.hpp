@@ -0,0 +1,53 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl.h>
+#include <vector>
+
+using namespace Microsoft::WRL;
+
+namespace dx
+{
+	//Ring of slots in one persistently mapped upload buffer that the CPU writes and the
+	//GPU reads in place, without a copy to a default heap. Upload memory is write-combined,
+	//so writers should store whole, sequential elements and never read it back. A fence
+	//value per slot guards reuse: Acquire only hands out a slot once the GPU finished the
+	//work that was submitted before the slot was released.
+	class UploadRing
+	{
+	public:
+		UploadRing(ID3D12Device* device, const UINT64 & slotSize, const UINT & numSlots);
+		~UploadRing();
+
+	public:
+		//Next slot, waits on the fence if the GPU still reads it
+		UINT Acquire();
+
+		//Call after submitting the work that reads the slot
+		void Release(ID3D12CommandQueue* commandQueue, const UINT & slot);
+
+		//Structured buffer view of one slot
+		void CreateSRV(const UINT & slot, const UINT & stride, D3D12_CPU_DESCRIPTOR_HANDLE handle);
+
+		void* GetAddress(const UINT & slot) const;
+		D3D12_GPU_VIRTUAL_ADDRESS GetGPUAddress(const UINT & slot) const;
+
+		//For copies out of a slot
+		ID3D12Resource* GetResource() const;
+		UINT64 GetOffset(const UINT & slot) const;
+		UINT64 GetSlotSize() const;
+		UINT GetNumSlots() const;
+		UINT64 GetNumStalls() const;		//Acquires that had to wait for the GPU
+
+	private:
+		ID3D12Device* m_device;
+		ComPtr<ID3D12Resource> m_buffer;
+		ComPtr<ID3D12Fence> m_fence;
+		HANDLE m_fenceEvent;
+		UINT8* m_address;
+		UINT64 m_slotSize;
+		UINT64 m_fenceValue = 0;
+		std::vector<UINT64> m_slotFenceValues;
+		UINT m_next = 0;
+		UINT64 m_numStalls = 0;
+	};
+}
@@ -1,9 +1,43 @@
 #include <graphics/nbody/nBody.hpp>
+#include <simulation/CpuNBody.hpp>
+#include <simulation/Importers.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <simulation/TiledCoordinates.hpp>
+#include <assert.h>
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static_assert(sizeof(BodyData) == sizeof(dx::Body), "BodyData and Body must share the same layout");
+static_assert(!GROWABLE_BODY_BUFFERS || (!TILE_RELATIVE_COORDINATES && !FUSED_RENDER_PREP), "Cell and render record buffers are sized for NUM_BODIES");
+static_assert(!CPU_SIMULATION || (!TILE_RELATIVE_COORDINATES && !FUSED_RENDER_PREP && !GROWABLE_BODY_BUFFERS), "The CPU simulation only fills the body ring");
+static_assert(!STOCHASTIC_RENDERING || !FUSED_RENDER_PREP, "The fused pass draws a compacted list, it cannot be sampled by body index");
+static_assert(NUM_BODIES <= MAX_BODIES && MAX_BODIES % 256 == 0, "MAX_BODIES is the capacity of the growable body buffers, in whole blocks");
+static_assert(BODY_SEGMENT_CAPACITY % 256 == 0 && BODY_SEGMENT_CAPACITY % MAX_SUBSET_STRIDE == 0, "Segments hold whole blocks and whole subset strides");
+static_assert(BODY_SEGMENT_CAPACITY <= dx::MaxDispatchSegmentCapacity && dx::MaxDispatchGroups == D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION,
+	"Every segment is updated by a single dispatch along x");
+
+//Body segments, all but the last one hold BODY_SEGMENT_CAPACITY bodies
+static const UINT NUM_BODY_SEGMENTS = static_cast<UINT>((UINT64(NUM_BODIES) + BODY_SEGMENT_CAPACITY - 1) / BODY_SEGMENT_CAPACITY);
+static_assert(NUM_BODY_SEGMENTS == 1 || (!TILE_RELATIVE_COORDINATES && !FUSED_RENDER_PREP && !GROWABLE_BODY_BUFFERS), "Cells, render records and growable buffers are not segmented");
+static_assert(!SINGLE_STATE_UPDATE || (!TILE_RELATIVE_COORDINATES && !FUSED_RENDER_PREP && !GROWABLE_BODY_BUFFERS), "The single-state passes only update the bodies and take the render record root slot");
+static_assert(!ESCAPER_DETECTION || (!CPU_SIMULATION && !SINGLE_STATE_UPDATE && !GROWABLE_BODY_BUFFERS && !TILE_RELATIVE_COORDINATES),
+	"The gather pass compacts the bodies of both states of the ping-pong update, not their cells");
+static_assert(!SNAPSHOT_INTERVAL || (!CPU_SIMULATION && !GROWABLE_BODY_BUFFERS && !TILE_RELATIVE_COORDINATES), "Snapshots read back the NUM_BODIES bodies of the compute update");
+
+//Copies of the body state, the single-state update reads and writes the same one every frame
+static const UINT BODY_STATES = SINGLE_STATE_UPDATE ? 1 : FRAME_BUFFERS;
 
 //Constant buffer for rendering particles
 struct CB_DRAW
 {
 	Matrix g_mWorldViewProjection;
+	float g_cellSize;
+
+	//Only read with stochastic rendering
+	UINT g_subsetStride;
+	UINT g_subsetPhase;
 };
 
 //Constant buffer for the simulation update compute shader
@@ -11,16 +45,111 @@ struct CB_UPDATE
 {
 	float g_timestep;
     float g_softeningSquared;
+	//Bodies of the segment this dispatch updates and its thread groups
 	UINT g_numParticles;
-	UINT g_numBlocks = UINT(ceil(NUM_BODIES / 256.0f));
+	UINT g_numBlocks;
+
+	//Only read by the fused integrate-and-render-prep pass
+	Matrix g_mWorldViewProjection;
+	float g_pointSize;
+
+	//Only read with tile-relative coordinates
+	float g_cellSize;
+
+	//Only read by the EQUAL_MASS permutation
+	float g_equalMass;
+
+	//The updated segment, the sources are read from every segment
+	UINT g_segment;
+	UINT g_numSegments;
+	UINT g_segmentCapacity;
+	UINT g_lastSegmentCount;
+
+	//Bodies that attract, the tracers demoted by escaper detection follow them
+	UINT g_numSources;
 };
 
-FLOAT blendFactors[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+//Each segment's dispatch reads its own copy of the update constants from the frame's buffer
+static const UINT CB_UPDATE_STRIDE = (sizeof(CB_UPDATE) + 255) & ~255;
+static_assert(NUM_BODY_SEGMENTS * CB_UPDATE_STRIDE <= D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, "The update constants of every segment share one constant buffer");
+
+//Size of the SRV array the compute shader reads the segments from
+static const std::string segmentCountDefine = std::to_string(NUM_BODY_SEGMENTS);
+
+//Shader permutation matching the defines in nBody.hpp
+static const D3D_SHADER_MACRO shaderDefines[] =
+{
+#if FUSED_RENDER_PREP
+	{ "FUSED_RENDER_PREP", "1" },
+#endif
+#if TILE_RELATIVE_COORDINATES
+	{ "TILE_RELATIVE_COORDINATES", "1" },
+#endif
+#if KERNEL_PRECISION == 1
+	{ "DOUBLE_PRECISION", "1" },
+#elif KERNEL_PRECISION == 2
+	{ "DOUBLE_ACCUMULATION", "1" },
+#endif
+#if EQUAL_MASS_BODIES
+	{ "EQUAL_MASS", "1" },
+#endif
+#if !SOFTENING
+	{ "NO_SOFTENING", "1" },
+#endif
+#if PLANAR_SIMULATION
+	{ "PLANAR", "1" },
+#endif
+#if STOCHASTIC_RENDERING
+	{ "STOCHASTIC_RENDERING", "1" },
+#endif
+	{ "NUM_SEGMENTS", segmentCountDefine.c_str() },
+	{ nullptr, nullptr }
+};
+
+//The single-state passes are the same permutation plus the define selecting the pass
+static std::vector<D3D_SHADER_MACRO> GetPassDefines(const char* pass)
+{
+	std::vector<D3D_SHADER_MACRO> defines(std::begin(shaderDefines), std::end(shaderDefines) - 1);
+	defines.push_back({ pass, "1" });
+	defines.push_back({ nullptr, nullptr });
+	return defines;
+}
+
+static const std::vector<D3D_SHADER_MACRO> accelerationPassDefines = GetPassDefines("ACCELERATION_PASS");
+static const std::vector<D3D_SHADER_MACRO> integrationPassDefines = GetPassDefines("INTEGRATION_PASS");
+static const std::vector<D3D_SHADER_MACRO> gatherPassDefines = GetPassDefines("GATHER_PASS");
+
+//Descriptors are the body SRVs and UAVs of each state (one per segment), the particle texture
+//and the render records, then the body ring slots of the CPU simulation (one per segment)
+static const UINT BODY_SRV_DESCRIPTOR = 0;
+static const UINT BODY_UAV_DESCRIPTOR = BODY_STATES * NUM_BODY_SEGMENTS;
+static const UINT TEXTURE_DESCRIPTOR = 2 * BODY_STATES * NUM_BODY_SEGMENTS;
+static const UINT RENDER_RECORD_DESCRIPTOR = TEXTURE_DESCRIPTOR + 1;
+static const UINT BODY_RING_DESCRIPTOR = TEXTURE_DESCRIPTOR + 2;
+static const UINT BODY_RING_SLOTS = CPU_SIMULATION ? FRAME_BUFFERS + 1 : 0;
+
+//Body state a frame draws from, and the state the ping-pong update writes
+static UINT GetBodyState(const UINT & frame)
+{
+	return SINGLE_STATE_UPDATE ? 0 : frame;
+}
+
+#if GROWABLE_BODY_BUFFERS
+//The update dispatches whole blocks of 256 and the threads past the last body still write,
+//so the bound tiles have to cover the last block
+static UINT64 GetBoundBodyBytes(const UINT & numBodies)
+{
+	return UINT64(sizeof(BodyData)) * ((numBodies + 255) / 256 * 256);
+}
+
+//Upload ring slot, large enough for the initial bodies and for one SetBodyCount
+static const UINT64 BODY_UPLOAD_BYTES = UINT64(sizeof(BodyData)) * (NUM_BODIES > MAX_APPENDED_BODIES ? NUM_BODIES : MAX_APPENDED_BODIES);
+#endif
 
 namespace dx
 {
-	NBody::NBody(ID3D12Device* device, ID3D12GraphicsCommandList* commandList, Buffer* buffer, Camera* camera, Texture* texture) : m_device(device), 
-								 m_commandList(commandList), m_buffer(buffer), m_camera(camera), m_texture(texture), m_clusterScale(1.54f), m_velocityScale(8.0f)
+	NBody::NBody(ID3D12Device* device, ID3D12CommandQueue* commandQueue, ID3D12GraphicsCommandList* commandList, Buffer* buffer, Camera* camera, Texture* texture) : m_device(device), 
+								 m_commandQueue(commandQueue), m_commandList(commandList), m_buffer(buffer), m_camera(camera), m_texture(texture), m_clusterScale(1.54f), m_velocityScale(8.0f)
 	{
 		Initialize();
 		InitializeBodies();
@@ -35,7 +164,62 @@ namespace dx
 
 		//Descriptor heap
 		m_srvUavDescHeap = std::make_unique<DescriptorHeap>(m_device, m_commandList, 1);
-		m_srvUavDescHeap->CreateDescriptorHeap(5, D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		m_srvUavDescHeap->CreateDescriptorHeap(BODY_RING_DESCRIPTOR + BODY_RING_SLOTS * NUM_BODY_SEGMENTS, D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+#if KERNEL_PRECISION != 0
+		//The double permutations need double precision shader operations
+		D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+		m_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options));
+		assert(options.DoublePrecisionFloatShaderOps);
+#endif
+
+#if FUSED_RENDER_PREP
+		//Command signature for drawing the compacted render records
+		D3D12_INDIRECT_ARGUMENT_DESC argumentDesc = {};
+		argumentDesc.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+
+		D3D12_COMMAND_SIGNATURE_DESC signatureDesc = {};
+		signatureDesc.ByteStride = sizeof(D3D12_DRAW_ARGUMENTS);
+		signatureDesc.NumArgumentDescs = 1;
+		signatureDesc.pArgumentDescs = &argumentDesc;
+		assert(!m_device->CreateCommandSignature(&signatureDesc, nullptr, IID_PPV_ARGS(m_drawCommandSignature.GetAddressOf())));
+#endif
+	}
+
+	const D3D_SHADER_MACRO* NBody::GetShaderDefines()
+	{
+		return shaderDefines;
+	}
+
+	DXGI_FORMAT NBody::GetRenderTargetFormat()
+	{
+		return STOCHASTIC_RENDERING ? TemporalAccumulator::Format : DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	const D3D_SHADER_MACRO* NBody::GetComputePassDefines(const Shaders::ID & pass)
+	{
+		switch (pass)
+		{
+		case Shaders::ID::NBodyAccelerate:
+			return accelerationPassDefines.data();
+		case Shaders::ID::NBodyIntegrate:
+			return integrationPassDefines.data();
+		case Shaders::ID::NBodyGather:
+			return gatherPassDefines.data();
+		default:
+			return shaderDefines;
+		}
+	}
+
+	UINT NBody::GetNumSegments()
+	{
+		return NUM_BODY_SEGMENTS;
+	}
+
+	Matrix NBody::GetWorldViewProjection() const
+	{
+		Matrix world = XMMatrixTranslationFromVector(Vector3(0.f, 0.f, 100.f));
+		return world * m_camera->GetViewProjectionMatrix();
 	}
 
 	//Render the bodies as particles using sprites
@@ -43,47 +227,178 @@ namespace dx
 	{
 		//Set constant buffer data for normal pipeline
 		CB_DRAW cbDraw;
-		Matrix world = XMMatrixIdentity();
-		world = XMMatrixTranslationFromVector(Vector3(0.f, 0.f, 100.f));
-		Matrix WVP = world * m_camera->GetViewProjectionMatrix();
-		cbDraw.g_mWorldViewProjection = WVP;
+		cbDraw.g_mWorldViewProjection = GetWorldViewProjection();
+		cbDraw.g_cellSize = static_cast<float>(CELL_SIZE);
+		cbDraw.g_subsetStride = m_subsetStride;
+		cbDraw.g_subsetPhase = m_subsetPhase;
 
 		m_buffer->SetConstantBufferData(&cbDraw, sizeof(cbDraw), frameIndex, &m_cbDrawAddress[0]);
 
-		//Set the normal NBody shader and root signature
+		//Set the normal NBody shader and root signature, the blend factor weights the bodies
+		const FLOAT blendFactors[] = { m_subsetWeight, m_subsetWeight, m_subsetWeight, m_subsetWeight };
 		m_commandList->OMSetBlendFactor(blendFactors);
 		m_commandList->SetPipelineState(shader->GetShaders(Shaders::ID::NBody).pipelineState.Get());
 		signature->SetRootSignature();
 		m_buffer->BindConstantBufferForRootDescriptor(0, frameIndex, m_cbDrawUploadHeap->GetAddressOf()); //Root index 0
-		m_srvUavDescHeap->SetRootDescriptorTable(1, m_srvUavDescHeap->GetGPUIncrementHandle(frameIndex)); //Root index 1 for SRV table
-		m_srvUavDescHeap->SetRootDescriptorTable(2, m_srvUavDescHeap->GetGPUIncrementHandle(4));
+#if FUSED_RENDER_PREP
+		m_srvUavDescHeap->SetRootDescriptorTable(1, m_srvUavDescHeap->GetGPUIncrementHandle(RENDER_RECORD_DESCRIPTOR)); //Root index 1 for render record SRV
+#endif
+		m_srvUavDescHeap->SetRootDescriptorTable(2, m_srvUavDescHeap->GetGPUIncrementHandle(TEXTURE_DESCRIPTOR));
+#if TILE_RELATIVE_COORDINATES && !FUSED_RENDER_PREP
+		m_commandList->SetGraphicsRootShaderResourceView(3, m_cellBuffer[frameIndex]->GetGPUVirtualAddress()); //Root index 3 for cells
+#endif
 		shader->SetTopology(D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
 
 		//Draw particles
-		m_commandList->DrawInstanced(NUM_BODIES, 1, 0, 0);
+#if FUSED_RENDER_PREP
+		//The vertex count was written by the compute pass
+		m_commandList->ExecuteIndirect(m_drawCommandSignature.Get(), 1, m_drawArgsBuffer.Get(), 0, nullptr, 0);
+#else
+		//One draw per segment and one vertex per body of the subset. Segments hold a multiple
+		//of the stride, so the subset is the same as over the whole population.
+		for (UINT segment = 0; segment < m_layout.GetNumSegments(); ++segment)
+		{
+#if CPU_SIMULATION
+			UINT descriptor = BODY_RING_DESCRIPTOR + m_bodySlot * NUM_BODY_SEGMENTS + segment;
+#else
+			UINT descriptor = BODY_SRV_DESCRIPTOR + GetBodyState(frameIndex) * NUM_BODY_SEGMENTS + segment;
+#endif
+			m_srvUavDescHeap->SetRootDescriptorTable(1, m_srvUavDescHeap->GetGPUIncrementHandle(descriptor)); //Root index 1 for SRV table
+
+			UINT size = m_layout.GetSegmentSize(segment);
+			UINT count = size > m_subsetPhase ? (size - m_subsetPhase + m_subsetStride - 1) / m_subsetStride : 0;
+			m_commandList->DrawInstanced(count, 1, 0, 0);
+		}
+#endif
 	}
 
 	//Update the positions and velocities of all bodies in the system
 	void NBody::UpdateBodies(Shader* shader, RootSignature* signature, const UINT & frameIndex)
 	{
+#if CPU_SIMULATION
+		//The engine writes the new state straight into the slot this frame draws from
+		for (UINT segment = 0; segment < NUM_BODY_SEGMENTS; ++segment)
+		{
+			UINT slot = m_bodyRings[segment]->Acquire();
+			assert(segment == 0 || slot == m_bodySlot);
+			m_bodySlot = slot;
+			m_bodySegments[segment] = static_cast<Body*>(m_bodyRings[segment]->GetAddress(slot));
+		}
+		m_cpuEngine->StepIntoSegments(m_bodySegments.data(), m_layout);
+		return;
+#endif
+
+#if BODY_READBACK
+		//Compacts the state this update reads and shrinks m_numSources before the constants are written
+		ProcessReadback(shader, signature, frameIndex);
+#endif
+
 		//Update the data for the compute constant buffer
 		CB_UPDATE cbUpdate;
 		cbUpdate.g_timestep = 0.0016f;
 		cbUpdate.g_softeningSquared = 0.0012500000f * 0.0012500000f;
-		cbUpdate.g_numParticles = NUM_BODIES;
-		m_buffer->SetConstantBufferData(&cbUpdate, sizeof(cbUpdate), 1 - frameIndex, &m_cbUpdateAddress[0]);
+		cbUpdate.g_mWorldViewProjection = GetWorldViewProjection();
+		cbUpdate.g_pointSize = m_pointSize;
+		cbUpdate.g_cellSize = static_cast<float>(CELL_SIZE);
+		cbUpdate.g_equalMass = m_equalMass;
+		cbUpdate.g_numSegments = m_layout.GetNumSegments();
+		cbUpdate.g_segmentCapacity = m_layout.GetCapacity();
+		cbUpdate.g_lastSegmentCount = m_layout.GetSegmentSize(m_layout.GetNumSegments() - 1);
+		cbUpdate.g_numSources = static_cast<UINT>(m_numSources);
+
+#if SINGLE_STATE_UPDATE
+		//Pass 1 reads every segment as sources, so it has to finish for all of them before
+		//pass 2 moves any body
+		signature->SetComputeRootSignature();
+		m_commandList->SetPipelineState(shader->GetShaders(Shaders::ID::NBodyAccelerate).pipelineState.Get());
+		m_srvUavDescHeap->SetComputeRootDescriptorTable(COMPUTE_ROOT_BODY_SRVS, m_srvUavDescHeap->GetGPUIncrementHandle(BODY_SRV_DESCRIPTOR));
+		for (UINT segment = 0; segment < m_layout.GetNumSegments(); ++segment)
+		{
+			cbUpdate.g_segment = segment;
+			cbUpdate.g_numParticles = m_layout.GetSegmentSize(segment);
+			cbUpdate.g_numBlocks = GetDispatchGroups(cbUpdate.g_numParticles);
+			m_buffer->SetConstantBufferData(&cbUpdate, sizeof(cbUpdate), 1 - frameIndex, &m_cbUpdateAddress[0], segment * CB_UPDATE_STRIDE);
+
+			m_buffer->BindConstantBufferComputeForRootDescriptor(COMPUTE_ROOT_CONSTANTS, 1 - frameIndex, m_cbUpdateUploadHeap->GetAddressOf(), segment * CB_UPDATE_STRIDE);
+			m_commandList->SetComputeRootUnorderedAccessView(COMPUTE_ROOT_PASS_UAV, m_accelerationBuffer[segment]->GetGPUVirtualAddress());
+			shader->SetComputeDispatch(cbUpdate.g_numBlocks, 1, 1);
+		}
 
-		m_buffer->SetResourceBarrier(m_srvBuffer[1 - frameIndex].GetAddressOf(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		for (ComPtr<ID3D12Resource> & accelerations : m_accelerationBuffer)
+			m_buffer->SetUAVBarrier(accelerations.GetAddressOf());
+		SetBodyBarriers(0, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+		//Pass 2 integrates every segment in place with the constants written above
+		m_commandList->SetPipelineState(shader->GetShaders(Shaders::ID::NBodyIntegrate).pipelineState.Get());
+		for (UINT segment = 0; segment < m_layout.GetNumSegments(); ++segment)
+		{
+			m_buffer->BindConstantBufferComputeForRootDescriptor(COMPUTE_ROOT_CONSTANTS, 1 - frameIndex, m_cbUpdateUploadHeap->GetAddressOf(), segment * CB_UPDATE_STRIDE);
+			m_srvUavDescHeap->SetComputeRootDescriptorTable(COMPUTE_ROOT_BODY_UAVS, m_srvUavDescHeap->GetGPUIncrementHandle(BODY_UAV_DESCRIPTOR + segment));
+			m_commandList->SetComputeRootUnorderedAccessView(COMPUTE_ROOT_PASS_UAV, m_accelerationBuffer[segment]->GetGPUVirtualAddress());
+			shader->SetComputeDispatch(GetDispatchGroups(m_layout.GetSegmentSize(segment)), 1, 1);
+		}
+
+		SetBodyBarriers(0, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+#if BODY_READBACK
+		ReadBackBodies(frameIndex);
+#endif
+		return;
+#endif
+
+		SetBodyBarriers(1 - frameIndex, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+#if TILE_RELATIVE_COORDINATES
+		m_buffer->SetResourceBarrier(m_cellBuffer[frameIndex].GetAddressOf(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+#endif
+
+#if FUSED_RENDER_PREP
+		//Reset the draw arguments to zero vertices and one instance
+		m_buffer->SetResourceBarrier(m_drawArgsBuffer.GetAddressOf(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST);
+		m_buffer->CopyBufferRegion(m_drawArgsBuffer.GetAddressOf(), m_drawArgsUploadHeap.GetAddressOf(), sizeof(D3D12_DRAW_ARGUMENTS));
+		m_buffer->SetResourceBarrier(m_drawArgsBuffer.GetAddressOf(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		m_buffer->SetResourceBarrier(m_renderRecordBuffer.GetAddressOf(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+#endif
 
 		//Set NBody compute shader
 		m_commandList->SetPipelineState(shader->GetShaders(Shaders::ID::NBodyCompute).pipelineState.Get());
 		signature->SetComputeRootSignature();
-		m_buffer->BindConstantBufferComputeForRootDescriptor(0, 1 - frameIndex, m_cbUpdateUploadHeap->GetAddressOf()); //Root index 0
-		m_srvUavDescHeap->SetComputeRootDescriptorTable(1, m_srvUavDescHeap->GetGPUIncrementHandle(2 + frameIndex)); //Root index 1 for UAV table
-		m_srvUavDescHeap->SetComputeRootDescriptorTable(2, m_srvUavDescHeap->GetGPUIncrementHandle(1 - frameIndex));
-		shader->SetComputeDispatch(static_cast<int>(ceil(NUM_BODIES / 256.0f)), 1, 1);
+		m_srvUavDescHeap->SetComputeRootDescriptorTable(COMPUTE_ROOT_BODY_SRVS, m_srvUavDescHeap->GetGPUIncrementHandle(BODY_SRV_DESCRIPTOR + (1 - frameIndex) * NUM_BODY_SEGMENTS));
+#if FUSED_RENDER_PREP
+		m_commandList->SetComputeRootUnorderedAccessView(COMPUTE_ROOT_PASS_UAV, m_renderRecordBuffer->GetGPUVirtualAddress());
+		m_commandList->SetComputeRootUnorderedAccessView(COMPUTE_ROOT_DRAW_ARGS, m_drawArgsBuffer->GetGPUVirtualAddress());
+#endif
+#if TILE_RELATIVE_COORDINATES
+		m_commandList->SetComputeRootShaderResourceView(COMPUTE_ROOT_OLD_CELLS, m_cellBuffer[1 - frameIndex]->GetGPUVirtualAddress());
+		m_commandList->SetComputeRootUnorderedAccessView(COMPUTE_ROOT_NEW_CELLS, m_cellBuffer[frameIndex]->GetGPUVirtualAddress());
+#endif
+
+		//One dispatch per segment, each with its own copy of the constants
+		for (UINT segment = 0; segment < m_layout.GetNumSegments(); ++segment)
+		{
+			cbUpdate.g_segment = segment;
+			cbUpdate.g_numParticles = m_layout.GetSegmentSize(segment);
+			cbUpdate.g_numBlocks = GetDispatchGroups(cbUpdate.g_numParticles);
+			m_buffer->SetConstantBufferData(&cbUpdate, sizeof(cbUpdate), 1 - frameIndex, &m_cbUpdateAddress[0], segment * CB_UPDATE_STRIDE);
+
+			m_buffer->BindConstantBufferComputeForRootDescriptor(COMPUTE_ROOT_CONSTANTS, 1 - frameIndex, m_cbUpdateUploadHeap->GetAddressOf(), segment * CB_UPDATE_STRIDE);
+			m_srvUavDescHeap->SetComputeRootDescriptorTable(COMPUTE_ROOT_BODY_UAVS, m_srvUavDescHeap->GetGPUIncrementHandle(BODY_UAV_DESCRIPTOR + frameIndex * NUM_BODY_SEGMENTS + segment));
+			shader->SetComputeDispatch(cbUpdate.g_numBlocks, 1, 1);
+		}
 
-		m_buffer->SetResourceBarrier(m_srvBuffer[1 - frameIndex].GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		SetBodyBarriers(1 - frameIndex, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+#if TILE_RELATIVE_COORDINATES
+		m_buffer->SetResourceBarrier(m_cellBuffer[frameIndex].GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+#endif
+
+#if BODY_READBACK
+		ReadBackBodies(frameIndex);
+#endif
+
+#if FUSED_RENDER_PREP
+		m_buffer->SetResourceBarrier(m_renderRecordBuffer.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		m_buffer->SetResourceBarrier(m_drawArgsBuffer.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+#endif
 	}
 
 	void NBody::InitializeBodies()
@@ -93,7 +408,7 @@ namespace dx
 		float inner = 2.5f * m_clusterScale;
 		float outer = 4.0f * m_clusterScale;
 
-		unsigned int i = 0;
+		UINT64 i = 0;
 		while (i < NUM_BODIES)
 		{
 			Vector4 point;
@@ -123,22 +438,398 @@ namespace dx
 			Vector4 velocity = Vector4(bodyData[i].position);
 			auto res = velocity.Cross(velocity, axis);
 			bodyData[i].velocity = Vector4(res.x * vscale, res.y * vscale, res.z * vscale, 1.f);
+
+#if PLANAR_SIMULATION
+			//Flatten the shell into a disc in the xy plane
+			bodyData[i].position.z = 0.f;
+			bodyData[i].velocity.z = 0.f;
+#endif
 			i++;
 		}
 
-		//Create SRV | UAV buffer for pipelines
-		m_buffer->CreateSharedSRVUAVForTable(bodyData, sizeof(BodyData) * NUM_BODIES, sizeof(BodyData), NUM_BODIES, m_srvBuffer[0].GetAddressOf(), m_srvBufferUploadHeap[0].GetAddressOf(), 
-			m_srvUavDescHeap->GetCPUIncrementHandle(0), m_srvUavDescHeap->GetCPUIncrementHandle(2), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		if (sizeof(INITIAL_CONDITIONS_FILE) > 1)
+		{
+			//Imported straight into the upload layout. The buffers, segments and passes are sized
+			//for NUM_BODIES, so a short file fails instead of being padded with shell bodies.
+			ImportResult result;
+			std::string error;
+			bool imported = ImportBodies(INITIAL_CONDITIONS_FILE, reinterpret_cast<Body*>(bodyData), NUM_BODIES, result, error);
+			if (!imported)
+				OutputDebugStringA((error + "\n").c_str());
+			else if (result.count < NUM_BODIES)
+				OutputDebugStringA((INITIAL_CONDITIONS_FILE " holds " + std::to_string(result.count) + " bodies, fewer than NUM_BODIES\n").c_str());
+			if (result.truncated)
+				OutputDebugStringA(INITIAL_CONDITIONS_FILE " holds more than NUM_BODIES bodies, only the first ones are used\n");
+			assert(imported && result.count == NUM_BODIES);
+		}
+
+		//The EQUAL_MASS permutation applies one mass to every source, take it from the bodies
+		//like the CPU kernels do, an imported set has to really be equal-mass
+		m_equalMass = bodyData[0].position.w;
+#if EQUAL_MASS_BODIES
+		for (UINT64 body = 1; body < NUM_BODIES; ++body)
+		{
+			if (bodyData[body].position.w != m_equalMass)
+			{
+				OutputDebugStringA("EQUAL_MASS_BODIES is set but the bodies have different masses\n");
+				assert(false);
+				break;
+			}
+		}
+#endif
+
+#if TILE_RELATIVE_COORDINATES
+		//Split the positions into integer cells and float offsets before upload
+		TiledCoordinates tiled(CELL_SIZE);
+		tiled.SetBodies(BodyArray(reinterpret_cast<Body*>(bodyData), reinterpret_cast<Body*>(bodyData) + NUM_BODIES));
+		memcpy(bodyData, tiled.GetOffsetBodies().data(), sizeof(BodyData) * NUM_BODIES);
+
+		for (unsigned int i = 0; i < FRAME_BUFFERS; ++i)
+		{
+			m_buffer->CreateRootDescriptorBuffer(tiled.GetCells().data(), sizeof(Int4) * NUM_BODIES, m_cellBuffer[i].GetAddressOf(), m_cellBufferUploadHeap[i].GetAddressOf(),
+				D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		}
+#endif
+
+#if CPU_SIMULATION
+		InitializeCpuSimulation(bodyData);
+#elif GROWABLE_BODY_BUFFERS
+		//Reserve MAX_BODIES and bind tiles for the initial population, the views cover the whole range
+		for (unsigned int i = 0; i < FRAME_BUFFERS; ++i)
+		{
+			m_growableBodyBuffer[i] = std::make_unique<GrowableBuffer>(m_device, m_commandQueue, m_commandList, UINT64(sizeof(BodyData)) * MAX_BODIES,
+				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, BODY_UPLOAD_BYTES, FRAME_BUFFERS + 1);
+			bool bound = m_growableBodyBuffer[i]->Resize(GetBoundBodyBytes(NUM_BODIES));
+			assert(bound);
+			bool written = m_growableBodyBuffer[i]->Write(0, bodyData, sizeof(BodyData) * NUM_BODIES, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+			assert(written);
+			m_srvBuffer[i].assign(1, m_growableBodyBuffer[i]->GetResource());
 
-		m_buffer->CreateSharedSRVUAVForTable(bodyData, sizeof(BodyData) * NUM_BODIES, sizeof(BodyData), NUM_BODIES, m_srvBuffer[1].GetAddressOf(), m_srvBufferUploadHeap[1].GetAddressOf(),
-			m_srvUavDescHeap->GetCPUIncrementHandle(1), m_srvUavDescHeap->GetCPUIncrementHandle(3), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+			m_buffer->CreateSharedSRVUAVViews(m_srvBuffer[i][0].Get(), sizeof(BodyData), MAX_BODIES, m_srvUavDescHeap->GetCPUIncrementHandle(BODY_SRV_DESCRIPTOR + i),
+				m_srvUavDescHeap->GetCPUIncrementHandle(BODY_UAV_DESCRIPTOR + i));
+		}
+#else
+		//Create SRV | UAV buffers for pipelines, one per state and segment
+		for (unsigned int i = 0; i < BODY_STATES; ++i)
+		{
+			m_srvBuffer[i].resize(NUM_BODY_SEGMENTS);
+			m_srvBufferUploadHeap[i].resize(NUM_BODY_SEGMENTS);
+			for (UINT segment = 0; segment < NUM_BODY_SEGMENTS; ++segment)
+			{
+				UINT size = m_layout.GetSegmentSize(segment);
+				m_buffer->CreateSharedSRVUAVForTable(bodyData + m_layout.GetSegmentBegin(segment), UINT64(sizeof(BodyData)) * size, sizeof(BodyData), size,
+					m_srvBuffer[i][segment].GetAddressOf(), m_srvBufferUploadHeap[i][segment].GetAddressOf(),
+					m_srvUavDescHeap->GetCPUIncrementHandle(BODY_SRV_DESCRIPTOR + i * NUM_BODY_SEGMENTS + segment),
+					m_srvUavDescHeap->GetCPUIncrementHandle(BODY_UAV_DESCRIPTOR + i * NUM_BODY_SEGMENTS + segment), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+			}
+		}
+
+#if SINGLE_STATE_UPDATE
+		//Pass 1 writes every thread of the last block through a root UAV, which has no bounds
+		//checks, so the accelerations cover whole blocks
+		m_accelerationBuffer.resize(NUM_BODY_SEGMENTS);
+		for (UINT segment = 0; segment < NUM_BODY_SEGMENTS; ++segment)
+		{
+			UINT64 blocks = (m_layout.GetSegmentSize(segment) + 255) / 256;
+			m_buffer->CreateScratchBuffer(blocks * 256 * 3 * sizeof(float), m_accelerationBuffer[segment].GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		}
+#endif
+#if BODY_READBACK
+		InitializeBodyReadback();
+#endif
+#endif
 
 		//Create SRV from texture
-		m_texture->CreateSRVFromTexture(Textures::ID::Particle, m_srvUavDescHeap->GetCPUIncrementHandle(4));
+		m_texture->CreateSRVFromTexture(Textures::ID::Particle, m_srvUavDescHeap->GetCPUIncrementHandle(TEXTURE_DESCRIPTOR));
 
 		//Release memory
 		delete[] bodyData;
 		bodyData = nullptr;
+
+#if FUSED_RENDER_PREP
+		InitializeRenderRecords();
+#endif
+	}
+
+	void NBody::OnFrameCompleted()
+	{
+#if GROWABLE_BODY_BUFFERS
+		//The tiles unbound by a shrink are no longer read once the queue is idle
+		if (m_shrunk)
+		{
+			for (std::unique_ptr<GrowableBuffer> & buffer : m_growableBodyBuffer)
+				buffer->ReleaseUnusedHeaps();
+			m_shrunk = false;
+		}
+#endif
+	}
+
+	UINT64 NBody::GetBodyCount() const
+	{
+		return m_numBodies;
+	}
+
+	void NBody::OnFrameSubmitted()
+	{
+#if SINGLE_STATE_UPDATE
+		//The initial upload ran before the first frame, keeping its staging copy around would
+		//give back most of what the single state saves
+		m_srvBufferUploadHeap[0].clear();
+#endif
+
+#if GROWABLE_BODY_BUFFERS
+		for (std::unique_ptr<GrowableBuffer> & buffer : m_growableBodyBuffer)
+			buffer->OnSubmitted();
+#endif
+
+#if ESCAPER_DETECTION
+		if (m_orderPending)
+			m_orderRing->Release(m_commandQueue, m_orderSlot);
+		m_orderPending = false;
+#endif
+
+#if CPU_SIMULATION
+		//The slot is free again once the queue gets past this frame
+		for (std::unique_ptr<UploadRing> & ring : m_bodyRings)
+			ring->Release(m_commandQueue, m_bodySlot);
+#endif
+	}
+
+	void NBody::SetBodyBarriers(const UINT & frame, D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter)
+	{
+		for (ComPtr<ID3D12Resource> & segment : m_srvBuffer[frame])
+			m_buffer->SetResourceBarrier(segment.GetAddressOf(), stateBefore, stateAfter);
+	}
+
+	void NBody::SetRenderSubset(const UINT & stride, const UINT & phase, const float & weight)
+	{
+		assert(stride > 0 && phase < stride);
+		m_subsetStride = stride;
+		m_subsetPhase = phase;
+		m_subsetWeight = weight;
+	}
+
+	void NBody::InitializeCpuSimulation(const BodyData* bodies)
+	{
+#if CPU_SIMULATION
+		BodyArray initial(reinterpret_cast<const Body*>(bodies), reinterpret_cast<const Body*>(bodies) + NUM_BODIES);
+		SimulationParams params;
+
+		if (std::string(CPU_SIMULATION_ENGINE) == "cpu")
+		{
+			//Same permutation as the compute shader would use
+			KernelConfig config;
+			config.precision = KERNEL_PRECISION == 1 ? KernelPrecision::Double : KERNEL_PRECISION == 2 ? KernelPrecision::FloatDoubleAccumulate : KernelPrecision::Float;
+			config.equalMass = EQUAL_MASS_BODIES != 0;
+			config.softening = SOFTENING != 0;
+			config.planar = PLANAR_SIMULATION != 0;
+			config.singleState = SINGLE_STATE_UPDATE != 0;
+			m_cpuEngine = std::make_unique<CpuNBody>(initial, params, config);
+		}
+		else
+			m_cpuEngine = CreateEngine(CPU_SIMULATION_ENGINE, initial, params);
+		assert(m_cpuEngine);
+
+		m_bodySegments.resize(NUM_BODY_SEGMENTS);
+		for (UINT segment = 0; segment < NUM_BODY_SEGMENTS; ++segment)
+		{
+			m_bodyRings.push_back(std::make_unique<UploadRing>(m_device, UINT64(sizeof(BodyData)) * m_layout.GetSegmentSize(segment), BODY_RING_SLOTS));
+			for (UINT i = 0; i < BODY_RING_SLOTS; ++i)
+				m_bodyRings[segment]->CreateSRV(i, sizeof(BodyData), m_srvUavDescHeap->GetCPUIncrementHandle(BODY_RING_DESCRIPTOR + i * NUM_BODY_SEGMENTS + segment));
+		}
+#endif
+	}
+
+	void NBody::InitializeBodyReadback()
+	{
+#if BODY_READBACK
+		m_bodyReadback.resize(NUM_BODY_SEGMENTS);
+		m_bodyReadbackAddress.resize(NUM_BODY_SEGMENTS);
+		for (UINT segment = 0; segment < NUM_BODY_SEGMENTS; ++segment)
+		{
+			UINT64 size = UINT64(sizeof(BodyData)) * m_layout.GetSegmentSize(segment);
+			assert(!m_device->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK), D3D12_HEAP_FLAG_NONE,
+				&CD3DX12_RESOURCE_DESC::Buffer(size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(m_bodyReadback[segment].GetAddressOf())));
+			m_bodyReadback[segment]->SetName(L"Body Readback Heap");
+
+			//Only read after the frame loop waited for the copy
+			CD3DX12_RANGE readRange(0, static_cast<SIZE_T>(size));
+			void* address = nullptr;
+			assert(!m_bodyReadback[segment]->Map(0, &readRange, &address));
+			m_bodyReadbackAddress[segment] = static_cast<const Body*>(address);
+		}
+
+		m_readbackBodies.resize(NUM_BODIES);
+#endif
+#if ESCAPER_DETECTION
+		//The gather pass reads whole blocks of the last segment through a root SRV
+		m_orderRing = std::make_unique<UploadRing>(m_device, UINT64(sizeof(uint32_t)) * ((NUM_BODIES + 255) / 256 * 256), FRAME_BUFFERS);
+#endif
+#if SNAPSHOT_INTERVAL
+		m_snapshotWriter = std::make_unique<SnapshotWriter>();
+#endif
+	}
+
+#if BODY_READBACK
+	void NBody::ReadBackBodies(const UINT & frameIndex)
+	{
+		//The state this update wrote is the one the next update reads
+		++m_updateCount;
+		bool detect = ESCAPER_DETECTION && m_updateCount % ESCAPER_INTERVAL == 0;
+		bool snapshot = SNAPSHOT_INTERVAL > 0 && m_updateCount % (SNAPSHOT_INTERVAL > 0 ? SNAPSHOT_INTERVAL : 1) == 0;
+		if (!detect && !snapshot)
+			return;
+
+		const UINT state = GetBodyState(frameIndex);
+		SetBodyBarriers(state, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		for (UINT segment = 0; segment < m_layout.GetNumSegments(); ++segment)
+			m_buffer->CopyBufferRegion(m_bodyReadback[segment].GetAddressOf(), m_srvBuffer[state][segment].GetAddressOf(), UINT64(sizeof(BodyData)) * m_layout.GetSegmentSize(segment));
+		SetBodyBarriers(state, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		m_readbackUpdate = m_updateCount;
+		m_readbackPending = true;
+	}
+
+	void NBody::ProcessReadback(Shader* shader, RootSignature* signature, const UINT & frameIndex)
+	{
+		//The frame loop waits for the GPU every frame, so the copy of the previous update is done
+		if (!m_readbackPending)
+			return;
+		m_readbackPending = false;
+
+		for (UINT segment = 0; segment < m_layout.GetNumSegments(); ++segment)
+		{
+			const Body* bodies = m_bodyReadbackAddress[segment];
+			std::copy(bodies, bodies + m_layout.GetSegmentSize(segment), m_readbackBodies.begin() + m_layout.GetSegmentBegin(segment));
+		}
+
+#if SNAPSHOT_INTERVAL
+		if (m_readbackUpdate % SNAPSHOT_INTERVAL == 0)
+		{
+			//Failures of the writer thread are reported once, on the next snapshot
+			SnapshotResult result;
+			if (m_snapshotWriter->GetLastResult(result) && !result.succeeded && result.path != m_reportedSnapshot)
+			{
+				OutputDebugStringA(("could not write " + result.path + ": " + result.error + "\n").c_str());
+				m_reportedSnapshot = result.path;
+			}
+
+			//Skipped rather than queued while the disk is behind
+			std::string path = std::string(SNAPSHOT_PATH) + "_" + std::to_string(m_readbackUpdate) + ".gadget";
+			if (!m_snapshotWriter->Submit(path, m_readbackBodies, m_readbackUpdate * double(SimulationParams().timestep)))
+				OutputDebugStringA(("skipped " + path + ", the previous snapshots are still being written\n").c_str());
+		}
+#endif
+
+#if ESCAPER_DETECTION
+		if (m_readbackUpdate % ESCAPER_INTERVAL == 0)
+			DemoteEscapers(shader, signature, frameIndex);
+#endif
+	}
+#endif
+
+#if ESCAPER_DETECTION
+	void NBody::DemoteEscapers(Shader* shader, RootSignature* signature, const UINT & frameIndex)
+	{
+		EscaperSettings settings;
+		settings.radiusFactor = ESCAPER_RADIUS_FACTOR;
+		if (FindEscapers(m_readbackBodies.data(), m_numSources, SimulationParams(), settings, m_escaping, m_escaperReport) == 0)
+			return;
+
+		m_numSources = GetDemotionOrder(m_escaping, m_numSources, m_numBodies, m_order);
+		m_orderSlot = m_orderRing->Acquire();
+		m_orderPending = true;
+		memcpy(m_orderRing->GetAddress(m_orderSlot), m_order.data(), sizeof(uint32_t) * m_order.size());
+
+		//Gathered into the state this frame's update overwrites anyway, then copied back
+		//into the one it reads
+		SetBodyBarriers(frameIndex, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		m_commandList->SetPipelineState(shader->GetShaders(Shaders::ID::NBodyGather).pipelineState.Get());
+		signature->SetComputeRootSignature();
+		m_srvUavDescHeap->SetComputeRootDescriptorTable(COMPUTE_ROOT_BODY_SRVS, m_srvUavDescHeap->GetGPUIncrementHandle(BODY_SRV_DESCRIPTOR + (1 - frameIndex) * NUM_BODY_SEGMENTS));
+		m_commandList->SetComputeRootShaderResourceView(COMPUTE_ROOT_BODY_ORDER, m_orderRing->GetGPUAddress(m_orderSlot));
+
+		//Only the segment and its size are read, the update rewrites the constants after this
+		CB_UPDATE cbGather = {};
+		cbGather.g_segmentCapacity = m_layout.GetCapacity();
+		for (UINT segment = 0; segment < m_layout.GetNumSegments(); ++segment)
+		{
+			cbGather.g_segment = segment;
+			cbGather.g_numParticles = m_layout.GetSegmentSize(segment);
+			cbGather.g_numBlocks = GetDispatchGroups(cbGather.g_numParticles);
+			m_buffer->SetConstantBufferData(&cbGather, sizeof(cbGather), 1 - frameIndex, &m_cbUpdateAddress[0], segment * CB_UPDATE_STRIDE);
+
+			m_buffer->BindConstantBufferComputeForRootDescriptor(COMPUTE_ROOT_CONSTANTS, 1 - frameIndex, m_cbUpdateUploadHeap->GetAddressOf(), segment * CB_UPDATE_STRIDE);
+			m_srvUavDescHeap->SetComputeRootDescriptorTable(COMPUTE_ROOT_BODY_UAVS, m_srvUavDescHeap->GetGPUIncrementHandle(BODY_UAV_DESCRIPTOR + frameIndex * NUM_BODY_SEGMENTS + segment));
+			shader->SetComputeDispatch(cbGather.g_numBlocks, 1, 1);
+		}
+
+		SetBodyBarriers(frameIndex, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		SetBodyBarriers(1 - frameIndex, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+		for (UINT segment = 0; segment < m_layout.GetNumSegments(); ++segment)
+			m_commandList->CopyResource(m_srvBuffer[1 - frameIndex][segment].Get(), m_srvBuffer[frameIndex][segment].Get());
+		SetBodyBarriers(1 - frameIndex, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		SetBodyBarriers(frameIndex, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	}
+#endif
+
+#if GROWABLE_BODY_BUFFERS
+	bool NBody::SetBodyCount(const UINT & count, const BodyData* appended)
+	{
+		//Checked up front so a failure leaves the buffers and the population as they were,
+		//within MAX_BODIES the resize always fits the reserved range
+		if (count == 0 || count > MAX_BODIES || (count > m_numBodies && count - m_numBodies > MAX_APPENDED_BODIES))
+			return false;
+
+		const UINT64 appendedBytes = count > m_numBodies ? UINT64(sizeof(BodyData)) * (count - m_numBodies) : 0;
+		for (unsigned int i = 0; i < FRAME_BUFFERS; ++i)
+		{
+			if (appendedBytes > 0 && !m_growableBodyBuffer[i]->CanWrite(appendedBytes))
+				return false;
+		}
+
+		for (unsigned int i = 0; i < FRAME_BUFFERS; ++i)
+		{
+			bool resized = m_growableBodyBuffer[i]->Resize(GetBoundBodyBytes(count));
+			assert(resized);
+		}
+
+		//Only the new tail is uploaded, the bodies already on the GPU stay where they are.
+		//Both buffers get it since the next update reads one and overwrites the other.
+		if (count > m_numBodies)
+		{
+			for (unsigned int i = 0; i < FRAME_BUFFERS; ++i)
+			{
+				bool written = m_growableBodyBuffer[i]->Write(UINT64(sizeof(BodyData)) * m_numBodies, appended, appendedBytes, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+				assert(written);
+			}
+		}
+
+		//Heaps left without tiles are released once the GPU is done with the frame
+		m_shrunk = m_shrunk || count < m_numBodies;
+		m_numBodies = count;
+		m_numSources = count;
+		m_layout = SegmentLayout(count, BODY_SEGMENT_CAPACITY);
+		return true;
+	}
+
+	bool NBody::AppendBodies(const UINT & count)
+	{
+		//A different seed per batch, so the new shell does not land on an earlier one
+		BodyArray bodies = GenerateShellBodies(count, m_clusterScale, m_velocityScale, ++m_numAppends + 1);
+		return SetBodyCount(static_cast<UINT>(m_numBodies) + count, reinterpret_cast<const BodyData*>(bodies.data()));
+	}
+#endif
+
+	void NBody::InitializeRenderRecords()
+	{
+		//Worst case every body is visible
+		std::vector<RenderRecord> records(NUM_BODIES, RenderRecord{});
+		m_buffer->CreateSRVForRootTable(records.data(), sizeof(RenderRecord) * NUM_BODIES, sizeof(RenderRecord), NUM_BODIES, m_renderRecordBuffer.GetAddressOf(),
+			m_renderRecordUploadHeap.GetAddressOf(), m_srvUavDescHeap->GetCPUIncrementHandle(RENDER_RECORD_DESCRIPTOR), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+		//The upload heap keeps the reset values (zero vertices, one instance) for every frame
+		D3D12_DRAW_ARGUMENTS drawArgs = { 0, 1, 0, 0 };
+		m_buffer->CreateIndirectArgumentBuffer(&drawArgs, sizeof(drawArgs), m_drawArgsBuffer.GetAddressOf(), m_drawArgsUploadHeap.GetAddressOf());
 	}
 }
 
@@ -7,43 +7,203 @@
 #include <graphics/Buffer.hpp>
 #include <graphics/Camera.hpp>
 #include <graphics/DescriptorHeap.hpp>
+#include <graphics/GrowableBuffer.hpp>
 #include <graphics/RootSignature.hpp>
 #include <graphics/Texture.hpp>
 #include <graphics/Shader.hpp>
+#include <graphics/TemporalAccumulator.hpp>
+#include <graphics/UploadRing.hpp>
+#include <simulation/Engine.hpp>
+#include <simulation/Escapers.hpp>
+#include <simulation/Segments.hpp>
+#include <utils/SnapshotWriter.hpp>
 #include <utils/Utility.hpp>
 
 //Test data values
 //1024, 4096, 8192, 14336, 16384, 28672, 30720, 32768, 57344, 61440, 65536 
 #define NUM_BODIES 30720
 
+//Body buffers are split into segments of at most BODY_SEGMENT_CAPACITY bodies, each its own
+//resource and descriptor (see SegmentLayout), so large runs are dispatched and drawn segment
+//by segment. Whole blocks of 256, a multiple of MAX_SUBSET_STRIDE and at most 65535 blocks,
+//the most thread groups one dispatch dimension takes.
+#define BODY_SEGMENT_CAPACITY (65535 * 256)
+
+//Back the body buffers with reserved resources so NBody::SetBodyCount can grow or shrink
+//the population up to MAX_BODIES by binding tiles, without recreating or copying them. New
+//bodies go through persistent upload rings, at most MAX_APPENDED_BODIES per call. In the app
+//+ appends a generated shell of MAX_APPENDED_BODIES bodies and - removes as many.
+#define GROWABLE_BODY_BUFFERS 0
+#define MAX_BODIES (1 << 20)
+#define MAX_APPENDED_BODIES (1 << 16)
+
+//Simulate on the CPU with CPU_SIMULATION_ENGINE (a CreateEngine name, "cpu" uses the kernel
+//permutation below) instead of the compute pass. The engine integrates straight into a
+//mapped upload ring that the sprite pass reads, so the bodies are never copied.
+#define CPU_SIMULATION 0
+#define CPU_SIMULATION_ENGINE "tree"
+
+//Keep one copy of the body state instead of one per frame. A first pass writes every body's
+//acceleration to a compact float3 buffer, a second pass integrates the bodies in place, so
+//the state costs 44 instead of 64 bytes per body for an extra dispatch per segment. With
+//CPU_SIMULATION the "cpu" engine runs the same two passes (KernelConfig::singleState).
+#define SINGLE_STATE_UPDATE 0
+
+//Gadget snapshot or CSV file to start from instead of the generated shell, empty to generate.
+//The first NUM_BODIES bodies of the file are used, a file with fewer fails to load.
+#define INITIAL_CONDITIONS_FILE ""
+
+//Let the integration kernel also write clip-space render records for the visible bodies
+//and draw them with ExecuteIndirect instead of transforming every body in the vertex shader
+#define FUSED_RENDER_PREP 0
+
+//Draw a rotating 1/k subset of the bodies each frame, weighted by k, and accumulate the
+//frames in a floating point target (see SubsetSchedule). k adapts so the GPU time of the
+//sprite and accumulation passes, timed on their own, stays within SUBSET_FRAME_BUDGET_MS.
+#define STOCHASTIC_RENDERING 0
+#define SUBSET_FRAME_BUDGET_MS 8.0
+#define MAX_SUBSET_STRIDE 64
+
+//Copy every FRAME_CAPTURE_INTERVAL-th back buffer into a ring of FRAME_CAPTURE_SLOTS readback
+//buffers and encode the finished copies on background threads (see FrameCapture), as PNG
+//files or, with FRAME_CAPTURE_RAW_VIDEO, one raw rgb24 stream. Frames are dropped rather
+//than waited for when every slot is busy or the encoders are saturated.
+#define FRAME_CAPTURE 0
+#define FRAME_CAPTURE_INTERVAL 1
+#define FRAME_CAPTURE_SLOTS 4
+#define FRAME_CAPTURE_RAW_VIDEO 0
+#define FRAME_CAPTURE_PATH "capture"
+
+//Every ESCAPER_INTERVAL frames read the bodies back and run FindEscapers over the ones that
+//still attract. A gather pass moves the new escapers behind them, where they stay as tracers,
+//and the update only reads that active prefix as sources (see EscaperNBody).
+#define ESCAPER_DETECTION 0
+#define ESCAPER_INTERVAL 64
+#define ESCAPER_RADIUS_FACTOR 4.0f
+
+//Every SNAPSHOT_INTERVAL updates write the bodies to SNAPSHOT_PATH_<update>.gadget on a
+//background thread (see SnapshotWriter), so a run can be restarted from them through
+//INITIAL_CONDITIONS_FILE. 0 disables. Shares the body readback with escaper detection.
+#define SNAPSHOT_INTERVAL 0
+#define SNAPSHOT_PATH "snapshot"
+
+//Copies of the body state are read back for escaper detection and snapshots
+#define BODY_READBACK (ESCAPER_DETECTION || SNAPSHOT_INTERVAL > 0)
+
+//Sample memory, handles and step times over the session (see SoakMonitor) and write
+//soak.csv once a trend fails
+#define SOAK_MONITOR 0
+
+//Seconds between two re-reads of the CPU quota, cpuset and memory limit (see ResourceLimits)
+#define RESOURCE_REFRESH_SECONDS 5.0
+
+//Store positions as float offsets from integer cell anchors (see TiledCoordinates) so large
+//domains keep near-double accuracy for close interactions
+#define TILE_RELATIVE_COORDINATES 0
+#define CELL_SIZE 1024.0
+
+//Force kernel specialization, each combination is compiled into its own shader permutation
+//KERNEL_PRECISION: 0 = float, 1 = double, 2 = float with double accumulation
+#define KERNEL_PRECISION 0
+#define EQUAL_MASS_BODIES 0
+#define SOFTENING 1
+#define PLANAR_SIMULATION 0
+
+//Root parameters of the compute root signature. Only the ones the configured passes read
+//exist, each optional one follows the previous one.
+static const UINT COMPUTE_ROOT_CONSTANTS = 0;
+static const UINT COMPUTE_ROOT_BODY_UAVS = 1;		//Updated segment
+static const UINT COMPUTE_ROOT_BODY_SRVS = 2;		//Every segment, the sources
+static const UINT COMPUTE_ROOT_PASS_UAV = 3;		//Render records of the fused pass or accelerations of the single-state passes
+static const UINT COMPUTE_ROOT_DRAW_ARGS = COMPUTE_ROOT_PASS_UAV + (FUSED_RENDER_PREP || SINGLE_STATE_UPDATE ? 1 : 0);
+static const UINT COMPUTE_ROOT_OLD_CELLS = COMPUTE_ROOT_DRAW_ARGS + (FUSED_RENDER_PREP ? 1 : 0);
+static const UINT COMPUTE_ROOT_NEW_CELLS = COMPUTE_ROOT_OLD_CELLS + 1;
+static const UINT COMPUTE_ROOT_BODY_ORDER = COMPUTE_ROOT_OLD_CELLS + (TILE_RELATIVE_COORDINATES ? 2 : 0);
+static const UINT COMPUTE_ROOT_COUNT = COMPUTE_ROOT_BODY_ORDER + (ESCAPER_DETECTION ? 1 : 0);
+
 struct BodyData
 {
 	Vector4 position;
 	Vector4 velocity;
 };
 
+//Compact render data produced by the fused integration pass
+struct RenderRecord
+{
+	Vector4 clipPosition;
+	float spriteSize;		//Projected, in NDC
+	UINT bodyIndex;
+	UINT visible;
+	UINT padding;
+};
+
 namespace dx
 {
 	class NBody
 	{
 	public:
-		NBody(ID3D12Device* device, ID3D12GraphicsCommandList* commandList, Buffer* buffer, Camera* camera, Texture* texture);
+		NBody(ID3D12Device* device, ID3D12CommandQueue* commandQueue, ID3D12GraphicsCommandList* commandList, Buffer* buffer, Camera* camera, Texture* texture);
 		void UpdateBodies(Shader* shader, RootSignature* signature, const UINT & frameIndex);
 		void RenderBodies(Shader* shader, RootSignature* signature, const UINT & frameIndex);
+		UINT64 GetBodyCount() const;
+
+		//Call after the frame's command list was submitted
+		void OnFrameSubmitted();
+
+		//Call once the GPU has finished the frame
+		void OnFrameCompleted();
+
+		//Draw only the bodies with index % stride == phase, each scaled by weight
+		void SetRenderSubset(const UINT & stride, const UINT & phase, const float & weight);
+
+#if GROWABLE_BODY_BUFFERS
+		//Grows or truncates the population at its end. When growing, appended holds the
+		//count - GetBodyCount() new bodies, at most MAX_APPENDED_BODIES. Records on the command
+		//list, so call it while the frame is recording and before UpdateBodies, at most once
+		//per frame. Any count from 1 is valid, the update reads the partial last block. Fails
+		//without changing anything when the count is out of range or the upload slots are taken.
+		bool SetBodyCount(const UINT & count, const BodyData* appended);
+
+		//Appends count bodies of a new generated shell through SetBodyCount
+		bool AppendBodies(const UINT & count);
+#endif
+
+	public:
+		static const D3D_SHADER_MACRO* GetShaderDefines();
+		static const D3D_SHADER_MACRO* GetComputePassDefines(const Shaders::ID & pass);
+		static DXGI_FORMAT GetRenderTargetFormat();
+		static UINT GetNumSegments();
 
 	private:
 		void Initialize();
 		void InitializeBodies();
+		void InitializeRenderRecords();
+		void InitializeCpuSimulation(const BodyData* bodies);
+		void InitializeBodyReadback();
+		void ReadBackBodies(const UINT & frameIndex);
+		void ProcessReadback(Shader* shader, RootSignature* signature, const UINT & frameIndex);
+		void DemoteEscapers(Shader* shader, RootSignature* signature, const UINT & frameIndex);
+		Matrix GetWorldViewProjection() const;
+		void SetBodyBarriers(const UINT & frame, D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter);
 
 	private:
 		float m_clusterScale = 1.54f;
 		float m_velocityScale = 8.0f;
+		float m_pointSize = 1.0f;
+		float m_equalMass = 1.0f;
+		UINT64 m_numBodies = NUM_BODIES;
+		UINT64 m_numSources = NUM_BODIES;
+		SegmentLayout m_layout = SegmentLayout(NUM_BODIES, BODY_SEGMENT_CAPACITY);
+		UINT m_subsetStride = 1;
+		UINT m_subsetPhase = 0;
+		float m_subsetWeight = 1.0f;
 
 	private:
 		Camera * m_camera;
 		Buffer * m_buffer;
 		Texture * m_texture;
 		ID3D12Device * m_device;
+		ID3D12CommandQueue* m_commandQueue;
 		ID3D12GraphicsCommandList* m_commandList;
 
 	private:
@@ -53,14 +213,67 @@ namespace dx
 		UINT8* m_cbDrawAddress[FRAME_BUFFERS];
 		UINT8* m_cbUpdateAddress[FRAME_BUFFERS];
 
-		//SRV buffer
-		ComPtr<ID3D12Resource> m_srvBuffer[FRAME_BUFFERS];
-		ComPtr<ID3D12Resource> m_srvBufferUploadHeap[FRAME_BUFFERS];
+		//SRV buffer, one resource per segment
+		std::vector<ComPtr<ID3D12Resource>> m_srvBuffer[FRAME_BUFFERS];
+		std::vector<ComPtr<ID3D12Resource>> m_srvBufferUploadHeap[FRAME_BUFFERS];
+#if GROWABLE_BODY_BUFFERS
+		std::unique_ptr<GrowableBuffer> m_growableBodyBuffer[FRAME_BUFFERS];
+		bool m_shrunk = false;
+		unsigned int m_numAppends = 0;
+#endif
+
+#if CPU_SIMULATION
+		//CPU engine and the rings it integrates into, one per segment acquired in lockstep
+		std::unique_ptr<Engine> m_cpuEngine;
+		std::vector<std::unique_ptr<UploadRing>> m_bodyRings;
+		std::vector<Body*> m_bodySegments;
+		UINT m_bodySlot = 0;
+#endif
+
+#if BODY_READBACK
+		//Persistently mapped readback of one state per segment, filled after the updates
+		//that detect escapers or write a snapshot
+		std::vector<ComPtr<ID3D12Resource>> m_bodyReadback;
+		std::vector<const Body*> m_bodyReadbackAddress;
+		BodyArray m_readbackBodies;
+		UINT64 m_updateCount = 0;
+		UINT64 m_readbackUpdate = 0;
+		bool m_readbackPending = false;
+#endif
+
+#if ESCAPER_DETECTION
+		//The ring the gather order is uploaded through
+		std::unique_ptr<UploadRing> m_orderRing;
+		UINT m_orderSlot = 0;
+		bool m_orderPending = false;
+		std::vector<unsigned char> m_escaping;
+		std::vector<uint32_t> m_order;
+		EscaperReport m_escaperReport;
+#endif
+
+#if SNAPSHOT_INTERVAL
+		std::unique_ptr<SnapshotWriter> m_snapshotWriter;
+		std::string m_reportedSnapshot;
+#endif
+
+		//Compact accelerations of the single-state update, one per segment
+		std::vector<ComPtr<ID3D12Resource>> m_accelerationBuffer;
 
 		//UAV buffer
 		ComPtr<ID3D12Resource> m_uavBuffer[FRAME_BUFFERS];
 		ComPtr<ID3D12Resource> m_uavBufferUploadHeap[FRAME_BUFFERS];
 
+		//Integer cell anchors for tile-relative coordinates
+		ComPtr<ID3D12Resource> m_cellBuffer[FRAME_BUFFERS];
+		ComPtr<ID3D12Resource> m_cellBufferUploadHeap[FRAME_BUFFERS];
+
+		//Render records and indirect draw arguments for the fused pass
+		ComPtr<ID3D12Resource> m_renderRecordBuffer;
+		ComPtr<ID3D12Resource> m_renderRecordUploadHeap;
+		ComPtr<ID3D12Resource> m_drawArgsBuffer;
+		ComPtr<ID3D12Resource> m_drawArgsUploadHeap;
+		ComPtr<ID3D12CommandSignature> m_drawCommandSignature;
+
 		//Descriptor heap
 		std::unique_ptr<DescriptorHeap> m_srvUavDescHeap;
 	};
@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Fullscreen passes of the stochastic subset rendering. FADE scales the accumulated image
+// by the blend factor before the subset is added, otherwise the accumulated image is
+// resolved to the back buffer.
+//--------------------------------------------------------------------------------------
+Texture2D<float4> g_accumulated : register(t1);
+
+struct VS_OUT
+{
+    float4 position : SV_Position;
+};
+
+//--------------------------------------------------------------------------------------
+// Vertex Shader, one triangle covering the screen
+//--------------------------------------------------------------------------------------
+VS_OUT VS_MAIN(uint id : SV_VERTEXID)
+{
+    VS_OUT output = (VS_OUT) 0;
+    float2 uv = float2((id << 1) & 2, id & 2);
+    output.position = float4(uv * float2(2.f, -2.f) + float2(-1.f, 1.f), 0.f, 1.f);
+    return output;
+}
+
+//--------------------------------------------------------------------------------------
+// Pixel Shader
+//--------------------------------------------------------------------------------------
+float4 PS_MAIN(VS_OUT input) : SV_TARGET
+{
+#ifdef FADE
+    //The blend state does the scaling
+    return float4(0.f, 0.f, 0.f, 0.f);
+#else
+    return g_accumulated.Load(int3(input.position.xy, 0));
+#endif
+}
@@ -7,8 +7,27 @@ struct BodyData
     float4 velocity;
 };
 
-Texture2D<float4> g_ParticleTex : register(t1);
+#ifdef FUSED_RENDER_PREP
+// Precomputed by the integration pass in nBodyCS.hlsl
+struct RenderRecord
+{
+    float4 clipPos;
+    float spriteSize;
+    uint bodyIndex;
+    uint visible;
+    uint padding;
+};
+
+StructuredBuffer<RenderRecord> g_renderRecords : register(t0);
+#else
 StructuredBuffer<BodyData> g_particles : register(t0);
+#endif
+
+#ifdef TILE_RELATIVE_COORDINATES
+StructuredBuffer<int4> g_cells : register(t2);
+#endif
+
+Texture2D<float4> g_ParticleTex : register(t1);
 
 SamplerState g_particleSampler : register(s0);
 
@@ -18,6 +37,9 @@ SamplerState g_particleSampler : register(s0);
 cbuffer cbDraw : register(b0)
 {
     row_major float4x4 g_mWorldViewProjection;
+    float g_cellSize;
+    uint g_subsetStride;
+    uint g_subsetPhase;
 };
 
 cbuffer cbImmutable
@@ -51,6 +73,7 @@ struct VS_OUT
 {
     float4 position : POSITION;
     float2 uv : TEXCOORD;
+    float size : SPRITESIZE;
 };
 
 struct GS_OUT
@@ -65,8 +88,25 @@ struct GS_OUT
 VS_OUT VS_MAIN(uint id : SV_VERTEXID)
 {
     VS_OUT output = (VS_OUT) 0;
+
+#ifdef STOCHASTIC_RENDERING
+    //Vertex n draws body n * stride + phase of this frame's subset
+    id = id * g_subsetStride + g_subsetPhase;
+#endif
     
+#ifdef FUSED_RENDER_PREP
+    //Only visible bodies are in the compact list, so no transform is needed here. The GS
+    //offsets the corners in clip space, so the projected size goes back through w.
+    output.position = g_renderRecords[id].clipPos;
+    output.size = g_renderRecords[id].spriteSize * output.position.w;
+#elif defined(TILE_RELATIVE_COORDINATES)
+    float4 pos = g_particles[id].pos;
+    output.position = mul(float4(float3(g_cells[id].xyz) * g_cellSize + pos.xyz, pos.w), g_mWorldViewProjection);
+    output.size = g_pointSize;
+#else
     output.position = mul(g_particles[id].pos, g_mWorldViewProjection);
+    output.size = g_pointSize;
+#endif
     output.uv = float2(0.f, 0.f);
     return output;
 }
@@ -96,7 +136,7 @@ void GS_MAIN(point VS_OUT input[1], inout TriangleStream<GS_OUT> SpriteStream)
 	[unroll]
     for (uint i = 0; i < 4; ++i)
     {
-        output.position = input[0].position + float4(g_positions[i].xy * g_pointSize, 0.f, 0.f);
+        output.position = input[0].position + float4(g_positions[i].xy * input[0].size, 0.f, 0.f);
         output.uv = g_texcoords[i];
         SpriteStream.Append(output);
     }
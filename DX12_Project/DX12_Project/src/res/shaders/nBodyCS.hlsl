@@ -7,57 +7,172 @@ cbuffer cbUpdate : register(b0)
     float g_softeningSquared;
     uint g_numParticles;
     uint g_numBlocks;
+    row_major float4x4 g_mWorldViewProjection;
+    float g_pointSize;
+    float g_cellSize;
+    float g_equalMass;
+    uint g_segment;
+    uint g_numSegments;
+    uint g_segmentCapacity;
+    uint g_lastSegmentCount;
+    uint g_numSources;
 };	
 
+// Kernel policy, every scenario is compiled into its own permutation through
+// the defines given when the shader is loaded:
+//  DOUBLE_ACCUMULATION - float pair terms, double running sums
+//  DOUBLE_PRECISION    - double pair terms and sums (needs double shader ops)
+//  EQUAL_MASS          - every body has mass g_equalMass, applied once per body
+//  NO_SOFTENING        - no softening, the self term is masked out instead
+//  PLANAR              - 2D simulation in the xy plane
+//  ACCELERATION_PASS   - pass 1 of the single-state update, writes the accelerations
+//  INTEGRATION_PASS    - pass 2 of the single-state update, integrates in place
+//  GATHER_PASS         - compaction after escapers were demoted, no update
+#ifdef DOUBLE_PRECISION
+#define real double
+#define real3 double3
+#else
+#define real float
+#define real3 float3
+#endif
+
+#if defined(DOUBLE_PRECISION) || defined(DOUBLE_ACCUMULATION)
+#define accum3 double3
+#else
+#define accum3 float3
+#endif
+
 struct BodyData
 {
     float4 pos;
     float4 velocity;
 };
 
-StructuredBuffer<BodyData> oldParticles : register(t0);
+// Bodies are stored in NUM_SEGMENTS buffers (all but the last hold g_segmentCapacity),
+// each dispatch updates segment g_segment and g_numParticles is its body count
+StructuredBuffer<BodyData> oldParticles[NUM_SEGMENTS] : register(t0);
 RWStructuredBuffer<BodyData> particles : register(u0);
 
-// This function computes the gravitational attraction between two bodies
-// at positions bi and bj. The mass of the bodies is stored in the w 
-// component
-float3 BodyBodyInteraction(float4 bi, float4 bj, int particles)
+#if defined(ACCELERATION_PASS) || defined(INTEGRATION_PASS)
+// Single-state update, there is one copy of the bodies: pass 1 reads them through
+// oldParticles and writes the accelerations of segment g_segment, pass 2 reads those
+// and updates particles in place. Bound as a root UAV without bounds checks, so the
+// buffer is padded to whole blocks.
+RWStructuredBuffer<float3> accelerations : register(u1);
+#endif
+
+#ifdef GATHER_PASS
+// Body i of the compacted state is body order[i] of the old one, across segments. Bound
+// as a root SRV without bounds checks, so it covers whole blocks of the last segment.
+StructuredBuffer<uint> order : register(t2);
+#endif
+
+#ifdef TILE_RELATIVE_COORDINATES
+// Positions are stored as float offsets from the anchor of an integer cell
+// (cell * g_cellSize), the cells live in a buffer parallel to the bodies
+StructuredBuffer<int4> oldCells : register(t1);
+RWStructuredBuffer<int4> cells : register(u3);
+#endif
+
+#ifdef FUSED_RENDER_PREP
+// Compact per-body render data written by the integration pass so the
+// sprite pipeline only has to expand precomputed clip-space positions
+struct RenderRecord
+{
+    float4 clipPos;
+    float spriteSize;
+    uint bodyIndex;
+    uint visible;
+    uint padding;
+};
+
+RWStructuredBuffer<RenderRecord> renderRecords : register(u1);
+
+// D3D12_DRAW_ARGUMENTS, the vertex count is used as the append counter
+RWByteAddressBuffer drawArgs : register(u2);
+#endif
+
+real InverseSqrt(real x)
+{
+#ifdef DOUBLE_PRECISION
+    // There is no double sqrt, refine the float estimate with one Newton step
+    double y = rsqrt((float)x);
+    return y * (1.5L - 0.5L * x * y * y);
+#else
+    return 1.0f / sqrt(x);
+#endif
+}
+
+// This function computes the gravitational attraction of a source body of
+// mass sourceMass at separation r from the body being updated
+accum3 BodyBodyInteraction(real3 r, float sourceMass, int particles)
 {
-    float3 r = bi - bj;
+#ifdef PLANAR
+    real distSqr = r.x * r.x + r.y * r.y;
+#else
+    real distSqr = dot(r, r);
+#endif
 
-    float distSqr = dot(r, r);
+#ifdef NO_SOFTENING
+    real invDist = distSqr > 0 ? InverseSqrt(distSqr) : 0;
+#else
     distSqr += g_softeningSquared;
+    real invDist = InverseSqrt(distSqr);
+#endif
+    real invDistCube = invDist * invDist * invDist;
+
+#ifdef EQUAL_MASS
+    real s = invDistCube * particles;
+#else
+    real s = sourceMass * invDistCube * particles;
+#endif
 
-    float invDist = 1.0f / sqrt(distSqr);
-    float invDistCube = invDist * invDist * invDist;
+    return (accum3)(r * s);
+}
 
-    float s = bj.w * invDistCube * particles;
+// bi is the source and bj the body being updated, the mass of the bodies is
+// stored in the w component and only the one of the source counts
+accum3 BodyBodyInteraction(float4 bi, float4 bj, int particles)
+{
+    // The difference of two floats is exact in double
+    return BodyBodyInteraction((real3)bi.xyz - (real3)bj.xyz, bi.w, particles);
+}
 
-    return r * s;
+#ifdef TILE_RELATIVE_COORDINATES
+// The anchor difference is an exact integer for nearby cells and the offsets
+// carry the fraction, so close pairs keep full precision far from the origin
+accum3 BodyBodyInteraction(float4 bi, int4 ci, float4 bj, int4 cj, int particles)
+{
+    float3 r = float3(ci.xyz - cj.xyz) * g_cellSize + (bi.xyz - bj.xyz);
+    return BodyBodyInteraction(r, bi.w, particles);
 }
+#endif
 
 // This groupshared memory is used to cache BLOCK_SIZE body positions
 // in on-chip shared memory so that we can achieve maximal reuse of 
 // data loaded from global memory
 groupshared float4 sharedPos[BLOCK_SIZE];
+#ifdef TILE_RELATIVE_COORDINATES
+groupshared int4 sharedCell[BLOCK_SIZE];
+#endif
 
-// The main gravitation function, computes the interaction between
-// a body and all other bodies in the system
-float3 Gravitation(float4 myPos, float3 accel)
+// The main gravitation function, computes the interaction between a body and
+// the numSources bodies cached in the tile. The last tile of a segment may be
+// partial, its slots past numSources hold no body and are weighted by 0.
+accum3 Gravitation(float4 myPos, int4 myCell, uint numSources, accum3 accel)
 {
     uint i = 0;
 
     [unroll]
-    for (uint counter = 0; counter < BLOCK_SIZE; counter++) 
-        accel += BodyBodyInteraction(sharedPos[i++], myPos, 1);
-    
-    // g_numParticles is the number of our particles, however this number might not 
-	// be an exact multiple of the tile size. In such cases, out of bound reads 
-	// occur in the process above, which means there will be tooManyParticles 
-	// "phantom" particles generating false gravity at position (0, 0, 0), so 
-	// we have to subtract them here. NOTE, out of bound reads always return 0 in CS.
-    const int tooManyParticles = g_numBlocks * BLOCK_SIZE - g_numParticles;
-    accel += BodyBodyInteraction(float4(0.0f, 0.0f, 0.0f, 0.0f), myPos, -tooManyParticles);
+    for (uint counter = 0; counter < BLOCK_SIZE; counter++, i++)
+    {
+        int weight = i < numSources ? 1 : 0;
+#ifdef TILE_RELATIVE_COORDINATES
+        accel += BodyBodyInteraction(sharedPos[i], sharedCell[i], myPos, myCell, weight);
+#else
+        accel += BodyBodyInteraction(sharedPos[i], myPos, weight);
+#endif
+    }
 
     return accel;
 }
@@ -65,42 +180,152 @@ float3 Gravitation(float4 myPos, float3 accel)
 // Computes the total acceleration on the body with position myPos 
 // caused by the gravitational attraction of all other bodies in 
 // the simulation
-float3 ComputeBodyAccel(float4 bodyPos, uint threadId, uint blockId)
+accum3 ComputeBodyAccel(float4 bodyPos, int4 bodyCell, uint threadId, uint blockId)
 {
-    float3 acceleration = { 0.0f, 0.0f, 0.0f };
+    accum3 acceleration = (accum3)0;
     uint p = BLOCK_SIZE;
-    uint n = g_numParticles;
-    uint numTiles = n / p;
 
-    for (uint tile = 0; tile < numTiles; tile++)
+    // The sources are the first g_numSources bodies, the ones demoted to tracers follow
+    // them. They are walked segment by segment, the index is uniform across the dispatch.
+    for (uint segment = 0; segment < g_numSegments && segment * g_segmentCapacity < g_numSources; segment++)
     {
-        sharedPos[threadId] = oldParticles[tile * p + threadId].pos;
-       
-        GroupMemoryBarrierWithGroupSync();
-        acceleration = Gravitation(bodyPos, acceleration);
-        GroupMemoryBarrierWithGroupSync();
+        uint n = min(segment + 1 == g_numSegments ? g_lastSegmentCount : g_segmentCapacity, g_numSources - segment * g_segmentCapacity);
+        uint numTiles = (n + p - 1) / p;
+
+        for (uint tile = 0; tile < numTiles; tile++)
+        {
+            // Out of range slots are never read, a cached zero mass at the origin would
+            // still attract in the EQUAL_MASS permutation
+            uint source = tile * p + threadId;
+            sharedPos[threadId] = source < n ? oldParticles[segment][source].pos : float4(0.0f, 0.0f, 0.0f, 0.0f);
+#ifdef TILE_RELATIVE_COORDINATES
+            sharedCell[threadId] = source < n ? oldCells[source] : int4(0, 0, 0, 0);
+#endif
+
+            GroupMemoryBarrierWithGroupSync();
+            acceleration = Gravitation(bodyPos, bodyCell, min(n - tile * p, p), acceleration);
+            GroupMemoryBarrierWithGroupSync();
+        }
     }
 
     return acceleration;
 }
 
+#ifdef FUSED_RENDER_PREP
+groupshared uint sharedVisibleCount;
+groupshared uint sharedRecordOffset;
+
+// Projects the integrated body into clip space, culls it against the view
+// frustum (expanded by the sprite size) and appends the visible ones to the
+// compact render record list. Slots are reserved once per thread group to
+// keep the atomic traffic on the draw arguments low.
+void PrepareRenderRecord(float4 pos, uint bodyIndex, uint threadId)
+{
+    if (threadId == 0)
+        sharedVisibleCount = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    RenderRecord record;
+    record.clipPos = mul(pos, g_mWorldViewProjection);
+    record.bodyIndex = bodyIndex;
+    record.padding = 0;
+
+    // Projected sprite size in NDC, the quad is offset by g_pointSize in clip space so it
+    // shrinks with 1/w. Bodies behind the camera are culled and keep a size of zero.
+    bool inFront = record.clipPos.w > 0.0f;
+    record.spriteSize = inFront ? g_pointSize / record.clipPos.w : 0.0f;
+
+    float extent = record.clipPos.w * (1.0f + 0.5f * record.spriteSize);
+    bool visible = bodyIndex < g_numParticles && inFront &&
+                   abs(record.clipPos.x) <= extent && abs(record.clipPos.y) <= extent &&
+                   record.clipPos.z >= 0.0f && record.clipPos.z <= record.clipPos.w;
+    record.visible = visible ? 1 : 0;
+
+    uint localSlot = 0;
+    if (visible)
+        InterlockedAdd(sharedVisibleCount, 1, localSlot);
+    GroupMemoryBarrierWithGroupSync();
+
+    if (threadId == 0)
+    {
+        uint offset;
+        drawArgs.InterlockedAdd(0, sharedVisibleCount, offset);
+        sharedRecordOffset = offset;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (visible)
+        renderRecords[sharedRecordOffset + localSlot] = record;
+}
+#endif
+
+// The acceleration on a body with the per-permutation scaling applied
+float3 ComputeAcceleration(float4 pos, int4 cell, uint threadId, uint blockId)
+{
+    float3 accel = (float3)ComputeBodyAccel(pos, cell, threadId, blockId);
+#ifdef EQUAL_MASS
+    accel *= g_equalMass;
+#endif
+#ifdef PLANAR
+    accel.z = 0.0f;
+#endif
+    return accel;
+}
+
 // NBodyUpdate is the compute shader entry point for the n-body simulation
 // This function first computes the acceleration on all bodies in parallel,
 // and then integrates the velocity and position to get the new state of
 // all particles, using a simple Leapfrog-Verlet integration step.
+// The single-state permutations split this into the two passes.
 [numthreads(BLOCK_SIZE, 1, 1)]
 void CS_MAIN(uint threadId : SV_GroupIndex, uint3 groupId : SV_GroupID, uint3 globalThreadId : SV_DispatchThreadID)
 {
-    float4 pos = oldParticles[globalThreadId.x].pos;
-    float4 vel = oldParticles[globalThreadId.x].velocity;
+#if defined(GATHER_PASS)
+    uint source = order[g_segment * g_segmentCapacity + globalThreadId.x];
+    particles[globalThreadId.x] = oldParticles[NonUniformResourceIndex(source / g_segmentCapacity)][source % g_segmentCapacity];
+#elif defined(ACCELERATION_PASS)
+    float4 pos = oldParticles[g_segment][globalThreadId.x].pos;
+    accelerations[globalThreadId.x] = ComputeAcceleration(pos, int4(0, 0, 0, 0), threadId, groupId.x);
+#elif defined(INTEGRATION_PASS)
+    float4 pos = particles[globalThreadId.x].pos;
+    float4 vel = particles[globalThreadId.x].velocity;
+    float3 accel = accelerations[globalThreadId.x];
+
+    vel.xyz += accel * g_timestep;
+    pos.xyz += vel * g_timestep;
+
+    particles[globalThreadId.x].pos = pos;
+    particles[globalThreadId.x].velocity = vel;
+#else
+    float4 pos = oldParticles[g_segment][globalThreadId.x].pos;
+    float4 vel = oldParticles[g_segment][globalThreadId.x].velocity;
+#ifdef TILE_RELATIVE_COORDINATES
+    int4 cell = oldCells[globalThreadId.x];
+#else
+    int4 cell = int4(0, 0, 0, 0);
+#endif
 
 	//Compute acceleration
-    float3 accel = ComputeBodyAccel(pos, threadId, groupId.x);
+    float3 accel = ComputeAcceleration(pos, cell, threadId, groupId.x);
 	
 	//Leapfrog-Verlet integration of velocity and position
     vel.xyz += accel * g_timestep;
     pos.xyz += vel * g_timestep;
+
+#ifdef TILE_RELATIVE_COORDINATES
+    //Move whole cells out of the offset once the body has left its cell
+    float3 shift = floor(pos.xyz / g_cellSize + 0.5f);
+    pos.xyz -= shift * g_cellSize;
+    cell.xyz += int3(shift);
+    cells[globalThreadId.x] = cell;
+#endif
     
     particles[globalThreadId.x].pos = pos;
     particles[globalThreadId.x].velocity = vel;
+
+#ifdef FUSED_RENDER_PREP
+    //Rendering only needs float precision, so the anchor is folded back in
+    PrepareRenderRecord(float4(float3(cell.xyz) * g_cellSize + pos.xyz, pos.w), globalThreadId.x, threadId);
+#endif
+#endif
 }
@@ -0,0 +1,192 @@
+#include <simulation/AccuracySampler.hpp>
+#include <simulation/ForceKernel.hpp>
+#include <utils/ThreadPriority.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace dx
+{
+	typedef KernelPolicy<DoublePrecision, false, true, 3> ExactPolicy;
+	typedef KernelPolicy<DoublePrecision, false, false, 3> ExactUnsoftenedPolicy;
+
+	template<typename Policy>
+	static void ComputeExact(const BodyArray & bodies, const std::vector<uint32_t> & indices, const double & softeningSquared, std::vector<Float4> & exact)
+	{
+		KernelSources<Policy> sources;
+		sources.Gather(bodies.data(), bodies.size());
+
+		exact.resize(indices.size());
+		for (size_t k = 0; k < indices.size(); ++k)
+		{
+			size_t i = indices[k];
+			double ax = 0.0, ay = 0.0, az = 0.0;
+			ForceKernel<Policy>::Accumulate(sources, 0, i, sources.x[i], sources.y[i], sources.z[i], softeningSquared, ax, ay, az);
+			ForceKernel<Policy>::Accumulate(sources, i + 1, sources.GetCount(), sources.x[i], sources.y[i], sources.z[i], softeningSquared, ax, ay, az);
+			exact[k] = { static_cast<float>(ax), static_cast<float>(ay), static_cast<float>(az), 0.f };
+		}
+	}
+
+	static double Percentile(const std::vector<double> & sorted, const double & fraction)
+	{
+		size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+		return sorted[(std::min)(index, sorted.size() - 1)];
+	}
+
+	AccuracySampler::AccuracySampler(ApproximateSolver* solver, const SimulationParams & params, const AccuracySettings & settings) : m_solver(solver), m_params(params),
+									 m_settings(settings), m_random(settings.seed),
+									 m_tightenRequested(false), m_numSkipped(0)
+	{
+		m_thread = std::thread(&AccuracySampler::SampleLoop, this);
+	}
+
+	AccuracySampler::~AccuracySampler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+
+		m_workCondition.notify_all();
+		m_thread.join();
+	}
+
+	void AccuracySampler::BeginStep(const uint64_t & step, const BodyArray & bodies)
+	{
+		//Parameter changes are applied here so the solver is only touched from the simulation thread
+		if (m_solver && m_tightenRequested.exchange(false))
+		{
+			float parameter = m_solver->GetAccuracyParameter() * m_settings.tightenFactor;
+			m_solver->SetAccuracyParameter((std::max)(parameter, m_solver->GetMinAccuracyParameter()));
+		}
+
+		if (m_settings.sampleInterval == 0 || step % m_settings.sampleInterval != 0 || bodies.empty())
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_hasWork)
+		{
+			++m_numSkipped;
+			return;
+		}
+
+		m_step = step;
+		m_parameter = m_solver ? m_solver->GetAccuracyParameter() : 0.f;
+		m_bodies = bodies;
+		m_capturing = true;
+	}
+
+	void AccuracySampler::EndStep(const std::vector<Float4> & accelerations)
+	{
+		if (!m_capturing)
+			return;
+
+		m_capturing = false;
+		if (accelerations.size() != m_bodies.size())
+			return;
+
+		size_t count = (std::min)(m_settings.sampleSize, m_bodies.size());
+		std::uniform_int_distribution<uint32_t> distribution(0, static_cast<uint32_t>(m_bodies.size() - 1));
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_indices.resize(count);
+			m_approximate.resize(count);
+			for (size_t k = 0; k < count; ++k)
+			{
+				m_indices[k] = distribution(m_random);
+				m_approximate[k] = accelerations[m_indices[k]];
+			}
+
+			m_hasWork = true;
+		}
+
+		m_workCondition.notify_one();
+	}
+
+	void AccuracySampler::SampleLoop()
+	{
+		LowerCurrentThreadPriority();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_workCondition.wait(lock, [this] { return m_stop || m_hasWork; });
+			if (m_stop)
+				return;
+
+			//The snapshot is not touched by BeginStep and EndStep while m_hasWork is set
+			lock.unlock();
+			Evaluate();
+			lock.lock();
+
+			m_hasWork = false;
+			m_idleCondition.notify_all();
+		}
+	}
+
+	void AccuracySampler::Evaluate()
+	{
+		const double softeningSquared = m_params.softeningSquared;
+		std::vector<Float4> exact;
+		if (softeningSquared > 0.0)
+			ComputeExact<ExactPolicy>(m_bodies, m_indices, softeningSquared, exact);
+		else
+			ComputeExact<ExactUnsoftenedPolicy>(m_bodies, m_indices, softeningSquared, exact);
+
+		std::vector<double> errors;
+		errors.reserve(exact.size());
+		for (size_t k = 0; k < exact.size(); ++k)
+		{
+			double ex = exact[k].x, ey = exact[k].y, ez = exact[k].z;
+			double dx = m_approximate[k].x - ex;
+			double dy = m_approximate[k].y - ey;
+			double dz = m_approximate[k].z - ez;
+			double norm = std::sqrt(ex * ex + ey * ey + ez * ez);
+			if (norm > 0.0)
+				errors.push_back(std::sqrt(dx * dx + dy * dy + dz * dz) / norm);
+		}
+
+		if (errors.empty())
+			return;
+
+		std::sort(errors.begin(), errors.end());
+
+		AccuracyReport report;
+		report.step = m_step;
+		report.numSamples = errors.size();
+		report.p50 = Percentile(errors, 0.5);
+		report.p90 = Percentile(errors, 0.9);
+		report.p99 = Percentile(errors, 0.99);
+		report.max = errors.back();
+		report.parameter = m_parameter;
+		report.overBudget = report.p99 > m_settings.errorBudget;
+
+		if (report.overBudget && m_settings.autoTighten)
+			m_tightenRequested = true;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_report = report;
+		m_hasReport = true;
+	}
+
+	bool AccuracySampler::GetLatestReport(AccuracyReport & report) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_hasReport)
+			return false;
+
+		report = m_report;
+		return true;
+	}
+
+	uint64_t AccuracySampler::GetNumSkipped() const
+	{
+		return m_numSkipped;
+	}
+
+	void AccuracySampler::Flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idleCondition.wait(lock, [this] { return !m_hasWork; });
+	}
+}
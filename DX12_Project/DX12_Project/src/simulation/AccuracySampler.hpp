@@ -0,0 +1,85 @@
+#pragma once
+#include <simulation/ApproximateSolver.hpp>
+#include <simulation/Body.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace dx
+{
+	struct AccuracySettings
+	{
+		unsigned int sampleInterval = 64;		//Steps between two samples
+		size_t sampleSize = 64;					//Bodies checked against the exact sum per sample
+		double errorBudget = 1e-3;				//Allowed p99 relative acceleration error
+		bool autoTighten = false;				//Shrink the solver parameter when over budget
+		float tightenFactor = 0.8f;
+		unsigned int seed = 1;
+	};
+
+	struct AccuracyReport
+	{
+		uint64_t step = 0;
+		size_t numSamples = 0;
+		double p50 = 0.0;
+		double p90 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+		float parameter = 0.f;		//Solver accuracy parameter the sample was taken with
+		bool overBudget = false;
+	};
+
+	//Watches an approximate force solver while it runs. Every few steps a random subset of
+	//bodies is handed to a low priority background thread, which computes their exact
+	//accelerations by direct summation in double and publishes the relative error
+	//percentiles of the approximation. A sample is skipped rather than queued when the
+	//previous one has not finished, so the simulation never waits on the check and the
+	//cost stays bounded by sampleSize * N interactions per sampleInterval steps.
+	class AccuracySampler
+	{
+	public:
+		AccuracySampler(ApproximateSolver* solver, const SimulationParams & params, const AccuracySettings & settings = AccuracySettings());
+		~AccuracySampler();
+
+	public:
+		//Called on the simulation thread around each step, the bodies must be the state the
+		//accelerations are computed from, i.e. before integration
+		void BeginStep(const uint64_t & step, const BodyArray & bodies);
+		void EndStep(const std::vector<Float4> & accelerations);
+		bool GetLatestReport(AccuracyReport & report) const;
+		uint64_t GetNumSkipped() const;
+		void Flush();
+
+	private:
+		void SampleLoop();
+		void Evaluate();
+
+	private:
+		ApproximateSolver* m_solver;
+		SimulationParams m_params;
+		AccuracySettings m_settings;
+		std::mt19937 m_random;
+
+		//Snapshot handed to the background thread
+		uint64_t m_step = 0;
+		float m_parameter = 0.f;
+		BodyArray m_bodies;
+		std::vector<uint32_t> m_indices;
+		std::vector<Float4> m_approximate;
+		bool m_capturing = false;
+		bool m_hasWork = false;
+
+		AccuracyReport m_report;
+		bool m_hasReport = false;
+		std::atomic<bool> m_tightenRequested;
+		std::atomic<uint64_t> m_numSkipped;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_workCondition;
+		std::condition_variable m_idleCondition;
+		bool m_stop = false;
+		std::thread m_thread;
+	};
+}
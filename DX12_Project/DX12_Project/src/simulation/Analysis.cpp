@@ -0,0 +1,302 @@
+#include <simulation/Analysis.hpp>
+#include <utils/ProcessStats.hpp>
+#include <utils/ThreadPriority.hpp>
+#include <algorithm>
+#include <cstdio>
+
+namespace dx
+{
+	namespace
+	{
+		//Every stride-th body carrying the mass of the ones it stands for
+		BodyArray Subsample(const BodyArray & bodies, const size_t & stride)
+		{
+			BodyArray sample;
+			sample.reserve(bodies.size() / stride + 1);
+			for (size_t i = 0; i < bodies.size(); i += stride)
+			{
+				sample.push_back(bodies[i]);
+				sample.back().position.w *= static_cast<float>(stride);
+			}
+
+			return sample;
+		}
+	}
+
+	AnalysisScheduler::AnalysisScheduler(const AnalysisSchedulerSettings & settings) : m_settings(settings)
+	{
+		m_settings.numWorkers = (std::max)(m_settings.numWorkers, 1u);
+		for (unsigned int i = 0; i < m_settings.numWorkers; ++i)
+			m_threads.emplace_back(&AnalysisScheduler::WorkLoop, this);
+	}
+
+	AnalysisScheduler::~AnalysisScheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+
+		m_workCondition.notify_all();
+		for (auto & thread : m_threads)
+			thread.join();
+	}
+
+	size_t AnalysisScheduler::AddPlugin(std::shared_ptr<AnalysisPlugin> plugin, const AnalysisSchedule & schedule)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		PluginState state;
+		state.plugin = std::move(plugin);
+		state.schedule = schedule;
+		state.schedule.cadence = (std::max)(state.schedule.cadence, 1u);
+		state.costs.assign(state.schedule.maxCoarsening + 1, 0.0);
+		m_plugins.push_back(std::move(state));
+		return m_plugins.size() - 1;
+	}
+
+	void AnalysisScheduler::OnStep(const uint64_t & step, const double & stepSeconds, const std::function<BodyArray()> & snapshot)
+	{
+		std::vector<Job> jobs;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			//React to a slow step at once but let the smoothed time carry a slow trend
+			m_stepSeconds = m_stepSeconds > 0.0 ? 0.9 * m_stepSeconds + 0.1 * stepSeconds : stepSeconds;
+			double pressure = m_settings.stepBudgetSeconds > 0.0 ? (std::max)(m_stepSeconds, stepSeconds) / m_settings.stepBudgetSeconds : 0.0;
+
+			for (size_t i = 0; i < m_plugins.size(); ++i)
+			{
+				PluginState & state = m_plugins[i];
+				const AnalysisSchedule & schedule = state.schedule;
+
+				//Budget accrues with simulation time, unused budget is only kept for about two runs
+				double income = stepSeconds * schedule.cpuShare;
+				double cap = (std::max)(2.0 * EstimateCost(state, 0), 2.0 * income * schedule.cadence);
+				state.credit = (std::min)(state.credit + income, cap);
+
+				if (step % schedule.cadence != 0)
+					continue;
+
+				++state.metrics.due;
+				if (state.busy)
+				{
+					++state.metrics.missed;
+					continue;
+				}
+
+				//Under pressure only the coarsest level is allowed, over the limit nothing runs
+				unsigned int first = pressure >= m_settings.coarsenThreshold ? schedule.maxCoarsening : 0;
+				if (pressure >= m_settings.skipThreshold || (pressure >= m_settings.coarsenThreshold && schedule.maxCoarsening == 0))
+				{
+					++state.metrics.skippedPressure;
+					continue;
+				}
+
+				//A plugin that was never measured starts at its cheapest level
+				bool measured = std::any_of(state.costs.begin(), state.costs.end(), [](const double & cost) { return cost > 0.0; });
+				unsigned int level = measured ? first : schedule.maxCoarsening;
+				while (level <= schedule.maxCoarsening && EstimateCost(state, level) > state.credit)
+					++level;
+				if (level > schedule.maxCoarsening)
+				{
+					++state.metrics.skippedBudget;
+					continue;
+				}
+
+				state.busy = true;
+				jobs.push_back({ i, level, { step, nullptr } });
+			}
+		}
+
+		if (jobs.empty())
+			return;
+
+		//One copy for all plugins of this step, taken on the simulation thread
+		std::shared_ptr<const BodyArray> bodies = std::make_shared<const BodyArray>(snapshot());
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (Job & job : jobs)
+			{
+				job.view.bodies = bodies;
+				m_jobs.push_back(std::move(job));
+			}
+		}
+		m_workCondition.notify_all();
+	}
+
+	void AnalysisScheduler::Flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idleCondition.wait(lock, [this]() { return m_jobs.empty() && m_running == 0; });
+	}
+
+	AnalysisMetrics AnalysisScheduler::GetMetrics(const size_t & plugin) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_plugins[plugin].metrics;
+	}
+
+	std::string AnalysisScheduler::FormatMetrics() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		char line[256];
+		std::snprintf(line, sizeof(line), "%-16s %8s %8s %10s %8s %10s %8s %10s\n", "plugin", "due", "runs", "coarsened", "budget", "pressure", "missed", "cpu s");
+		std::string text = line;
+		for (const PluginState & state : m_plugins)
+		{
+			const AnalysisMetrics & m = state.metrics;
+			std::snprintf(line, sizeof(line), "%-16s %8llu %8llu %10llu %8llu %10llu %8llu %10.3f\n", state.plugin->GetName().c_str(), static_cast<unsigned long long>(m.due),
+						  static_cast<unsigned long long>(m.runs), static_cast<unsigned long long>(m.coarsenedRuns), static_cast<unsigned long long>(m.skippedBudget),
+						  static_cast<unsigned long long>(m.skippedPressure), static_cast<unsigned long long>(m.missed), m.cpuSeconds);
+			text += line;
+		}
+
+		return text;
+	}
+
+	double AnalysisScheduler::EstimateCost(const PluginState & state, const unsigned int & coarsening) const
+	{
+		if (state.costs[coarsening] > 0.0)
+			return state.costs[coarsening];
+
+		//Scaled from the nearest measured level, each level about halves the work
+		for (unsigned int distance = 1; distance < state.costs.size(); ++distance)
+		{
+			if (coarsening >= distance && state.costs[coarsening - distance] > 0.0)
+				return state.costs[coarsening - distance] / double(1u << distance);
+			if (coarsening + distance < state.costs.size() && state.costs[coarsening + distance] > 0.0)
+				return state.costs[coarsening + distance] * double(1u << distance);
+		}
+
+		//Never measured, the first (coarsest) run tells
+		return 0.0;
+	}
+
+	void AnalysisScheduler::WorkLoop()
+	{
+		LowerCurrentThreadPriority();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_workCondition.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+			if (m_stop)
+				return;
+
+			Job job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			std::shared_ptr<AnalysisPlugin> plugin = m_plugins[job.plugin].plugin;
+			++m_running;
+			lock.unlock();
+
+			double cpuStart = GetThreadCpuSeconds();
+			plugin->Run(job.view, job.coarsening);
+			double cpu = GetThreadCpuSeconds() - cpuStart;
+			job.view.bodies.reset();
+
+			lock.lock();
+			PluginState & state = m_plugins[job.plugin];
+			double & cost = state.costs[job.coarsening];
+			cost = cost > 0.0 ? 0.7 * cost + 0.3 * cpu : cpu;
+			state.credit -= cpu;
+			state.busy = false;
+
+			AnalysisMetrics & metrics = state.metrics;
+			++metrics.runs;
+			if (job.coarsening > 0)
+				++metrics.coarsenedRuns;
+			metrics.cpuSeconds += cpu;
+			metrics.lastCpuSeconds = cpu;
+			metrics.lastCoarsening = job.coarsening;
+
+			--m_running;
+			if (m_jobs.empty() && m_running == 0)
+				m_idleCondition.notify_all();
+		}
+	}
+
+	EnergyPlugin::EnergyPlugin(const float & softeningSquared) : m_softeningSquared(softeningSquared)
+	{
+	}
+
+	std::string EnergyPlugin::GetName() const
+	{
+		return "energy";
+	}
+
+	void EnergyPlugin::Run(const AnalysisView & view, const unsigned int & coarsening)
+	{
+		//Single threaded, the scheduler decides how many cores analysis gets
+		EnergyReport report = coarsening == 0 ? ComputeEnergy(*view.bodies, m_softeningSquared, 1)
+											  : ComputeEnergy(Subsample(*view.bodies, size_t(1) << coarsening), m_softeningSquared, 1);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_report = report;
+	}
+
+	EnergyReport EnergyPlugin::GetLastReport() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_report;
+	}
+
+	DensityGridPlugin::DensityGridPlugin(const unsigned int & resolution) : m_resolution((std::max)(resolution, 1u))
+	{
+	}
+
+	std::string DensityGridPlugin::GetName() const
+	{
+		return "density-grid";
+	}
+
+	void DensityGridPlugin::Run(const AnalysisView & view, const unsigned int & coarsening)
+	{
+		const BodyArray & bodies = *view.bodies;
+		if (bodies.empty())
+			return;
+
+		const size_t stride = size_t(1) << coarsening;
+		float min[3] = { bodies[0].position.x, bodies[0].position.y, bodies[0].position.z };
+		float max[3] = { min[0], min[1], min[2] };
+		for (size_t i = 0; i < bodies.size(); i += stride)
+		{
+			const Float4 & p = bodies[i].position;
+			min[0] = (std::min)(min[0], p.x); max[0] = (std::max)(max[0], p.x);
+			min[1] = (std::min)(min[1], p.y); max[1] = (std::max)(max[1], p.y);
+			min[2] = (std::min)(min[2], p.z); max[2] = (std::max)(max[2], p.z);
+		}
+
+		const unsigned int n = m_resolution;
+		float scale[3];
+		for (int axis = 0; axis < 3; ++axis)
+			scale[axis] = max[axis] > min[axis] ? n / (max[axis] - min[axis]) : 0.0f;
+
+		auto cell = [n](const float & value, const float & low, const float & s)
+		{
+			return (std::min)(static_cast<unsigned int>((std::max)((value - low) * s, 0.0f)), n - 1);
+		};
+
+		std::vector<float> grid(size_t(n) * n * n, 0.0f);
+		for (size_t i = 0; i < bodies.size(); i += stride)
+		{
+			const Float4 & p = bodies[i].position;
+			size_t index = (size_t(cell(p.z, min[2], scale[2])) * n + cell(p.y, min[1], scale[1])) * n + cell(p.x, min[0], scale[0]);
+			grid[index] += p.w * stride;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_grid.swap(grid);
+		std::copy(min, min + 3, m_min);
+		std::copy(max, max + 3, m_max);
+	}
+
+	std::vector<float> DensityGridPlugin::GetLastGrid(float min[3], float max[3]) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::copy(m_min, m_min + 3, min);
+		std::copy(m_max, m_max + 3, max);
+		return m_grid;
+	}
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <simulation/Body.hpp>
+#include <simulation/Diagnostics.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//In-situ analysis next to a running simulation. Plugins get a read-only snapshot of the
+//bodies and run on low priority worker threads, AnalysisScheduler decides per step which of
+//them run, at what resolution, or not at all, so analysis never takes more than its share
+//of the CPU and backs off when the simulation step is at risk.
+namespace dx
+{
+	//State of one step, shared by every plugin that runs on it and never written
+	struct AnalysisView
+	{
+		uint64_t step;
+		std::shared_ptr<const BodyArray> bodies;
+	};
+
+	class AnalysisPlugin
+	{
+	public:
+		virtual ~AnalysisPlugin() = default;
+
+	public:
+		virtual std::string GetName() const = 0;
+
+		//Coarsening 0 is the full analysis, every level above should roughly halve the
+		//work, e.g. by using every 2^level-th body. Called on a worker thread.
+		virtual void Run(const AnalysisView & view, const unsigned int & coarsening) = 0;
+	};
+
+	struct AnalysisSchedule
+	{
+		unsigned int cadence = 1;			//Steps between runs
+		double cpuShare = 0.1;				//CPU seconds per second of simulation time the plugin may use
+		unsigned int maxCoarsening = 0;		//Levels the plugin may be coarsened to instead of being skipped
+	};
+
+	struct AnalysisSchedulerSettings
+	{
+		unsigned int numWorkers = 1;		//Fixed for the scheduler's lifetime, a changed CPU quota does not resize it
+		double stepBudgetSeconds = 0.0;		//Step time the simulation has to keep, 0 disables the pressure checks
+		double coarsenThreshold = 0.8;		//Fraction of the step budget from which runs are coarsened
+		double skipThreshold = 1.0;			//And from which they are skipped
+	};
+
+	struct AnalysisMetrics
+	{
+		uint64_t due = 0;					//Steps the cadence asked for a run
+		uint64_t runs = 0;
+		uint64_t coarsenedRuns = 0;
+		uint64_t skippedBudget = 0;			//Not enough CPU budget left, even coarsened
+		uint64_t skippedPressure = 0;		//The simulation step was over the skip threshold
+		uint64_t missed = 0;				//The previous run had not finished yet
+		double cpuSeconds = 0.0;
+		double lastCpuSeconds = 0.0;
+		unsigned int lastCoarsening = 0;
+	};
+
+	class AnalysisScheduler
+	{
+	public:
+		AnalysisScheduler(const AnalysisSchedulerSettings & settings = AnalysisSchedulerSettings());
+		~AnalysisScheduler();
+
+	public:
+		//Returns the plugin index for GetMetrics
+		size_t AddPlugin(std::shared_ptr<AnalysisPlugin> plugin, const AnalysisSchedule & schedule);
+
+		//Call after every simulation step with its duration. snapshot is only called, once,
+		//when a plugin runs on this step.
+		void OnStep(const uint64_t & step, const double & stepSeconds, const std::function<BodyArray()> & snapshot);
+
+		//Waits for the queued and running plugins
+		void Flush();
+
+		AnalysisMetrics GetMetrics(const size_t & plugin) const;
+		std::string FormatMetrics() const;
+
+	private:
+		struct PluginState
+		{
+			std::shared_ptr<AnalysisPlugin> plugin;
+			AnalysisSchedule schedule;
+			AnalysisMetrics metrics;
+			double credit = 0.0;
+			std::vector<double> costs;		//Measured CPU seconds per coarsening level, 0 = unknown
+			bool busy = false;
+		};
+
+		struct Job
+		{
+			size_t plugin;
+			unsigned int coarsening;
+			AnalysisView view;
+		};
+
+		double EstimateCost(const PluginState & state, const unsigned int & coarsening) const;
+		void WorkLoop();
+
+	private:
+		AnalysisSchedulerSettings m_settings;
+		std::vector<PluginState> m_plugins;
+		std::deque<Job> m_jobs;
+		double m_stepSeconds = 0.0;			//Smoothed step time
+		size_t m_running = 0;
+		bool m_stop = false;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_workCondition;
+		std::condition_variable m_idleCondition;
+		std::vector<std::thread> m_threads;
+	};
+
+	//Total energy, coarsened by evaluating every 2^level-th body with its mass scaled up
+	class EnergyPlugin : public AnalysisPlugin
+	{
+	public:
+		EnergyPlugin(const float & softeningSquared = SimulationParams().softeningSquared);
+
+	public:
+		std::string GetName() const override;
+		void Run(const AnalysisView & view, const unsigned int & coarsening) override;
+		EnergyReport GetLastReport() const;
+
+	private:
+		float m_softeningSquared;
+		EnergyReport m_report = { 0.0, 0.0 };
+		mutable std::mutex m_mutex;
+	};
+
+	//Mass on a cubic grid over the bounding box, nearest grid point deposit. Coarsened by
+	//depositing every 2^level-th body with its mass scaled up.
+	class DensityGridPlugin : public AnalysisPlugin
+	{
+	public:
+		DensityGridPlugin(const unsigned int & resolution = 64);
+
+	public:
+		std::string GetName() const override;
+		void Run(const AnalysisView & view, const unsigned int & coarsening) override;
+
+		//Grid of resolution^3 masses, x fastest, and its bounds
+		std::vector<float> GetLastGrid(float min[3], float max[3]) const;
+
+	private:
+		unsigned int m_resolution;
+		std::vector<float> m_grid;
+		float m_min[3] = {};
+		float m_max[3] = {};
+		mutable std::mutex m_mutex;
+	};
+}
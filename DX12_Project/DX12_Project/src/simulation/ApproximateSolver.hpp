@@ -0,0 +1,17 @@
+#pragma once
+
+namespace dx
+{
+	//Implemented by force solvers that trade accuracy for speed through a single
+	//parameter (tree opening angle, expansion radius, ...). Smaller is always tighter.
+	class ApproximateSolver
+	{
+	public:
+		virtual ~ApproximateSolver() = default;
+
+	public:
+		virtual float GetAccuracyParameter() const = 0;
+		virtual void SetAccuracyParameter(const float & value) = 0;
+		virtual float GetMinAccuracyParameter() const = 0;
+	};
+}
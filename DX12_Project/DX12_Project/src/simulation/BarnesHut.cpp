@@ -0,0 +1,277 @@
+#include <simulation/BarnesHut.hpp>
+#include <utils/ParallelFor.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace dx
+{
+	static const unsigned int MAX_TREE_DEPTH = 32;
+	static const float MIN_THETA = 0.05f;
+
+	BarnesHutNBody::BarnesHutNBody(const BodyArray & bodies, const SimulationParams & params, const float & theta, const unsigned int & leafSize) : m_bodies(bodies),
+								   m_params(params), m_theta(theta), m_leafSize(leafSize)
+	{
+	}
+
+	void BarnesHutNBody::BuildTree()
+	{
+		const uint32_t n = static_cast<uint32_t>(m_bodies.size());
+		m_nodes.clear();
+		m_childLists.clear();
+		m_order.resize(n);
+		m_scratch.resize(n);
+		for (uint32_t i = 0; i < n; ++i)
+			m_order[i] = i;
+
+		if (n == 0)
+			return;
+
+		//Bounding cube of all bodies
+		float lo[3] = { m_bodies[0].position.x, m_bodies[0].position.y, m_bodies[0].position.z };
+		float hi[3] = { lo[0], lo[1], lo[2] };
+		for (const Body & body : m_bodies)
+		{
+			const float p[3] = { body.position.x, body.position.y, body.position.z };
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				lo[axis] = (std::min)(lo[axis], p[axis]);
+				hi[axis] = (std::max)(hi[axis], p[axis]);
+			}
+		}
+
+		float center[3], half = 0.f;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			center[axis] = 0.5f * (lo[axis] + hi[axis]);
+			half = (std::max)(half, 0.5f * (hi[axis] - lo[axis]));
+		}
+
+		m_nodes.reserve(2 * n / m_leafSize + 64);
+		BuildNode(0, n, center, half * 1.0001f + 1e-6f, 0);
+	}
+
+	//Partitions m_order[begin, end) into octants and recurses, so every node owns a contiguous body range
+	uint32_t BarnesHutNBody::BuildNode(const uint32_t & begin, const uint32_t & end, const float center[3], const float & half, const unsigned int & depth)
+	{
+		uint32_t index = static_cast<uint32_t>(m_nodes.size());
+		m_nodes.push_back(Node());
+
+		//Monopole of the bodies in this node
+		double com[3] = { 0.0, 0.0, 0.0 }, mass = 0.0;
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const Float4 & p = m_bodies[m_order[i]].position;
+			com[0] += static_cast<double>(p.x) * p.w;
+			com[1] += static_cast<double>(p.y) * p.w;
+			com[2] += static_cast<double>(p.z) * p.w;
+			mass += p.w;
+		}
+
+		Node node = {};
+		for (int axis = 0; axis < 3; ++axis)
+			node.com[axis] = mass > 0.0 ? static_cast<float>(com[axis] / mass) : center[axis];
+		node.mass = static_cast<float>(mass);
+		node.size = 2.f * half;
+		node.bodyBegin = begin;
+		node.bodyEnd = end;
+
+		if (end - begin <= m_leafSize || depth >= MAX_TREE_DEPTH)
+		{
+			m_nodes[index] = node;
+			return index;
+		}
+
+		//Counting sort of the bodies into the eight octants
+		uint32_t counts[8] = {};
+		auto octant = [&](uint32_t body)
+		{
+			const Float4 & p = m_bodies[body].position;
+			return (p.x >= center[0] ? 1u : 0u) | (p.y >= center[1] ? 2u : 0u) | (p.z >= center[2] ? 4u : 0u);
+		};
+
+		for (uint32_t i = begin; i < end; ++i)
+			++counts[octant(m_order[i])];
+
+		uint32_t offsets[9];
+		offsets[0] = begin;
+		for (int i = 0; i < 8; ++i)
+			offsets[i + 1] = offsets[i] + counts[i];
+
+		uint32_t cursor[8];
+		std::copy(offsets, offsets + 8, cursor);
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t body = m_order[i];
+			m_scratch[cursor[octant(body)]++] = body;
+		}
+		std::copy(m_scratch.begin() + begin, m_scratch.begin() + end, m_order.begin() + begin);
+
+		uint32_t childIndices[8];
+		uint32_t numChildren = 0;
+		for (int i = 0; i < 8; ++i)
+		{
+			if (counts[i] == 0)
+				continue;
+
+			float childCenter[3];
+			float quarter = 0.5f * half;
+			childCenter[0] = center[0] + ((i & 1) ? quarter : -quarter);
+			childCenter[1] = center[1] + ((i & 2) ? quarter : -quarter);
+			childCenter[2] = center[2] + ((i & 4) ? quarter : -quarter);
+			childIndices[numChildren++] = BuildNode(offsets[i], offsets[i + 1], childCenter, quarter, depth + 1);
+		}
+
+		//Children were built depth first and are not adjacent, record them as an explicit list
+		node.childBegin = static_cast<uint32_t>(m_childLists.size());
+		node.childCount = numChildren;
+		m_childLists.insert(m_childLists.end(), childIndices, childIndices + numChildren);
+		m_nodes[index] = node;
+		return index;
+	}
+
+	void BarnesHutNBody::ComputeBodyAcceleration(const size_t & index, Float4 & acceleration) const
+	{
+		const Float4 & pi = m_bodies[index].position;
+		const float theta2 = m_theta * m_theta;
+		const float eps2 = m_params.softeningSquared;
+
+		float ax = 0.f, ay = 0.f, az = 0.f;
+		uint32_t stack[8 * MAX_TREE_DEPTH + 8];
+		int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			const Node & node = m_nodes[stack[--top]];
+			float dx = node.com[0] - pi.x;
+			float dy = node.com[1] - pi.y;
+			float dz = node.com[2] - pi.z;
+			float distSqr = dx * dx + dy * dy + dz * dz;
+
+			if (node.childCount == 0)
+			{
+				for (uint32_t k = node.bodyBegin; k < node.bodyEnd; ++k)
+				{
+					uint32_t j = m_order[k];
+					if (j == index)
+						continue;
+
+					const Float4 & pj = m_bodies[j].position;
+					float rx = pj.x - pi.x;
+					float ry = pj.y - pi.y;
+					float rz = pj.z - pi.z;
+					float r2 = rx * rx + ry * ry + rz * rz + eps2;
+					float invDist = 1.f / std::sqrt(r2);
+					float s = pj.w * invDist * invDist * invDist;
+					ax += rx * s;
+					ay += ry * s;
+					az += rz * s;
+				}
+			}
+			else if (node.size * node.size < theta2 * distSqr)
+			{
+				float r2 = distSqr + eps2;
+				float invDist = 1.f / std::sqrt(r2);
+				float s = node.mass * invDist * invDist * invDist;
+				ax += dx * s;
+				ay += dy * s;
+				az += dz * s;
+			}
+			else
+			{
+				for (uint32_t c = 0; c < node.childCount; ++c)
+					stack[top++] = m_childLists[node.childBegin + c];
+			}
+		}
+
+		acceleration = { ax, ay, az, 0.f };
+	}
+
+	void BarnesHutNBody::ComputeAccelerations(std::vector<Float4> & accelerations)
+	{
+		BuildTree();
+		accelerations.resize(m_bodies.size());
+
+		ParallelFor(0, m_bodies.size(), [&](size_t i)
+		{
+			ComputeBodyAcceleration(i, accelerations[i]);
+		});
+	}
+
+	void BarnesHutNBody::Step()
+	{
+		ComputeAccelerations(m_accelerations);
+		Integrate(nullptr);
+	}
+
+	void BarnesHutNBody::StepInto(Body * output)
+	{
+		ComputeAccelerations(m_accelerations);
+		Integrate(output);
+	}
+
+	void BarnesHutNBody::Integrate(Body * output)
+	{
+		const float dt = m_params.timestep;
+		ParallelFor(0, m_bodies.size(), [&](size_t i)
+		{
+			Body & body = m_bodies[i];
+			const Float4 & a = m_accelerations[i];
+			body.velocity.x += a.x * dt;
+			body.velocity.y += a.y * dt;
+			body.velocity.z += a.z * dt;
+			body.position.x += body.velocity.x * dt;
+			body.position.y += body.velocity.y * dt;
+			body.position.z += body.velocity.z * dt;
+
+			if (output)
+				output[i] = body;
+		});
+	}
+
+	void BarnesHutNBody::SetBodies(const BodyArray & bodies)
+	{
+		m_bodies = bodies;
+		m_accelerations.clear();
+	}
+
+	BodyArray BarnesHutNBody::GetBodies() const
+	{
+		return m_bodies;
+	}
+
+	const BodyArray & BarnesHutNBody::GetBodyArray() const
+	{
+		return m_bodies;
+	}
+
+	const std::vector<Float4> & BarnesHutNBody::GetAccelerations() const
+	{
+		return m_accelerations;
+	}
+
+	const SimulationParams & BarnesHutNBody::GetParams() const
+	{
+		return m_params;
+	}
+
+	std::string BarnesHutNBody::GetName() const
+	{
+		return "tree";
+	}
+
+	float BarnesHutNBody::GetAccuracyParameter() const
+	{
+		return m_theta;
+	}
+
+	void BarnesHutNBody::SetAccuracyParameter(const float & value)
+	{
+		m_theta = (std::max)(value, MIN_THETA);
+	}
+
+	float BarnesHutNBody::GetMinAccuracyParameter() const
+	{
+		return MIN_THETA;
+	}
+}
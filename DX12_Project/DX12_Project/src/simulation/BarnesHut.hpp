@@ -0,0 +1,62 @@
+#pragma once
+#include <simulation/ApproximateSolver.hpp>
+#include <simulation/Engine.hpp>
+
+namespace dx
+{
+	//Barnes-Hut octree backend. Cells that appear smaller than the opening angle theta
+	//are replaced by their monopole, everything closer is summed directly, giving
+	//O(N log N) steps with an error controlled by theta.
+	class BarnesHutNBody : public Engine, public ApproximateSolver
+	{
+	public:
+		BarnesHutNBody(const BodyArray & bodies, const SimulationParams & params, const float & theta = 0.5f, const unsigned int & leafSize = 16);
+		void Step() override;
+		void StepInto(Body* output) override;
+		void ComputeAccelerations(std::vector<Float4> & accelerations);
+
+	public:
+		void SetBodies(const BodyArray & bodies) override;
+		BodyArray GetBodies() const override;
+		const BodyArray & GetBodyArray() const;
+		const std::vector<Float4> & GetAccelerations() const override;
+		const SimulationParams & GetParams() const override;
+		std::string GetName() const override;
+
+	public:
+		float GetAccuracyParameter() const override;
+		void SetAccuracyParameter(const float & value) override;
+		float GetMinAccuracyParameter() const override;
+
+	private:
+		struct Node
+		{
+			float com[3];
+			float mass;
+			float size;
+			uint32_t childBegin;		//Into m_childLists
+			uint32_t childCount;
+			uint32_t bodyBegin;
+			uint32_t bodyEnd;
+		};
+
+	private:
+		void BuildTree();
+		uint32_t BuildNode(const uint32_t & begin, const uint32_t & end, const float center[3], const float & half, const unsigned int & depth);
+		void ComputeBodyAcceleration(const size_t & index, Float4 & acceleration) const;
+		void Integrate(Body* output);
+
+	private:
+		BodyArray m_bodies;
+		std::vector<Float4> m_accelerations;
+		SimulationParams m_params;
+		float m_theta;
+		unsigned int m_leafSize;
+
+	private:
+		std::vector<Node> m_nodes;
+		std::vector<uint32_t> m_order;		//Body indices grouped by leaf
+		std::vector<uint32_t> m_childLists;
+		std::vector<uint32_t> m_scratch;
+	};
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Portable body layout for the CPU engines, it mirrors BodyData so that the
+//same memory can be uploaded to the GPU without conversion
+namespace dx
+{
+	struct Float4
+	{
+		float x, y, z, w;
+	};
+
+	//Compact acceleration of the two-pass single-state update, mirrors the float3 buffer
+	struct Float3
+	{
+		float x, y, z;
+	};
+
+	struct Body
+	{
+		Float4 position;	//w component holds the mass
+		Float4 velocity;
+	};
+
+	//Same constants as the ones NBody uploads to CS_MAIN
+	struct SimulationParams
+	{
+		float timestep = 0.0016f;
+		float softeningSquared = 0.0012500000f * 0.0012500000f;
+	};
+
+	typedef std::vector<Body> BodyArray;
+}
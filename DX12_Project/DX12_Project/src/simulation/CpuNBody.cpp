@@ -0,0 +1,227 @@
+#include <simulation/CpuNBody.hpp>
+#include <simulation/ForceKernel.hpp>
+#include <utils/ParallelFor.hpp>
+#include <algorithm>
+
+namespace dx
+{
+	template<typename Policy>
+	static void ComputeAccelerationsImpl(const Body* bodies, const size_t & count, const size_t & numSources, Float4* accelerations, const float & softeningSquared,
+										 const float & equalMass)
+	{
+		KernelSources<Policy> sources;
+		sources.Gather(bodies, count);
+
+		ParallelForRange(0, count, [&](size_t begin, size_t end)
+		{
+			ForceKernel<Policy>::ComputeRange(sources, accelerations, begin, end, softeningSquared, equalMass, numSources);
+		});
+	}
+
+	template<typename Policy>
+	static void IntegrateImpl(Body* bodies, const Float4* accelerations, const size_t & count, const float & timestep, Body* output)
+	{
+		ParallelForRange(0, count, [&](size_t begin, size_t end)
+		{
+			ForceKernel<Policy>::IntegrateRange(bodies, accelerations, begin, end, timestep, output);
+		});
+	}
+
+	template<typename Policy>
+	static void ComputeCompactAccelerationsImpl(const Body* bodies, const size_t & count, const size_t & numSources, Float3* accelerations, const float & softeningSquared,
+												const float & equalMass)
+	{
+		ParallelForRange(0, count, [&](size_t begin, size_t end)
+		{
+			ForceKernel<Policy>::ComputeRangeCompact(bodies, numSources, accelerations, begin, end, softeningSquared, equalMass);
+		});
+	}
+
+	template<typename Policy>
+	static void IntegrateCompactImpl(Body* bodies, const Float3* accelerations, const size_t & count, const float & timestep, Body* output)
+	{
+		ParallelForRange(0, count, [&](size_t begin, size_t end)
+		{
+			ForceKernel<Policy>::IntegrateRange(bodies, accelerations, begin, end, timestep, output);
+		});
+	}
+
+	template<typename Policy>
+	static void SelectPolicy(CpuNBody::Kernels & kernels)
+	{
+		kernels.acceleration = &ComputeAccelerationsImpl<Policy>;
+		kernels.integrate = &IntegrateImpl<Policy>;
+		kernels.compactAcceleration = &ComputeCompactAccelerationsImpl<Policy>;
+		kernels.compactIntegrate = &IntegrateCompactImpl<Policy>;
+	}
+
+	//Walks the runtime configuration down to one of the compile-time policies
+	template<typename Precision, bool EqualMass, bool Softening>
+	static void SelectDimensions(const KernelConfig & config, CpuNBody::Kernels & kernels)
+	{
+		if (config.planar)
+			SelectPolicy<KernelPolicy<Precision, EqualMass, Softening, 2>>(kernels);
+		else
+			SelectPolicy<KernelPolicy<Precision, EqualMass, Softening, 3>>(kernels);
+	}
+
+	template<typename Precision, bool EqualMass>
+	static void SelectSoftening(const KernelConfig & config, CpuNBody::Kernels & kernels)
+	{
+		if (config.softening)
+			SelectDimensions<Precision, EqualMass, true>(config, kernels);
+		else
+			SelectDimensions<Precision, EqualMass, false>(config, kernels);
+	}
+
+	template<typename Precision>
+	static void SelectMass(const KernelConfig & config, CpuNBody::Kernels & kernels)
+	{
+		if (config.equalMass)
+			SelectSoftening<Precision, true>(config, kernels);
+		else
+			SelectSoftening<Precision, false>(config, kernels);
+	}
+
+	CpuNBody::CpuNBody(const BodyArray & bodies, const SimulationParams & params, const KernelConfig & config) : m_bodies(bodies), m_params(params), m_config(config)
+	{
+		switch (m_config.precision)
+		{
+		case KernelPrecision::Float:
+			SelectMass<FloatPrecision>(m_config, m_kernels);
+			break;
+		case KernelPrecision::Double:
+			SelectMass<DoublePrecision>(m_config, m_kernels);
+			break;
+		case KernelPrecision::FloatDoubleAccumulate:
+			SelectMass<MixedPrecision>(m_config, m_kernels);
+			break;
+		}
+	}
+
+	void CpuNBody::Step()
+	{
+		if (m_config.singleState)
+		{
+			StepSingleState(nullptr);
+			return;
+		}
+
+		ComputeAccelerations(m_accelerations);
+		m_kernels.integrate(m_bodies.data(), m_accelerations.data(), m_bodies.size(), m_params.timestep, nullptr);
+	}
+
+	void CpuNBody::StepInto(Body * output)
+	{
+		if (m_config.singleState)
+		{
+			StepSingleState(output);
+			return;
+		}
+
+		ComputeAccelerations(m_accelerations);
+		m_kernels.integrate(m_bodies.data(), m_accelerations.data(), m_bodies.size(), m_params.timestep, output);
+	}
+
+	void CpuNBody::StepSingleState(Body* output)
+	{
+		//Pass 1 has to finish for every body before pass 2 moves any of them
+		m_compactAccelerations.resize(m_bodies.size());
+		float equalMass = m_bodies.empty() ? 1.f : m_bodies[0].position.w;
+		m_kernels.compactAcceleration(m_bodies.data(), m_bodies.size(), GetNumSources(), m_compactAccelerations.data(), m_params.softeningSquared, equalMass);
+		m_kernels.compactIntegrate(m_bodies.data(), m_compactAccelerations.data(), m_bodies.size(), m_params.timestep, output);
+
+		//Stale until GetAccelerations expands them again
+		m_accelerations.clear();
+	}
+
+	void CpuNBody::ComputeAccelerations(std::vector<Float4> & accelerations) const
+	{
+		accelerations.resize(m_bodies.size());
+
+		//With equal masses the mass of the first body is applied once per body
+		float equalMass = m_bodies.empty() ? 1.f : m_bodies[0].position.w;
+		m_kernels.acceleration(m_bodies.data(), m_bodies.size(), GetNumSources(), accelerations.data(), m_params.softeningSquared, equalMass);
+	}
+
+	void CpuNBody::SetBodies(const BodyArray & bodies)
+	{
+		m_bodies = bodies;
+	}
+
+	void CpuNBody::SetNumSources(const size_t & numSources)
+	{
+		m_numSources = numSources;
+	}
+
+	size_t CpuNBody::GetNumSources() const
+	{
+		return (std::min)(m_numSources, m_bodies.size());
+	}
+
+	BodyArray CpuNBody::GetBodies() const
+	{
+		return m_bodies;
+	}
+
+	const BodyArray & CpuNBody::GetBodyArray() const
+	{
+		return m_bodies;
+	}
+
+	const std::vector<Float4> & CpuNBody::GetAccelerations() const
+	{
+		if (m_config.singleState && m_accelerations.size() != m_compactAccelerations.size())
+		{
+			m_accelerations.resize(m_compactAccelerations.size());
+			for (size_t i = 0; i < m_compactAccelerations.size(); ++i)
+				m_accelerations[i] = { m_compactAccelerations[i].x, m_compactAccelerations[i].y, m_compactAccelerations[i].z, 0.f };
+		}
+
+		return m_accelerations;
+	}
+
+	size_t CpuNBody::GetStepBytesPerBody() const
+	{
+		if (m_config.singleState)
+			return sizeof(Body) + sizeof(Float3);
+
+		//KernelSources holds x, y, z and the mass in the compute precision, minus the unused ones
+		size_t real = m_config.precision == KernelPrecision::Double ? sizeof(double) : sizeof(float);
+		size_t sources = real * ((m_config.planar ? 2 : 3) + (m_config.equalMass ? 0 : 1));
+		return sizeof(Body) + sizeof(Float4) + sources;
+	}
+
+	std::string CpuNBody::GetName() const
+	{
+		return GetConfigName(m_config);
+	}
+
+	const SimulationParams & CpuNBody::GetParams() const
+	{
+		return m_params;
+	}
+
+	const KernelConfig & CpuNBody::GetConfig() const
+	{
+		return m_config;
+	}
+
+	std::string CpuNBody::GetConfigName(const KernelConfig & config)
+	{
+		std::string name;
+		switch (config.precision)
+		{
+		case KernelPrecision::Float: name = "float"; break;
+		case KernelPrecision::Double: name = "double"; break;
+		case KernelPrecision::FloatDoubleAccumulate: name = "float+double-acc"; break;
+		}
+
+		name += config.equalMass ? " equal-mass" : " per-body-mass";
+		name += config.softening ? " softened" : " unsoftened";
+		name += config.planar ? " 2D" : " 3D";
+		if (config.singleState)
+			name += " single-state";
+		return name;
+	}
+}
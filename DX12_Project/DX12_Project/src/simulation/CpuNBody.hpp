@@ -0,0 +1,89 @@
+#pragma once
+#include <simulation/Engine.hpp>
+
+namespace dx
+{
+	enum class KernelPrecision
+	{
+		Float,
+		Double,
+		FloatDoubleAccumulate
+	};
+
+	//Runtime description of a scenario, resolved once to a compile-time specialized kernel
+	struct KernelConfig
+	{
+		KernelPrecision precision = KernelPrecision::Float;
+		bool equalMass = false;
+		bool softening = true;
+		bool planar = false;
+
+		//Two-pass update on a single copy of the state: pass 1 writes compact float3
+		//accelerations reading the bodies directly, pass 2 integrates them in place. Drops
+		//the structure of arrays copy and the padded accelerations, 44 instead of 64 bytes
+		//per body with float math, at the cost of a slower inner loop.
+		bool singleState = false;
+	};
+
+	//Direct-sum CPU engine with the same semantics as CS_MAIN
+	class CpuNBody : public Engine
+	{
+	public:
+		typedef void(*AccelerationFunc)(const Body* bodies, const size_t & count, const size_t & numSources, Float4* accelerations, const float & softeningSquared,
+										const float & equalMass);
+		typedef void(*IntegrateFunc)(Body* bodies, const Float4* accelerations, const size_t & count, const float & timestep, Body* output);
+		typedef void(*CompactAccelerationFunc)(const Body* bodies, const size_t & count, const size_t & numSources, Float3* accelerations, const float & softeningSquared,
+											   const float & equalMass);
+		typedef void(*CompactIntegrateFunc)(Body* bodies, const Float3* accelerations, const size_t & count, const float & timestep, Body* output);
+
+		//The specialization picked for a configuration
+		struct Kernels
+		{
+			AccelerationFunc acceleration;
+			IntegrateFunc integrate;
+			CompactAccelerationFunc compactAcceleration;
+			CompactIntegrateFunc compactIntegrate;
+		};
+
+	public:
+		CpuNBody(const BodyArray & bodies, const SimulationParams & params, const KernelConfig & config = KernelConfig());
+		void Step() override;
+		void StepInto(Body* output) override;
+		void ComputeAccelerations(std::vector<Float4> & accelerations) const;
+
+	public:
+		void SetBodies(const BodyArray & bodies) override;
+		BodyArray GetBodies() const override;
+		const std::vector<Float4> & GetAccelerations() const override;
+		const SimulationParams & GetParams() const override;
+		std::string GetName() const override;
+		const KernelConfig & GetConfig() const;
+		const BodyArray & GetBodyArray() const;
+
+		//Only bodies [0, numSources) attract, the ones beyond are tracers that move in their
+		//field at the cost of numSources interactions each (see EscaperNBody). SetBodies
+		//keeps the count, anything past the body count means all of them.
+		void SetNumSources(const size_t & numSources);
+		size_t GetNumSources() const;
+
+		//Bytes per body held during a step: the state, the accelerations and the source copy
+		size_t GetStepBytesPerBody() const;
+
+	public:
+		static std::string GetConfigName(const KernelConfig & config);
+
+	private:
+		void StepSingleState(Body* output);
+
+	private:
+		BodyArray m_bodies;
+		std::vector<Float3> m_compactAccelerations;
+		SimulationParams m_params;
+		KernelConfig m_config;
+		Kernels m_kernels;
+		size_t m_numSources = SIZE_MAX;
+
+		//With singleState only expanded from the compact ones when asked for
+		mutable std::vector<Float4> m_accelerations;
+	};
+}
@@ -0,0 +1,79 @@
+#include <simulation/Diagnostics.hpp>
+#include <utils/ParallelFor.hpp>
+#include <assert.h>
+#include <cmath>
+#include <mutex>
+
+namespace dx
+{
+	EnergyReport ComputeEnergy(const BodyArray & bodies, const float & softeningSquared, unsigned int numThreads)
+	{
+		const size_t n = bodies.size();
+		EnergyReport report = { 0.0, 0.0 };
+		std::mutex mutex;
+
+		ParallelForRange(0, n, [&](size_t begin, size_t end)
+		{
+			double kinetic = 0.0, potential = 0.0;
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				const Body & bi = bodies[i];
+				double vx = bi.velocity.x, vy = bi.velocity.y, vz = bi.velocity.z;
+				kinetic += 0.5 * bi.position.w * (vx * vx + vy * vy + vz * vz);
+
+				for (size_t j = i + 1; j < n; ++j)
+				{
+					const Body & bj = bodies[j];
+					double rx = static_cast<double>(bj.position.x) - bi.position.x;
+					double ry = static_cast<double>(bj.position.y) - bi.position.y;
+					double rz = static_cast<double>(bj.position.z) - bi.position.z;
+					potential -= static_cast<double>(bi.position.w) * bj.position.w / std::sqrt(rx * rx + ry * ry + rz * rz + softeningSquared);
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			report.kinetic += kinetic;
+			report.potential += potential;
+		}, numThreads);
+
+		return report;
+	}
+
+	template<typename Accessor>
+	static DivergenceReport ComputeDivergence(const size_t & count, Accessor accessor)
+	{
+		double maxError = 0.0, sumSquared = 0.0;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Float4 & a = accessor(i, 0);
+			const Float4 & b = accessor(i, 1);
+			double dx = static_cast<double>(a.x) - b.x;
+			double dy = static_cast<double>(a.y) - b.y;
+			double dz = static_cast<double>(a.z) - b.z;
+			double errorSquared = dx * dx + dy * dy + dz * dz;
+
+			sumSquared += errorSquared;
+			if (errorSquared > maxError)
+				maxError = errorSquared;
+		}
+
+		DivergenceReport report;
+		report.maxError = std::sqrt(maxError);
+		report.rmsError = count > 0 ? std::sqrt(sumSquared / count) : 0.0;
+		return report;
+	}
+
+	DivergenceReport ComputePositionDivergence(const BodyArray & a, const BodyArray & b)
+	{
+		assert(a.size() == b.size());
+		return ComputeDivergence(a.size(), [&](size_t i, int side) -> const Float4 & { return side == 0 ? a[i].position : b[i].position; });
+	}
+
+	DivergenceReport ComputeVectorDivergence(const std::vector<Float4> & a, const std::vector<Float4> & b)
+	{
+		assert(a.size() == b.size());
+		return ComputeDivergence(a.size(), [&](size_t i, int side) -> const Float4 & { return side == 0 ? a[i] : b[i]; });
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <simulation/Body.hpp>
+
+namespace dx
+{
+	struct EnergyReport
+	{
+		double kinetic;
+		double potential;
+
+		double GetTotal() const { return kinetic + potential; }
+	};
+
+	//Total energy of the system with the same softened potential as the force kernels (G = 1).
+	//O(N^2) in double precision, split over numThreads (all cores by default).
+	EnergyReport ComputeEnergy(const BodyArray & bodies, const float & softeningSquared, unsigned int numThreads = 0);
+
+	struct DivergenceReport
+	{
+		double maxError;
+		double rmsError;
+	};
+
+	//Max and RMS of |a_i - b_i| over the xyz components
+	DivergenceReport ComputePositionDivergence(const BodyArray & a, const BodyArray & b);
+	DivergenceReport ComputeVectorDivergence(const std::vector<Float4> & a, const std::vector<Float4> & b);
+}
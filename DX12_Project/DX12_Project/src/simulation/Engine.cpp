@@ -0,0 +1,87 @@
+#include <simulation/Engine.hpp>
+#include <simulation/BarnesHut.hpp>
+#include <simulation/CpuNBody.hpp>
+#include <simulation/Escapers.hpp>
+#include <simulation/KSRegularization.hpp>
+#include <simulation/Multigrid.hpp>
+#include <simulation/TiledCoordinates.hpp>
+#include <algorithm>
+
+namespace dx
+{
+	void Engine::StepInto(Body * output)
+	{
+		Step();
+
+		BodyArray bodies = GetBodies();
+		std::copy(bodies.begin(), bodies.end(), output);
+	}
+
+	void Engine::StepIntoSegments(Body* const* segments, const SegmentLayout & layout)
+	{
+		if (layout.GetNumSegments() == 1)
+		{
+			StepInto(segments[0]);
+			return;
+		}
+
+		Step();
+
+		BodyArray bodies = GetBodies();
+		CopyToSegments(bodies.data(), 0, bodies.size(), segments, layout);
+	}
+
+	std::unique_ptr<Engine> CreateEngine(const std::string & name, const BodyArray & bodies, const SimulationParams & params)
+	{
+		KernelConfig config;
+
+		if (name == "cpu")
+			return std::make_unique<CpuNBody>(bodies, params, config);
+
+		if (name == "cpu-double")
+		{
+			config.precision = KernelPrecision::Double;
+			return std::make_unique<CpuNBody>(bodies, params, config);
+		}
+
+		if (name == "cpu-mixed")
+		{
+			config.precision = KernelPrecision::FloatDoubleAccumulate;
+			return std::make_unique<CpuNBody>(bodies, params, config);
+		}
+
+		if (name == "cpu-equal-mass")
+		{
+			config.equalMass = true;
+			return std::make_unique<CpuNBody>(bodies, params, config);
+		}
+
+		if (name == "cpu-single-state")
+		{
+			config.singleState = true;
+			return std::make_unique<CpuNBody>(bodies, params, config);
+		}
+
+		if (name == "cpu-escapers")
+			return std::make_unique<EscaperNBody>(bodies, params, EscaperSettings(), config);
+
+		if (name == "tiled")
+			return std::make_unique<TiledNBody>(bodies, params);
+
+		if (name == "tree")
+			return std::make_unique<BarnesHutNBody>(bodies, params);
+
+		if (name == "ks")
+			return std::make_unique<KSRegularizedNBody>(bodies, params);
+
+		if (name == "multigrid")
+			return std::make_unique<MultigridNBody>(bodies, params);
+
+		return nullptr;
+	}
+
+	std::vector<std::string> GetEngineNames()
+	{
+		return { "cpu", "cpu-double", "cpu-mixed", "cpu-equal-mass", "cpu-single-state", "cpu-escapers", "tiled", "tree", "ks", "multigrid" };
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <simulation/Body.hpp>
+#include <simulation/Segments.hpp>
+#include <memory>
+#include <string>
+
+namespace dx
+{
+	//Common interface of the CPU simulation backends so they can be swapped, compared
+	//and driven by the tools without knowing the concrete implementation
+	class Engine
+	{
+	public:
+		virtual ~Engine() = default;
+
+	public:
+		virtual void Step() = 0;
+
+		//Steps and writes the new state to output in body order, e.g. straight into mapped
+		//GPU memory. The default copies after Step, engines that can fold the store into
+		//their integration pass override it so the state is written once.
+		virtual void StepInto(Body* output);
+
+		//Same for output split into segment buffers (see SegmentLayout). A single segment
+		//goes through StepInto, more are filled from a copy of the stepped state.
+		virtual void StepIntoSegments(Body* const* segments, const SegmentLayout & layout);
+		virtual void SetBodies(const BodyArray & bodies) = 0;
+		virtual BodyArray GetBodies() const = 0;
+
+		//Accelerations used by the last Step, in body order
+		virtual const std::vector<Float4> & GetAccelerations() const = 0;
+		virtual const SimulationParams & GetParams() const = 0;
+		virtual std::string GetName() const = 0;
+	};
+
+	//Creates a backend by name, see GetEngineNames. Returns nullptr for unknown names.
+	std::unique_ptr<Engine> CreateEngine(const std::string & name, const BodyArray & bodies, const SimulationParams & params);
+	std::vector<std::string> GetEngineNames();
+}
@@ -0,0 +1,249 @@
+#include <simulation/Escapers.hpp>
+#include <utils/ParallelFor.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <numeric>
+
+namespace dx
+{
+	size_t FindEscapers(const Body* bodies, const size_t & count, const SimulationParams & params, const EscaperSettings & settings,
+						std::vector<unsigned char> & escaping, EscaperReport & report)
+	{
+		escaping.assign(count, 0);
+		report.numNew = 0;
+		if (count < 2)
+			return 0;
+
+		//Center of mass and its velocity
+		double mass = 0.0, cx = 0.0, cy = 0.0, cz = 0.0, vx = 0.0, vy = 0.0, vz = 0.0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Body & body = bodies[i];
+			double m = body.position.w;
+			mass += m;
+			cx += m * body.position.x;
+			cy += m * body.position.y;
+			cz += m * body.position.z;
+			vx += m * body.velocity.x;
+			vy += m * body.velocity.y;
+			vz += m * body.velocity.z;
+		}
+
+		cx /= mass; cy /= mass; cz /= mass;
+		vx /= mass; vy /= mass; vz /= mass;
+
+		//Radius that holds half the mass
+		std::vector<std::pair<double, float>> radii(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			double dx = bodies[i].position.x - cx, dy = bodies[i].position.y - cy, dz = bodies[i].position.z - cz;
+			radii[i] = { dx * dx + dy * dy + dz * dz, bodies[i].position.w };
+		}
+		std::sort(radii.begin(), radii.end());
+
+		double enclosed = 0.0, halfMassSquared = 0.0;
+		for (const auto & radius : radii)
+		{
+			enclosed += radius.second;
+			halfMassSquared = radius.first;
+			if (enclosed >= 0.5 * mass)
+				break;
+		}
+
+		report.center = { static_cast<float>(cx), static_cast<float>(cy), static_cast<float>(cz) };
+		report.halfMassRadius = std::sqrt(halfMassSquared);
+		const double minRadiusSquared = double(settings.radiusFactor) * settings.radiusFactor * halfMassSquared;
+
+		//The cheap distance and direction tests run first, so the potential is only summed
+		//for the few bodies far out and on their way out
+		std::mutex mutex;
+		ParallelForRange(0, count, [&](size_t begin, size_t end)
+		{
+			size_t found = 0;
+			for (size_t i = begin; i < end; ++i)
+			{
+				const Body & body = bodies[i];
+				double dx = body.position.x - cx, dy = body.position.y - cy, dz = body.position.z - cz;
+				double ux = body.velocity.x - vx, uy = body.velocity.y - vy, uz = body.velocity.z - vz;
+				if (dx * dx + dy * dy + dz * dz <= minRadiusSquared || dx * ux + dy * uy + dz * uz <= 0.0)
+					continue;
+
+				double potential = 0.0;
+				for (size_t j = 0; j < count; ++j)
+				{
+					if (j == i)
+						continue;
+
+					double rx = static_cast<double>(bodies[j].position.x) - body.position.x;
+					double ry = static_cast<double>(bodies[j].position.y) - body.position.y;
+					double rz = static_cast<double>(bodies[j].position.z) - body.position.z;
+					potential -= bodies[j].position.w / std::sqrt(rx * rx + ry * ry + rz * rz + params.softeningSquared);
+				}
+
+				if (0.5 * (ux * ux + uy * uy + uz * uz) + potential > settings.minEnergy)
+				{
+					escaping[i] = 1;
+					++found;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			report.numNew += found;
+		});
+
+		return report.numNew;
+	}
+
+	EscaperNBody::EscaperNBody(const BodyArray & bodies, const SimulationParams & params, const EscaperSettings & settings, const KernelConfig & config)
+		: m_engine(bodies, params, config), m_settings(settings)
+	{
+		SetBodies(bodies);
+	}
+
+	void EscaperNBody::Step()
+	{
+		//Before the step, so the accelerations it leaves match the slots
+		if (m_settings.interval > 0 && m_step > 0 && m_step % m_settings.interval == 0)
+			Demote();
+
+		m_engine.Step();
+		++m_step;
+	}
+
+	size_t GetDemotionOrder(const std::vector<unsigned char> & escaping, const size_t & numActive, const size_t & count, std::vector<uint32_t> & order)
+	{
+		order.clear();
+		order.reserve(count);
+		for (size_t i = 0; i < numActive; ++i)
+		{
+			if (!escaping[i])
+				order.push_back(static_cast<uint32_t>(i));
+		}
+
+		const size_t remaining = order.size();
+		for (size_t i = 0; i < numActive; ++i)
+		{
+			if (escaping[i])
+				order.push_back(static_cast<uint32_t>(i));
+		}
+
+		for (size_t i = numActive; i < count; ++i)
+			order.push_back(static_cast<uint32_t>(i));
+		return remaining;
+	}
+
+	void EscaperNBody::Demote()
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		const BodyArray & bodies = m_engine.GetBodyArray();
+
+		if (FindEscapers(bodies.data(), m_numActive, m_engine.GetParams(), m_settings, m_escaping, m_report) > 0)
+		{
+			//Remaining active bodies, new tracers, old tracers, pruning drops the new tracers
+			std::vector<uint32_t> order;
+			const size_t numActive = GetDemotionOrder(m_escaping, m_numActive, bodies.size(), order);
+
+			BodyArray compacted;
+			std::vector<uint64_t> ids;
+			compacted.reserve(bodies.size());
+			ids.reserve(bodies.size());
+			for (size_t i = 0; i < order.size(); ++i)
+			{
+				if (m_settings.prune && i >= numActive && i < m_numActive)
+				{
+					m_archive.push_back({ m_ids[order[i]], m_step, bodies[order[i]] });
+					continue;
+				}
+
+				compacted.push_back(bodies[order[i]]);
+				ids.push_back(m_ids[order[i]]);
+			}
+
+			m_engine.SetBodies(compacted);
+			m_engine.SetNumSources(numActive);
+			m_ids.swap(ids);
+			m_numActive = numActive;
+		}
+
+		m_report.step = m_step;
+		m_report.numActive = m_numActive;
+		m_report.numTracers = m_ids.size() - m_numActive;
+		m_report.numArchived = m_archive.size();
+		m_report.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
+	std::vector<size_t> EscaperNBody::GetBodyOrder() const
+	{
+		std::vector<size_t> order(m_ids.size());
+		std::iota(order.begin(), order.end(), size_t(0));
+		std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return m_ids[a] < m_ids[b]; });
+		return order;
+	}
+
+	void EscaperNBody::SetBodies(const BodyArray & bodies)
+	{
+		m_engine.SetBodies(bodies);
+		m_engine.SetNumSources(SIZE_MAX);
+
+		m_ids.resize(bodies.size());
+		std::iota(m_ids.begin(), m_ids.end(), uint64_t(0));
+		m_numActive = bodies.size();
+		m_step = 0;
+		m_archive.clear();
+
+		m_report = EscaperReport();
+		m_report.numActive = m_numActive;
+	}
+
+	BodyArray EscaperNBody::GetBodies() const
+	{
+		const BodyArray & bodies = m_engine.GetBodyArray();
+		BodyArray ordered;
+		ordered.reserve(bodies.size());
+		for (size_t slot : GetBodyOrder())
+			ordered.push_back(bodies[slot]);
+		return ordered;
+	}
+
+	const std::vector<Float4> & EscaperNBody::GetAccelerations() const
+	{
+		const std::vector<Float4> & accelerations = m_engine.GetAccelerations();
+		m_accelerations.clear();
+		if (accelerations.size() == m_ids.size())
+			for (size_t slot : GetBodyOrder())
+				m_accelerations.push_back(accelerations[slot]);
+		return m_accelerations;
+	}
+
+	const SimulationParams & EscaperNBody::GetParams() const
+	{
+		return m_engine.GetParams();
+	}
+
+	std::string EscaperNBody::GetName() const
+	{
+		return m_engine.GetName() + (m_settings.prune ? " escaper pruning" : " escaper tracers");
+	}
+
+	size_t EscaperNBody::GetNumActive() const
+	{
+		return m_numActive;
+	}
+
+	size_t EscaperNBody::GetNumTracers() const
+	{
+		return m_ids.size() - m_numActive;
+	}
+
+	const std::vector<ArchivedBody> & EscaperNBody::GetArchive() const
+	{
+		return m_archive;
+	}
+
+	const EscaperReport & EscaperNBody::GetLastReport() const
+	{
+		return m_report;
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <simulation/CpuNBody.hpp>
+
+namespace dx
+{
+	struct EscaperSettings
+	{
+		unsigned int interval = 64;		//Steps between detection passes
+		float radiusFactor = 4.0f;		//Escapers are at least this many half-mass radii from the center
+		float minEnergy = 0.0f;			//Specific energy relative to the cluster above which a body is unbound
+		bool prune = false;				//Remove and archive escapers instead of keeping them as tracers
+	};
+
+	struct EscaperReport
+	{
+		uint64_t step = 0;
+		size_t numActive = 0;			//Bodies that attract
+		size_t numTracers = 0;
+		size_t numArchived = 0;
+		size_t numNew = 0;				//Escapers found by the last pass
+		Float3 center = { 0.f, 0.f, 0.f };
+		double halfMassRadius = 0.0;
+		double seconds = 0.0;			//Last detection pass and compaction
+	};
+
+	//A pruned body, as it was when it was removed
+	struct ArchivedBody
+	{
+		uint64_t id;					//Index in the initial bodies
+		uint64_t step;
+		Body body;
+	};
+
+	//Flags the bodies of [0, count) that left the cluster they form: beyond radiusFactor
+	//half-mass radii from the center of mass, moving away from it and with a positive
+	//specific energy 0.5 v^2 + phi, the velocity taken relative to the cluster's and phi
+	//the softened potential of all other bodies. One pass over all workers, the potential is
+	//summed in double precision and only for the bodies that pass the cheap tests.
+	size_t FindEscapers(const Body* bodies, const size_t & count, const SimulationParams & params, const EscaperSettings & settings,
+						std::vector<unsigned char> & escaping, EscaperReport & report);
+
+	//Order that moves the flagged bodies of [0, numActive) behind the remaining active ones,
+	//with the bodies of [numActive, count) last, each group in its previous order. Slot i of
+	//the compacted bodies takes body order[i]. Returns the new number of active bodies.
+	size_t GetDemotionOrder(const std::vector<unsigned char> & escaping, const size_t & numActive, const size_t & count, std::vector<uint32_t> & order);
+
+	//Direct-sum engine whose dense loop only runs over the bound population. Every interval
+	//steps FindEscapers checks the active bodies, escapers are moved behind them, where
+	//they stay as tracers (integrated in the field of the active bodies, attracting
+	//nothing) or are archived and dropped with prune. Demotion is permanent, an unbound
+	//body that far out does not come back. GetBodies returns the bodies in their initial
+	//order, without the pruned ones.
+	class EscaperNBody : public Engine
+	{
+	public:
+		EscaperNBody(const BodyArray & bodies, const SimulationParams & params, const EscaperSettings & settings = EscaperSettings(),
+					 const KernelConfig & config = KernelConfig());
+
+	public:
+		void Step() override;
+		void SetBodies(const BodyArray & bodies) override;
+		BodyArray GetBodies() const override;
+		const std::vector<Float4> & GetAccelerations() const override;
+		const SimulationParams & GetParams() const override;
+		std::string GetName() const override;
+
+		size_t GetNumActive() const;
+		size_t GetNumTracers() const;
+		const std::vector<ArchivedBody> & GetArchive() const;
+		const EscaperReport & GetLastReport() const;
+
+	private:
+		void Demote();
+
+		//Slots sorted by initial index
+		std::vector<size_t> GetBodyOrder() const;
+
+	private:
+		CpuNBody m_engine;
+		EscaperSettings m_settings;
+		std::vector<uint64_t> m_ids;			//Initial index of the body in every slot
+		size_t m_numActive;
+		uint64_t m_step = 0;
+		std::vector<ArchivedBody> m_archive;
+		EscaperReport m_report;
+		std::vector<unsigned char> m_escaping;
+		mutable std::vector<Float4> m_accelerations;
+	};
+}
@@ -0,0 +1,244 @@
+#pragma once
+#include <simulation/Body.hpp>
+#include <cmath>
+
+//Compile-time specialized direct-sum force kernel. The policy decides the arithmetic
+//precision, whether the masses are all equal (one multiply per body instead of per
+//pair), whether softening is applied and whether the simulation is planar, so every
+//scenario only pays for the math it actually needs.
+namespace dx
+{
+	struct FloatPrecision
+	{
+		typedef float Compute;
+		typedef float Accumulate;
+	};
+
+	struct DoublePrecision
+	{
+		typedef double Compute;
+		typedef double Accumulate;
+	};
+
+	//Pairwise terms in float, running sums in double
+	struct MixedPrecision
+	{
+		typedef float Compute;
+		typedef double Accumulate;
+	};
+
+	template<typename PrecisionT, bool EqualMassT, bool SofteningT, unsigned int DimensionsT>
+	struct KernelPolicy
+	{
+		static_assert(DimensionsT == 2 || DimensionsT == 3, "Only 2D and 3D kernels are supported");
+
+		typedef PrecisionT Precision;
+		static const bool EqualMass = EqualMassT;
+		static const bool Softening = SofteningT;
+		static const unsigned int Dimensions = DimensionsT;
+	};
+
+	//Matches CS_MAIN: float math, the mass of each source body, softening and three dimensions
+	typedef KernelPolicy<FloatPrecision, false, true, 3> ReferencePolicy;
+
+	//Structure of arrays copy of the positions in the compute precision, built once per
+	//step so the inner loop streams contiguous memory and vectorizes
+	template<typename Policy>
+	struct KernelSources
+	{
+		typedef typename Policy::Precision::Compute Real;
+
+		std::vector<Real> x, y, z, mass;
+
+		void Gather(const Body* bodies, const size_t & count)
+		{
+			x.resize(count);
+			y.resize(count);
+			if (Policy::Dimensions == 3)
+				z.resize(count);
+			if (!Policy::EqualMass)
+				mass.resize(count);
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				x[i] = static_cast<Real>(bodies[i].position.x);
+				y[i] = static_cast<Real>(bodies[i].position.y);
+				if (Policy::Dimensions == 3)
+					z[i] = static_cast<Real>(bodies[i].position.z);
+				if (!Policy::EqualMass)
+					mass[i] = static_cast<Real>(bodies[i].position.w);
+			}
+		}
+
+		size_t GetCount() const
+		{
+			return x.size();
+		}
+	};
+
+	template<typename Policy>
+	struct ForceKernel
+	{
+		typedef typename Policy::Precision::Compute Real;
+		typedef typename Policy::Precision::Accumulate Sum;
+
+		//Accumulates the interactions with sources [begin, end) into the sums
+		static inline void Accumulate(const KernelSources<Policy> & sources, const size_t & begin, const size_t & end, const Real & px, const Real & py,
+									  const Real & pz, const Real & softeningSquared, Sum & ax, Sum & ay, Sum & az)
+		{
+			const Real* sx = sources.x.data();
+			const Real* sy = sources.y.data();
+			const Real* sz = Policy::Dimensions == 3 ? sources.z.data() : nullptr;
+			const Real* sm = Policy::EqualMass ? nullptr : sources.mass.data();
+
+			for (size_t j = begin; j < end; ++j)
+			{
+				Real rx = sx[j] - px;
+				Real ry = sy[j] - py;
+				Real rz = Policy::Dimensions == 3 ? sz[j] - pz : Real(0);
+
+				Real distSqr = rx * rx + ry * ry;
+				if (Policy::Dimensions == 3)
+					distSqr += rz * rz;
+				if (Policy::Softening)
+					distSqr += softeningSquared;
+
+				Real invDist = Real(1) / std::sqrt(distSqr);
+				Real s = invDist * invDist * invDist;
+				if (!Policy::EqualMass)
+					s *= sm[j];
+
+				ax += static_cast<Sum>(rx * s);
+				ay += static_cast<Sum>(ry * s);
+				if (Policy::Dimensions == 3)
+					az += static_cast<Sum>(rz * s);
+			}
+		}
+
+		//Same sum as Accumulate, but read straight from the bodies for the single-state update
+		static inline void AccumulateBodies(const Body* bodies, const size_t & begin, const size_t & end, const Real & px, const Real & py, const Real & pz,
+											const Real & softeningSquared, Sum & ax, Sum & ay, Sum & az)
+		{
+			for (size_t j = begin; j < end; ++j)
+			{
+				const Float4 & source = bodies[j].position;
+				Real rx = static_cast<Real>(source.x) - px;
+				Real ry = static_cast<Real>(source.y) - py;
+				Real rz = Policy::Dimensions == 3 ? static_cast<Real>(source.z) - pz : Real(0);
+
+				Real distSqr = rx * rx + ry * ry;
+				if (Policy::Dimensions == 3)
+					distSqr += rz * rz;
+				if (Policy::Softening)
+					distSqr += softeningSquared;
+
+				Real invDist = Real(1) / std::sqrt(distSqr);
+				Real s = invDist * invDist * invDist;
+				if (!Policy::EqualMass)
+					s *= static_cast<Real>(source.w);
+
+				ax += static_cast<Sum>(rx * s);
+				ay += static_cast<Sum>(ry * s);
+				if (Policy::Dimensions == 3)
+					az += static_cast<Sum>(rz * s);
+			}
+		}
+
+		//Computes the accelerations of the bodies [begin, end) caused by the first numSources
+		//bodies, the ones beyond are tracers that feel the sources but do not attract
+		static void ComputeRange(const KernelSources<Policy> & sources, Float4* accelerations, const size_t & begin, const size_t & end,
+								 const float & softeningSquared, const float & equalMass, const size_t & numSources)
+		{
+			const size_t count = numSources;
+			const Real softening = static_cast<Real>(softeningSquared);
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				Real px = sources.x[i];
+				Real py = sources.y[i];
+				Real pz = Policy::Dimensions == 3 ? sources.z[i] : Real(0);
+				Sum ax = Sum(0), ay = Sum(0), az = Sum(0);
+
+				if (Policy::Softening || i >= count)
+				{
+					//Softening makes the self term vanish, no need to skip it
+					Accumulate(sources, 0, count, px, py, pz, softening, ax, ay, az);
+				}
+				else
+				{
+					//Without softening the self term is 0/0, split the loop around it
+					Accumulate(sources, 0, i, px, py, pz, softening, ax, ay, az);
+					Accumulate(sources, i + 1, count, px, py, pz, softening, ax, ay, az);
+				}
+
+				if (Policy::EqualMass)
+				{
+					ax *= equalMass;
+					ay *= equalMass;
+					az *= equalMass;
+				}
+
+				accelerations[i] = { static_cast<float>(ax), static_cast<float>(ay), static_cast<float>(az), 0.f };
+			}
+		}
+
+		//Pass 1 of the single-state update, same as ComputeRange without the structure of arrays
+		//copy and with the accelerations in the compact layout, count is the number of sources.
+		//Every source is still read, so nothing may be integrated before all ranges are done.
+		static void ComputeRangeCompact(const Body* bodies, const size_t & count, Float3* accelerations, const size_t & begin, const size_t & end,
+										const float & softeningSquared, const float & equalMass)
+		{
+			const Real softening = static_cast<Real>(softeningSquared);
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				Real px = static_cast<Real>(bodies[i].position.x);
+				Real py = static_cast<Real>(bodies[i].position.y);
+				Real pz = Policy::Dimensions == 3 ? static_cast<Real>(bodies[i].position.z) : Real(0);
+				Sum ax = Sum(0), ay = Sum(0), az = Sum(0);
+
+				if (Policy::Softening || i >= count)
+					AccumulateBodies(bodies, 0, count, px, py, pz, softening, ax, ay, az);
+				else
+				{
+					AccumulateBodies(bodies, 0, i, px, py, pz, softening, ax, ay, az);
+					AccumulateBodies(bodies, i + 1, count, px, py, pz, softening, ax, ay, az);
+				}
+
+				if (Policy::EqualMass)
+				{
+					ax *= equalMass;
+					ay *= equalMass;
+					az *= equalMass;
+				}
+
+				accelerations[i] = { static_cast<float>(ax), static_cast<float>(ay), static_cast<float>(az) };
+			}
+		}
+
+		//Same Leapfrog-Verlet update as CS_MAIN, Acceleration is Float4 or the compact Float3
+		//With output, every integrated body is also stored there as one whole 32 byte write,
+		//which keeps write-combined destinations streaming
+		template<typename Acceleration>
+		static void IntegrateRange(Body* bodies, const Acceleration* accelerations, const size_t & begin, const size_t & end, const float & timestep, Body* output = nullptr)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				Body & body = bodies[i];
+				body.velocity.x += accelerations[i].x * timestep;
+				body.velocity.y += accelerations[i].y * timestep;
+				body.position.x += body.velocity.x * timestep;
+				body.position.y += body.velocity.y * timestep;
+
+				if (Policy::Dimensions == 3)
+				{
+					body.velocity.z += accelerations[i].z * timestep;
+					body.position.z += body.velocity.z * timestep;
+				}
+
+				if (output)
+					output[i] = body;
+			}
+		}
+	};
+}
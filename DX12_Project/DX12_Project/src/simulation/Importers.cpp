@@ -0,0 +1,726 @@
+#include <simulation/Importers.hpp>
+#include <utils/ParallelFor.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace dx
+{
+	//Minimal binary reader with 64-bit offsets, every worker opens its own
+	class InputFile
+	{
+	public:
+		InputFile(const std::string & path) : m_file(std::fopen(path.c_str(), "rb"))
+		{
+		}
+
+		~InputFile()
+		{
+			if (m_file)
+				std::fclose(m_file);
+		}
+
+		bool IsOpen() const
+		{
+			return m_file != nullptr;
+		}
+
+		uint64_t GetSize()
+		{
+			if (!Seek(0, SEEK_END))
+				return 0;
+#ifdef _WIN32
+			return static_cast<uint64_t>(_ftelli64(m_file));
+#else
+			return static_cast<uint64_t>(ftello(m_file));
+#endif
+		}
+
+		bool Read(const uint64_t & offset, void* data, const size_t & size)
+		{
+			return Seek(offset, SEEK_SET) && std::fread(data, 1, size, m_file) == size;
+		}
+
+	private:
+		bool Seek(const uint64_t & offset, const int & origin)
+		{
+#ifdef _WIN32
+			return _fseeki64(m_file, static_cast<long long>(offset), origin) == 0;
+#else
+			return fseeko(m_file, static_cast<off_t>(offset), origin) == 0;
+#endif
+		}
+
+	private:
+		FILE* m_file;
+	};
+
+	static uint32_t SwapBytes(const uint32_t & value)
+	{
+		return (value >> 24) | ((value >> 8) & 0xFF00u) | ((value << 8) & 0xFF0000u) | (value << 24);
+	}
+
+	static uint64_t SwapBytes(const uint64_t & value)
+	{
+		return (static_cast<uint64_t>(SwapBytes(static_cast<uint32_t>(value))) << 32) | SwapBytes(static_cast<uint32_t>(value >> 32));
+	}
+
+	static bool HasExtension(const std::string & path, const char* extension)
+	{
+		size_t length = std::strlen(extension);
+		if (path.size() < length)
+			return false;
+
+		for (size_t i = 0; i < length; ++i)
+		{
+			char c = path[path.size() - length + i];
+			if (c >= 'A' && c <= 'Z')
+				c = static_cast<char>(c - 'A' + 'a');
+			if (c != extension[i])
+				return false;
+		}
+
+		return true;
+	}
+
+	static inline void SetComponent(Float4 & vector, const size_t & component, const float & value)
+	{
+		switch (component)
+		{
+		case 0: vector.x = value; break;
+		case 1: vector.y = value; break;
+		default: vector.z = value; break;
+		}
+	}
+
+	//
+	//Gadget
+	//
+
+	struct GadgetBlock
+	{
+		char label[5];
+		uint64_t offset;		//First byte of the payload
+		uint64_t size;
+	};
+
+	struct GadgetFile
+	{
+		bool swap = false;
+		uint32_t numParticles[6] = {};
+		double massTable[6] = {};
+		int32_t numFiles = 1;
+		std::vector<GadgetBlock> blocks;
+
+		const GadgetBlock* Find(const char* label) const
+		{
+			for (const GadgetBlock & block : blocks)
+			{
+				if (std::strncmp(block.label, label, 4) == 0)
+					return &block;
+			}
+
+			return nullptr;
+		}
+
+		size_t GetCount() const
+		{
+			size_t count = 0;
+			for (int t = 0; t < 6; ++t)
+				count += numParticles[t];
+			return count;
+		}
+	};
+
+	//Walks the Fortran records once, only the block markers and the header are read
+	static bool ScanGadget(const std::string & path, GadgetFile & gadget, std::string & error)
+	{
+		InputFile file(path);
+		if (!file.IsOpen())
+		{
+			error = "cannot open " + path;
+			return false;
+		}
+
+		uint64_t fileSize = file.GetSize();
+		uint32_t marker;
+		if (!file.Read(0, &marker, sizeof(marker)))
+		{
+			error = "empty file " + path;
+			return false;
+		}
+
+		//The first marker is 256 (format 1 header) or 8 (format 2 label record) in some byte order
+		bool format2;
+		if (marker == 256 || marker == 8)
+			gadget.swap = false;
+		else if (SwapBytes(marker) == 256 || SwapBytes(marker) == 8)
+			gadget.swap = true;
+		else
+		{
+			error = path + " is not a Gadget snapshot";
+			return false;
+		}
+
+		format2 = (gadget.swap ? SwapBytes(marker) : marker) == 8;
+
+		static const char* FORMAT1_ORDER[] = { "HEAD", "POS ", "VEL ", "ID  ", "MASS" };
+		uint64_t position = 0;
+		for (size_t index = 0; position + 8 <= fileSize; ++index)
+		{
+			GadgetBlock block = {};
+
+			if (format2)
+			{
+				char record[16];
+				if (!file.Read(position, record, sizeof(record)))
+					break;
+				std::memcpy(block.label, record + 4, 4);
+				position += 16;
+			}
+			else
+			{
+				if (index >= sizeof(FORMAT1_ORDER) / sizeof(FORMAT1_ORDER[0]))
+					break;
+				std::memcpy(block.label, FORMAT1_ORDER[index], 4);
+			}
+
+			uint32_t size;
+			if (!file.Read(position, &size, sizeof(size)))
+				break;
+			if (gadget.swap)
+				size = SwapBytes(size);
+
+			block.offset = position + 4;
+			block.size = size;
+			if (block.offset + block.size + 4 > fileSize)
+			{
+				error = "truncated block " + std::string(block.label) + " in " + path;
+				return false;
+			}
+
+			gadget.blocks.push_back(block);
+			position = block.offset + block.size + 4;
+		}
+
+		const GadgetBlock* header = gadget.Find("HEAD");
+		if (!header || header->size < 256)
+		{
+			error = "missing header in " + path;
+			return false;
+		}
+
+		unsigned char bytes[256];
+		if (!file.Read(header->offset, bytes, sizeof(bytes)))
+		{
+			error = "truncated header in " + path;
+			return false;
+		}
+
+		for (int t = 0; t < 6; ++t)
+		{
+			uint32_t count;
+			uint64_t mass;
+			std::memcpy(&count, bytes + 4 * t, sizeof(count));
+			std::memcpy(&mass, bytes + 24 + 8 * t, sizeof(mass));
+			if (gadget.swap)
+			{
+				count = SwapBytes(count);
+				mass = SwapBytes(mass);
+			}
+
+			gadget.numParticles[t] = count;
+			std::memcpy(&gadget.massTable[t], &mass, sizeof(mass));
+		}
+
+		uint32_t numFiles;
+		std::memcpy(&numFiles, bytes + 124, sizeof(numFiles));
+		gadget.numFiles = static_cast<int32_t>(gadget.swap ? SwapBytes(numFiles) : numFiles);
+		return true;
+	}
+
+	//Reads numValues float or double values starting at offset in chunks and hands each,
+	//converted to float, to func(valueIndex, value)
+	template<typename Func>
+	static bool ForEachValue(InputFile & file, const uint64_t & offset, const size_t & numValues, const size_t & precision, const bool & swap,
+							 const size_t & chunkSize, std::vector<unsigned char> & buffer, Func func)
+	{
+		const size_t valuesPerChunk = (std::max)(chunkSize / precision, size_t(1));
+
+		for (size_t first = 0; first < numValues; first += valuesPerChunk)
+		{
+			size_t count = (std::min)(valuesPerChunk, numValues - first);
+			buffer.resize(count * precision);
+			if (!file.Read(offset + first * precision, buffer.data(), buffer.size()))
+				return false;
+
+			const unsigned char* data = buffer.data();
+			for (size_t k = 0; k < count; ++k)
+			{
+				float value;
+				if (precision == 4)
+				{
+					uint32_t word;
+					std::memcpy(&word, data + 4 * k, sizeof(word));
+					if (swap)
+						word = SwapBytes(word);
+					std::memcpy(&value, &word, sizeof(value));
+				}
+				else
+				{
+					uint64_t word;
+					double wide;
+					std::memcpy(&word, data + 8 * k, sizeof(word));
+					if (swap)
+						word = SwapBytes(word);
+					std::memcpy(&wide, &word, sizeof(wide));
+					value = static_cast<float>(wide);
+				}
+
+				func(first + k, value);
+			}
+		}
+
+		return true;
+	}
+
+	bool GetGadgetBodyCount(const std::string & path, size_t & count, std::string & error)
+	{
+		GadgetFile gadget;
+		if (!ScanGadget(path, gadget, error))
+			return false;
+
+		count = gadget.GetCount();
+		return true;
+	}
+
+	bool ImportGadget(const std::string & path, Body* bodies, const size_t & capacity, ImportResult & result, std::string & error, const ImportOptions & options)
+	{
+		GadgetFile gadget;
+		if (!ScanGadget(path, gadget, error))
+			return false;
+
+		if (gadget.numFiles > 1)
+		{
+			error = "multi-file snapshots are not supported: " + path;
+			return false;
+		}
+
+		const size_t total = gadget.GetCount();
+		const GadgetBlock* positions = gadget.Find("POS ");
+		const GadgetBlock* velocities = gadget.Find("VEL ");
+		const GadgetBlock* masses = gadget.Find("MASS");
+		if (!positions || !velocities || total == 0)
+		{
+			error = "missing POS or VEL block in " + path;
+			return false;
+		}
+
+		const size_t precision = static_cast<size_t>(positions->size / (3 * total));
+		if ((precision != 4 && precision != 8) || positions->size != 3 * total * precision || velocities->size != positions->size)
+		{
+			error = "unexpected block sizes in " + path;
+			return false;
+		}
+
+		//Particles of the types without a header mass have one entry each in the MASS block
+		size_t typeBegin[7] = {};
+		size_t massBegin[7] = {};
+		for (int t = 0; t < 6; ++t)
+		{
+			typeBegin[t + 1] = typeBegin[t] + gadget.numParticles[t];
+			massBegin[t + 1] = massBegin[t] + (gadget.massTable[t] == 0.0 ? gadget.numParticles[t] : 0);
+		}
+
+		if (massBegin[6] > 0 && (!masses || masses->size != massBegin[6] * precision))
+		{
+			error = "missing or short MASS block in " + path;
+			return false;
+		}
+
+		const size_t count = (std::min)(total, capacity);
+		result.count = count;
+		result.truncated = total > capacity;
+		std::atomic<bool> failed(false);
+
+		ParallelForRange(0, count, [&](size_t begin, size_t end)
+		{
+			InputFile file(path);
+			std::vector<unsigned char> buffer;
+			if (!file.IsOpen())
+			{
+				failed = true;
+				return;
+			}
+
+			bool ok = ForEachValue(file, positions->offset + 3 * begin * precision, 3 * (end - begin), precision, gadget.swap, options.chunkSize, buffer,
+				[&](size_t k, float value) { SetComponent(bodies[begin + k / 3].position, k % 3, value); });
+
+			ok = ok && ForEachValue(file, velocities->offset + 3 * begin * precision, 3 * (end - begin), precision, gadget.swap, options.chunkSize, buffer,
+				[&](size_t k, float value) { SetComponent(bodies[begin + k / 3].velocity, k % 3, value); });
+
+			for (int t = 0; t < 6 && ok; ++t)
+			{
+				size_t first = (std::max)(begin, typeBegin[t]);
+				size_t last = (std::min)(end, typeBegin[t + 1]);
+				if (first >= last)
+					continue;
+
+				if (gadget.massTable[t] != 0.0)
+				{
+					for (size_t i = first; i < last; ++i)
+						bodies[i].position.w = static_cast<float>(gadget.massTable[t]);
+					continue;
+				}
+
+				size_t massIndex = massBegin[t] + (first - typeBegin[t]);
+				ok = ForEachValue(file, masses->offset + massIndex * precision, last - first, precision, gadget.swap, options.chunkSize, buffer,
+					[&](size_t k, float value) { bodies[first + k].position.w = value; });
+			}
+
+			for (size_t i = begin; i < end; ++i)
+				bodies[i].velocity.w = 1.f;
+
+			if (!ok)
+				failed = true;
+		}, options.numThreads);
+
+		if (failed)
+		{
+			error = "read error in " + path;
+			return false;
+		}
+
+		return true;
+	}
+
+	//
+	//CSV
+	//
+
+	static inline bool IsSeparator(const char & c)
+	{
+		return c == ',' || c == ';' || c == ' ' || c == '\t' || c == '\r';
+	}
+
+	static inline bool IsDigit(const char & c)
+	{
+		return static_cast<unsigned char>(c - '0') < 10;
+	}
+
+	//SWAR check and conversion of eight ASCII digits loaded as one little endian word
+	static inline bool IsEightDigits(const uint64_t & word)
+	{
+		return ((word & 0xF0F0F0F0F0F0F0F0ull) | (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+	}
+
+	static inline uint32_t ParseEightDigits(uint64_t word)
+	{
+		word -= 0x3030303030303030ull;
+		word = (word * 10) + (word >> 8);
+		word = (((word & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) + (((word >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+		return static_cast<uint32_t>(word);
+	}
+
+	static const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+											1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	static inline double ScaleByPowerOfTen(double value, int exponent)
+	{
+		while (exponent > 22)
+		{
+			value *= 1e22;
+			exponent -= 22;
+		}
+
+		while (exponent < -22)
+		{
+			value /= 1e22;
+			exponent += 22;
+		}
+
+		return exponent >= 0 ? value * POWERS_OF_TEN[exponent] : value / POWERS_OF_TEN[-exponent];
+	}
+
+	//Parses a decimal number at p, digits are consumed eight at a time where possible.
+	//Up to 19 significant digits are kept, which is far beyond float precision.
+	static inline bool ParseNumber(const char* & p, const char* end, float & out)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		const char* start = p;
+
+		auto consumeDigits = [&](const bool & fraction)
+		{
+			while (end - p >= 8)
+			{
+				uint64_t word;
+				std::memcpy(&word, p, sizeof(word));
+				if (!IsEightDigits(word) || digits > 11)
+					break;
+
+				mantissa = mantissa * 100000000ull + ParseEightDigits(word);
+				digits += 8;
+				exponent -= fraction ? 8 : 0;
+				p += 8;
+			}
+
+			for (; p < end && IsDigit(*p); ++p)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+					++digits;
+					exponent -= fraction ? 1 : 0;
+				}
+				else if (!fraction)
+					++exponent;
+			}
+		};
+
+		consumeDigits(false);
+		if (p < end && *p == '.')
+		{
+			++p;
+			consumeDigits(true);
+		}
+
+		if (p == start || (p == start + 1 && *start == '.'))
+			return false;
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* q = p + 1;
+			bool negativeExponent = false;
+			if (q < end && (*q == '-' || *q == '+'))
+				negativeExponent = *q++ == '-';
+
+			int value = 0;
+			const char* digitsStart = q;
+			for (; q < end && IsDigit(*q); ++q)
+				value = (std::min)(value * 10 + (*q - '0'), 100000);
+
+			if (q > digitsStart)
+			{
+				exponent += negativeExponent ? -value : value;
+				p = q;
+			}
+		}
+
+		double value = ScaleByPowerOfTen(static_cast<double>(mantissa), exponent);
+		out = static_cast<float>(negative ? -value : value);
+		return true;
+	}
+
+	//Kind of a row, decided from its first significant character
+	static inline bool IsDataRow(const char* p, const char* end)
+	{
+		while (p < end && IsSeparator(*p))
+			++p;
+
+		return p < end && (IsDigit(*p) || *p == '-' || *p == '+' || *p == '.');
+	}
+
+	//Parses the rows starting in [begin, end), the last one may extend to limit
+	static bool ParseRows(const char* begin, const char* end, const char* limit, const float & defaultMass, std::vector<Body> & out)
+	{
+		const char* p = begin;
+		while (p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', limit - p));
+			if (!lineEnd)
+				lineEnd = limit;
+
+			if (IsDataRow(p, lineEnd))
+			{
+				float values[7];
+				int numValues = 0;
+				const char* q = p;
+
+				while (numValues < 7)
+				{
+					while (q < lineEnd && IsSeparator(*q))
+						++q;
+					if (q >= lineEnd || !ParseNumber(q, lineEnd, values[numValues]))
+						break;
+					++numValues;
+				}
+
+				if (numValues < 6)
+					return false;
+
+				Body body;
+				body.position = { values[0], values[1], values[2], numValues > 6 ? values[6] : defaultMass };
+				body.velocity = { values[3], values[4], values[5], 1.f };
+				out.push_back(body);
+			}
+
+			p = lineEnd + 1;
+		}
+
+		return true;
+	}
+
+	//Splits the file into slices, parses a window of slices in parallel and hands the
+	//bodies to sink in file order, so the memory held at once is bounded by the window
+	template<typename Sink>
+	static bool ParseCsv(const std::string & path, const ImportOptions & options, std::string & error, Sink sink)
+	{
+		InputFile file(path);
+		if (!file.IsOpen())
+		{
+			error = "cannot open " + path;
+			return false;
+		}
+
+		const uint64_t fileSize = file.GetSize();
+		const size_t window = options.numThreads > 0 ? options.numThreads : GetWorkerCount();
+		//Every worker in the window holds a chunk, together they stay within an eighth of the memory limit
+		const size_t chunkSize = (std::max)(FitBufferBytes(options.chunkSize * window, 0.125) / window, size_t(4096));
+		const size_t numSlices = static_cast<size_t>((fileSize + chunkSize - 1) / chunkSize);
+
+		std::vector<std::vector<Body>> results(window);
+		std::vector<std::string> buffers(window);
+		std::atomic<bool> failed(false);
+
+		for (size_t firstSlice = 0; firstSlice < numSlices; firstSlice += window)
+		{
+			size_t slices = (std::min)(window, numSlices - firstSlice);
+
+			ParallelFor(0, slices, [&](size_t k)
+			{
+				//A row belongs to the slice its first byte is in: skip the partial row at the
+				//start and read on past the end until the last row is complete
+				uint64_t begin = (firstSlice + k) * chunkSize;
+				uint64_t end = (std::min)(begin + chunkSize, fileSize);
+				uint64_t readBegin = begin > 0 ? begin - 1 : 0;
+
+				InputFile slice(path);
+				std::string & buffer = buffers[k];
+				buffer.resize(static_cast<size_t>(end - readBegin));
+				if (!slice.IsOpen() || !slice.Read(readBegin, &buffer[0], buffer.size()))
+				{
+					failed = true;
+					return;
+				}
+
+				uint64_t tail = end;
+				while (tail < fileSize && buffer.back() != '\n')
+				{
+					size_t extra = static_cast<size_t>((std::min)(uint64_t(4096), fileSize - tail));
+					size_t oldSize = buffer.size();
+					buffer.resize(oldSize + extra);
+					if (!slice.Read(tail, &buffer[oldSize], extra))
+					{
+						failed = true;
+						return;
+					}
+
+					size_t newline = buffer.find('\n', oldSize);
+					if (newline != std::string::npos)
+						buffer.resize(newline + 1);
+					tail += extra;
+				}
+
+				const char* data = buffer.data();
+				const char* limit = data + buffer.size();
+				const char* rowsEnd = data + (end - readBegin);
+				const char* first = data;
+				if (begin > 0)
+				{
+					first = static_cast<const char*>(std::memchr(data, '\n', rowsEnd - data));
+					first = first ? first + 1 : rowsEnd;
+				}
+				else
+				{
+					//A header row has no leading number
+					const char* lineEnd = static_cast<const char*>(std::memchr(data, '\n', limit - data));
+					lineEnd = lineEnd ? lineEnd : limit;
+					const char* p = data;
+					while (p < lineEnd && IsSeparator(*p))
+						++p;
+					if (p < lineEnd && *p != '#' && !IsDataRow(p, lineEnd))
+						first = (std::min)(lineEnd + 1, limit);
+				}
+
+				results[k].clear();
+				if (!ParseRows(first, rowsEnd, limit, options.defaultMass, results[k]))
+					failed = true;
+			}, options.numThreads);
+
+			if (failed)
+			{
+				error = "read or parse error in " + path;
+				return false;
+			}
+
+			for (size_t k = 0; k < slices; ++k)
+			{
+				if (!sink(results[k].data(), results[k].size()))
+					return true;
+			}
+		}
+
+		return true;
+	}
+
+	bool GetCsvBodyCount(const std::string & path, size_t & count, std::string & error, const ImportOptions & options)
+	{
+		count = 0;
+		return ParseCsv(path, options, error, [&count](const Body*, const size_t & n)
+		{
+			count += n;
+			return true;
+		});
+	}
+
+	bool ImportCsv(const std::string & path, Body* bodies, const size_t & capacity, ImportResult & result, std::string & error, const ImportOptions & options)
+	{
+		result = ImportResult();
+		return ParseCsv(path, options, error, [&](const Body* batch, const size_t & n)
+		{
+			//Reading stops at the first body past the capacity, so a file that fits exactly is not truncated
+			size_t copied = (std::min)(n, capacity - result.count);
+			std::memcpy(bodies + result.count, batch, copied * sizeof(Body));
+			result.count += copied;
+			result.truncated = copied < n;
+			return !result.truncated;
+		});
+	}
+
+	bool ImportBodies(const std::string & path, Body* bodies, const size_t & capacity, ImportResult & result, std::string & error, const ImportOptions & options)
+	{
+		if (HasExtension(path, ".csv") || HasExtension(path, ".txt"))
+			return ImportCsv(path, bodies, capacity, result, error, options);
+
+		return ImportGadget(path, bodies, capacity, result, error, options);
+	}
+
+	bool ImportBodies(const std::string & path, BodyArray & bodies, std::string & error, const ImportOptions & options)
+	{
+		bodies.clear();
+
+		if (HasExtension(path, ".csv") || HasExtension(path, ".txt"))
+		{
+			return ParseCsv(path, options, error, [&bodies](const Body* batch, const size_t & n)
+			{
+				bodies.insert(bodies.end(), batch, batch + n);
+				return true;
+			});
+		}
+
+		size_t total;
+		ImportResult result;
+		if (!GetGadgetBodyCount(path, total, error))
+			return false;
+
+		bodies.resize(total);
+		return ImportGadget(path, bodies.data(), total, result, error, options);
+	}
+}
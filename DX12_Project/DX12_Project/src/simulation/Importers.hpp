@@ -0,0 +1,36 @@
+#pragma once
+#include <simulation/Body.hpp>
+#include <string>
+
+//Loaders for initial conditions produced elsewhere. Both formats are read in parallel
+//slices straight into Body (= BodyData) layout, so the result can be uploaded as is.
+namespace dx
+{
+	struct ImportOptions
+	{
+		unsigned int numThreads = 0;				//0 uses every worker
+		size_t chunkSize = size_t(16) << 20;		//Bytes read per call by each worker
+		float defaultMass = 1.f;					//Used when the file carries no masses
+	};
+
+	struct ImportResult
+	{
+		size_t count = 0;							//Bodies written
+		bool truncated = false;						//The file holds more bodies than the capacity
+	};
+
+	//Gadget snapshot (format 1 or 2, either endianness, float or double blocks). All
+	//particle types are loaded in file order, masses come from the MASS block or the
+	//header mass table. Only single-file snapshots are supported.
+	bool GetGadgetBodyCount(const std::string & path, size_t & count, std::string & error);
+	bool ImportGadget(const std::string & path, Body* bodies, const size_t & capacity, ImportResult & result, std::string & error, const ImportOptions & options = ImportOptions());
+
+	//Text file with one body per row: x y z vx vy vz [mass], separated by commas, semicolons,
+	//tabs or spaces. A leading header row and lines starting with '#' are skipped.
+	bool GetCsvBodyCount(const std::string & path, size_t & count, std::string & error, const ImportOptions & options = ImportOptions());
+	bool ImportCsv(const std::string & path, Body* bodies, const size_t & capacity, ImportResult & result, std::string & error, const ImportOptions & options = ImportOptions());
+
+	//Picks the format from the extension (.csv and .txt are text, everything else Gadget)
+	bool ImportBodies(const std::string & path, Body* bodies, const size_t & capacity, ImportResult & result, std::string & error, const ImportOptions & options = ImportOptions());
+	bool ImportBodies(const std::string & path, BodyArray & bodies, std::string & error, const ImportOptions & options = ImportOptions());
+}
@@ -0,0 +1,54 @@
+#include <simulation/InitialConditions.hpp>
+#include <cmath>
+#include <random>
+
+namespace dx
+{
+	BodyArray GenerateShellBodies(const size_t & numBodies, const float & clusterScale, const float & velocityScale, const unsigned int & seed)
+	{
+		BodyArray bodies(numBodies);
+		std::mt19937 generator(seed);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+		float vscale = clusterScale * velocityScale;
+		float inner = 2.5f * clusterScale;
+		float outer = 4.0f * clusterScale;
+
+		for (size_t i = 0; i < numBodies; ++i)
+		{
+			//Random direction, same normalization of (x, y, z, 1) as the GPU version
+			float x = unit(generator) * 2 - 1;
+			float y = unit(generator) * 2 - 1;
+			float z = unit(generator) * 2 - 1;
+			float length = std::sqrt(x * x + y * y + z * z + 1.f);
+			x /= length;
+			y /= length;
+			z /= length;
+
+			//Init positions
+			x *= (inner + (outer - inner) * unit(generator));
+			y *= (inner + (outer - inner) * unit(generator));
+			z *= (inner + (outer - inner) * unit(generator));
+			bodies[i].position = { x, y, z, 1.f };
+
+			//Init velocities, rotation around the z axis
+			float ax = 0.f, ay = 0.f, az = 1.f;
+			if (1.f - (x * ax + y * ay + z * az) < 1e-6f)
+			{
+				ax = y;
+				ay = x;
+				float axisLength = std::sqrt(ax * ax + ay * ay + az * az);
+				ax /= axisLength;
+				ay /= axisLength;
+				az /= axisLength;
+			}
+
+			float vx = y * az - z * ay;
+			float vy = z * ax - x * az;
+			float vz = x * ay - y * ax;
+			bodies[i].velocity = { vx * vscale, vy * vscale, vz * vscale, 1.f };
+		}
+
+		return bodies;
+	}
+}
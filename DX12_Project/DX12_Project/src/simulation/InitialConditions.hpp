@@ -0,0 +1,10 @@
+#pragma once
+#include <simulation/Body.hpp>
+
+namespace dx
+{
+	//Portable version of NBody::InitializeBodies, a rotating spherical shell of unit mass bodies.
+	//Uses its own deterministic generator so CPU runs can be reproduced on any platform.
+	BodyArray GenerateShellBodies(const size_t & numBodies, const float & clusterScale = 1.54f, const float & velocityScale = 8.0f,
+								  const unsigned int & seed = 1);
+}
@@ -0,0 +1,472 @@
+#include <simulation/KSRegularization.hpp>
+#include <utils/ParallelFor.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace dx
+{
+	static const double PI = 3.14159265358979323846;
+	static const int MAX_KS_STEPS = 1 << 16;
+
+	//First three rows of the KS matrix L(u) applied to a 4-vector
+	static void ApplyL(const double u[4], const double w[4], double out[3])
+	{
+		out[0] = u[0] * w[0] - u[1] * w[1] - u[2] * w[2] + u[3] * w[3];
+		out[1] = u[1] * w[0] + u[0] * w[1] - u[3] * w[2] - u[2] * w[3];
+		out[2] = u[2] * w[0] + u[3] * w[1] + u[0] * w[2] + u[1] * w[3];
+	}
+
+	//Transpose of L(u) applied to the 3-vector (a, 0)
+	static void ApplyLT(const double u[4], const double a[3], double out[4])
+	{
+		out[0] = u[0] * a[0] + u[1] * a[1] + u[2] * a[2];
+		out[1] = -u[1] * a[0] + u[0] * a[1] + u[3] * a[2];
+		out[2] = -u[2] * a[0] - u[3] * a[1] + u[0] * a[2];
+		out[3] = u[3] * a[0] - u[2] * a[1] + u[1] * a[2];
+	}
+
+	void ToKS(const double r[3], const double v[3], const double & mass, KSState & state)
+	{
+		double distance = std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+		double* u = state.u;
+
+		//Pick the branch that avoids dividing by a small component
+		if (r[0] >= 0.0)
+		{
+			u[0] = std::sqrt(0.5 * (distance + r[0]));
+			u[1] = r[1] / (2.0 * u[0]);
+			u[2] = r[2] / (2.0 * u[0]);
+			u[3] = 0.0;
+		}
+		else
+		{
+			u[1] = std::sqrt(0.5 * (distance - r[0]));
+			u[0] = r[1] / (2.0 * u[1]);
+			u[3] = r[2] / (2.0 * u[1]);
+			u[2] = 0.0;
+		}
+
+		ApplyLT(u, v, state.up);
+		for (int k = 0; k < 4; ++k)
+			state.up[k] *= 0.5;
+
+		double upSquared = 0.0;
+		for (int k = 0; k < 4; ++k)
+			upSquared += state.up[k] * state.up[k];
+
+		state.mass = mass;
+		state.energy = (2.0 * upSquared - mass) / distance;
+	}
+
+	void FromKS(const KSState & state, double r[3], double v[3])
+	{
+		ApplyL(state.u, state.u, r);
+		ApplyL(state.u, state.up, v);
+
+		double distance = 0.0;
+		for (int k = 0; k < 4; ++k)
+			distance += state.u[k] * state.u[k];
+
+		for (int k = 0; k < 3; ++k)
+			v[k] *= 2.0 / distance;
+	}
+
+	//d/ds of (u, u', h, t)
+	static void Derivative(const double y[10], const double perturbation[3], double dy[10])
+	{
+		const double* u = y;
+		const double* up = y + 4;
+		const double h = y[8];
+		const double distance = u[0] * u[0] + u[1] * u[1] + u[2] * u[2] + u[3] * u[3];
+
+		double force[4];
+		ApplyLT(u, perturbation, force);
+
+		double power = 0.0;
+		for (int k = 0; k < 4; ++k)
+		{
+			dy[k] = up[k];
+			dy[4 + k] = 0.5 * h * u[k] + 0.5 * distance * force[k];
+			power += up[k] * force[k];
+		}
+
+		dy[8] = 2.0 * power;
+		dy[9] = distance;
+	}
+
+	static void RungeKutta4(double y[10], const double & ds, const double perturbation[3])
+	{
+		double k1[10], k2[10], k3[10], k4[10], temp[10];
+
+		Derivative(y, perturbation, k1);
+		for (int k = 0; k < 10; ++k)
+			temp[k] = y[k] + 0.5 * ds * k1[k];
+
+		Derivative(temp, perturbation, k2);
+		for (int k = 0; k < 10; ++k)
+			temp[k] = y[k] + 0.5 * ds * k2[k];
+
+		Derivative(temp, perturbation, k3);
+		for (int k = 0; k < 10; ++k)
+			temp[k] = y[k] + ds * k3[k];
+
+		Derivative(temp, perturbation, k4);
+		for (int k = 0; k < 10; ++k)
+			y[k] += ds / 6.0 * (k1[k] + 2.0 * k2[k] + 2.0 * k3[k] + k4[k]);
+	}
+
+	void AdvanceKS(KSState & state, const double & dt, const double perturbation[3], const unsigned int & stepsPerOrbit)
+	{
+		double y[10];
+		std::copy(state.u, state.u + 4, y);
+		std::copy(state.up, state.up + 4, y + 4);
+		y[8] = state.energy;
+		y[9] = 0.0;
+
+		//The unperturbed oscillator has frequency sqrt(-h/2) in s, unbound pairs fall back to dt
+		double distance = y[0] * y[0] + y[1] * y[1] + y[2] * y[2] + y[3] * y[3];
+		double nominal = state.energy < 0.0 ? 2.0 * PI / std::sqrt(-0.5 * state.energy) / stepsPerOrbit : dt / (distance * stepsPerOrbit);
+
+		//Step until the physical time reaches dt. The last steps are sized from the remaining
+		//time and the current separation and may go backwards after an overshoot, which
+		//converges like a Newton iteration on t(s) = dt since dt/ds = |r|.
+		for (int i = 0; i < MAX_KS_STEPS; ++i)
+		{
+			double remaining = dt - y[9];
+			if (std::fabs(remaining) <= dt * 1e-12)
+				break;
+
+			distance = y[0] * y[0] + y[1] * y[1] + y[2] * y[2] + y[3] * y[3];
+			double ds = remaining / distance;
+			RungeKutta4(y, ds > 0.0 ? (std::min)(nominal, ds) : (std::max)(-nominal, ds), perturbation);
+		}
+
+		std::copy(y, y + 4, state.u);
+		std::copy(y + 4, y + 8, state.up);
+		state.energy = y[8];
+	}
+
+	KSRegularizedNBody::KSRegularizedNBody(const BodyArray & bodies, const SimulationParams & params, const RegularizationSettings & settings) : m_params(params),
+										   m_settings(settings), m_neighbors(settings.captureRadius, settings.captureRadius)
+	{
+		SetBodies(bodies);
+	}
+
+	void KSRegularizedNBody::SetBodies(const BodyArray & bodies)
+	{
+		m_bodies = bodies;
+		m_accelerations.assign(bodies.size(), { 0.f, 0.f, 0.f, 0.f });
+		m_pairs.clear();
+		m_pairOf.assign(bodies.size(), -1);
+		CapturePairs();
+	}
+
+	void KSRegularizedNBody::BuildParticles()
+	{
+		m_singles.clear();
+		for (uint32_t i = 0; i < m_bodies.size(); ++i)
+		{
+			if (m_pairOf[i] < 0)
+				m_singles.push_back(i);
+		}
+
+		m_particles.resize(m_singles.size() + m_pairs.size());
+		for (size_t k = 0; k < m_singles.size(); ++k)
+		{
+			const Body & body = m_bodies[m_singles[k]];
+			Particle & particle = m_particles[k];
+			particle.position[0] = body.position.x;
+			particle.position[1] = body.position.y;
+			particle.position[2] = body.position.z;
+			particle.velocity[0] = body.velocity.x;
+			particle.velocity[1] = body.velocity.y;
+			particle.velocity[2] = body.velocity.z;
+			particle.mass = body.position.w;
+		}
+
+		for (size_t k = 0; k < m_pairs.size(); ++k)
+		{
+			const Body & a = m_bodies[m_pairs[k].first];
+			const Body & b = m_bodies[m_pairs[k].second];
+			double ma = a.position.w, mb = b.position.w, mass = ma + mb;
+
+			Particle & particle = m_particles[m_singles.size() + k];
+			particle.position[0] = (ma * a.position.x + mb * b.position.x) / mass;
+			particle.position[1] = (ma * a.position.y + mb * b.position.y) / mass;
+			particle.position[2] = (ma * a.position.z + mb * b.position.z) / mass;
+			particle.velocity[0] = (ma * a.velocity.x + mb * b.velocity.x) / mass;
+			particle.velocity[1] = (ma * a.velocity.y + mb * b.velocity.y) / mass;
+			particle.velocity[2] = (ma * a.velocity.z + mb * b.velocity.z) / mass;
+			particle.mass = mass;
+		}
+	}
+
+	//Acceleration at p caused by every particle except the one at index skip
+	void KSRegularizedNBody::ExternalAcceleration(const size_t & skip, const double p[3], double a[3]) const
+	{
+		const double softening = m_params.softeningSquared;
+		a[0] = a[1] = a[2] = 0.0;
+
+		for (size_t j = 0; j < m_particles.size(); ++j)
+		{
+			if (j == skip)
+				continue;
+
+			const Particle & other = m_particles[j];
+			double rx = other.position[0] - p[0];
+			double ry = other.position[1] - p[1];
+			double rz = other.position[2] - p[2];
+			double distSqr = rx * rx + ry * ry + rz * rz + softening;
+			double invDist = 1.0 / std::sqrt(distSqr);
+			double s = other.mass * invDist * invDist * invDist;
+			a[0] += rx * s;
+			a[1] += ry * s;
+			a[2] += rz * s;
+		}
+	}
+
+	void KSRegularizedNBody::ComputeAccelerations()
+	{
+		const size_t numSingles = m_singles.size();
+		m_particleAccelerations.resize(3 * m_particles.size());
+
+		ParallelFor(0, m_particles.size(), [&](size_t k)
+		{
+			double* a = &m_particleAccelerations[3 * k];
+
+			if (k < numSingles)
+			{
+				ExternalAcceleration(k, m_particles[k].position, a);
+				Float4 & out = m_accelerations[m_singles[k]];
+				out = { static_cast<float>(a[0]), static_cast<float>(a[1]), static_cast<float>(a[2]), 0.f };
+				return;
+			}
+
+			//The tidal field is evaluated at both components, the composite moves with
+			//their mass-weighted mean and the pair feels the difference
+			Pair & pair = m_pairs[k - numSingles];
+			double r[3], v[3];
+			FromKS(pair.state, r, v);
+
+			const Particle & com = m_particles[k];
+			double ma = m_bodies[pair.first].position.w, mb = m_bodies[pair.second].position.w;
+			double pa[3], pb[3], aa[3], ab[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				pa[c] = com.position[c] - mb / com.mass * r[c];
+				pb[c] = com.position[c] + ma / com.mass * r[c];
+			}
+
+			ExternalAcceleration(k, pa, aa);
+			ExternalAcceleration(k, pb, ab);
+
+			double distance = std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+			double internal = 1.0 / (distance * distance * distance);
+			for (int c = 0; c < 3; ++c)
+			{
+				a[c] = (ma * aa[c] + mb * ab[c]) / com.mass;
+				pair.perturbation[c] = ab[c] - aa[c];
+				aa[c] += mb * r[c] * internal;
+				ab[c] -= ma * r[c] * internal;
+			}
+
+			m_accelerations[pair.first] = { static_cast<float>(aa[0]), static_cast<float>(aa[1]), static_cast<float>(aa[2]), 0.f };
+			m_accelerations[pair.second] = { static_cast<float>(ab[0]), static_cast<float>(ab[1]), static_cast<float>(ab[2]), 0.f };
+		});
+	}
+
+	void KSRegularizedNBody::Step()
+	{
+		const double dt = m_params.timestep;
+
+		BuildParticles();
+		ComputeAccelerations();
+
+		//Same kick-drift update as CS_MAIN for singles and centres of mass
+		ParallelFor(0, m_particles.size(), [&](size_t k)
+		{
+			Particle & particle = m_particles[k];
+			for (int c = 0; c < 3; ++c)
+			{
+				particle.velocity[c] += m_particleAccelerations[3 * k + c] * dt;
+				particle.position[c] += particle.velocity[c] * dt;
+			}
+		});
+
+		ParallelFor(0, m_pairs.size(), [&](size_t k)
+		{
+			AdvanceKS(m_pairs[k].state, dt, m_pairs[k].perturbation, m_settings.stepsPerOrbit);
+		});
+
+		WriteBack();
+		DissolvePairs();
+		CapturePairs();
+	}
+
+	void KSRegularizedNBody::WriteBack()
+	{
+		for (size_t k = 0; k < m_singles.size(); ++k)
+		{
+			const Particle & particle = m_particles[k];
+			Body & body = m_bodies[m_singles[k]];
+			body.position.x = static_cast<float>(particle.position[0]);
+			body.position.y = static_cast<float>(particle.position[1]);
+			body.position.z = static_cast<float>(particle.position[2]);
+			body.velocity.x = static_cast<float>(particle.velocity[0]);
+			body.velocity.y = static_cast<float>(particle.velocity[1]);
+			body.velocity.z = static_cast<float>(particle.velocity[2]);
+		}
+
+		for (size_t k = 0; k < m_pairs.size(); ++k)
+		{
+			const Particle & com = m_particles[m_singles.size() + k];
+			Body & a = m_bodies[m_pairs[k].first];
+			Body & b = m_bodies[m_pairs[k].second];
+			double fa = b.position.w / com.mass, fb = a.position.w / com.mass;
+
+			double r[3], v[3];
+			FromKS(m_pairs[k].state, r, v);
+
+			a.position.x = static_cast<float>(com.position[0] - fa * r[0]);
+			a.position.y = static_cast<float>(com.position[1] - fa * r[1]);
+			a.position.z = static_cast<float>(com.position[2] - fa * r[2]);
+			a.velocity.x = static_cast<float>(com.velocity[0] - fa * v[0]);
+			a.velocity.y = static_cast<float>(com.velocity[1] - fa * v[1]);
+			a.velocity.z = static_cast<float>(com.velocity[2] - fa * v[2]);
+			b.position.x = static_cast<float>(com.position[0] + fb * r[0]);
+			b.position.y = static_cast<float>(com.position[1] + fb * r[1]);
+			b.position.z = static_cast<float>(com.position[2] + fb * r[2]);
+			b.velocity.x = static_cast<float>(com.velocity[0] + fb * v[0]);
+			b.velocity.y = static_cast<float>(com.velocity[1] + fb * v[1]);
+			b.velocity.z = static_cast<float>(com.velocity[2] + fb * v[2]);
+		}
+	}
+
+	void KSRegularizedNBody::DissolvePairs()
+	{
+		for (size_t k = 0; k < m_pairs.size();)
+		{
+			const Pair & pair = m_pairs[k];
+			const KSState & state = pair.state;
+			double distance = state.u[0] * state.u[0] + state.u[1] * state.u[1] + state.u[2] * state.u[2] + state.u[3] * state.u[3];
+			double tidal = std::sqrt(pair.perturbation[0] * pair.perturbation[0] + pair.perturbation[1] * pair.perturbation[1] + pair.perturbation[2] * pair.perturbation[2]);
+			double gamma = tidal * distance * distance / state.mass;
+
+			if (distance > m_settings.dissolveRadius || state.energy >= 0.0 || gamma > m_settings.maxPerturbation)
+			{
+				m_pairOf[pair.first] = -1;
+				m_pairOf[pair.second] = -1;
+				m_pairs[k] = m_pairs.back();
+				m_pairs.pop_back();
+				++m_numDissolves;
+				continue;
+			}
+
+			++k;
+		}
+
+		for (size_t k = 0; k < m_pairs.size(); ++k)
+		{
+			m_pairOf[m_pairs[k].first] = static_cast<int32_t>(k);
+			m_pairOf[m_pairs[k].second] = static_cast<int32_t>(k);
+		}
+	}
+
+	void KSRegularizedNBody::CapturePairs()
+	{
+		const size_t n = m_bodies.size();
+		const float captureSquared = m_settings.captureRadius * m_settings.captureRadius;
+		m_neighbors.Update(m_bodies);
+
+		//Nearest unpaired neighbour within the capture radius, if any
+		std::vector<int32_t> nearest(n, -1);
+		ParallelFor(0, n, [&](size_t i)
+		{
+			if (m_pairOf[i] >= 0)
+				return;
+
+			const Float4 & p = m_bodies[i].position;
+			float best = captureSquared;
+			size_t count;
+			const uint32_t* neighbors = m_neighbors.GetNeighbors(i, count);
+
+			for (size_t k = 0; k < count; ++k)
+			{
+				uint32_t j = neighbors[k];
+				if (m_pairOf[j] >= 0)
+					continue;
+
+				const Float4 & q = m_bodies[j].position;
+				float dx = q.x - p.x, dy = q.y - p.y, dz = q.z - p.z;
+				float distSqr = dx * dx + dy * dy + dz * dz;
+				if (distSqr < best)
+				{
+					best = distSqr;
+					nearest[i] = static_cast<int32_t>(j);
+				}
+			}
+		});
+
+		//Mutual nearest neighbours that are bound become a pair
+		for (size_t i = 0; i < n; ++i)
+		{
+			int32_t j = nearest[i];
+			if (j < 0 || static_cast<size_t>(j) <= i || nearest[j] != static_cast<int32_t>(i))
+				continue;
+
+			const Body & a = m_bodies[i];
+			const Body & b = m_bodies[j];
+			double r[3] = { static_cast<double>(b.position.x) - a.position.x, static_cast<double>(b.position.y) - a.position.y, static_cast<double>(b.position.z) - a.position.z };
+			double v[3] = { static_cast<double>(b.velocity.x) - a.velocity.x, static_cast<double>(b.velocity.y) - a.velocity.y, static_cast<double>(b.velocity.z) - a.velocity.z };
+
+			Pair pair;
+			pair.first = static_cast<uint32_t>(i);
+			pair.second = static_cast<uint32_t>(j);
+			pair.perturbation[0] = pair.perturbation[1] = pair.perturbation[2] = 0.0;
+			ToKS(r, v, static_cast<double>(a.position.w) + b.position.w, pair.state);
+
+			if (pair.state.energy >= 0.0)
+				continue;
+
+			m_pairOf[i] = static_cast<int32_t>(m_pairs.size());
+			m_pairOf[j] = static_cast<int32_t>(m_pairs.size());
+			m_pairs.push_back(pair);
+			++m_numCaptures;
+		}
+	}
+
+	BodyArray KSRegularizedNBody::GetBodies() const
+	{
+		return m_bodies;
+	}
+
+	const std::vector<Float4> & KSRegularizedNBody::GetAccelerations() const
+	{
+		return m_accelerations;
+	}
+
+	const SimulationParams & KSRegularizedNBody::GetParams() const
+	{
+		return m_params;
+	}
+
+	std::string KSRegularizedNBody::GetName() const
+	{
+		return "ks";
+	}
+
+	size_t KSRegularizedNBody::GetNumPairs() const
+	{
+		return m_pairs.size();
+	}
+
+	uint64_t KSRegularizedNBody::GetNumCaptures() const
+	{
+		return m_numCaptures;
+	}
+
+	uint64_t KSRegularizedNBody::GetNumDissolves() const
+	{
+		return m_numDissolves;
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <simulation/Engine.hpp>
+#include <simulation/NeighborList.hpp>
+
+namespace dx
+{
+	//Relative motion of a binary in Kustaanheimo-Stiefel coordinates. The 4D vector u maps
+	//to the separation r = L(u) u with |r| = u.u and the fictitious time s with dt = |r| ds
+	//turns the Kepler problem into a harmonic oscillator, u'' = h/2 u, which stays smooth
+	//through arbitrarily close pericentre passages.
+	struct KSState
+	{
+		double u[4];
+		double up[4];		//du/ds
+		double energy;		//Binding energy per reduced mass h, negative while bound
+		double mass;		//m1 + m2
+	};
+
+	void ToKS(const double r[3], const double v[3], const double & mass, KSState & state);
+	void FromKS(const KSState & state, double r[3], double v[3]);
+
+	//Advances the relative motion by dt of physical time under a constant relative perturbing
+	//acceleration, integrating in s with RK4 at stepsPerOrbit steps per unperturbed period
+	void AdvanceKS(KSState & state, const double & dt, const double perturbation[3], const unsigned int & stepsPerOrbit);
+
+	struct RegularizationSettings
+	{
+		float captureRadius = 0.02f;		//Bound mutual nearest neighbours closer than this are regularized
+		float dissolveRadius = 0.04f;		//Pairs wider than this go back to the direct integration
+		float maxPerturbation = 0.05f;		//Dissolve when |P| r^2 / M exceeds this
+		unsigned int stepsPerOrbit = 64;
+	};
+
+	//Direct-sum engine that replaces tight bound pairs by composite particles at their centre
+	//of mass. The rest of the system, and the pair itself, only see the composite, while the
+	//internal motion is integrated in KS coordinates perturbed by the tidal field of the
+	//others. Pairs are dissolved again once they widen, become unbound or are perturbed too
+	//strongly, so the global step no longer has to resolve close encounters.
+	class KSRegularizedNBody : public Engine
+	{
+	public:
+		KSRegularizedNBody(const BodyArray & bodies, const SimulationParams & params, const RegularizationSettings & settings = RegularizationSettings());
+		void Step() override;
+
+	public:
+		void SetBodies(const BodyArray & bodies) override;
+		BodyArray GetBodies() const override;
+		const std::vector<Float4> & GetAccelerations() const override;
+		const SimulationParams & GetParams() const override;
+		std::string GetName() const override;
+
+	public:
+		size_t GetNumPairs() const;
+		uint64_t GetNumCaptures() const;
+		uint64_t GetNumDissolves() const;
+
+	private:
+		struct Pair
+		{
+			uint32_t first;
+			uint32_t second;
+			KSState state;
+			double perturbation[3];
+		};
+
+		struct Particle
+		{
+			double position[3];
+			double velocity[3];
+			double mass;
+		};
+
+	private:
+		void BuildParticles();
+		void ComputeAccelerations();
+		void ExternalAcceleration(const size_t & skip, const double p[3], double a[3]) const;
+		void WriteBack();
+		void DissolvePairs();
+		void CapturePairs();
+
+	private:
+		BodyArray m_bodies;
+		std::vector<Float4> m_accelerations;
+		SimulationParams m_params;
+		RegularizationSettings m_settings;
+		NeighborList m_neighbors;
+
+		std::vector<Pair> m_pairs;
+		std::vector<int32_t> m_pairOf;		//Pair index per body, -1 for singles
+
+		//Singles first, then one composite per pair
+		std::vector<Particle> m_particles;
+		std::vector<uint32_t> m_singles;
+		std::vector<double> m_particleAccelerations;
+
+		uint64_t m_numCaptures = 0;
+		uint64_t m_numDissolves = 0;
+	};
+}
@@ -0,0 +1,92 @@
+#include <simulation/LockstepValidator.hpp>
+#include <assert.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace dx
+{
+	LockstepValidator::LockstepValidator(Engine* reference, Engine* candidate, const unsigned int & energyInterval) : m_energyInterval(energyInterval),
+										 m_step(0), m_numBodies(0)
+	{
+		m_engines[0] = reference;
+		m_engines[1] = candidate;
+		m_initialEnergy[0] = m_initialEnergy[1] = 0.0;
+	}
+
+	void LockstepValidator::Reset(const BodyArray & bodies)
+	{
+		m_step = 0;
+		m_numBodies = bodies.size();
+
+		for (int i = 0; i < 2; ++i)
+		{
+			m_engines[i]->SetBodies(bodies);
+			m_initialEnergy[i] = ComputeEnergy(m_engines[i]->GetBodies(), m_engines[i]->GetParams().softeningSquared).GetTotal();
+		}
+	}
+
+	double LockstepValidator::TimeStep(Engine* engine) const
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		engine->Step();
+		auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	LockstepReport LockstepValidator::Step()
+	{
+		LockstepReport report;
+		report.step = ++m_step;
+
+		//Backends are stepped one after another so their timings do not compete for cores
+		for (int i = 0; i < 2; ++i)
+		{
+			report.stepMs[i] = TimeStep(m_engines[i]);
+			report.interactionsPerSecond[i] = static_cast<double>(m_numBodies) * m_numBodies / (report.stepMs[i] * 1e-3);
+		}
+
+		BodyArray reference = m_engines[0]->GetBodies();
+		BodyArray candidate = m_engines[1]->GetBodies();
+		assert(reference.size() == candidate.size());
+
+		report.position = ComputePositionDivergence(reference, candidate);
+		report.acceleration = ComputeVectorDivergence(m_engines[0]->GetAccelerations(), m_engines[1]->GetAccelerations());
+
+		//Energy is O(N^2), only sample it every few steps
+		bool sampleEnergy = m_energyInterval > 0 && m_step % m_energyInterval == 0;
+		for (int i = 0; i < 2; ++i)
+		{
+			report.energyDrift[i] = -1.0;
+			if (sampleEnergy)
+			{
+				double energy = ComputeEnergy(i == 0 ? reference : candidate, m_engines[i]->GetParams().softeningSquared).GetTotal();
+				report.energyDrift[i] = std::abs(energy - m_initialEnergy[i]) / std::abs(m_initialEnergy[i]);
+			}
+		}
+
+		return report;
+	}
+
+	void LockstepValidator::PrintHeader()
+	{
+		std::printf("%6s %11s %11s %11s %11s %11s %11s %10s %10s %9s %9s\n", "step", "pos max", "pos rms", "acc max", "acc rms",
+					"dE ref", "dE cand", "ms ref", "ms cand", "Gi/s ref", "Gi/s cand");
+	}
+
+	void LockstepValidator::Print(const LockstepReport & report)
+	{
+		char energy[2][16];
+		for (int i = 0; i < 2; ++i)
+		{
+			if (report.energyDrift[i] >= 0.0)
+				std::snprintf(energy[i], sizeof(energy[i]), "%11.3e", report.energyDrift[i]);
+			else
+				std::snprintf(energy[i], sizeof(energy[i]), "%11s", "-");
+		}
+
+		std::printf("%6llu %11.3e %11.3e %11.3e %11.3e %s %s %10.3f %10.3f %9.3f %9.3f\n", static_cast<unsigned long long>(report.step),
+					report.position.maxError, report.position.rmsError, report.acceleration.maxError, report.acceleration.rmsError,
+					energy[0], energy[1], report.stepMs[0], report.stepMs[1], report.interactionsPerSecond[0] * 1e-9, report.interactionsPerSecond[1] * 1e-9);
+	}
+}
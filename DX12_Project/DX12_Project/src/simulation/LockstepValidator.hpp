@@ -0,0 +1,41 @@
+#pragma once
+#include <simulation/Diagnostics.hpp>
+#include <simulation/Engine.hpp>
+
+namespace dx
+{
+	struct LockstepReport
+	{
+		uint64_t step;
+		DivergenceReport position;
+		DivergenceReport acceleration;
+		double energyDrift[2];			//|E - E0| / |E0| per backend, negative when not sampled this step
+		double stepMs[2];
+		double interactionsPerSecond[2];
+	};
+
+	//Runs two backends step by step from the same initial conditions and reports how far
+	//apart they drift, together with the throughput of each, so that every faster backend
+	//comes with an accuracy number against the reference
+	class LockstepValidator
+	{
+	public:
+		LockstepValidator(Engine* reference, Engine* candidate, const unsigned int & energyInterval = 10);
+		void Reset(const BodyArray & bodies);
+		LockstepReport Step();
+
+	public:
+		static void PrintHeader();
+		static void Print(const LockstepReport & report);
+
+	private:
+		double TimeStep(Engine* engine) const;
+
+	private:
+		Engine* m_engines[2];
+		double m_initialEnergy[2];
+		unsigned int m_energyInterval;
+		uint64_t m_step;
+		size_t m_numBodies;
+	};
+}
@@ -0,0 +1,550 @@
+#include <simulation/Multigrid.hpp>
+#include <utils/ParallelFor.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace dx
+{
+	static const float PI = 3.14159265358979f;
+
+	void PoissonGrid::Resize(const unsigned int & nodes)
+	{
+		n = nodes;
+		phi.assign(size_t(n) * n * n, 0.f);
+		rhs.assign(size_t(n) * n * n, 0.f);
+	}
+
+	MultigridPoisson::MultigridPoisson(const unsigned int & preSmooth, const unsigned int & postSmooth) : m_preSmooth(preSmooth), m_postSmooth(postSmooth)
+	{
+	}
+
+	MultigridReport MultigridPoisson::Solve(PoissonGrid & grid, const unsigned int & maxCycles, const float & tolerance)
+	{
+		Prepare(grid);
+
+		//The finest level works on the grid's own arrays
+		Level & finest = m_levels[0];
+		finest.spacing = grid.spacing;
+		finest.u.swap(grid.phi);
+		finest.f.swap(grid.rhs);
+
+		float scale = 0.f;
+		for (const float & value : finest.f)
+			scale = (std::max)(scale, std::fabs(value));
+		if (scale == 0.f)
+			scale = 1.f;
+
+		MultigridReport report = { 0, Residual(finest) / scale };
+		while (report.cycles < maxCycles && report.residual > tolerance)
+		{
+			Cycle(0);
+			report.residual = Residual(finest) / scale;
+			++report.cycles;
+		}
+
+		finest.u.swap(grid.phi);
+		finest.f.swap(grid.rhs);
+		return report;
+	}
+
+	void MultigridPoisson::Prepare(const PoissonGrid & grid)
+	{
+		if (!m_levels.empty() && m_levels[0].n == grid.n)
+			return;
+
+		m_levels.clear();
+		for (unsigned int n = grid.n; n >= 3; n = (n - 1) / 2 + 1)
+		{
+			Level level;
+			level.n = n;
+			level.spacing = 0.f;
+			if (!m_levels.empty())
+			{
+				level.u.assign(size_t(n) * n * n, 0.f);
+				level.f.assign(size_t(n) * n * n, 0.f);
+			}
+			level.r.assign(size_t(n) * n * n, 0.f);
+			m_levels.push_back(std::move(level));
+
+			if (n == 3)
+				break;
+		}
+	}
+
+	void MultigridPoisson::Cycle(const size_t & index)
+	{
+		Level & level = m_levels[index];
+		if (index + 1 == m_levels.size())
+		{
+			//A single interior node, one sweep solves it
+			Smooth(level, 1);
+			return;
+		}
+
+		Level & coarse = m_levels[index + 1];
+		coarse.spacing = 2.f * level.spacing;
+
+		Smooth(level, m_preSmooth);
+		Residual(level);
+		Restrict(level, coarse);
+		std::fill(coarse.u.begin(), coarse.u.end(), 0.f);
+		Cycle(index + 1);
+		Prolong(coarse, level);
+		Smooth(level, m_postSmooth);
+	}
+
+	void MultigridPoisson::Smooth(Level & level, const unsigned int & sweeps)
+	{
+		const unsigned int n = level.n;
+		const ptrdiff_t row = n, plane = row * n;
+		const float h2 = level.spacing * level.spacing;
+		const float sixth = 1.f / 6.f;
+
+		for (unsigned int sweep = 0; sweep < sweeps; ++sweep)
+		{
+			for (unsigned int color = 0; color < 2; ++color)
+			{
+				//Nodes of one color only read the other color, so the planes are independent.
+				//The stride 2 row loop reads and writes through one pointer, which lets the
+				//compiler see that the strides never overlap and vectorize it.
+				ParallelForRange(1, n - 1, [&](size_t zBegin, size_t zEnd)
+				{
+					for (size_t z = zBegin; z < zEnd; ++z)
+					{
+						for (unsigned int y = 1; y < n - 1; ++y)
+						{
+							float* u = &level.u[(z * n + y) * n];
+							const float* f = &level.f[(z * n + y) * n];
+							unsigned int first = 1 + ((1 + y + z + color) & 1);
+							for (unsigned int x = first; x < n - 1; x += 2)
+								u[x] = (u[x - 1] + u[x + 1] + u[x - row] + u[x + row] + u[x - plane] + u[x + plane] - h2 * f[x]) * sixth;
+						}
+					}
+				});
+			}
+		}
+	}
+
+	float MultigridPoisson::Residual(Level & level)
+	{
+		const unsigned int n = level.n;
+		const ptrdiff_t row = n, plane = row * n;
+		const float invH2 = 1.f / (level.spacing * level.spacing);
+		std::vector<float> planeMax(n, 0.f);
+
+		ParallelForRange(1, n - 1, [&](size_t zBegin, size_t zEnd)
+		{
+			for (size_t z = zBegin; z < zEnd; ++z)
+			{
+				float maxResidual = 0.f;
+				for (unsigned int y = 1; y < n - 1; ++y)
+				{
+					const float* u = &level.u[(z * n + y) * n];
+					const float* f = &level.f[(z * n + y) * n];
+					float* r = &level.r[(z * n + y) * n];
+					for (unsigned int x = 1; x < n - 1; ++x)
+					{
+						r[x] = f[x] - (u[x - 1] + u[x + 1] + u[x - row] + u[x + row] + u[x - plane] + u[x + plane] - 6.f * u[x]) * invH2;
+						maxResidual = (std::max)(maxResidual, std::fabs(r[x]));
+					}
+				}
+				planeMax[z] = maxResidual;
+			}
+		});
+
+		return *std::max_element(planeMax.begin(), planeMax.end());
+	}
+
+	void MultigridPoisson::Restrict(const Level & fine, Level & coarse)
+	{
+		//Full weighting, (2 - |d|) per axis over the 27 fine neighbours of a coarse node
+		const unsigned int nf = fine.n;
+		const unsigned int nc = coarse.n;
+		ParallelFor(1, nc - 1, [&](size_t Z)
+		{
+			for (unsigned int Y = 1; Y < nc - 1; ++Y)
+			{
+				for (unsigned int X = 1; X < nc - 1; ++X)
+				{
+					float sum = 0.f;
+					for (int dz = -1; dz <= 1; ++dz)
+					{
+						for (int dy = -1; dy <= 1; ++dy)
+						{
+							const float* r = &fine.r[((2 * Z + dz) * nf + (2 * Y + dy)) * nf + 2 * X];
+							float weight = float((2 - std::abs(dz)) * (2 - std::abs(dy)));
+							sum += weight * (r[-1] + 2.f * r[0] + r[1]);
+						}
+					}
+
+					coarse.f[(Z * nc + Y) * nc + X] = sum * (1.f / 64.f);
+				}
+			}
+		});
+	}
+
+	void MultigridPoisson::Prolong(const Level & coarse, Level & fine)
+	{
+		//Trilinear, the coarse boundary is zero like the correction it carries
+		const unsigned int nf = fine.n;
+		const unsigned int nc = coarse.n;
+		ParallelFor(1, nf - 1, [&](size_t z)
+		{
+			size_t Z0 = z / 2, Z1 = Z0 + (z & 1);
+			for (unsigned int y = 1; y < nf - 1; ++y)
+			{
+				size_t Y0 = y / 2, Y1 = Y0 + (y & 1);
+				const float* c00 = &coarse.u[(Z0 * nc + Y0) * nc];
+				const float* c01 = &coarse.u[(Z0 * nc + Y1) * nc];
+				const float* c10 = &coarse.u[(Z1 * nc + Y0) * nc];
+				const float* c11 = &coarse.u[(Z1 * nc + Y1) * nc];
+				float* u = &fine.u[(z * nf + y) * nf];
+				for (unsigned int x = 1; x < nf - 1; ++x)
+				{
+					size_t X0 = x / 2, X1 = X0 + (x & 1);
+					u[x] += 0.125f * (c00[X0] + c00[X1] + c01[X0] + c01[X1] + c10[X0] + c10[X1] + c11[X0] + c11[X1]);
+				}
+			}
+		});
+	}
+
+	MultigridNBody::MultigridNBody(const BodyArray & bodies, const SimulationParams & params, const MultigridSettings & settings) : m_bodies(bodies),
+								   m_params(params), m_settings(settings)
+	{
+		m_settings.gridLevels = (std::max)(m_settings.gridLevels, 2u);
+	}
+
+	void MultigridNBody::ComputeAccelerations(std::vector<Float4> & accelerations)
+	{
+		accelerations.assign(m_bodies.size(), Float4{ 0.f, 0.f, 0.f, 0.f });
+		m_reports.clear();
+		if (m_bodies.empty())
+			return;
+
+		//Root grid: the bounding cube of the bodies with an empty margin
+		float lo[3] = { m_bodies[0].position.x, m_bodies[0].position.y, m_bodies[0].position.z };
+		float hi[3] = { lo[0], lo[1], lo[2] };
+		for (const Body & body : m_bodies)
+		{
+			const float p[3] = { body.position.x, body.position.y, body.position.z };
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				lo[axis] = (std::min)(lo[axis], p[axis]);
+				hi[axis] = (std::max)(hi[axis], p[axis]);
+			}
+		}
+
+		float half = 0.f;
+		for (int axis = 0; axis < 3; ++axis)
+			half = (std::max)(half, 0.5f * (hi[axis] - lo[axis]));
+		half = (std::max)(half, 1e-3f) * (1.f + m_settings.padding);
+
+		m_grids.resize(1);
+		PoissonGrid & root = m_grids[0];
+		root.Resize((1u << m_settings.gridLevels) + 1);
+		root.spacing = 2.f * half / (root.n - 1);
+		for (int axis = 0; axis < 3; ++axis)
+			root.origin[axis] = 0.5f * (lo[axis] + hi[axis]) - half;
+
+		Deposit(root);
+		SetMultipoleBoundary(root);
+		m_reports.push_back(m_solver.Solve(root, m_settings.maxCycles, m_settings.tolerance));
+		Interpolate(root, accelerations, false);
+
+		//Each patch overrides the accelerations of the bodies well inside it
+		for (unsigned int level = 0; level < m_settings.refinementLevels; ++level)
+		{
+			PoissonGrid child;
+			if (!FindRefinement(m_grids.back(), child))
+				break;
+
+			Deposit(child);
+			SetInterpolatedBoundary(child, m_grids.back());
+			m_reports.push_back(m_solver.Solve(child, m_settings.maxCycles, m_settings.tolerance));
+			Interpolate(child, accelerations, true);
+			m_grids.push_back(std::move(child));
+		}
+	}
+
+	void MultigridNBody::Deposit(PoissonGrid & grid) const
+	{
+		//Cloud-in-cell mass onto the nodes, then 4 pi G rho with G = 1
+		const unsigned int n = grid.n;
+		const float invH = 1.f / grid.spacing;
+		std::fill(grid.rhs.begin(), grid.rhs.end(), 0.f);
+
+		for (const Body & body : m_bodies)
+		{
+			float g[3] = { (body.position.x - grid.origin[0]) * invH, (body.position.y - grid.origin[1]) * invH, (body.position.z - grid.origin[2]) * invH };
+			if (g[0] < 0.f || g[1] < 0.f || g[2] < 0.f || g[0] >= n - 1 || g[1] >= n - 1 || g[2] >= n - 1)
+				continue;
+
+			unsigned int i[3];
+			float t[3];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				i[axis] = static_cast<unsigned int>(g[axis]);
+				t[axis] = g[axis] - i[axis];
+			}
+
+			for (unsigned int corner = 0; corner < 8; ++corner)
+			{
+				unsigned int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+				float weight = (dx ? t[0] : 1.f - t[0]) * (dy ? t[1] : 1.f - t[1]) * (dz ? t[2] : 1.f - t[2]);
+				grid.rhs[grid.Index(i[0] + dx, i[1] + dy, i[2] + dz)] += body.position.w * weight;
+			}
+		}
+
+		const float scale = 4.f * PI * invH * invH * invH;
+		for (float & value : grid.rhs)
+			value *= scale;
+	}
+
+	void MultigridNBody::SetMultipoleBoundary(PoissonGrid & grid) const
+	{
+		//Monopole and traceless quadrupole about the center of mass, the dipole vanishes there
+		double mass = 0.0, com[3] = { 0.0, 0.0, 0.0 };
+		for (const Body & body : m_bodies)
+		{
+			mass += body.position.w;
+			com[0] += static_cast<double>(body.position.x) * body.position.w;
+			com[1] += static_cast<double>(body.position.y) * body.position.w;
+			com[2] += static_cast<double>(body.position.z) * body.position.w;
+		}
+		if (mass <= 0.0)
+			return;
+		for (double & c : com)
+			c /= mass;
+
+		double q[3][3] = {};
+		for (const Body & body : m_bodies)
+		{
+			double d[3] = { body.position.x - com[0], body.position.y - com[1], body.position.z - com[2] };
+			double r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+			for (int a = 0; a < 3; ++a)
+				for (int b = 0; b < 3; ++b)
+					q[a][b] += body.position.w * (3.0 * d[a] * d[b] - (a == b ? r2 : 0.0));
+		}
+
+		auto potential = [&](const unsigned int & x, const unsigned int & y, const unsigned int & z)
+		{
+			double d[3] = { grid.origin[0] + x * grid.spacing - com[0], grid.origin[1] + y * grid.spacing - com[1], grid.origin[2] + z * grid.spacing - com[2] };
+			double r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+			double r = std::sqrt(r2);
+			double quadrupole = 0.0;
+			for (int a = 0; a < 3; ++a)
+				for (int b = 0; b < 3; ++b)
+					quadrupole += q[a][b] * d[a] * d[b];
+			return static_cast<float>(-mass / r - 0.5 * quadrupole / (r2 * r2 * r));
+		};
+
+		const unsigned int n = grid.n;
+		for (unsigned int z = 0; z < n; ++z)
+		{
+			for (unsigned int y = 0; y < n; ++y)
+			{
+				bool face = z == 0 || z == n - 1 || y == 0 || y == n - 1;
+				for (unsigned int x = 0; x < n; x += face ? 1 : n - 1)
+					grid.phi[grid.Index(x, y, z)] = potential(x, y, z);
+			}
+		}
+	}
+
+	void MultigridNBody::SetInterpolatedBoundary(PoissonGrid & grid, const PoissonGrid & parent) const
+	{
+		//Trilinear from the parent potential, the patch lies inside the parent's interior
+		const float invH = 1.f / parent.spacing;
+		auto sample = [&](const unsigned int & x, const unsigned int & y, const unsigned int & z)
+		{
+			float g[3] = { (grid.origin[0] + x * grid.spacing - parent.origin[0]) * invH, (grid.origin[1] + y * grid.spacing - parent.origin[1]) * invH,
+						   (grid.origin[2] + z * grid.spacing - parent.origin[2]) * invH };
+			unsigned int i[3];
+			float t[3];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				i[axis] = (std::min)(static_cast<unsigned int>((std::max)(g[axis], 0.f)), parent.n - 2);
+				t[axis] = g[axis] - i[axis];
+			}
+
+			float value = 0.f;
+			for (unsigned int corner = 0; corner < 8; ++corner)
+			{
+				unsigned int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+				float weight = (dx ? t[0] : 1.f - t[0]) * (dy ? t[1] : 1.f - t[1]) * (dz ? t[2] : 1.f - t[2]);
+				value += weight * parent.phi[parent.Index(i[0] + dx, i[1] + dy, i[2] + dz)];
+			}
+			return value;
+		};
+
+		const unsigned int n = grid.n;
+		for (unsigned int z = 0; z < n; ++z)
+		{
+			for (unsigned int y = 0; y < n; ++y)
+			{
+				bool face = z == 0 || z == n - 1 || y == 0 || y == n - 1;
+				for (unsigned int x = 0; x < n; x += face ? 1 : n - 1)
+					grid.phi[grid.Index(x, y, z)] = sample(x, y, z);
+			}
+		}
+	}
+
+	bool MultigridNBody::FindRefinement(const PoissonGrid & parent, PoissonGrid & child) const
+	{
+		//Mass weighted center of the overdense nodes
+		double sum = 0.0;
+		size_t occupied = 0;
+		for (const float & value : parent.rhs)
+		{
+			if (value > 0.f)
+			{
+				sum += value;
+				++occupied;
+			}
+		}
+		if (occupied == 0)
+			return false;
+
+		const float threshold = static_cast<float>(m_settings.refineOverdensity * sum / occupied);
+		double weight = 0.0, center[3] = { 0.0, 0.0, 0.0 };
+		const unsigned int n = parent.n;
+		for (unsigned int z = 0; z < n; ++z)
+		{
+			for (unsigned int y = 0; y < n; ++y)
+			{
+				for (unsigned int x = 0; x < n; ++x)
+				{
+					float value = parent.rhs[parent.Index(x, y, z)];
+					if (value > threshold)
+					{
+						weight += value;
+						center[0] += double(x) * value;
+						center[1] += double(y) * value;
+						center[2] += double(z) * value;
+					}
+				}
+			}
+		}
+		if (weight == 0.0)
+			return false;
+
+		//Half the parent's extent at twice its resolution, aligned to parent nodes and kept
+		//two parent cells away from its boundary
+		const unsigned int childCells = (n - 1) / 2;
+		child.Resize(n);
+		child.spacing = parent.spacing * 0.5f;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			int corner = static_cast<int>(std::lround(center[axis] / weight)) - static_cast<int>(childCells / 2);
+			corner = (std::max)(2, (std::min)(corner, static_cast<int>(n - 1 - childCells - 2)));
+			child.origin[axis] = parent.origin[axis] + corner * parent.spacing;
+		}
+
+		return true;
+	}
+
+	void MultigridNBody::Interpolate(const PoissonGrid & grid, std::vector<Float4> & accelerations, const bool & interiorOnly) const
+	{
+		//-grad phi by central differences at the 8 nodes around a body, blended with the
+		//deposit weights. Patches skip bodies near their interpolated boundary.
+		const unsigned int n = grid.n;
+		const unsigned int margin = interiorOnly ? 2 : 1;
+		const float invH = 1.f / grid.spacing;
+		const float invTwoH = 0.5f * invH;
+		const ptrdiff_t row = n, plane = row * n;
+
+		ParallelFor(0, m_bodies.size(), [&](size_t b)
+		{
+			const Float4 & p = m_bodies[b].position;
+			float g[3] = { (p.x - grid.origin[0]) * invH, (p.y - grid.origin[1]) * invH, (p.z - grid.origin[2]) * invH };
+
+			unsigned int i[3];
+			float t[3];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				if (g[axis] < margin || g[axis] >= n - 1 - margin)
+				{
+					if (interiorOnly)
+						return;
+					g[axis] = (std::min)((std::max)(g[axis], float(margin)), n - 1 - margin - 1e-3f);
+				}
+				i[axis] = static_cast<unsigned int>(g[axis]);
+				t[axis] = g[axis] - i[axis];
+			}
+
+			float a[3] = { 0.f, 0.f, 0.f };
+			for (unsigned int corner = 0; corner < 8; ++corner)
+			{
+				unsigned int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+				float weight = (dx ? t[0] : 1.f - t[0]) * (dy ? t[1] : 1.f - t[1]) * (dz ? t[2] : 1.f - t[2]);
+				const float* phi = &grid.phi[grid.Index(i[0] + dx, i[1] + dy, i[2] + dz)];
+				a[0] -= weight * (phi[1] - phi[-1]) * invTwoH;
+				a[1] -= weight * (phi[row] - phi[-row]) * invTwoH;
+				a[2] -= weight * (phi[plane] - phi[-plane]) * invTwoH;
+			}
+
+			accelerations[b] = { a[0], a[1], a[2], 0.f };
+		});
+	}
+
+	void MultigridNBody::Step()
+	{
+		ComputeAccelerations(m_accelerations);
+		Integrate(nullptr);
+	}
+
+	void MultigridNBody::StepInto(Body * output)
+	{
+		ComputeAccelerations(m_accelerations);
+		Integrate(output);
+	}
+
+	void MultigridNBody::Integrate(Body * output)
+	{
+		const float dt = m_params.timestep;
+		ParallelFor(0, m_bodies.size(), [&](size_t i)
+		{
+			Body & body = m_bodies[i];
+			const Float4 & a = m_accelerations[i];
+			body.velocity.x += a.x * dt;
+			body.velocity.y += a.y * dt;
+			body.velocity.z += a.z * dt;
+			body.position.x += body.velocity.x * dt;
+			body.position.y += body.velocity.y * dt;
+			body.position.z += body.velocity.z * dt;
+
+			if (output)
+				output[i] = body;
+		});
+	}
+
+	void MultigridNBody::SetBodies(const BodyArray & bodies)
+	{
+		m_bodies = bodies;
+		m_accelerations.clear();
+	}
+
+	BodyArray MultigridNBody::GetBodies() const
+	{
+		return m_bodies;
+	}
+
+	const std::vector<Float4> & MultigridNBody::GetAccelerations() const
+	{
+		return m_accelerations;
+	}
+
+	const SimulationParams & MultigridNBody::GetParams() const
+	{
+		return m_params;
+	}
+
+	std::string MultigridNBody::GetName() const
+	{
+		return "multigrid";
+	}
+
+	const std::vector<MultigridReport> & MultigridNBody::GetReports() const
+	{
+		return m_reports;
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <simulation/Engine.hpp>
+
+namespace dx
+{
+	//Vertex centered cubic grid of n^3 nodes, x fastest. The outer layer of phi holds the
+	//Dirichlet boundary values and is never changed by the solver.
+	struct PoissonGrid
+	{
+		unsigned int n = 0;
+		float spacing = 0.f;
+		float origin[3] = {};
+		std::vector<float> phi;
+		std::vector<float> rhs;
+
+		void Resize(const unsigned int & nodes);
+		size_t Index(const unsigned int & x, const unsigned int & y, const unsigned int & z) const { return (size_t(z) * n + y) * n + x; }
+	};
+
+	struct MultigridReport
+	{
+		unsigned int cycles;
+		float residual;			//Max norm of the final residual relative to the right hand side
+	};
+
+	//Geometric multigrid V-cycles for the Laplacian, n has to be 2^k + 1. Smoothing is red-black
+	//Gauss-Seidel: every row is relaxed as a whole into a scratch row, which vectorizes, and
+	//only the nodes of the current color are copied back. Both colors of a sweep are split
+	//over all cores by z-plane. Restriction is full weighting, prolongation trilinear.
+	class MultigridPoisson
+	{
+	public:
+		MultigridPoisson(const unsigned int & preSmooth = 2, const unsigned int & postSmooth = 2);
+
+	public:
+		//Solves Laplacian(phi) = rhs inside the boundary layer, starting from phi
+		MultigridReport Solve(PoissonGrid & grid, const unsigned int & maxCycles = 10, const float & tolerance = 1e-4f);
+
+	private:
+		struct Level
+		{
+			unsigned int n;
+			float spacing;
+			std::vector<float> u;
+			std::vector<float> f;
+			std::vector<float> r;
+		};
+
+		void Prepare(const PoissonGrid & grid);
+		void Cycle(const size_t & level);
+		void Smooth(Level & level, const unsigned int & sweeps);
+		float Residual(Level & level);
+		void Restrict(const Level & fine, Level & coarse);
+		void Prolong(const Level & coarse, Level & fine);
+
+	private:
+		unsigned int m_preSmooth;
+		unsigned int m_postSmooth;
+		std::vector<Level> m_levels;
+	};
+
+	struct MultigridSettings
+	{
+		unsigned int gridLevels = 6;			//2^gridLevels + 1 nodes per axis on every grid
+		unsigned int refinementLevels = 1;		//Nested patches of half the size around the densest region, 0 for one grid
+		float refineOverdensity = 4.0f;			//Nodes denser than this times the mean of the occupied nodes are refined
+		float padding = 0.5f;					//Empty margin around the bodies as a fraction of their extent
+		unsigned int maxCycles = 10;
+		float tolerance = 1e-4f;
+	};
+
+	//Particle-mesh backend on isolated (non-periodic) boundaries. Mass is deposited with
+	//cloud-in-cell onto a grid around the bodies, the boundary potential comes from the
+	//monopole and quadrupole of the mass, MultigridPoisson solves for the potential and the
+	//central difference gradient is interpolated back to the bodies. Dense regions get
+	//nested grids of half the spacing, whose boundaries are interpolated from their parent.
+	//The grid spacing sets the softening, SimulationParams::softeningSquared is not used.
+	class MultigridNBody : public Engine
+	{
+	public:
+		MultigridNBody(const BodyArray & bodies, const SimulationParams & params, const MultigridSettings & settings = MultigridSettings());
+		void Step() override;
+		void StepInto(Body* output) override;
+		void ComputeAccelerations(std::vector<Float4> & accelerations);
+
+	public:
+		void SetBodies(const BodyArray & bodies) override;
+		BodyArray GetBodies() const override;
+		const std::vector<Float4> & GetAccelerations() const override;
+		const SimulationParams & GetParams() const override;
+		std::string GetName() const override;
+
+		//Solver result of each grid of the last step, root first
+		const std::vector<MultigridReport> & GetReports() const;
+
+	private:
+		void Deposit(PoissonGrid & grid) const;
+		void SetMultipoleBoundary(PoissonGrid & grid) const;
+		void SetInterpolatedBoundary(PoissonGrid & grid, const PoissonGrid & parent) const;
+		bool FindRefinement(const PoissonGrid & parent, PoissonGrid & child) const;
+		void Interpolate(const PoissonGrid & grid, std::vector<Float4> & accelerations, const bool & interiorOnly) const;
+		void Integrate(Body* output);
+
+	private:
+		BodyArray m_bodies;
+		std::vector<Float4> m_accelerations;
+		SimulationParams m_params;
+		MultigridSettings m_settings;
+		MultigridPoisson m_solver;
+		std::vector<PoissonGrid> m_grids;
+		std::vector<MultigridReport> m_reports;
+	};
+}
@@ -0,0 +1,268 @@
+#include <simulation/NeighborList.hpp>
+#include <utils/ParallelFor.hpp>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace dx
+{
+	//Cell coordinates are packed into 21 bits per axis, wider spreads get coarser cells
+	static const float MAX_CELLS_PER_AXIS = 1 << 20;
+
+	NeighborList::NeighborList(const float & cutoff, const float & skin) : m_cutoff(cutoff), m_skin(skin)
+	{
+	}
+
+	bool NeighborList::Update(const BodyArray & bodies)
+	{
+		++m_numUpdates;
+
+		if (bodies.size() != m_buildPositions.size() || 2.f * ComputeMaxDisplacement(bodies) > m_skin)
+		{
+			Build(bodies);
+			return true;
+		}
+
+		return false;
+	}
+
+	float NeighborList::ComputeMaxDisplacement(const BodyArray & bodies) const
+	{
+		float maxSquared = 0.f;
+		std::mutex mutex;
+
+		ParallelForRange(0, (std::min)(bodies.size(), m_buildPositions.size()), [&](size_t begin, size_t end)
+		{
+			float localMax = 0.f;
+			for (size_t i = begin; i < end; ++i)
+			{
+				float dx = bodies[i].position.x - m_buildPositions[i].x;
+				float dy = bodies[i].position.y - m_buildPositions[i].y;
+				float dz = bodies[i].position.z - m_buildPositions[i].z;
+				localMax = (std::max)(localMax, dx * dx + dy * dy + dz * dz);
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			maxSquared = (std::max)(maxSquared, localMax);
+		});
+
+		return std::sqrt(maxSquared);
+	}
+
+	void NeighborList::Build(const BodyArray & bodies)
+	{
+		const size_t n = bodies.size();
+		++m_numBuilds;
+
+		m_buildPositions.resize(n);
+		for (size_t i = 0; i < n; ++i)
+			m_buildPositions[i] = bodies[i].position;
+
+		m_offsets.assign(n + 1, 0);
+		m_indices.clear();
+		if (n == 0)
+			return;
+
+		//Bin the bodies into a sparse uniform grid of cells at least cutoff + skin wide
+		float lo[3] = { bodies[0].position.x, bodies[0].position.y, bodies[0].position.z };
+		float hi[3] = { lo[0], lo[1], lo[2] };
+		for (const Body & body : bodies)
+		{
+			const float p[3] = { body.position.x, body.position.y, body.position.z };
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				lo[axis] = (std::min)(lo[axis], p[axis]);
+				hi[axis] = (std::max)(hi[axis], p[axis]);
+			}
+		}
+
+		const float range = m_cutoff + m_skin;
+		float cellSize = range;
+		for (int axis = 0; axis < 3; ++axis)
+			cellSize = (std::max)(cellSize, (hi[axis] - lo[axis]) / MAX_CELLS_PER_AXIS);
+
+		auto cellCoordinate = [&](const float & value, const int & axis)
+		{
+			return static_cast<int>((value - lo[axis]) / cellSize);
+		};
+
+		auto cellKey = [](const int & x, const int & y, const int & z)
+		{
+			return (static_cast<uint64_t>(z) << 42) | (static_cast<uint64_t>(y) << 21) | static_cast<uint64_t>(x);
+		};
+
+		//Only occupied cells are stored: bodies sorted by cell key, one range per distinct key
+		std::vector<std::pair<uint64_t, uint32_t>> sorted(n);
+		ParallelFor(0, n, [&](size_t i)
+		{
+			const Float4 & p = bodies[i].position;
+			sorted[i] = std::make_pair(cellKey(cellCoordinate(p.x, 0), cellCoordinate(p.y, 1), cellCoordinate(p.z, 2)), static_cast<uint32_t>(i));
+		});
+		std::sort(sorted.begin(), sorted.end());
+
+		m_cellKeys.clear();
+		m_cellStart.clear();
+		m_cellBodies.resize(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			if (i == 0 || sorted[i].first != sorted[i - 1].first)
+			{
+				m_cellKeys.push_back(sorted[i].first);
+				m_cellStart.push_back(static_cast<uint32_t>(i));
+			}
+
+			m_cellBodies[i] = sorted[i].second;
+		}
+		m_cellStart.push_back(static_cast<uint32_t>(n));
+
+		//Open addressing table from cell key to cell index, at most half full
+		size_t tableSize = 16;
+		int tableBits = 4;
+		while (tableSize < 2 * m_cellKeys.size())
+		{
+			tableSize *= 2;
+			++tableBits;
+		}
+
+		const uint32_t EMPTY = UINT32_MAX;
+		const size_t tableMask = tableSize - 1;
+		m_cellTable.assign(tableSize, EMPTY);
+
+		//Fibonacci hashing, the top bits of the product depend on all three coordinates
+		auto hash = [tableBits](const uint64_t & key)
+		{
+			return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - tableBits));
+		};
+
+		for (uint32_t c = 0; c < m_cellKeys.size(); ++c)
+		{
+			size_t slot = hash(m_cellKeys[c]);
+			while (m_cellTable[slot] != EMPTY)
+				slot = (slot + 1) & tableMask;
+			m_cellTable[slot] = c;
+		}
+
+		auto findCell = [&](const uint64_t & key)
+		{
+			for (size_t slot = hash(key); m_cellTable[slot] != EMPTY; slot = (slot + 1) & tableMask)
+			{
+				if (m_cellKeys[m_cellTable[slot]] == key)
+					return m_cellTable[slot];
+			}
+
+			return EMPTY;
+		};
+
+		//Visits every pair (i, j) within range where i lies in the given cell, the 27 surrounding
+		//cells are looked up once per cell rather than once per body
+		const float rangeSquared = range * range;
+		auto forEachPair = [&](const uint32_t & cell, auto func)
+		{
+			const uint64_t key = m_cellKeys[cell];
+			const int cx = static_cast<int>(key & 0x1FFFFF);
+			const int cy = static_cast<int>((key >> 21) & 0x1FFFFF);
+			const int cz = static_cast<int>(key >> 42);
+
+			uint32_t neighbors[27];
+			int numNeighbors = 0;
+			for (int z = (std::max)(cz - 1, 0); z <= cz + 1; ++z)
+				for (int y = (std::max)(cy - 1, 0); y <= cy + 1; ++y)
+					for (int x = (std::max)(cx - 1, 0); x <= cx + 1; ++x)
+					{
+						uint32_t neighbor = findCell(cellKey(x, y, z));
+						if (neighbor != EMPTY)
+							neighbors[numNeighbors++] = neighbor;
+					}
+
+			for (uint32_t a = m_cellStart[cell]; a < m_cellStart[cell + 1]; ++a)
+			{
+				const uint32_t i = m_cellBodies[a];
+				const Float4 & p = bodies[i].position;
+
+				for (int c = 0; c < numNeighbors; ++c)
+				{
+					for (uint32_t b = m_cellStart[neighbors[c]]; b < m_cellStart[neighbors[c] + 1]; ++b)
+					{
+						uint32_t j = m_cellBodies[b];
+						if (j == i)
+							continue;
+
+						const Float4 & q = bodies[j].position;
+						float dx = q.x - p.x, dy = q.y - p.y, dz = q.z - p.z;
+						if (dx * dx + dy * dy + dz * dz <= rangeSquared)
+							func(i, j);
+					}
+				}
+			}
+		};
+
+		//Two passes: count per body, prefix sum into the CSR offsets, then fill in place
+		const size_t numCells = m_cellKeys.size();
+		ParallelFor(0, numCells, [&](size_t cell)
+		{
+			forEachPair(static_cast<uint32_t>(cell), [this](uint32_t i, uint32_t) { ++m_offsets[i + 1]; });
+		});
+
+		for (size_t i = 0; i < n; ++i)
+			m_offsets[i + 1] += m_offsets[i];
+
+		m_indices.resize(m_offsets[n]);
+		ParallelFor(0, numCells, [&](size_t cell)
+		{
+			//Bodies of a cell are visited in order, so a single cursor per body suffices
+			uint32_t current = UINT32_MAX;
+			uint32_t* out = nullptr;
+			forEachPair(static_cast<uint32_t>(cell), [&](uint32_t i, uint32_t j)
+			{
+				if (i != current)
+				{
+					current = i;
+					out = m_indices.data() + m_offsets[i];
+				}
+
+				*out++ = j;
+			});
+		});
+	}
+
+	const uint32_t* NeighborList::GetNeighbors(const size_t & body, size_t & count) const
+	{
+		count = m_offsets[body + 1] - m_offsets[body];
+		return m_indices.data() + m_offsets[body];
+	}
+
+	const std::vector<uint32_t> & NeighborList::GetOffsets() const
+	{
+		return m_offsets;
+	}
+
+	const std::vector<uint32_t> & NeighborList::GetIndices() const
+	{
+		return m_indices;
+	}
+
+	size_t NeighborList::GetNumPairs() const
+	{
+		return m_indices.size() / 2;
+	}
+
+	float NeighborList::GetCutoff() const
+	{
+		return m_cutoff;
+	}
+
+	float NeighborList::GetSkin() const
+	{
+		return m_skin;
+	}
+
+	uint64_t NeighborList::GetNumBuilds() const
+	{
+		return m_numBuilds;
+	}
+
+	uint64_t NeighborList::GetNumUpdates() const
+	{
+		return m_numUpdates;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <simulation/Body.hpp>
+
+namespace dx
+{
+	//Verlet neighbor list for short-range work (close encounters, collisions, near field
+	//sums). Every body lists all others within cutoff + skin, so the list stays valid
+	//until some body has moved more than half the skin since the last build. Update only
+	//rebuilds then, the check itself is a parallel max-displacement reduction. The lists
+	//are stored in CSR form: the neighbors of body i are indices[offsets[i], offsets[i + 1]).
+	class NeighborList
+	{
+	public:
+		NeighborList(const float & cutoff, const float & skin);
+
+	public:
+		//Returns true when the list had to be rebuilt
+		bool Update(const BodyArray & bodies);
+		void Build(const BodyArray & bodies);
+		float ComputeMaxDisplacement(const BodyArray & bodies) const;
+
+	public:
+		//Candidates within cutoff + skin at build time, callers filter on the actual cutoff
+		const uint32_t* GetNeighbors(const size_t & body, size_t & count) const;
+		const std::vector<uint32_t> & GetOffsets() const;
+		const std::vector<uint32_t> & GetIndices() const;
+		size_t GetNumPairs() const;
+
+	public:
+		float GetCutoff() const;
+		float GetSkin() const;
+		uint64_t GetNumBuilds() const;
+		uint64_t GetNumUpdates() const;
+
+	private:
+		float m_cutoff;
+		float m_skin;
+
+		std::vector<uint32_t> m_offsets;
+		std::vector<uint32_t> m_indices;
+		std::vector<Float4> m_buildPositions;
+
+		//Occupied cells of the last build, bodies sorted by cell and a hash table over the keys
+		std::vector<uint64_t> m_cellKeys;
+		std::vector<uint32_t> m_cellStart;
+		std::vector<uint32_t> m_cellBodies;
+		std::vector<uint32_t> m_cellTable;
+
+		uint64_t m_numBuilds = 0;
+		uint64_t m_numUpdates = 0;
+	};
+}
@@ -0,0 +1,150 @@
+#include <simulation/Parareal.hpp>
+#include <simulation/Diagnostics.hpp>
+#include <utils/ParallelFor.hpp>
+#include <assert.h>
+#include <chrono>
+
+namespace dx
+{
+	static double SecondsSince(const std::chrono::high_resolution_clock::time_point & begin)
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
+	PararealIntegrator::PararealIntegrator(const SimulationParams & params, const PararealSettings & settings) : m_fineParams(params), m_coarseParams(params),
+																												  m_settings(settings)
+	{
+		assert(m_settings.fineStepsPerSlice > 0 && m_settings.coarseStepRatio > 0);
+		m_numSlices = m_settings.numSlices > 0 ? m_settings.numSlices : GetWorkerCount();
+
+		//The coarse steps cover the slice exactly, even when the ratio does not divide it
+		m_coarseSteps = (std::max)(1u, m_settings.fineStepsPerSlice / m_settings.coarseStepRatio);
+		m_coarseParams.timestep = params.timestep * m_settings.fineStepsPerSlice / m_coarseSteps;
+	}
+
+	void PararealIntegrator::Propagate(Engine & engine, const BodyArray & start, const unsigned int & steps, BodyArray & end) const
+	{
+		engine.SetBodies(start);
+		for (unsigned int i = 0; i < steps; ++i)
+			engine.Step();
+		end = engine.GetBodies();
+	}
+
+	void PararealIntegrator::Correct(const BodyArray & a, const BodyArray & b, const BodyArray & c, BodyArray & out)
+	{
+		out.resize(a.size());
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			const float* pa = &a[i].position.x;
+			const float* pb = &b[i].position.x;
+			const float* pc = &c[i].position.x;
+			float* po = &out[i].position.x;
+
+			//Position xyz, mass, velocity xyzw
+			for (int j = 0; j < 8; ++j)
+				po[j] = j == 3 ? pa[j] : static_cast<float>(double(pa[j]) + double(pb[j]) - double(pc[j]));
+		}
+	}
+
+	PararealReport PararealIntegrator::Advance(BodyArray & bodies)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		const unsigned int numSlices = m_numSlices;
+		const unsigned int maxIterations = m_settings.maxIterations > 0 ? (std::min)(m_settings.maxIterations, numSlices) : numSlices;
+
+		PararealReport report;
+		report.numSlices = numSlices;
+
+		if (!m_coarseEngine)
+			m_coarseEngine = CreateEngine(m_settings.coarseEngine, bodies, m_coarseParams);
+		assert(m_coarseEngine);
+
+		std::vector<std::unique_ptr<Engine>> fineEngines(numSlices);
+		for (std::unique_ptr<Engine> & engine : fineEngines)
+		{
+			engine = CreateEngine(m_settings.fineEngine, bodies, m_fineParams);
+			assert(engine);
+		}
+
+		//Slice boundary states, and the coarse and fine results of every slice
+		std::vector<BodyArray> states(numSlices + 1), coarse(numSlices), fine(numSlices);
+		BodyArray next, coarseNext;
+		states[0] = bodies;
+
+		//Iteration 0 is the plain coarse sweep
+		auto coarseBegin = std::chrono::high_resolution_clock::now();
+		for (unsigned int n = 0; n < numSlices; ++n)
+		{
+			Propagate(*m_coarseEngine, states[n], m_coarseSteps, coarse[n]);
+			states[n + 1] = coarse[n];
+		}
+		report.coarseSeconds += SecondsSince(coarseBegin);
+
+		//Slices before first start from an exact state, so their fine result is final
+		unsigned int first = 0;
+		const unsigned int workers = GetWorkerCount();
+		while (report.iterations < maxIterations)
+		{
+			unsigned int active = numSlices - first;
+			unsigned int sliceWorkers = (std::max)(1u, workers / active);
+
+			auto fineBegin = std::chrono::high_resolution_clock::now();
+			ParallelFor(first, numSlices, [&](size_t n)
+			{
+				ScopedWorkerLimit limit(sliceWorkers);
+				Propagate(*fineEngines[n], states[n], m_settings.fineStepsPerSlice, fine[n]);
+			}, (std::min)(workers, active));
+			report.fineSeconds += SecondsSince(fineBegin);
+			report.fineSteps += uint64_t(active) * m_settings.fineStepsPerSlice;
+
+			//The serial correction sweep, the first active slice did not move so its coarse
+			//result is unchanged and the correction is just the fine result
+			coarseBegin = std::chrono::high_resolution_clock::now();
+			double correction = 0.0;
+			for (unsigned int n = first; n < numSlices; ++n)
+			{
+				if (n == first)
+					next = fine[n];
+				else
+				{
+					Propagate(*m_coarseEngine, states[n], m_coarseSteps, coarseNext);
+					Correct(coarseNext, fine[n], coarse[n], next);
+					coarse[n].swap(coarseNext);
+				}
+
+				correction = (std::max)(correction, ComputePositionDivergence(next, states[n + 1]).maxError);
+				states[n + 1].swap(next);
+			}
+			report.coarseSeconds += SecondsSince(coarseBegin);
+
+			++first;
+			++report.iterations;
+			report.corrections.push_back(correction);
+
+			if (correction < m_settings.tolerance || first == numSlices)
+			{
+				report.converged = true;
+				break;
+			}
+		}
+
+		bodies = states[numSlices];
+		report.totalSeconds = SecondsSince(begin);
+		return report;
+	}
+
+	unsigned int PararealIntegrator::GetNumSlices() const
+	{
+		return m_numSlices;
+	}
+
+	uint64_t PararealIntegrator::GetStepsPerWindow() const
+	{
+		return uint64_t(m_numSlices) * m_settings.fineStepsPerSlice;
+	}
+
+	const PararealSettings & PararealIntegrator::GetSettings() const
+	{
+		return m_settings;
+	}
+}
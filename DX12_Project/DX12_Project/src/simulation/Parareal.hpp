@@ -0,0 +1,63 @@
+#pragma once
+#include <simulation/Engine.hpp>
+
+namespace dx
+{
+	struct PararealSettings
+	{
+		std::string fineEngine = "cpu";			//CreateEngine name of the accurate propagator
+		std::string coarseEngine = "cpu";		//CreateEngine name of the cheap propagator, e.g. "tree"
+		unsigned int numSlices = 0;				//Time slices per window, 0 for one per worker
+		unsigned int fineStepsPerSlice = 32;	//SimulationParams::timestep steps of the fine propagator
+		unsigned int coarseStepRatio = 8;		//Fine steps per coarse step, the coarse step is this many times longer
+		unsigned int maxIterations = 0;			//0 for numSlices, after which the result is the fine one anyway
+		double tolerance = 1e-5;				//Max position correction of an iteration that counts as converged
+	};
+
+	struct PararealReport
+	{
+		unsigned int numSlices = 0;
+		unsigned int iterations = 0;
+		std::vector<double> corrections;		//Max position correction of every iteration
+		double coarseSeconds = 0.0;				//Serial coarse sweeps
+		double fineSeconds = 0.0;				//Concurrent fine sweeps, wall-clock
+		double totalSeconds = 0.0;
+		uint64_t fineSteps = 0;					//Fine steps over all slices and iterations
+		bool converged = false;
+	};
+
+	//Time-parallel integration of one window of numSlices * fineStepsPerSlice fine steps.
+	//A coarse propagator G runs serially over the slices, the fine propagator F runs on all
+	//slices concurrently from the current start states, and every iteration corrects
+	//	U[n + 1] = G(U[n]) + F(U_old[n]) - G(U_old[n])
+	//until the largest change of a slice boundary state is below the tolerance. After k
+	//iterations the first k slices are exact, so their fine sweeps are not repeated. Each
+	//slice's engine is limited to its share of the workers, G uses all of them.
+	class PararealIntegrator
+	{
+	public:
+		PararealIntegrator(const SimulationParams & params, const PararealSettings & settings = PararealSettings());
+
+	public:
+		//Advances bodies by one window
+		PararealReport Advance(BodyArray & bodies);
+
+		unsigned int GetNumSlices() const;
+		uint64_t GetStepsPerWindow() const;
+		const PararealSettings & GetSettings() const;
+
+	private:
+		void Propagate(Engine & engine, const BodyArray & start, const unsigned int & steps, BodyArray & end) const;
+
+		//out = a + b - c per position and velocity component, the mass is kept from a
+		static void Correct(const BodyArray & a, const BodyArray & b, const BodyArray & c, BodyArray & out);
+
+	private:
+		SimulationParams m_fineParams;
+		SimulationParams m_coarseParams;
+		PararealSettings m_settings;
+		unsigned int m_numSlices;
+		unsigned int m_coarseSteps;
+		std::unique_ptr<Engine> m_coarseEngine;
+	};
+}
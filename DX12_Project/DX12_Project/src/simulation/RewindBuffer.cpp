@@ -0,0 +1,253 @@
+#include <simulation/RewindBuffer.hpp>
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+
+namespace dx
+{
+	static const size_t WORDS_PER_BODY = sizeof(Body) / sizeof(uint32_t);
+
+	RewindBuffer::RewindBuffer(const RewindSettings & settings) : m_settings(settings)
+	{
+		assert(m_settings.keyframeInterval > 0);
+		assert(m_settings.quantizationBits < 23);
+		m_thread = std::thread(&RewindBuffer::CompressionLoop, this);
+	}
+
+	RewindBuffer::~RewindBuffer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_pendingMutex);
+			m_running = false;
+		}
+		m_pendingCondition.notify_all();
+		m_thread.join();
+	}
+
+	bool RewindBuffer::Record(const uint64_t & step, const BodyArray & bodies)
+	{
+		return Record(step, bodies.data(), bodies.size());
+	}
+
+	//Copies the state and hands it to the compression thread. Blocks only when the
+	//thread has fallen maxPendingFrames behind, so history is never silently dropped.
+	//Rejects a step that is not after the last recorded one.
+	bool RewindBuffer::Record(const uint64_t & step, const Body* bodies, const size_t & count)
+	{
+		PendingFrame pending;
+		pending.step = step;
+		pending.words.resize(count * WORDS_PER_BODY);
+		memcpy(pending.words.data(), bodies, count * sizeof(Body));
+
+		std::unique_lock<std::mutex> lock(m_pendingMutex);
+		if (m_hasRecorded && step <= m_lastRecordedStep)
+			return false;
+
+		m_hasRecorded = true;
+		m_lastRecordedStep = step;
+		m_idleCondition.wait(lock, [this] { return m_pending.size() < m_settings.maxPendingFrames; });
+		m_pending.push_back(std::move(pending));
+		lock.unlock();
+		m_pendingCondition.notify_one();
+		return true;
+	}
+
+	void RewindBuffer::Flush()
+	{
+		std::unique_lock<std::mutex> lock(m_pendingMutex);
+		m_idleCondition.wait(lock, [this] { return m_pending.empty() && !m_busy; });
+	}
+
+	void RewindBuffer::Clear()
+	{
+		//Holding the hand-over lock from the moment the thread is idle keeps it from taking
+		//another frame and Record from queuing one until the keyframe is reset
+		std::unique_lock<std::mutex> lock(m_pendingMutex);
+		m_idleCondition.wait(lock, [this] { return m_pending.empty() && !m_busy; });
+
+		{
+			std::lock_guard<std::mutex> framesLock(m_framesMutex);
+			m_frames.clear();
+			m_memoryUsage = 0;
+		}
+
+		//Next recorded step starts a new keyframe and may go back in time
+		m_keyframe.reset();
+		m_framesSinceKeyframe = 0;
+		m_hasRecorded = false;
+	}
+
+	void RewindBuffer::CompressionLoop()
+	{
+		for (;;)
+		{
+			PendingFrame pending;
+			{
+				std::unique_lock<std::mutex> lock(m_pendingMutex);
+				m_pendingCondition.wait(lock, [this] { return !m_pending.empty() || !m_running; });
+				if (m_pending.empty())
+					return;
+
+				pending = std::move(m_pending.front());
+				m_pending.pop_front();
+				m_busy = true;
+			}
+			m_idleCondition.notify_all();
+
+			Compress(pending);
+
+			{
+				std::lock_guard<std::mutex> lock(m_pendingMutex);
+				m_busy = false;
+			}
+			m_idleCondition.notify_all();
+		}
+	}
+
+	uint32_t RewindBuffer::Quantize(const uint32_t & word) const
+	{
+		const unsigned int bits = m_settings.quantizationBits;
+		if (bits == 0)
+			return word;
+
+		//Round to nearest on the retained mantissa bits
+		return (word + (1u << (bits - 1))) & ~((1u << bits) - 1);
+	}
+
+	void RewindBuffer::Compress(PendingFrame & pending)
+	{
+		Frame frame;
+		frame.step = pending.step;
+		frame.isKeyframe = !m_keyframe || m_keyframe->size() != pending.words.size() || m_framesSinceKeyframe >= m_settings.keyframeInterval;
+
+		if (frame.isKeyframe)
+		{
+			m_keyframe = std::make_shared<const WordArray>(std::move(pending.words));
+			m_framesSinceKeyframe = 1;
+			frame.keyframe = m_keyframe;
+			frame.bytes = m_keyframe->size() * sizeof(uint32_t);
+		}
+		else
+		{
+			const WordArray & key = *m_keyframe;
+			const WordArray & words = pending.words;
+			const unsigned int bits = m_settings.quantizationBits;
+			const size_t numWords = words.size();
+
+			frame.keyframe = m_keyframe;
+			frame.tags.assign((numWords + 3) / 4, 0);
+			frame.payload.resize(numWords * sizeof(uint32_t));
+			uint8_t* out = frame.payload.data();
+
+			for (size_t i = 0; i < numWords; ++i)
+			{
+				//The low quantization bits of the XOR are always zero, shift them out
+				uint32_t delta = (Quantize(words[i]) ^ Quantize(key[i])) >> bits;
+
+				//Tag 0: unchanged, 1: two low bytes, 2: three low bytes, 3: all four
+				uint32_t tag = delta == 0 ? 0 : delta < (1u << 16) ? 1 : delta < (1u << 24) ? 2 : 3;
+				frame.tags[i >> 2] |= static_cast<uint8_t>(tag << ((i & 3) * 2));
+
+				if (tag != 0)
+				{
+					size_t numBytes = tag + 1;
+					memcpy(out, &delta, numBytes);
+					out += numBytes;
+				}
+			}
+
+			frame.payload.resize(out - frame.payload.data());
+			frame.payload.shrink_to_fit();
+			frame.bytes = frame.payload.size() + frame.tags.size();
+			++m_framesSinceKeyframe;
+		}
+
+		std::lock_guard<std::mutex> lock(m_framesMutex);
+		m_memoryUsage += frame.bytes;
+		m_frames.push_back(std::move(frame));
+		Evict();
+	}
+
+	//Drops whole keyframe groups from the front until the history fits the cap again,
+	//the newest group is always kept
+	void RewindBuffer::Evict()
+	{
+		while (m_memoryUsage > m_settings.memoryCap && !m_frames.empty())
+		{
+			auto nextKeyframe = std::find_if(m_frames.begin() + 1, m_frames.end(), [](const Frame & frame) { return frame.isKeyframe; });
+			if (nextKeyframe == m_frames.end())
+				break;
+
+			for (auto it = m_frames.begin(); it != nextKeyframe; ++it)
+				m_memoryUsage -= it->bytes;
+			m_frames.erase(m_frames.begin(), nextKeyframe);
+		}
+	}
+
+	bool RewindBuffer::Restore(const uint64_t & step, BodyArray & bodies) const
+	{
+		std::lock_guard<std::mutex> lock(m_framesMutex);
+
+		auto found = std::lower_bound(m_frames.begin(), m_frames.end(), step, [](const Frame & frame, const uint64_t & value) { return frame.step < value; });
+		if (found == m_frames.end() || found->step != step)
+			return false;
+
+		const WordArray & key = *found->keyframe;
+		bodies.resize(key.size() / WORDS_PER_BODY);
+		uint32_t* words = reinterpret_cast<uint32_t*>(bodies.data());
+
+		if (found->isKeyframe)
+		{
+			memcpy(words, key.data(), key.size() * sizeof(uint32_t));
+			return true;
+		}
+
+		const unsigned int bits = m_settings.quantizationBits;
+		const uint8_t* in = found->payload.data();
+
+		for (size_t i = 0; i < key.size(); ++i)
+		{
+			uint32_t tag = (found->tags[i >> 2] >> ((i & 3) * 2)) & 3;
+			uint32_t delta = 0;
+
+			if (tag != 0)
+			{
+				size_t numBytes = tag + 1;
+				memcpy(&delta, in, numBytes);
+				in += numBytes;
+			}
+
+			words[i] = (delta << bits) ^ Quantize(key[i]);
+		}
+
+		return true;
+	}
+
+	bool RewindBuffer::GetStepRange(uint64_t & first, uint64_t & last) const
+	{
+		std::lock_guard<std::mutex> lock(m_framesMutex);
+		if (m_frames.empty())
+			return false;
+
+		first = m_frames.front().step;
+		last = m_frames.back().step;
+		return true;
+	}
+
+	size_t RewindBuffer::GetMemoryUsage() const
+	{
+		std::lock_guard<std::mutex> lock(m_framesMutex);
+		return m_memoryUsage;
+	}
+
+	size_t RewindBuffer::GetNumFrames() const
+	{
+		std::lock_guard<std::mutex> lock(m_framesMutex);
+		return m_frames.size();
+	}
+
+	const RewindSettings & RewindBuffer::GetSettings() const
+	{
+		return m_settings;
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <simulation/Body.hpp>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace dx
+{
+	struct RewindSettings
+	{
+		unsigned int keyframeInterval = 32;				//A full state every K recorded steps
+		size_t memoryCap = size_t(512) << 20;			//Bytes of compressed history, the oldest is evicted first
+		unsigned int quantizationBits = 0;				//Low mantissa bits dropped from the in-between states
+		size_t maxPendingFrames = 4;					//Raw states waiting for the compression thread
+	};
+
+	//Bounded in-memory history of the body state for scrubbing back in simulation time.
+	//Every K-th recorded step is kept as a full keyframe, the steps in between are stored as
+	//the XOR of their (optionally quantized) words against the keyframe, packed to the
+	//significant bytes only. Since every delta refers straight to its keyframe, any stored
+	//step is restored with a single linear pass. Compression runs on a background thread.
+	//Steps have to be recorded in increasing order, Restore searches the history by step.
+	class RewindBuffer
+	{
+	public:
+		RewindBuffer(const RewindSettings & settings = RewindSettings());
+		~RewindBuffer();
+
+	public:
+		bool Record(const uint64_t & step, const BodyArray & bodies);
+		bool Record(const uint64_t & step, const Body* bodies, const size_t & count);
+		bool Restore(const uint64_t & step, BodyArray & bodies) const;
+		void Flush();
+		void Clear();
+
+	public:
+		bool GetStepRange(uint64_t & first, uint64_t & last) const;
+		size_t GetMemoryUsage() const;
+		size_t GetNumFrames() const;
+		const RewindSettings & GetSettings() const;
+
+	private:
+		typedef std::vector<uint32_t> WordArray;
+
+		struct PendingFrame
+		{
+			uint64_t step;
+			WordArray words;
+		};
+
+		struct Frame
+		{
+			uint64_t step;
+			bool isKeyframe;
+			std::shared_ptr<const WordArray> keyframe;
+			std::vector<uint8_t> tags;		//Two bits per word, number of stored bytes
+			std::vector<uint8_t> payload;
+			size_t bytes;
+		};
+
+	private:
+		void CompressionLoop();
+		void Compress(PendingFrame & pending);
+		void Evict();
+		uint32_t Quantize(const uint32_t & word) const;
+
+	private:
+		RewindSettings m_settings;
+
+		//Compressed history, ordered by step
+		std::deque<Frame> m_frames;
+		size_t m_memoryUsage = 0;
+		mutable std::mutex m_framesMutex;
+
+		//Hand-over to the compression thread
+		std::deque<PendingFrame> m_pending;
+		std::mutex m_pendingMutex;
+		std::condition_variable m_pendingCondition;
+		std::condition_variable m_idleCondition;
+		bool m_busy = false;
+		bool m_running = true;
+		bool m_hasRecorded = false;
+		uint64_t m_lastRecordedStep = 0;
+		std::thread m_thread;
+
+		//Only touched by the compression thread, or by Clear while it is idle and locked out
+		std::shared_ptr<const WordArray> m_keyframe;
+		unsigned int m_framesSinceKeyframe = 0;
+	};
+}
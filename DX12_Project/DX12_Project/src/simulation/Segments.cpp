@@ -0,0 +1,77 @@
+#include <simulation/Segments.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace dx
+{
+	SegmentLayout::SegmentLayout(const uint64_t & count, const uint32_t & capacity) : m_count(count), m_capacity((std::max)(capacity, 1u))
+	{
+		uint64_t numSegments = (std::max)((m_count + m_capacity - 1) / m_capacity, uint64_t(1));
+		assert(numSegments <= UINT32_MAX);
+		m_numSegments = static_cast<uint32_t>(numSegments);
+	}
+
+	uint32_t GetDispatchGroups(const uint32_t & count)
+	{
+		return static_cast<uint32_t>((uint64_t(count) + DispatchBlockSize - 1) / DispatchBlockSize);
+	}
+
+	uint64_t SegmentLayout::GetCount() const
+	{
+		return m_count;
+	}
+
+	uint32_t SegmentLayout::GetCapacity() const
+	{
+		return m_capacity;
+	}
+
+	uint32_t SegmentLayout::GetNumSegments() const
+	{
+		return m_numSegments;
+	}
+
+	uint64_t SegmentLayout::GetSegmentBegin(const uint32_t & segment) const
+	{
+		return uint64_t(segment) * m_capacity;
+	}
+
+	uint32_t SegmentLayout::GetSegmentSize(const uint32_t & segment) const
+	{
+		uint64_t begin = GetSegmentBegin(segment);
+		return begin < m_count ? static_cast<uint32_t>((std::min)(m_count - begin, uint64_t(m_capacity))) : 0;
+	}
+
+	void SegmentLayout::Locate(const uint64_t & index, uint32_t & segment, uint32_t & local) const
+	{
+		segment = static_cast<uint32_t>(index / m_capacity);
+		local = static_cast<uint32_t>(index % m_capacity);
+	}
+
+	void CopyToSegments(const Body* bodies, const uint64_t & first, const uint64_t & count, Body* const* segments, const SegmentLayout & layout)
+	{
+		assert(first + count <= layout.GetCount());
+		for (uint64_t copied = 0; copied < count;)
+		{
+			uint32_t segment, local;
+			layout.Locate(first + copied, segment, local);
+			uint64_t run = (std::min)(uint64_t(layout.GetSegmentSize(segment) - local), count - copied);
+			std::memcpy(segments[segment] + local, bodies + copied, sizeof(Body) * run);
+			copied += run;
+		}
+	}
+
+	void CopyFromSegments(const Body* const* segments, const SegmentLayout & layout, const uint64_t & first, const uint64_t & count, Body* bodies)
+	{
+		assert(first + count <= layout.GetCount());
+		for (uint64_t copied = 0; copied < count;)
+		{
+			uint32_t segment, local;
+			layout.Locate(first + copied, segment, local);
+			uint64_t run = (std::min)(uint64_t(layout.GetSegmentSize(segment) - local), count - copied);
+			std::memcpy(bodies + copied, segments[segment] + local, sizeof(Body) * run);
+			copied += run;
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <simulation/Body.hpp>
+
+//Splits a 64-bit body count into segments of at most capacity bodies. GPU views, dispatches
+//and draws count elements in 32 bits and drivers cap the size of a single resource, so body
+//data past a few GB has to span several buffers. Every segment but the last one is full, so
+//a body's segment follows from its index alone. The CPU paths use the same layout to write
+//straight into the segment buffers.
+namespace dx
+{
+	class SegmentLayout
+	{
+	public:
+		SegmentLayout(const uint64_t & count = 0, const uint32_t & capacity = UINT32_MAX);
+
+	public:
+		uint64_t GetCount() const;
+		uint32_t GetCapacity() const;
+		uint32_t GetNumSegments() const;
+		uint64_t GetSegmentBegin(const uint32_t & segment) const;
+		uint32_t GetSegmentSize(const uint32_t & segment) const;
+
+		//Segment of a body and its index within that segment
+		void Locate(const uint64_t & index, uint32_t & segment, uint32_t & local) const;
+
+	private:
+		uint64_t m_count;
+		uint32_t m_capacity;
+		uint32_t m_numSegments;
+	};
+
+	//A segment is updated by one dispatch of DispatchBlockSize thread blocks along x, and a
+	//dispatch dimension takes at most MaxDispatchGroups groups
+	//(D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION), which bounds the segment capacity
+	constexpr uint32_t DispatchBlockSize = 256;
+	constexpr uint32_t MaxDispatchGroups = 65535;
+	constexpr uint32_t MaxDispatchSegmentCapacity = MaxDispatchGroups * DispatchBlockSize;
+
+	//Thread groups covering count bodies
+	uint32_t GetDispatchGroups(const uint32_t & count);
+
+	//Copy count bodies starting at logical index first between contiguous and segmented
+	//storage. Only the segments the range touches are accessed.
+	void CopyToSegments(const Body* bodies, const uint64_t & first, const uint64_t & count, Body* const* segments, const SegmentLayout & layout);
+	void CopyFromSegments(const Body* const* segments, const SegmentLayout & layout, const uint64_t & first, const uint64_t & count, Body* bodies);
+}
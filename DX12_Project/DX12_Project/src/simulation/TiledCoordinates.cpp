@@ -0,0 +1,203 @@
+#include <simulation/TiledCoordinates.hpp>
+#include <utils/ParallelFor.hpp>
+#include <assert.h>
+#include <cmath>
+
+namespace dx
+{
+	TiledCoordinates::TiledCoordinates(const double & cellSize) : m_cellSize(cellSize), m_cellSizeF(static_cast<float>(cellSize))
+	{
+		assert(cellSize > 0.0);
+	}
+
+	void TiledCoordinates::SetBodies(const BodyArray & bodies)
+	{
+		m_bodies.resize(bodies.size());
+		m_cells.resize(bodies.size());
+
+		for (size_t i = 0; i < bodies.size(); ++i)
+		{
+			Double3 position = { bodies[i].position.x, bodies[i].position.y, bodies[i].position.z };
+			SetBody(i, position, bodies[i].velocity, bodies[i].position.w);
+		}
+	}
+
+	void TiledCoordinates::SetBody(const size_t & index, const Double3 & position, const Float4 & velocity, const float & mass)
+	{
+		Body & body = m_bodies[index];
+		Int4 & cell = m_cells[index];
+
+		Split(position.x, m_cellSize, cell.x, body.position.x);
+		Split(position.y, m_cellSize, cell.y, body.position.y);
+		Split(position.z, m_cellSize, cell.z, body.position.z);
+		cell.w = 0;
+		body.position.w = mass;
+		body.velocity = velocity;
+	}
+
+	void TiledCoordinates::Split(const double & position, const double & cellSize, int32_t & cell, float & offset)
+	{
+		double index = std::floor(position / cellSize + 0.5);
+		cell = static_cast<int32_t>(index);
+		offset = static_cast<float>(position - index * cellSize);
+	}
+
+	void TiledCoordinates::ComputeAccelerations(std::vector<Float4> & accelerations, const float & softeningSquared) const
+	{
+		accelerations.resize(m_bodies.size());
+		const size_t n = m_bodies.size();
+
+		ParallelFor(0, n, [&](size_t i)
+		{
+			const Float4 & pi = m_bodies[i].position;
+			const Int4 & ci = m_cells[i];
+			float ax = 0.f, ay = 0.f, az = 0.f;
+
+			for (size_t j = 0; j < n; ++j)
+			{
+				const Float4 & pj = m_bodies[j].position;
+				const Int4 & cj = m_cells[j];
+
+				//Anchor difference is an exact integer for nearby cells, the offsets carry the fraction
+				float rx = static_cast<float>(cj.x - ci.x) * m_cellSizeF + (pj.x - pi.x);
+				float ry = static_cast<float>(cj.y - ci.y) * m_cellSizeF + (pj.y - pi.y);
+				float rz = static_cast<float>(cj.z - ci.z) * m_cellSizeF + (pj.z - pi.z);
+
+				float distSqr = rx * rx + ry * ry + rz * rz + softeningSquared;
+				float invDist = 1.0f / std::sqrt(distSqr);
+				float s = pj.w * invDist * invDist * invDist;
+
+				ax += rx * s;
+				ay += ry * s;
+				az += rz * s;
+			}
+
+			accelerations[i] = { ax, ay, az, 0.f };
+		});
+	}
+
+	void TiledCoordinates::Step(const SimulationParams & params)
+	{
+		std::vector<Float4> accelerations;
+		Step(params, accelerations);
+	}
+
+	void TiledCoordinates::Step(const SimulationParams & params, std::vector<Float4> & accelerations)
+	{
+		ComputeAccelerations(accelerations, params.softeningSquared);
+
+		//Same integration as CS_MAIN, applied to the offsets
+		ParallelFor(0, m_bodies.size(), [&](size_t i)
+		{
+			Body & body = m_bodies[i];
+			body.velocity.x += accelerations[i].x * params.timestep;
+			body.velocity.y += accelerations[i].y * params.timestep;
+			body.velocity.z += accelerations[i].z * params.timestep;
+			body.position.x += body.velocity.x * params.timestep;
+			body.position.y += body.velocity.y * params.timestep;
+			body.position.z += body.velocity.z * params.timestep;
+		});
+
+		Rebase();
+	}
+
+	//Moves whole cells out of the offsets whenever a body has left its cell, this keeps
+	//the offsets within half a cell and therefore at full float precision
+	void TiledCoordinates::Rebase()
+	{
+		ParallelFor(0, m_bodies.size(), [&](size_t i)
+		{
+			float* offset = &m_bodies[i].position.x;
+			int32_t* cell = &m_cells[i].x;
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float shift = std::floor(offset[axis] / m_cellSizeF + 0.5f);
+				if (shift != 0.f)
+				{
+					cell[axis] += static_cast<int32_t>(shift);
+					offset[axis] -= shift * m_cellSizeF;
+				}
+			}
+		});
+	}
+
+	size_t TiledCoordinates::GetNumBodies() const
+	{
+		return m_bodies.size();
+	}
+
+	double TiledCoordinates::GetCellSize() const
+	{
+		return m_cellSize;
+	}
+
+	Double3 TiledCoordinates::GetPosition(const size_t & index) const
+	{
+		const Float4 & offset = m_bodies[index].position;
+		const Int4 & cell = m_cells[index];
+		return { cell.x * m_cellSize + offset.x, cell.y * m_cellSize + offset.y, cell.z * m_cellSize + offset.z };
+	}
+
+	BodyArray TiledCoordinates::GetBodies() const
+	{
+		BodyArray bodies(m_bodies.size());
+		for (size_t i = 0; i < m_bodies.size(); ++i)
+		{
+			Double3 position = GetPosition(i);
+			bodies[i].position = { static_cast<float>(position.x), static_cast<float>(position.y), static_cast<float>(position.z), m_bodies[i].position.w };
+			bodies[i].velocity = m_bodies[i].velocity;
+		}
+		return bodies;
+	}
+
+	const BodyArray & TiledCoordinates::GetOffsetBodies() const
+	{
+		return m_bodies;
+	}
+
+	const std::vector<Int4> & TiledCoordinates::GetCells() const
+	{
+		return m_cells;
+	}
+
+	TiledNBody::TiledNBody(const BodyArray & bodies, const SimulationParams & params, const double & cellSize) : m_coordinates(cellSize), m_params(params)
+	{
+		m_coordinates.SetBodies(bodies);
+	}
+
+	void TiledNBody::Step()
+	{
+		m_coordinates.Step(m_params, m_accelerations);
+	}
+
+	void TiledNBody::SetBodies(const BodyArray & bodies)
+	{
+		m_coordinates.SetBodies(bodies);
+	}
+
+	BodyArray TiledNBody::GetBodies() const
+	{
+		return m_coordinates.GetBodies();
+	}
+
+	const std::vector<Float4> & TiledNBody::GetAccelerations() const
+	{
+		return m_accelerations;
+	}
+
+	const SimulationParams & TiledNBody::GetParams() const
+	{
+		return m_params;
+	}
+
+	std::string TiledNBody::GetName() const
+	{
+		return "tiled cell=" + std::to_string(m_coordinates.GetCellSize());
+	}
+
+	const TiledCoordinates & TiledNBody::GetCoordinates() const
+	{
+		return m_coordinates;
+	}
+}
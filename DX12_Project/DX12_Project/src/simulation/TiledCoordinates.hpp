@@ -0,0 +1,74 @@
+#pragma once
+#include <simulation/Engine.hpp>
+
+//Mixed precision body positions for large domains. Every body is stored as an integer
+//cell index and a float offset from that cell's anchor (cell * cellSize), so the anchor
+//is exact in double precision while all per-body arithmetic stays in float. Separations
+//are formed from the anchor difference plus the offset difference, which keeps close
+//interactions accurate no matter how far from the origin the bodies are.
+namespace dx
+{
+	struct Int4
+	{
+		int32_t x, y, z, w;
+	};
+
+	struct Double3
+	{
+		double x, y, z;
+	};
+
+	class TiledCoordinates
+	{
+	public:
+		TiledCoordinates(const double & cellSize = 1024.0);
+		void SetBodies(const BodyArray & bodies);
+		void SetBody(const size_t & index, const Double3 & position, const Float4 & velocity, const float & mass);
+		void Step(const SimulationParams & params);
+		void Step(const SimulationParams & params, std::vector<Float4> & accelerations);
+
+	public:
+		void ComputeAccelerations(std::vector<Float4> & accelerations, const float & softeningSquared) const;
+		void Rebase();
+
+	public:
+		size_t GetNumBodies() const;
+		double GetCellSize() const;
+		Double3 GetPosition(const size_t & index) const;
+		BodyArray GetBodies() const;
+
+		//GPU layout, offsets go into BodyData::position and cells into a parallel int4 buffer
+		const BodyArray & GetOffsetBodies() const;
+		const std::vector<Int4> & GetCells() const;
+
+	public:
+		static void Split(const double & position, const double & cellSize, int32_t & cell, float & offset);
+
+	private:
+		double m_cellSize;
+		float m_cellSizeF;
+		BodyArray m_bodies;
+		std::vector<Int4> m_cells;
+	};
+
+	//Engine adapter so the tile-relative scheme can be validated against the other backends
+	class TiledNBody : public Engine
+	{
+	public:
+		TiledNBody(const BodyArray & bodies, const SimulationParams & params, const double & cellSize = 1024.0);
+		void Step() override;
+
+	public:
+		void SetBodies(const BodyArray & bodies) override;
+		BodyArray GetBodies() const override;
+		const std::vector<Float4> & GetAccelerations() const override;
+		const SimulationParams & GetParams() const override;
+		std::string GetName() const override;
+		const TiledCoordinates & GetCoordinates() const;
+
+	private:
+		TiledCoordinates m_coordinates;
+		SimulationParams m_params;
+		std::vector<Float4> m_accelerations;
+	};
+}
@@ -0,0 +1,92 @@
+//Steps an engine with and without in-situ analysis (energy and a density grid) and reports
+//how the step time changes and what the scheduler ran, coarsened or skipped, e.g.
+//  AnalysisBenchmark tree 32768 400 0.1
+//The step budget is set to 1.25x the median step time without analysis.
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/AnalysisBenchmark.cpp src/simulation/*.cpp -pthread
+#include <simulation/Analysis.hpp>
+#include <simulation/Engine.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+static double Percentile(std::vector<double> values, const double & fraction)
+{
+	std::sort(values.begin(), values.end());
+	return values[static_cast<size_t>(fraction * (values.size() - 1))];
+}
+
+//Returns the step times in seconds
+static std::vector<double> Run(Engine & engine, const unsigned int & numSteps, AnalysisScheduler* scheduler)
+{
+	std::vector<double> times;
+	for (unsigned int step = 0; step < numSteps; ++step)
+	{
+		auto start = std::chrono::steady_clock::now();
+		engine.Step();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		times.push_back(seconds);
+
+		if (scheduler)
+			scheduler->OnStep(step, seconds, [&engine]() { return engine.GetBodies(); });
+	}
+
+	if (scheduler)
+		scheduler->Flush();
+	return times;
+}
+
+int main(int argc, char** argv)
+{
+	std::string engineName = argc > 1 ? argv[1] : "tree";
+	size_t numBodies = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 16384;
+	unsigned int numSteps = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 200;
+	double cpuShare = argc > 4 ? std::atof(argv[4]) : 0.1;
+
+	BodyArray bodies = GenerateShellBodies(numBodies);
+	std::unique_ptr<Engine> engine = CreateEngine(engineName, bodies, SimulationParams());
+	if (!engine)
+	{
+		std::fprintf(stderr, "unknown engine %s\n", engineName.c_str());
+		return EXIT_FAILURE;
+	}
+
+	std::vector<double> baseline = Run(*engine, numSteps, nullptr);
+	double median = Percentile(baseline, 0.5);
+	std::printf("%s, %zu bodies, %u steps, analysis share %.2f\n", engine->GetName().c_str(), numBodies, numSteps, cpuShare);
+	std::printf("%-12s p50 %8.3f ms  p99 %8.3f ms\n", "no analysis", median * 1e3, Percentile(baseline, 0.99) * 1e3);
+
+	AnalysisSchedulerSettings settings;
+	settings.stepBudgetSeconds = 1.25 * median;
+
+	auto energy = std::make_shared<EnergyPlugin>();
+	auto density = std::make_shared<DensityGridPlugin>(64);
+	{
+		AnalysisScheduler scheduler(settings);
+
+		AnalysisSchedule energySchedule;
+		energySchedule.cadence = 10;
+		energySchedule.cpuShare = cpuShare;
+		energySchedule.maxCoarsening = 6;
+		scheduler.AddPlugin(energy, energySchedule);
+
+		AnalysisSchedule densitySchedule;
+		densitySchedule.cadence = 2;
+		densitySchedule.cpuShare = cpuShare * 0.5;
+		densitySchedule.maxCoarsening = 3;
+		scheduler.AddPlugin(density, densitySchedule);
+
+		engine->SetBodies(bodies);
+		std::vector<double> scheduled = Run(*engine, numSteps, &scheduler);
+		std::printf("%-12s p50 %8.3f ms  p99 %8.3f ms\n", "scheduled", Percentile(scheduled, 0.5) * 1e3, Percentile(scheduled, 0.99) * 1e3);
+		std::printf("%s", scheduler.FormatMetrics().c_str());
+	}
+
+	EnergyReport report = energy->GetLastReport();
+	std::printf("last energy %.6f (kinetic %.6f, potential %.6f)\n", report.GetTotal(), report.kinetic, report.potential);
+	return EXIT_SUCCESS;
+}
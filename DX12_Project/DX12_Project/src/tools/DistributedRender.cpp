@@ -0,0 +1,218 @@
+//Sort-last distributed rendering of the generated shell. The bodies are split across
+//forked processes, each rasterizes its share with the CPU sprite model and the images are
+//composited with radix-k (binary swap for maxRadix 2) over Unix sockets, then gathered on
+//rank 0 and compared with the single-process image. Reports the bytes every rank sent
+//while compositing, which stays below one image however many processes there are, e.g.
+//  DistributedRender 200000 16 2 shell.png
+//POSIX only. Not part of the Windows application, build it next to the utilities, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/DistributedRender.cpp src/simulation/*.cpp src/utils/SpriteRaster.cpp src/utils/Compositor.cpp src/utils/FrameEncoder.cpp src/utils/AsyncFileWriter.cpp -pthread
+#include <simulation/InitialConditions.hpp>
+#include <utils/Compositor.hpp>
+#include <utils/FrameEncoder.hpp>
+#include <utils/Utility.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace dx;
+
+namespace
+{
+	const float Pi = 3.14159265f;
+
+	//Fixed size so a child's report arrives in one pipe write
+	struct RankResult
+	{
+		unsigned int rank;
+		double rasterSeconds;
+		double compositeSeconds;
+		uint64_t bytesSent;
+		uint64_t gatherBytes;
+		double maxError;
+		double maxValue;
+		int succeeded;
+	};
+
+	double SecondsSince(const std::chrono::high_resolution_clock::time_point & begin)
+	{
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
+	bool WriteImage(const SpriteImage & image, const std::string & path)
+	{
+		std::vector<unsigned char> rgba(size_t(image.width) * image.height * 4, 255);
+		for (size_t i = 0; i < size_t(image.width) * image.height; ++i)
+			for (int c = 0; c < 3; ++c)
+				rgba[i * 4 + c] = static_cast<unsigned char>((std::min)(image.pixels[i * 3 + c], 1.0f) * 255.0f + 0.5f);
+
+		std::vector<unsigned char> png;
+		EncodePng({ rgba.data(), image.width, image.height, size_t(image.width) * 4 }, png);
+
+		FILE* file = std::fopen(path.c_str(), "wb");
+		bool written = file && std::fwrite(png.data(), 1, png.size(), file) == png.size();
+		if (file && std::fclose(file) != 0)
+			written = false;
+		return written;
+	}
+
+	//Body range, rasterization and compositing of one rank, the root also checks the result
+	RankResult RunRank(SocketTransport & transport, const BodyArray & bodies, const SpriteSettings & sprites, const SpriteTexture & texture,
+					   const SpriteImage & reference, const CompositeSettings & settings, const std::string & output)
+	{
+		const unsigned int rank = transport.GetRank();
+		const unsigned int size = transport.GetSize();
+		size_t first = bodies.size() * rank / size;
+		size_t end = bodies.size() * (rank + 1) / size;
+
+		RankResult result = {};
+		result.rank = rank;
+
+		SpriteImage image;
+		image.Resize(reference.width, reference.height);
+		auto begin = std::chrono::high_resolution_clock::now();
+		RasterizeSprites(bodies.data() + first, end - first, sprites, texture, image);
+		result.rasterSeconds = SecondsSince(begin);
+
+		CompositeReport report = CompositeImage(transport, image, settings);
+		result.compositeSeconds = report.seconds;
+		result.bytesSent = report.bytesSent - (rank == settings.root ? 0 : report.gatherBytes);
+		result.gatherBytes = report.gatherBytes;
+		result.succeeded = report.succeeded ? 1 : 0;
+
+		if (rank == settings.root)
+		{
+			for (size_t i = 0; i < image.pixels.size(); ++i)
+			{
+				result.maxError = (std::max)(result.maxError, double(std::fabs(image.pixels[i] - reference.pixels[i])));
+				result.maxValue = (std::max)(result.maxValue, double(reference.pixels[i]));
+			}
+
+			if (!output.empty() && !WriteImage(image, output))
+				result.succeeded = 0;
+		}
+
+		return result;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+	unsigned int maxProcesses = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 16;
+	CompositeSettings settings;
+	settings.maxRadix = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 2;
+	std::string output = argc > 4 ? argv[4] : "";
+
+	const BodyArray bodies = GenerateShellBodies(numBodies);
+	const SpriteTexture texture = GenerateStarTexture();
+
+	//Looking at the shell from outside, same projection as Camera
+	SpriteSettings sprites;
+	float view[16], projection[16];
+	MakeLookAtLH({ 0.0f, 0.0f, -20.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, view);
+	MakePerspectiveFovLH(45.0f * Pi / 180.0f, float(SCREEN_WIDTH) / SCREEN_HEIGHT, 0.1f, 1000.0f, projection);
+	MultiplyMatrices(view, projection, sprites.viewProjection);
+	sprites.pointSize = 0.2f;
+
+	SpriteImage reference;
+	reference.Resize(SCREEN_WIDTH, SCREEN_HEIGHT);
+	auto begin = std::chrono::high_resolution_clock::now();
+	RasterizeSprites(bodies.data(), bodies.size(), sprites, texture, reference);
+	double referenceSeconds = SecondsSince(begin);
+
+	const double imageMB = reference.pixels.size() * sizeof(float) / 1e6;
+	std::printf("%zu bodies, %ux%u image of %.2f MB, max radix %u, single process raster %.1f ms\n", numBodies, SCREEN_WIDTH, SCREEN_HEIGHT, imageMB,
+				settings.maxRadix, referenceSeconds * 1e3);
+	std::printf("%6s %-12s %10s %13s %15s %11s %13s %11s\n", "ranks", "rounds", "raster ms", "composite ms", "sent MB / rank", "of image", "gather MB", "max error");
+
+	const unsigned int counts[] = { 1, 2, 3, 4, 6, 8, 12, 16, 32, 64 };
+	unsigned int largest = 1;
+	for (unsigned int size : counts)
+		largest = size <= maxProcesses ? size : largest;
+
+	size_t failures = 0;
+	for (unsigned int size : counts)
+	{
+		if (size > maxProcesses)
+			break;
+
+		std::vector<int> sockets;
+		std::string error;
+		int results[2];
+		if (!SocketTransport::CreateMesh(size, sockets, error) || pipe(results) != 0)
+		{
+			std::printf("%u ranks: %s\n", size, error.c_str());
+			return EXIT_FAILURE;
+		}
+
+		std::vector<pid_t> children;
+		for (unsigned int rank = 0; rank < size; ++rank)
+		{
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				close(results[0]);
+				RankResult result;
+				{
+					SocketTransport transport(rank, size, sockets);
+					result = RunRank(transport, bodies, sprites, texture, reference, settings, size == largest ? output : "");
+				}
+				ssize_t written = write(results[1], &result, sizeof(result));
+				_exit(written == sizeof(result) ? 0 : 1);
+			}
+			children.push_back(pid);
+		}
+
+		close(results[1]);
+		for (int socket : sockets)
+			close(socket);
+
+		std::vector<RankResult> ranks;
+		RankResult result;
+		while (read(results[0], &result, sizeof(result)) == sizeof(result))
+			ranks.push_back(result);
+		close(results[0]);
+
+		bool succeeded = ranks.size() == size;
+		for (pid_t child : children)
+		{
+			int status = 0;
+			waitpid(child, &status, 0);
+			succeeded = succeeded && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		}
+
+		double raster = 0.0, composite = 0.0, sent = 0.0, gather = 0.0, maxError = 0.0, maxValue = 0.0;
+		for (const RankResult & rank : ranks)
+		{
+			raster = (std::max)(raster, rank.rasterSeconds);
+			composite = (std::max)(composite, rank.compositeSeconds);
+			sent = (std::max)(sent, double(rank.bytesSent));
+			succeeded = succeeded && rank.succeeded;
+			if (rank.rank == settings.root)
+			{
+				gather = double(rank.gatherBytes);
+				maxError = rank.maxError;
+				maxValue = rank.maxValue;
+			}
+		}
+
+		//Summation order differs between the ranks, the sums only agree up to rounding
+		succeeded = succeeded && maxError <= 1e-5 * (std::max)(1.0, maxValue);
+		failures += succeeded ? 0 : 1;
+
+		std::string rounds;
+		for (unsigned int k : GetCompositeRounds(size, settings.maxRadix))
+			rounds += (rounds.empty() ? "" : " ") + std::to_string(k);
+
+		std::printf("%6u %-12s %10.1f %13.1f %15.2f %10.0f%% %13.2f %11.2e%s\n", size, rounds.empty() ? "-" : rounds.c_str(), raster * 1e3, composite * 1e3,
+					sent / 1e6, 100.0 * sent / 1e6 / imageMB, gather / 1e6, maxError, succeeded ? "" : "  FAILED");
+	}
+
+	std::printf("%s\n", failures == 0 ? "passed" : "FAILED");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,121 @@
+//Runs the generated shell with the plain CPU engine and with escapers demoted to tracers or
+//pruned, and reports how the active population and the cost of a step shrink as bodies
+//leave, along with how far the bound bodies drift from the plain run. The shell is slowed
+//down so it stays bound, and a fraction of it is launched outward above escape speed, e.g.
+//  EscaperBenchmark 8192 2048 64 4 0.2
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/EscaperBenchmark.cpp src/simulation/*.cpp -pthread
+#include <simulation/Diagnostics.hpp>
+#include <simulation/Escapers.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+static double SecondsSince(const std::chrono::steady_clock::time_point & start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 8192;
+	unsigned int numSteps = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 2048;
+	EscaperSettings settings;
+	settings.interval = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 64;
+	settings.radiusFactor = argc > 4 ? static_cast<float>(std::atof(argv[4])) : 4.0f;
+	float hotFraction = argc > 5 ? static_cast<float>(std::atof(argv[5])) : 0.2f;
+	const unsigned int reportInterval = (std::max)(numSteps / 8, 1u);
+
+	//Every hot body gets 1.5 times the escape speed of the whole mass at its radius, radially
+	BodyArray bodies = GenerateShellBodies(numBodies, 1.54f, 1.0f);
+	const size_t hotStride = hotFraction > 0.0f ? (std::max)(size_t(1.0f / hotFraction + 0.5f), size_t(1)) : 0;
+	for (size_t i = 0; hotStride > 0 && i < numBodies; i += hotStride)
+	{
+		Body & body = bodies[i];
+		float r = std::sqrt(body.position.x * body.position.x + body.position.y * body.position.y + body.position.z * body.position.z);
+		float speed = 1.5f * std::sqrt(2.0f * numBodies / r);
+		body.velocity.x += body.position.x / r * speed;
+		body.velocity.y += body.position.y / r * speed;
+		body.velocity.z += body.position.z / r * speed;
+	}
+
+	const SimulationParams params;
+
+	EscaperSettings pruneSettings = settings;
+	pruneSettings.prune = true;
+
+	CpuNBody plain(bodies, params);
+	EscaperNBody tracers(bodies, params, settings);
+	EscaperNBody pruned(bodies, params, pruneSettings);
+
+	std::printf("%zu bodies, 1 in %zu launched, %u steps, detection every %u steps beyond %.1f half-mass radii\n", numBodies, hotStride, numSteps, settings.interval,
+				settings.radiusFactor);
+	std::printf("%6s %10s %9s %9s %10s %10s %10s %12s %12s\n", "step", "plain ms", "active", "tracers", "tracer ms", "archived", "pruned ms", "detect ms", "half-mass r");
+
+	double plainTotal = 0.0, tracerTotal = 0.0, prunedTotal = 0.0;
+	double plainWindow = 0.0, tracerWindow = 0.0, prunedWindow = 0.0;
+	for (unsigned int step = 1; step <= numSteps; ++step)
+	{
+		auto start = std::chrono::steady_clock::now();
+		plain.Step();
+		plainWindow += SecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		tracers.Step();
+		tracerWindow += SecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		pruned.Step();
+		prunedWindow += SecondsSince(start);
+
+		if (step % reportInterval == 0 || step == numSteps)
+		{
+			unsigned int steps = step % reportInterval == 0 ? reportInterval : step % reportInterval;
+			const EscaperReport & report = tracers.GetLastReport();
+			std::printf("%6u %10.2f %9zu %9zu %10.2f %10zu %10.2f %12.2f %12.3f\n", step, plainWindow * 1e3 / steps, tracers.GetNumActive(), tracers.GetNumTracers(),
+						tracerWindow * 1e3 / steps, pruned.GetArchive().size(), prunedWindow * 1e3 / steps, report.seconds * 1e3, report.halfMassRadius);
+
+			plainTotal += plainWindow;
+			tracerTotal += tracerWindow;
+			prunedTotal += prunedWindow;
+			plainWindow = tracerWindow = prunedWindow = 0.0;
+		}
+	}
+
+	//Bodies that stayed active in the tracer run, compared with the same bodies of the plain run.
+	//Dropping the pull of the escapers on them is the approximation both modes make.
+	BodyArray reference = plain.GetBodies();
+	BodyArray candidate = tracers.GetBodies();
+	BodyArray bound, boundReference;
+	std::vector<unsigned char> archived(numBodies, 0);
+	for (const ArchivedBody & body : pruned.GetArchive())
+		archived[body.id] = 1;
+	for (size_t i = 0; i < numBodies; ++i)
+	{
+		if (!archived[i])
+		{
+			bound.push_back(candidate[i]);
+			boundReference.push_back(reference[i]);
+		}
+	}
+
+	//Tracers and pruning make the same decisions, so the survivors of one are the active bodies of the other
+	BodyArray survivors = pruned.GetBodies();
+	bool consistent = survivors.size() == bound.size() && pruned.GetArchive().size() == tracers.GetNumTracers();
+	DivergenceReport boundDrift = ComputePositionDivergence(boundReference, bound);
+	DivergenceReport prunedDrift = consistent ? ComputePositionDivergence(bound, survivors) : DivergenceReport{ -1.0, -1.0 };
+	DivergenceReport allDrift = ComputePositionDivergence(reference, candidate);
+
+	std::printf("total %.1f ms plain, %.1f ms tracers (%.2fx), %.1f ms pruned (%.2fx)\n", plainTotal * 1e3, tracerTotal * 1e3, plainTotal / tracerTotal,
+				prunedTotal * 1e3, plainTotal / prunedTotal);
+	std::printf("bound bodies vs plain: max %.3e rms %.3e, all bodies with tracers vs plain: max %.3e rms %.3e\n", boundDrift.maxError, boundDrift.rmsError,
+				allDrift.maxError, allDrift.rmsError);
+	std::printf("pruned vs tracers: max %.3e rms %.3e\n", prunedDrift.maxError, prunedDrift.rmsError);
+	std::printf("%s\n", consistent && prunedDrift.maxError == 0.0 ? "passed" : "FAILED");
+	return consistent && prunedDrift.maxError == 0.0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,122 @@
+//Measures what the flight recorder costs per event: CPU scopes, counters and queue states
+//from one thread and scopes from several threads sharing the ring, against an empty loop.
+//Also checks that a dump taken between frames lists the frame times oldest first and that
+//its reason is escaped and that a frame timed by the recorder is not clamped, e.g.
+//  FlightRecorderBenchmark 10000000 4
+//Not part of the Windows application, build it next to the utilities, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/FlightRecorderBenchmark.cpp src/utils/FlightRecorder.cpp -pthread
+#include <utils/FlightRecorder.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dx;
+
+namespace
+{
+	double SecondsSince(const std::chrono::steady_clock::time_point & start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	//Nanoseconds per iteration of record on numThreads threads, each doing numEvents
+	template <typename Record>
+	double Measure(const size_t & numEvents, const unsigned int & numThreads, Record record)
+	{
+		std::atomic<bool> start(false);
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t < numThreads; ++t)
+		{
+			threads.emplace_back([&]
+			{
+				while (!start.load())
+					std::this_thread::yield();
+				for (size_t i = 0; i < numEvents; ++i)
+					record(i);
+			});
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		start.store(true);
+		for (std::thread & thread : threads)
+			thread.join();
+		return SecondsSince(begin) * 1e9 / numEvents;
+	}
+
+	std::string ReadFile(const std::string & path)
+	{
+		std::ifstream file(path);
+		std::stringstream contents;
+		contents << file.rdbuf();
+		return contents.str();
+	}
+
+	size_t CheckDump()
+	{
+		FlightRecorderSettings settings;
+		settings.historyFrames = 4;
+		settings.spikeThresholdMs = 0.0;
+		settings.spikeRatio = 0.0;
+		settings.outputPrefix = "flight_recorder_check";
+		FlightRecorder recorder(settings);
+
+		//Six frames through a ring of four, then a dump from outside EndFrame
+		for (int frame = 1; frame <= 6; ++frame)
+		{
+			FLIGHT_SCOPE(&recorder, "Frame \"quoted\"");
+			recorder.EndFrame(double(frame));
+		}
+		recorder.DumpNow("manual \"dump\" from C:\\trace\n");
+		recorder.Flush();
+
+		std::string json = ReadFile(recorder.GetLastDumpPath());
+		std::remove(recorder.GetLastDumpPath().c_str());
+
+		//A frame timed by the recorder itself is not clamped
+		recorder.BeginFrame();
+		std::this_thread::sleep_for(std::chrono::milliseconds(150));
+		recorder.EndFrame();
+
+		size_t failures = 0;
+		failures += recorder.GetLastFrameMs() >= 150.0 ? 0 : 1;
+		failures += json.find("\"frameTimesMs\":[3.000,4.000,5.000,6.000]") != std::string::npos ? 0 : 1;
+		failures += json.find("\"reason\":\"manual \\\"dump\\\" from C:\\\\trace\\u000a\"") != std::string::npos ? 0 : 1;
+		failures += json.find("\"name\":\"Frame \\\"quoted\\\"\"") != std::string::npos ? 0 : 1;
+		std::printf("dump between frames: %s\n", failures ? "FAILED" : "passed");
+		return failures;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t numEvents = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+	unsigned int numThreads = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 4;
+
+	FlightRecorder recorder;
+	std::atomic<uint64_t> sink(0);
+
+	//The loop and the argument computation alone
+	double baseline = Measure(numEvents, 1, [&](size_t i) { sink.fetch_add(i & 1, std::memory_order_relaxed); });
+	double scope = Measure(numEvents, 1, [&](size_t i) { FLIGHT_SCOPE(&recorder, "Scope"); sink.fetch_add(i & 1, std::memory_order_relaxed); });
+	double counter = Measure(numEvents, 1, [&](size_t i) { recorder.RecordCounter("Counter", double(i)); });
+	double queue = Measure(numEvents, 1, [&](size_t i) { recorder.RecordQueueState("Queue", i + 2, i); });
+	double shared = Measure(numEvents, numThreads, [&](size_t i) { FLIGHT_SCOPE(&recorder, "Scope"); sink.fetch_add(i & 1, std::memory_order_relaxed); });
+
+	std::printf("%zu events per run\n", numEvents);
+	std::printf("%-28s %8.2f ns\n", "empty loop", baseline);
+	std::printf("%-28s %8.2f ns\n", "scope", scope - baseline);
+	std::printf("%-28s %8.2f ns\n", "counter", counter);
+	std::printf("%-28s %8.2f ns\n", "queue state", queue);
+	std::string sharedLabel = "scope on " + std::to_string(numThreads) + " threads";
+	std::printf("%-28s %8.2f ns, each thread\n", sharedLabel.c_str(), shared - baseline);
+
+	size_t failures = CheckDump();
+	std::printf("%s\n", failures ? "FAILED" : "passed");
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+//Writes the generated shell as CSV and as Gadget snapshots (format 1 little endian float,
+//format 2 big endian double), imports them again and reports throughput and round-trip error.
+//Also checks that an import into a smaller capacity reports the truncation, e.g.
+//  ImportBenchmark 1000000 /tmp
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/ImportBenchmark.cpp src/simulation/*.cpp -pthread
+#include <simulation/Importers.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace dx;
+
+static void WriteRecord(FILE* file, const void* data, const uint32_t & size, const bool & bigEndian)
+{
+	unsigned char marker[4];
+	for (int i = 0; i < 4; ++i)
+		marker[i] = static_cast<unsigned char>(size >> (bigEndian ? 24 - 8 * i : 8 * i));
+
+	std::fwrite(marker, 1, 4, file);
+	std::fwrite(data, 1, size, file);
+	std::fwrite(marker, 1, 4, file);
+}
+
+static void AppendValue(std::vector<unsigned char> & out, const double & value, const bool & isDouble, const bool & bigEndian)
+{
+	unsigned char bytes[8];
+	size_t size = isDouble ? 8 : 4;
+	if (isDouble)
+		std::memcpy(bytes, &value, 8);
+	else
+	{
+		float narrow = static_cast<float>(value);
+		std::memcpy(bytes, &narrow, 4);
+	}
+
+	for (size_t i = 0; i < size; ++i)
+		out.push_back(bytes[bigEndian ? size - 1 - i : i]);
+}
+
+static void WriteGadget(const std::string & path, const BodyArray & bodies, const bool & format2, const bool & isDouble, const bool & bigEndian)
+{
+	FILE* file = std::fopen(path.c_str(), "wb");
+
+	//All bodies as type 1 with per-particle masses
+	std::vector<unsigned char> header(256, 0);
+	uint32_t count = static_cast<uint32_t>(bodies.size());
+	for (int i = 0; i < 4; ++i)
+	{
+		header[4 + i] = static_cast<unsigned char>(count >> (bigEndian ? 24 - 8 * i : 8 * i));
+		header[124 + i] = static_cast<unsigned char>(1u >> (bigEndian ? 24 - 8 * i : 8 * i));
+	}
+
+	std::vector<unsigned char> positions, velocities, ids, masses;
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		const Body & body = bodies[i];
+		AppendValue(positions, body.position.x, isDouble, bigEndian);
+		AppendValue(positions, body.position.y, isDouble, bigEndian);
+		AppendValue(positions, body.position.z, isDouble, bigEndian);
+		AppendValue(velocities, body.velocity.x, isDouble, bigEndian);
+		AppendValue(velocities, body.velocity.y, isDouble, bigEndian);
+		AppendValue(velocities, body.velocity.z, isDouble, bigEndian);
+		AppendValue(masses, body.position.w, isDouble, bigEndian);
+		ids.insert(ids.end(), 4, 0);
+	}
+
+	const char* labels[] = { "HEAD", "POS ", "VEL ", "ID  ", "MASS" };
+	const std::vector<unsigned char>* blocks[] = { &header, &positions, &velocities, &ids, &masses };
+	for (int b = 0; b < 5; ++b)
+	{
+		if (format2)
+		{
+			unsigned char label[8];
+			uint32_t next = static_cast<uint32_t>(blocks[b]->size() + 8);
+			std::memcpy(label, labels[b], 4);
+			for (int i = 0; i < 4; ++i)
+				label[4 + i] = static_cast<unsigned char>(next >> (bigEndian ? 24 - 8 * i : 8 * i));
+			WriteRecord(file, label, 8, bigEndian);
+		}
+
+		WriteRecord(file, blocks[b]->data(), static_cast<uint32_t>(blocks[b]->size()), bigEndian);
+	}
+
+	std::fclose(file);
+}
+
+static void WriteCsv(const std::string & path, const BodyArray & bodies)
+{
+	FILE* file = std::fopen(path.c_str(), "w");
+	std::fprintf(file, "x,y,z,vx,vy,vz,mass\n");
+	for (const Body & body : bodies)
+	{
+		std::fprintf(file, "%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n", body.position.x, body.position.y, body.position.z,
+					 body.velocity.x, body.velocity.y, body.velocity.z, body.position.w);
+	}
+	std::fclose(file);
+}
+
+static bool Measure(const char* name, const std::string & path, const BodyArray & reference)
+{
+	FILE* file = std::fopen(path.c_str(), "rb");
+	std::fseek(file, 0, SEEK_END);
+	double megabytes = std::ftell(file) / double(1 << 20);
+	std::fclose(file);
+
+	BodyArray bodies;
+	std::string error;
+	auto start = std::chrono::high_resolution_clock::now();
+	bool success = ImportBodies(path, bodies, error);
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (!success || bodies.size() != reference.size())
+	{
+		std::printf("%-28s failed: %s (%zu bodies)\n", name, error.c_str(), bodies.size());
+		return false;
+	}
+
+	double maxError = 0.0;
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		const float* a = &bodies[i].position.x;
+		const float* b = &reference[i].position.x;
+		for (int c = 0; c < 8; ++c)
+			maxError = (std::max)(maxError, static_cast<double>(std::fabs(a[c] - b[c])));
+	}
+
+	std::printf("%-28s %8.1f MB %8.3f s %8.1f MB/s %8.2f Mbodies/s  max error %.3e\n", name, megabytes, seconds, megabytes / seconds,
+				bodies.size() / seconds * 1e-6, maxError);
+	return maxError < 1e-5;
+}
+
+//One body short of the file and exactly its size
+static bool CheckCapacity(const char* name, const std::string & path, const size_t & numBodies)
+{
+	BodyArray bodies(numBodies);
+	ImportResult shorter, exact;
+	std::string error;
+	bool ok = ImportBodies(path, bodies.data(), numBodies - 1, shorter, error) && shorter.truncated && shorter.count == numBodies - 1;
+	ok = ImportBodies(path, bodies.data(), numBodies, exact, error) && !exact.truncated && exact.count == numBodies && ok;
+
+	std::printf("%-28s capacity %zu: %zu bodies%s, capacity %zu: %zu bodies%s%s\n", name, numBodies - 1, shorter.count, shorter.truncated ? " truncated" : "",
+				numBodies, exact.count, exact.truncated ? " truncated" : "", ok ? "" : "  FAILED");
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+	std::string directory = argc > 2 ? argv[2] : ".";
+
+	BodyArray bodies = GenerateShellBodies(numBodies);
+	for (size_t i = 0; i < bodies.size(); ++i)
+		bodies[i].position.w = 1.f + static_cast<float>(i % 7);
+
+	WriteCsv(directory + "/bodies.csv", bodies);
+	WriteGadget(directory + "/bodies_f1.gadget", bodies, false, false, false);
+	WriteGadget(directory + "/bodies_f2.gadget", bodies, true, true, true);
+
+	bool ok = Measure("csv", directory + "/bodies.csv", bodies);
+	ok = Measure("gadget format 1 float LE", directory + "/bodies_f1.gadget", bodies) && ok;
+	ok = Measure("gadget format 2 double BE", directory + "/bodies_f2.gadget", bodies) && ok;
+	ok = CheckCapacity("csv", directory + "/bodies.csv", numBodies) && ok;
+	ok = CheckCapacity("gadget format 1 float LE", directory + "/bodies_f1.gadget", numBodies) && ok;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
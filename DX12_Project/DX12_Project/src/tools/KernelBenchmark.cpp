@@ -0,0 +1,80 @@
+//Headless benchmark of the compile-time specialized CPU force kernels, and of the
+//single-state two-pass update against them (step time and bytes per body).
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -ffast-math -Isrc src/tools/KernelBenchmark.cpp src/simulation/*.cpp -pthread
+#include <simulation/CpuNBody.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+static double MeasureStepMs(const BodyArray & bodies, const KernelConfig & config, const int & steps, size_t* bytesPerBody = nullptr)
+{
+	SimulationParams params;
+	CpuNBody engine(bodies, params, config);
+	if (bytesPerBody)
+		*bytesPerBody = engine.GetStepBytesPerBody();
+
+	//Warm up caches and thread creation
+	engine.Step();
+
+	auto begin = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < steps; ++i)
+		engine.Step();
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - begin).count() / steps;
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16384;
+	int steps = argc > 2 ? std::atoi(argv[2]) : 5;
+	BodyArray bodies = GenerateShellBodies(numBodies);
+
+	KernelConfig reference;
+	double referenceMs = MeasureStepMs(bodies, reference, steps);
+
+	std::printf("%zu bodies, %d steps\n", numBodies, steps);
+	std::printf("%-48s %12s %14s %9s\n", "kernel", "ms/step", "Ginteract/s", "speedup");
+
+	const KernelPrecision precisions[] = { KernelPrecision::Float, KernelPrecision::Double, KernelPrecision::FloatDoubleAccumulate };
+	for (KernelPrecision precision : precisions)
+	{
+		for (int variant = 0; variant < 8; ++variant)
+		{
+			KernelConfig config;
+			config.precision = precision;
+			config.equalMass = (variant & 1) != 0;
+			config.softening = (variant & 2) == 0;
+			config.planar = (variant & 4) != 0;
+
+			double ms = precision == reference.precision && variant == 0 ? referenceMs : MeasureStepMs(bodies, config, steps);
+			double interactions = static_cast<double>(numBodies) * static_cast<double>(numBodies);
+			std::printf("%-48s %12.3f %14.3f %8.2fx\n", CpuNBody::GetConfigName(config).c_str(), ms, interactions / (ms * 1e6), referenceMs / ms);
+		}
+	}
+
+	//Memory against throughput of the two-pass update, per precision with the reference options
+	std::printf("\n%-56s %12s %14s %9s %9s\n", "kernel", "ms/step", "Ginteract/s", "B/body", "speedup");
+	for (KernelPrecision precision : precisions)
+	{
+		KernelConfig config;
+		config.precision = precision;
+
+		size_t bytes = 0, singleBytes = 0;
+		double ms = MeasureStepMs(bodies, config, steps, &bytes);
+		config.singleState = true;
+		double singleMs = MeasureStepMs(bodies, config, steps, &singleBytes);
+
+		double interactions = static_cast<double>(numBodies) * static_cast<double>(numBodies);
+		config.singleState = false;
+		std::printf("%-56s %12.3f %14.3f %9zu %8.2fx\n", CpuNBody::GetConfigName(config).c_str(), ms, interactions / (ms * 1e6), bytes, 1.0);
+		config.singleState = true;
+		std::printf("%-56s %12.3f %14.3f %9zu %8.2fx\n", CpuNBody::GetConfigName(config).c_str(), singleMs, interactions / (singleMs * 1e6), singleBytes, ms / singleMs);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+//Headless scaling report for the multigrid backend: solve time, V-cycles and force error
+//against direct summation as the root grid grows, with and without a refinement patch, e.g.
+//  MultigridScaling 16384 4 7 256
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/MultigridScaling.cpp src/simulation/*.cpp -pthread
+#include <simulation/InitialConditions.hpp>
+#include <simulation/Multigrid.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+//Direct summation for every stride-th body, the reference the mesh forces are held to
+static std::vector<Float4> DirectAccelerations(const BodyArray & bodies, const size_t & stride, const float & softeningSquared)
+{
+	std::vector<Float4> accelerations;
+	for (size_t i = 0; i < bodies.size(); i += stride)
+	{
+		double a[3] = { 0.0, 0.0, 0.0 };
+		const Float4 & p = bodies[i].position;
+		for (const Body & other : bodies)
+		{
+			double dx = other.position.x - p.x, dy = other.position.y - p.y, dz = other.position.z - p.z;
+			double r2 = dx * dx + dy * dy + dz * dz + softeningSquared;
+			double s = other.position.w / (r2 * std::sqrt(r2));
+			a[0] += dx * s;
+			a[1] += dy * s;
+			a[2] += dz * s;
+		}
+		accelerations.push_back({ float(a[0]), float(a[1]), float(a[2]), 0.f });
+	}
+
+	return accelerations;
+}
+
+//Median and 90th percentile of |a - a_ref| / |a_ref| over the sampled bodies
+static void ForceError(const std::vector<Float4> & mesh, const std::vector<Float4> & reference, const size_t & stride, double & median, double & p90)
+{
+	std::vector<double> errors;
+	for (size_t k = 0; k < reference.size(); ++k)
+	{
+		const Float4 & a = mesh[k * stride];
+		const Float4 & r = reference[k];
+		double dx = a.x - r.x, dy = a.y - r.y, dz = a.z - r.z;
+		double norm = std::sqrt(double(r.x) * r.x + double(r.y) * r.y + double(r.z) * r.z);
+		errors.push_back(std::sqrt(dx * dx + dy * dy + dz * dz) / (std::max)(norm, 1e-12));
+	}
+
+	std::sort(errors.begin(), errors.end());
+	median = errors[errors.size() / 2];
+	p90 = errors[errors.size() * 9 / 10];
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16384;
+	unsigned int minLevels = argc > 2 ? std::atoi(argv[2]) : 4;
+	unsigned int maxLevels = argc > 3 ? std::atoi(argv[3]) : 7;
+	size_t samples = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 256;
+
+	BodyArray bodies = GenerateShellBodies(numBodies);
+	SimulationParams params;
+	size_t stride = (std::max)(numBodies / (std::max)(samples, size_t(1)), size_t(1));
+	std::vector<Float4> reference = DirectAccelerations(bodies, stride, params.softeningSquared);
+
+	std::printf("%zu bodies, %zu reference samples\n", numBodies, reference.size());
+	std::printf("%6s %7s %9s %9s %7s %10s %9s %9s\n", "grid", "patches", "ms", "ns/node", "cycles", "residual", "err p50", "err p90");
+
+	for (unsigned int levels = minLevels; levels <= maxLevels; ++levels)
+	{
+		for (unsigned int refinement = 0; refinement <= 1; ++refinement)
+		{
+			MultigridSettings settings;
+			settings.gridLevels = levels;
+			settings.refinementLevels = refinement;
+			MultigridNBody engine(bodies, params, settings);
+
+			//One warm-up pass sizes the level hierarchy, then the best of three
+			std::vector<Float4> accelerations;
+			engine.ComputeAccelerations(accelerations);
+			double best = 1e30;
+			for (int run = 0; run < 3; ++run)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				engine.ComputeAccelerations(accelerations);
+				best = (std::min)(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+			}
+
+			const std::vector<MultigridReport> & reports = engine.GetReports();
+			unsigned int cycles = 0;
+			float residual = 0.f;
+			for (const MultigridReport & report : reports)
+			{
+				cycles += report.cycles;
+				residual = (std::max)(residual, report.residual);
+			}
+
+			double nodes = 0.0;
+			for (size_t k = 0; k < reports.size(); ++k)
+				nodes += std::pow(double((1u << levels) + 1), 3.0);
+
+			double median, p90;
+			ForceError(accelerations, reference, stride, median, p90);
+			std::printf("%4u^3 %7zu %9.2f %9.2f %7u %10.2e %9.4f %9.4f\n", (1u << levels) + 1, reports.size() - 1, best, best * 1e6 / nodes, cycles, residual, median, p90);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,83 @@
+//Headless comparison of rebuilding the near-field neighbor list every step against
+//Verlet reuse with a skin. The defaults give the shell a few neighbors per body and lists that
+//survive several steps, e.g.
+//  NeighborBenchmark 16384 100 0.25 0.1 0.0001
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/NeighborBenchmark.cpp src/simulation/*.cpp -pthread
+#include <simulation/CpuNBody.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <simulation/NeighborList.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+//Number of pairs actually within the cutoff, the near-field work both variants must agree on
+static size_t CountPairs(const BodyArray & bodies, const NeighborList & list)
+{
+	const float cutoffSquared = list.GetCutoff() * list.GetCutoff();
+	size_t pairs = 0;
+
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		size_t count;
+		const uint32_t* neighbors = list.GetNeighbors(i, count);
+		for (size_t k = 0; k < count; ++k)
+		{
+			const Float4 & p = bodies[i].position;
+			const Float4 & q = bodies[neighbors[k]].position;
+			float dx = q.x - p.x, dy = q.y - p.y, dz = q.z - p.z;
+			if (dx * dx + dy * dy + dz * dz <= cutoffSquared)
+				++pairs;
+		}
+	}
+
+	return pairs / 2;
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16384;
+	int steps = argc > 2 ? std::atoi(argv[2]) : 100;
+	float cutoff = argc > 3 ? static_cast<float>(std::atof(argv[3])) : 0.25f;
+	float skin = argc > 4 ? static_cast<float>(std::atof(argv[4])) : 0.1f;
+	float timestep = argc > 5 ? static_cast<float>(std::atof(argv[5])) : 0.0001f;
+
+	BodyArray bodies = GenerateShellBodies(numBodies);
+	SimulationParams params;
+	params.timestep = timestep;
+	CpuNBody engine(bodies, params, KernelConfig());
+
+	NeighborList rebuilt(cutoff, 0.f);
+	NeighborList verlet(cutoff, skin);
+	double rebuildMs = 0.0, verletMs = 0.0;
+	size_t mismatches = 0;
+
+	std::printf("%zu bodies, %d steps, cutoff %.4f, skin %.4f, timestep %.5f\n", numBodies, steps, cutoff, skin, timestep);
+
+	for (int i = 0; i < steps; ++i)
+	{
+		const BodyArray & state = engine.GetBodyArray();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		rebuilt.Build(state);
+		auto middle = std::chrono::high_resolution_clock::now();
+		verlet.Update(state);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		rebuildMs += std::chrono::duration<double, std::milli>(middle - start).count();
+		verletMs += std::chrono::duration<double, std::milli>(end - middle).count();
+
+		if (CountPairs(state, rebuilt) != CountPairs(state, verlet))
+			++mismatches;
+
+		engine.Step();
+	}
+
+	std::printf("rebuild every step: %.3f ms/step, %.1f pairs per body\n", rebuildMs / steps, 2.0 * rebuilt.GetNumPairs() / numBodies);
+	std::printf("verlet with skin:   %.3f ms/step, %llu builds in %llu updates, %.1f candidates per body\n", verletMs / steps,
+				static_cast<unsigned long long>(verlet.GetNumBuilds()), static_cast<unsigned long long>(verlet.GetNumUpdates()), 2.0 * verlet.GetNumPairs() / numBodies);
+	std::printf("speedup %.2fx, steps with mismatching pairs: %zu\n", rebuildMs / verletMs, mismatches);
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,85 @@
+//Headless comparison of Parareal against serial fine integration over the same window.
+//Reports the correction of every iteration, the measured wall-clock speedup, both runs
+//using all workers, and the position error against the serial result, which has to stay
+//within the tolerance for equal accuracy. The softening defaults to 0.01 rather than the
+//application's: with that one close encounters are not resolved at this step, halving the
+//step moves bodies by O(10), so there is no fine solution for the corrections to converge
+//to. E.g.
+//  PararealBenchmark 2048 0 32 8 1e-5 cpu 0.01
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/PararealBenchmark.cpp src/simulation/*.cpp -pthread
+#include <simulation/Diagnostics.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <simulation/Parareal.hpp>
+#include <utils/ResourceLimits.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+//Time-serial integration with all workers on every step
+static double IntegrateSerial(const std::string & name, BodyArray & bodies, const SimulationParams & params, const uint64_t & steps)
+{
+	std::unique_ptr<Engine> engine = CreateEngine(name, bodies, params);
+
+	auto begin = std::chrono::high_resolution_clock::now();
+	for (uint64_t i = 0; i < steps; ++i)
+		engine->Step();
+	auto end = std::chrono::high_resolution_clock::now();
+
+	bodies = engine->GetBodies();
+	return std::chrono::duration<double>(end - begin).count();
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2048;
+	PararealSettings settings;
+	settings.numSlices = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 0;
+	settings.fineStepsPerSlice = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 32;
+	settings.coarseStepRatio = argc > 4 ? static_cast<unsigned int>(std::atoi(argv[4])) : 8;
+	settings.tolerance = argc > 5 ? std::atof(argv[5]) : 1e-5;
+	settings.coarseEngine = argc > 6 ? argv[6] : "cpu";
+
+	SimulationParams params;
+	params.softeningSquared = argc > 7 ? static_cast<float>(std::atof(argv[7])) : 0.01f;
+	PararealIntegrator parareal(params, settings);
+	const BodyArray initial = GenerateShellBodies(numBodies);
+	const uint64_t steps = parareal.GetStepsPerWindow();
+
+	std::printf("%zu bodies, %u workers, %u slices of %u fine steps, coarse %s at %ux the step, tolerance %g, softening squared %g\n", numBodies,
+				GetWorkerCount(), parareal.GetNumSlices(), settings.fineStepsPerSlice, settings.coarseEngine.c_str(), settings.coarseStepRatio, settings.tolerance,
+				params.softeningSquared);
+
+	BodyArray serial = initial;
+	double serialSeconds = IntegrateSerial(settings.fineEngine, serial, params, steps);
+
+	//Coarse alone over the window, how far the cheap propagator is from the answer
+	SimulationParams coarseParams = params;
+	coarseParams.timestep *= settings.coarseStepRatio;
+	BodyArray coarseOnly = initial;
+	double coarseSeconds = IntegrateSerial(settings.coarseEngine, coarseOnly, coarseParams, steps / settings.coarseStepRatio);
+
+	BodyArray result = initial;
+	PararealReport report = parareal.Advance(result);
+
+	for (unsigned int k = 0; k < report.iterations; ++k)
+		std::printf("  iteration %2u: max correction %.3e\n", k + 1, report.corrections[k]);
+
+	DivergenceReport error = ComputePositionDivergence(result, serial);
+	DivergenceReport coarseError = ComputePositionDivergence(coarseOnly, serial);
+	double speedup = serialSeconds / report.totalSeconds;
+
+	std::printf("%-18s %10s %12s %12s\n", "", "seconds", "max error", "rms error");
+	std::printf("%-18s %10.3f %12s %12s\n", "serial fine", serialSeconds, "-", "-");
+	std::printf("%-18s %10.3f %12.3e %12.3e\n", "coarse only", coarseSeconds, coarseError.maxError, coarseError.rmsError);
+	std::printf("%-18s %10.3f %12.3e %12.3e\n", "parareal", report.totalSeconds, error.maxError, error.rmsError);
+	std::printf("parareal: %u iterations%s, %.3f s coarse, %.3f s fine, %llu fine steps for %llu serial ones\n", report.iterations,
+				report.converged ? "" : " (not converged)", report.coarseSeconds, report.fineSeconds, static_cast<unsigned long long>(report.fineSteps),
+				static_cast<unsigned long long>(steps));
+	std::printf("speedup %.2fx (%.0f%% parallel efficiency over %u slices), %s accuracy\n", speedup, 100.0 * speedup / parareal.GetNumSlices(), parareal.GetNumSlices(),
+				error.maxError <= settings.tolerance ? "equal" : "NOT equal");
+
+	return error.maxError <= settings.tolerance ? EXIT_SUCCESS : EXIT_FAILURE;
+}
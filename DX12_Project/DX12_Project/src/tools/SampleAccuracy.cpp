@@ -0,0 +1,122 @@
+//Headless run of the Barnes-Hut backend under the online accuracy sampler, then the same
+//steps at a fixed theta with the sampler off and on to time what it costs. Fails when the
+//default cadence costs more than MAX_OVERHEAD_PERCENT of a step, e.g.
+//  SampleAccuracy 32768 200 0.8 1e-3
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/SampleAccuracy.cpp src/simulation/*.cpp -pthread
+#include <simulation/AccuracySampler.hpp>
+#include <simulation/BarnesHut.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+using namespace dx;
+
+#define MAX_OVERHEAD_PERCENT 3.0
+
+namespace
+{
+	//Average ms per step of a fresh engine, under the sampler when settings are given
+	double Run(const BodyArray & bodies, const SimulationParams & params, const float & theta, const int & steps, const AccuracySettings* settings)
+	{
+		BarnesHutNBody engine(bodies, params, theta);
+		std::unique_ptr<AccuracySampler> sampler;
+		if (settings)
+			sampler = std::make_unique<AccuracySampler>(&engine, params, *settings);
+
+		uint64_t lastReported = UINT64_MAX;
+		double totalMs = 0.0;
+		for (int i = 1; i <= steps; ++i)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			if (sampler)
+				sampler->BeginStep(i, engine.GetBodyArray());
+			engine.Step();
+			if (sampler)
+				sampler->EndStep(engine.GetAccelerations());
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			totalMs += ms;
+
+			//Only the auto-tightened run prints its samples
+			AccuracyReport report;
+			if (sampler && settings->autoTighten && sampler->GetLatestReport(report) && report.step != lastReported)
+			{
+				std::printf("%8llu %8.3f %12.4e %12.4e %12.4e %12.4e %10.3f%s\n", static_cast<unsigned long long>(report.step), report.parameter,
+							report.p50, report.p90, report.p99, report.max, ms, report.overBudget ? "  over budget" : "");
+				lastReported = report.step;
+			}
+		}
+
+		if (sampler)
+		{
+			sampler->Flush();
+			if (settings->autoTighten)
+				std::printf("final theta %.3f, skipped samples %llu\n", engine.GetAccuracyParameter(), static_cast<unsigned long long>(sampler->GetNumSkipped()));
+		}
+		return totalMs / steps;
+	}
+
+	//Steps an engine with the sampler and one without in lockstep so both see the same machine
+	//load, the sample is waited for inside the timed step so its whole cost is charged to it
+	void Compare(const BodyArray & bodies, const SimulationParams & params, const float & theta, const int & steps, const AccuracySettings & settings,
+				 double & offMs, double & onMs)
+	{
+		BarnesHutNBody off(bodies, params, theta), on(bodies, params, theta);
+		AccuracySampler sampler(&on, params, settings);
+
+		offMs = 0.0;
+		onMs = 0.0;
+		for (int i = 1; i <= steps; ++i)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			off.Step();
+			auto middle = std::chrono::high_resolution_clock::now();
+			sampler.BeginStep(i, on.GetBodyArray());
+			on.Step();
+			sampler.EndStep(on.GetAccelerations());
+			sampler.Flush();
+			auto end = std::chrono::high_resolution_clock::now();
+
+			offMs += std::chrono::duration<double, std::milli>(middle - start).count();
+			onMs += std::chrono::duration<double, std::milli>(end - middle).count();
+		}
+
+		offMs /= steps;
+		onMs /= steps;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 32768;
+	int steps = argc > 2 ? std::atoi(argv[2]) : 200;
+	float theta = argc > 3 ? static_cast<float>(std::atof(argv[3])) : 0.8f;
+
+	AccuracySettings settings;
+	settings.errorBudget = argc > 4 ? std::atof(argv[4]) : 1e-3;
+	settings.autoTighten = true;
+
+	BodyArray bodies = GenerateShellBodies(numBodies);
+	SimulationParams params;
+
+	std::printf("%zu bodies, %d steps, theta %.3f, p99 budget %.1e\n", numBodies, steps, theta, settings.errorBudget);
+	std::printf("%8s %8s %12s %12s %12s %12s %10s\n", "step", "theta", "p50", "p90", "p99", "max", "ms/step");
+	double tightenedMs = Run(bodies, params, theta, steps, &settings);
+
+	//The cost of the sampler alone, at a theta that stays put
+	AccuracySettings fixed = settings;
+	fixed.autoTighten = false;
+	double offMs, onMs;
+	Compare(bodies, params, theta, steps, fixed, offMs, onMs);
+	double overhead = (onMs / offMs - 1.0) * 100.0;
+
+	std::printf("average ms/step auto-tightened %.3f\n", tightenedMs);
+	std::printf("average ms/step at theta %.3f: sampler off %.3f, on %.3f (%+.1f%%, every %u steps, %zu bodies)\n", theta, offMs, onMs, overhead,
+				fixed.sampleInterval, fixed.sampleSize);
+
+	bool passed = overhead < MAX_OVERHEAD_PERCENT;
+	std::printf("%s, sampler overhead %s %.1f%%\n", passed ? "passed" : "FAILED", passed ? "under" : "over", MAX_OVERHEAD_PERCENT);
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,123 @@
+//Writes Gadget snapshots of the generated shell through each AsyncFileWriter backend and
+//through buffered stdio, reports throughput, how long Submit holds the simulation thread,
+//and reads every file back to check it, e.g.
+//  SnapshotBenchmark 8000000 /data 16 4
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/SnapshotBenchmark.cpp src/simulation/*.cpp src/utils/AsyncFileWriter.cpp src/utils/SnapshotWriter.cpp -pthread
+#include <simulation/Importers.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <utils/SnapshotWriter.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace dx;
+
+static bool Matches(const std::string & path, const BodyArray & bodies)
+{
+	BodyArray imported;
+	std::string error;
+	if (!ImportBodies(path, imported, error) || imported.size() != bodies.size())
+		return false;
+
+	return std::memcmp(imported.data(), bodies.data(), sizeof(Body) * bodies.size()) == 0;
+}
+
+//Same records with plain fwrite, the way results were dumped so far
+static double WriteWithStdio(const std::string & path, const BodyArray & bodies)
+{
+	auto start = std::chrono::steady_clock::now();
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (!file)
+		return 0.0;
+
+	auto record = [file](const void* data, uint32_t size)
+	{
+		std::fwrite(&size, 4, 1, file);
+		std::fwrite(data, 1, size, file);
+		std::fwrite(&size, 4, 1, file);
+	};
+
+	unsigned char header[256] = {};
+	uint32_t count = static_cast<uint32_t>(bodies.size()), numFiles = 1;
+	std::memcpy(header + 4, &count, 4);
+	std::memcpy(header + 100, &count, 4);
+	std::memcpy(header + 124, &numFiles, 4);
+	record(header, sizeof(header));
+
+	std::vector<float> positions, velocities, masses;
+	std::vector<uint32_t> ids;
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		const Body & body = bodies[i];
+		positions.insert(positions.end(), { body.position.x, body.position.y, body.position.z });
+		velocities.insert(velocities.end(), { body.velocity.x, body.velocity.y, body.velocity.z });
+		ids.push_back(static_cast<uint32_t>(i));
+		masses.push_back(body.position.w);
+	}
+
+	record(positions.data(), static_cast<uint32_t>(positions.size() * 4));
+	record(velocities.data(), static_cast<uint32_t>(velocities.size() * 4));
+	record(ids.data(), static_cast<uint32_t>(ids.size() * 4));
+	record(masses.data(), static_cast<uint32_t>(masses.size() * 4));
+	std::fclose(file);
+
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+	std::string directory = argc > 2 ? argv[2] : ".";
+	unsigned int queueDepth = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 16;
+	size_t blockSize = (argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 4) << 20;
+
+	BodyArray bodies = GenerateShellBodies(numBodies);
+	std::printf("%zu bodies, queue depth %u, %zu KB blocks\n", numBodies, queueDepth, blockSize >> 10);
+
+	struct Variant
+	{
+		const char* name;
+		bool directIO;
+		bool useUring;
+	};
+
+	const Variant variants[] = { { "direct", true, false }, { "direct", true, true }, { "buffered", false, false } };
+	bool allMatch = true;
+
+	for (const Variant & variant : variants)
+	{
+		AsyncIOSettings settings;
+		settings.queueDepth = queueDepth;
+		settings.blockSize = blockSize;
+		settings.directIO = variant.directIO;
+		settings.useUring = variant.useUring;
+
+		SnapshotWriter writer(settings);
+		std::string path = directory + "/snapshot_" + variant.name + (variant.useUring ? "_uring" : "") + ".gadget";
+
+		//The submitting thread only pays for the copy of the bodies
+		auto start = std::chrono::steady_clock::now();
+		writer.Submit(path, bodies, 0.0);
+		double submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		writer.Flush();
+
+		SnapshotResult result;
+		writer.GetLastResult(result);
+		bool match = result.succeeded && Matches(path, bodies);
+		allMatch = allMatch && match;
+
+		std::printf("%-8s %-28s %8.1f MB/s, submit %.2f ms, %s%s\n", variant.name, result.backend.c_str(), result.bytes / (1024.0 * 1024.0) / result.seconds,
+					submitMs, match ? "round trip ok" : "MISMATCH ", result.error.c_str());
+		std::remove(path.c_str());
+	}
+
+	std::string path = directory + "/snapshot_stdio.gadget";
+	double seconds = WriteWithStdio(path, bodies);
+	std::printf("%-8s %-28s %8.1f MB/s (page cache, not synced), %s\n", "stdio", "fwrite", (numBodies * 28.0 + 296.0) / (1024.0 * 1024.0) / seconds,
+				Matches(path, bodies) ? "round trip ok" : "MISMATCH");
+	std::remove(path.c_str());
+
+	return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
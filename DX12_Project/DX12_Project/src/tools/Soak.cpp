@@ -0,0 +1,82 @@
+//Headless soak run: steps a backend for hours while sampling memory, handles and step
+//time percentiles, then fails when a trend grows faster than the configured slopes, e.g.
+//  Soak tree 32768 12 60 soak.csv
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/Soak.cpp src/simulation/*.cpp src/utils/SoakMonitor.cpp -pthread
+#include <simulation/Engine.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <utils/ResourceLimits.hpp>
+#include <utils/SoakMonitor.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace dx;
+
+int main(int argc, char** argv)
+{
+	std::string engineName = argc > 1 ? argv[1] : "cpu";
+	size_t numBodies = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8192;
+	double hours = argc > 3 ? std::atof(argv[3]) : 1.0;
+	double interval = argc > 4 ? std::atof(argv[4]) : 60.0;
+	std::string csvPath = argc > 5 ? argv[5] : "";
+
+	//The body count has to fit the container's memory limit with room for the engine's copies
+	std::printf("%s", FormatResourceLimits(GetResourceLimits()).c_str());
+	size_t bodyBudget = GetBodyBudget(4 * sizeof(Body));
+	if (numBodies > bodyBudget)
+	{
+		std::printf("%zu bodies do not fit the memory limit, using %zu\n", numBodies, bodyBudget);
+		numBodies = bodyBudget;
+	}
+
+	std::unique_ptr<Engine> engine = CreateEngine(engineName, GenerateShellBodies(numBodies), SimulationParams());
+	if (!engine)
+	{
+		std::fprintf(stderr, "unknown engine %s\n", engineName.c_str());
+		return EXIT_FAILURE;
+	}
+
+	SoakSettings settings;
+	settings.sampleIntervalSeconds = interval;
+	SoakMonitor monitor(settings);
+
+	std::printf("%s, %zu bodies, %.2f hours, sample every %.0f s\n", engine->GetName().c_str(), numBodies, hours, interval);
+	std::printf("%10s %12s %12s %8s %10s %10s %10s\n", "seconds", "steps", "rss MB", "handles", "p50 ms", "p90 ms", "p99 ms");
+
+	const double duration = hours * 3600.0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (;;)
+	{
+		auto stepStart = std::chrono::steady_clock::now();
+		engine->Step();
+		auto stepEnd = std::chrono::steady_clock::now();
+		monitor.RecordStep(std::chrono::duration<double>(stepEnd - stepStart).count());
+
+		if (monitor.Update())
+		{
+			const SoakSample & s = monitor.GetSamples().back();
+			std::printf("%10.0f %12llu %12.1f %8llu %10.3f %10.3f %10.3f\n", s.elapsedSeconds, static_cast<unsigned long long>(s.steps),
+						s.residentBytes / (1024.0 * 1024.0), static_cast<unsigned long long>(s.handles), s.stepMsP50, s.stepMsP90, s.stepMsP99);
+			std::fflush(stdout);
+
+			//A resized pod shows up here, parallel loops use the new worker count from the next step
+			if (RefreshResourceLimits())
+				std::printf("%s", FormatResourceLimits(GetResourceLimits()).c_str());
+		}
+
+		if (std::chrono::duration<double>(stepEnd - start).count() >= duration)
+			break;
+	}
+
+	monitor.Sample();
+	SoakVerdict verdict = monitor.Evaluate();
+	std::printf("%s", FormatSoakVerdict(verdict).c_str());
+
+	if (!csvPath.empty() && !monitor.WriteCsv(csvPath))
+		std::fprintf(stderr, "could not write %s\n", csvPath.c_str());
+
+	return verdict.passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,191 @@
+//Records a run of one engine as an indexed trajectory, then times per-body trajectory and
+//region queries through TrajectoryReader against scanning the whole data file, and checks
+//that both give the same answer, e.g.
+//  TrajectoryBenchmark 32768 512 tree /data/run.traj 32
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/TrajectoryBenchmark.cpp src/simulation/*.cpp src/utils/AsyncFileWriter.cpp src/utils/MappedFile.cpp src/utils/Trajectory.cpp -pthread
+#include <simulation/Engine.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <utils/Trajectory.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace dx;
+
+static double SecondsSince(const std::chrono::steady_clock::time_point & start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//What answering a query looked like without the index: read every frame of the file
+template <typename Visit>
+static void ScanAll(const std::string & path, const std::vector<TrajectoryChunk> & chunks, Visit visit)
+{
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (!file)
+		return;
+
+	std::vector<float> positions;
+	for (const TrajectoryChunk & chunk : chunks)
+	{
+		positions.resize(size_t(chunk.numBodies) * chunk.numFrames * 3);
+		std::fseek(file, static_cast<long>(chunk.dataOffset), SEEK_SET);
+		if (std::fread(positions.data(), sizeof(float), positions.size(), file) != positions.size())
+			break;
+
+		visit(chunk, positions.data());
+	}
+	std::fclose(file);
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 32768;
+	unsigned int numSteps = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 512;
+	std::string engineName = argc > 3 ? argv[3] : "tree";
+	std::string path = argc > 4 ? argv[4] : "trajectory.traj";
+	size_t chunkMegabytes = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 32;
+
+	BodyArray bodies = GenerateShellBodies(numBodies);
+	std::unique_ptr<Engine> engine = CreateEngine(engineName, bodies, SimulationParams());
+	if (!engine)
+	{
+		std::printf("unknown engine %s\n", engineName.c_str());
+		return 1;
+	}
+
+	std::string error;
+	TrajectorySettings settings;
+	settings.chunkBytes = chunkMegabytes << 20;
+	TrajectoryWriter writer(settings);
+	if (!writer.Open(path, error))
+	{
+		std::printf("%s\n", error.c_str());
+		return 1;
+	}
+
+	double simulateSeconds = 0.0;
+	auto recordStart = std::chrono::steady_clock::now();
+	for (unsigned int step = 0; step < numSteps; step++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		engine->Step();
+		simulateSeconds += SecondsSince(start);
+
+		if (!writer.AppendFrame(step, engine->GetBodies()))
+		{
+			std::printf("AppendFrame failed at step %u\n", step);
+			return 1;
+		}
+	}
+	if (!writer.Close(error))
+	{
+		std::printf("%s\n", error.c_str());
+		return 1;
+	}
+	double recordSeconds = SecondsSince(recordStart) - simulateSeconds;
+
+	TrajectoryReader reader;
+	if (!reader.Open(path, error))
+	{
+		std::printf("%s\n", error.c_str());
+		return 1;
+	}
+
+	const std::vector<TrajectoryChunk> & chunks = reader.GetChunks();
+	std::printf("%zu bodies, %u steps with %s: %zu chunks of %u frames, recording overhead %.2f s (simulation %.2f s)\n",
+		numBodies, numSteps, engineName.c_str(), chunks.size(), chunks.front().numFrames, recordSeconds, simulateSeconds);
+
+	std::mt19937_64 random(1);
+	int failures = 0;
+	const int numQueries = 16;
+
+	//Trajectory of one body over a window of steps
+	double indexedSeconds = 0.0, scanSeconds = 0.0;
+	for (int q = 0; q < numQueries; q++)
+	{
+		uint64_t id = random() % numBodies;
+		uint64_t first = random() % numSteps;
+		uint64_t last = (std::min)(uint64_t(numSteps - 1), first + numSteps / 4);
+
+		std::vector<TrajectoryPoint> points;
+		auto start = std::chrono::steady_clock::now();
+		reader.GetTrajectory(id, first, last, points);
+		indexedSeconds += SecondsSince(start);
+
+		std::vector<TrajectoryPoint> expected;
+		start = std::chrono::steady_clock::now();
+		ScanAll(path, chunks, [&](const TrajectoryChunk & chunk, const float* positions)
+		{
+			for (uint32_t frame = 0; frame < chunk.numFrames; frame++)
+			{
+				uint64_t step = chunk.firstStep + frame;
+				const float* p = positions + (id * chunk.numFrames + frame) * 3;
+				if (step >= first && step <= last)
+					expected.push_back({ step, p[0], p[1], p[2] });
+			}
+		});
+		scanSeconds += SecondsSince(start);
+
+		bool same = points.size() == expected.size();
+		for (size_t i = 0; i < points.size() && same; i++)
+			same = points[i].step == expected[i].step && points[i].x == expected[i].x && points[i].y == expected[i].y && points[i].z == expected[i].z;
+		failures += same ? 0 : 1;
+	}
+	std::printf("trajectory queries: indexed %8.3f ms, full scan %8.3f ms\n", indexedSeconds * 1e3 / numQueries, scanSeconds * 1e3 / numQueries);
+
+	//Bodies that entered a small box during a window of steps
+	indexedSeconds = 0.0, scanSeconds = 0.0;
+	size_t numFound = 0;
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (int q = 0; q < numQueries; q++)
+	{
+		const TrajectoryChunk & chunk = chunks[random() % chunks.size()];
+		float min[3], max[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = chunk.max[axis] - chunk.min[axis];
+			min[axis] = chunk.min[axis] + extent * (0.3f + 0.3f * unit(random));
+			max[axis] = min[axis] + extent * 0.1f;
+		}
+		uint64_t first = random() % numSteps;
+		uint64_t last = (std::min)(uint64_t(numSteps - 1), first + numSteps / 8);
+
+		std::vector<uint64_t> ids;
+		auto start = std::chrono::steady_clock::now();
+		reader.FindBodiesInRegion(min, max, first, last, ids);
+		indexedSeconds += SecondsSince(start);
+		numFound += ids.size();
+
+		std::vector<uint64_t> expected;
+		start = std::chrono::steady_clock::now();
+		ScanAll(path, chunks, [&](const TrajectoryChunk & chunk, const float* positions)
+		{
+			for (uint32_t slot = 0; slot < chunk.numBodies; slot++)
+			{
+				for (uint32_t frame = 0; frame < chunk.numFrames; frame++)
+				{
+					uint64_t step = chunk.firstStep + frame;
+					const float* p = positions + (size_t(slot) * chunk.numFrames + frame) * 3;
+					if (step >= first && step <= last && p[0] >= min[0] && p[0] <= max[0] && p[1] >= min[1] && p[1] <= max[1] && p[2] >= min[2] && p[2] <= max[2])
+					{
+						expected.push_back(slot);
+						break;
+					}
+				}
+			}
+		});
+		std::sort(expected.begin(), expected.end());
+		expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+		scanSeconds += SecondsSince(start);
+
+		failures += ids == expected ? 0 : 1;
+	}
+	std::printf("region queries:     indexed %8.3f ms, full scan %8.3f ms (%.1f bodies per query)\n", indexedSeconds * 1e3 / numQueries, scanSeconds * 1e3 / numQueries, double(numFound) / numQueries);
+
+	std::printf("%d mismatches\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+//Headless lockstep comparison of two CPU backends. Both are first checked on three bodies of
+//different mass, the pull on each body has to scale with the mass of the others as in CS_MAIN, e.g.
+//  ValidateBackends cpu tiled 8192 100
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/ValidateBackends.cpp src/simulation/*.cpp -pthread
+#include <simulation/InitialConditions.hpp>
+#include <simulation/LockstepValidator.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+//Largest error of the accelerations of a step relative to the direct sum in double over
+//the source masses. The equal-mass kernel takes one mass for every body and the mesh of
+//multigrid does not resolve three bodies, neither is checked.
+static bool CheckSourceMass(const std::string & name, const SimulationParams & params)
+{
+	if (name == "cpu-equal-mass" || name == "multigrid")
+		return true;
+
+	BodyArray bodies(3);
+	const float masses[3] = { 1.0f, 3.0f, 0.25f };
+	const float positions[3][3] = { { 0.0f, 0.0f, 0.0f }, { 0.5f, 0.1f, 0.0f }, { -0.2f, 0.4f, 0.3f } };
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		bodies[i].position = { positions[i][0], positions[i][1], positions[i][2], masses[i] };
+		bodies[i].velocity = { 0.0f, 0.0f, 0.0f, 1.0f };
+	}
+
+	auto engine = CreateEngine(name, bodies, params);
+	engine->Step();
+	const std::vector<Float4> & accelerations = engine->GetAccelerations();
+
+	double maxError = 0.0;
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		double expected[3] = { 0.0, 0.0, 0.0 };
+		for (size_t j = 0; j < bodies.size(); ++j)
+		{
+			double r[3] = { double(positions[j][0]) - positions[i][0], double(positions[j][1]) - positions[i][1], double(positions[j][2]) - positions[i][2] };
+			double distSqr = r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + params.softeningSquared;
+			double s = masses[j] / (distSqr * std::sqrt(distSqr));
+			for (int k = 0; k < 3; ++k)
+				expected[k] += r[k] * s;
+		}
+
+		const double actual[3] = { accelerations[i].x, accelerations[i].y, accelerations[i].z };
+		double norm = std::sqrt(expected[0] * expected[0] + expected[1] * expected[1] + expected[2] * expected[2]);
+		for (int k = 0; k < 3; ++k)
+			maxError = (std::max)(maxError, std::fabs(actual[k] - expected[k]) / norm);
+	}
+
+	bool passed = maxError < 1e-4;
+	std::printf("%s: source masses, max relative error %.2e%s\n", name.c_str(), maxError, passed ? "" : "  FAILED");
+	return passed;
+}
+
+static void PrintUsage()
+{
+	std::printf("usage: ValidateBackends <reference> <candidate> [bodies=8192] [steps=100] [energy interval=10]\nbackends:");
+	for (const auto & name : GetEngineNames())
+		std::printf(" %s", name.c_str());
+	std::printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return EXIT_FAILURE;
+	}
+
+	size_t numBodies = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 8192;
+	int steps = argc > 4 ? std::atoi(argv[4]) : 100;
+	unsigned int energyInterval = argc > 5 ? static_cast<unsigned int>(std::atoi(argv[5])) : 10;
+
+	BodyArray bodies = GenerateShellBodies(numBodies);
+	SimulationParams params;
+
+	auto reference = CreateEngine(argv[1], bodies, params);
+	auto candidate = CreateEngine(argv[2], bodies, params);
+	if (!reference || !candidate)
+	{
+		PrintUsage();
+		return EXIT_FAILURE;
+	}
+
+	//Fails on engines that weight a pull by the mass of the body it acts on
+	bool massesPassed = CheckSourceMass(argv[1], params) & CheckSourceMass(argv[2], params);
+
+	std::printf("reference: %s\ncandidate: %s\n%zu bodies, %d steps\n", reference->GetName().c_str(), candidate->GetName().c_str(), numBodies, steps);
+
+	LockstepValidator validator(reference.get(), candidate.get(), energyInterval);
+	validator.Reset(bodies);
+	LockstepValidator::PrintHeader();
+
+	double totalMs[2] = { 0.0, 0.0 };
+	for (int i = 0; i < steps; ++i)
+	{
+		LockstepReport report = validator.Step();
+		LockstepValidator::Print(report);
+		totalMs[0] += report.stepMs[0];
+		totalMs[1] += report.stepMs[1];
+	}
+
+	std::printf("average ms/step: reference %.3f, candidate %.3f (%.2fx)\n", totalMs[0] / steps, totalMs[1] / steps, totalMs[0] / totalMs[1]);
+	return massesPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
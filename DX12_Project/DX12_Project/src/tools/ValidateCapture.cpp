@@ -0,0 +1,307 @@
+//Headless check of the frame capture slot and fence handling behind FrameCapture. A
+//stand-in queue thread executes the copies into the slots with a random latency and
+//advances a fence, a render loop acquires, submits and polls like D3D::EndScene and the
+//encoder pool releases the slots. Verifies that no slot is copied into while another
+//frame owns it, that frames retire in order, that every frame is encoded or counted as
+//dropped and that all slots come back, and reports how long the render loop spent in the
+//capture calls. The second run slows the encoders down until the pool saturates, e.g.
+//  ValidateCapture 2000 4 2 3000
+//Not part of the Windows application, build it next to the utilities, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/ValidateCapture.cpp src/utils/CaptureRing.cpp src/utils/FrameEncoder.cpp src/utils/AsyncFileWriter.cpp -pthread
+#include <utils/CaptureRing.hpp>
+#include <utils/FrameEncoder.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace dx;
+
+namespace
+{
+	const unsigned int Width = 160;
+	const unsigned int Height = 90;
+	const size_t RowPitch = 768;		//Width * 4 aligned to 256 like a copy footprint
+
+	//Owner of a slot as the test sees it, independent of CaptureRing's own state
+	enum Owner
+	{
+		Free,
+		Copying,
+		Encoding
+	};
+
+	unsigned char Pattern(const uint64_t & frame, const unsigned int & x, const unsigned int & y, const unsigned int & c)
+	{
+		return static_cast<unsigned char>(frame * 7 + x * 3 + y * 5 + c);
+	}
+
+	//Executes copies in submission order after a random latency, then signals their fence
+	class StandInQueue
+	{
+	public:
+		StandInQueue(std::vector<std::vector<unsigned char>> & slots, std::vector<std::atomic<int>> & owners, const unsigned int & maxLatencyUs)
+			: m_slots(slots), m_owners(owners), m_maxLatencyUs(maxLatencyUs)
+		{
+			m_thread = std::thread(&StandInQueue::Run, this);
+		}
+
+		~StandInQueue()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+
+			m_condition.notify_one();
+			m_thread.join();
+		}
+
+		uint64_t Copy(const unsigned int & slot, const uint64_t & frame)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_commands.push_back({ slot, frame, ++m_fenceValue });
+			m_condition.notify_one();
+			return m_fenceValue;
+		}
+
+		uint64_t GetSubmittedValue()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_fenceValue;
+		}
+
+		uint64_t GetCompletedValue() const
+		{
+			return m_completed.load();
+		}
+
+		void Wait(const uint64_t & value) const
+		{
+			while (m_completed.load() < value)
+				std::this_thread::yield();
+		}
+
+		size_t GetNumOverwrites() const
+		{
+			return m_numOverwrites.load();
+		}
+
+	private:
+		struct Command
+		{
+			unsigned int slot;
+			uint64_t frame;
+			uint64_t fenceValue;
+		};
+
+		void Run()
+		{
+			std::mt19937 random(7);
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (;;)
+			{
+				m_condition.wait(lock, [this] { return m_stop || !m_commands.empty(); });
+				if (m_commands.empty())
+					return;
+
+				Command command = m_commands.front();
+				m_commands.pop_front();
+				lock.unlock();
+
+				std::this_thread::sleep_for(std::chrono::microseconds(random() % (m_maxLatencyUs + 1)));
+
+				//Writing a slot that is not waiting for this copy is the bug the ring prevents
+				if (m_owners[command.slot].load() != Copying)
+					++m_numOverwrites;
+
+				std::vector<unsigned char> & pixels = m_slots[command.slot];
+				for (unsigned int y = 0; y < Height; ++y)
+					for (unsigned int x = 0; x < Width; ++x)
+						for (unsigned int c = 0; c < 4; ++c)
+							pixels[y * RowPitch + x * 4 + c] = Pattern(command.frame, x, y, c);
+
+				m_completed.store(command.fenceValue);
+				lock.lock();
+			}
+		}
+
+	private:
+		std::vector<std::vector<unsigned char>> & m_slots;
+		std::vector<std::atomic<int>> & m_owners;
+		unsigned int m_maxLatencyUs;
+		std::deque<Command> m_commands;
+		uint64_t m_fenceValue = 0;
+		std::atomic<uint64_t> m_completed{ 0 };
+		std::atomic<size_t> m_numOverwrites{ 0 };
+		bool m_stop = false;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::thread m_thread;
+	};
+
+	struct RunResult
+	{
+		uint64_t captured = 0;
+		uint64_t encoded = 0;
+		uint64_t droppedNoSlot = 0;
+		uint64_t rejected = 0;
+		size_t failures = 0;
+		double maxCaptureUs = 0.0;
+		double meanCaptureUs = 0.0;
+	};
+
+	RunResult Run(const uint64_t & frames, const unsigned int & numSlots, const unsigned int & numThreads, const unsigned int & maxLatencyUs,
+				  const unsigned int & encodeDelayUs)
+	{
+		std::vector<std::vector<unsigned char>> slots(numSlots, std::vector<unsigned char>(RowPitch * Height));
+		std::vector<std::atomic<int>> owners(numSlots);
+		for (std::atomic<int> & owner : owners)
+			owner.store(Free);
+
+		std::atomic<size_t> failures(0);
+		RunResult result;
+
+		{
+			CaptureRing ring(numSlots);
+			EncoderSettings settings;
+			settings.path.clear();
+			settings.numThreads = numThreads;
+			FrameEncoderPool encoders(settings);
+			StandInQueue queue(slots, owners, maxLatencyUs);
+
+			std::vector<RetiredCapture> retired;
+			uint64_t lastRetired = 0;
+			bool anyRetired = false;
+			double totalUs = 0.0;
+
+			auto poll = [&]()
+			{
+				retired.clear();
+				ring.Retire(queue.GetCompletedValue(), retired);
+				for (const RetiredCapture & capture : retired)
+				{
+					if (anyRetired && capture.frame <= lastRetired)
+						++failures;
+					anyRetired = true;
+					lastRetired = capture.frame;
+
+					if (owners[capture.slot].exchange(Encoding) != Copying)
+						++failures;
+
+					unsigned int slot = capture.slot;
+					uint64_t frame = capture.frame;
+					CaptureImage image = { slots[slot].data(), Width, Height, RowPitch };
+					auto release = [&, slot, frame]
+					{
+						if (encodeDelayUs > 0)
+							std::this_thread::sleep_for(std::chrono::microseconds(encodeDelayUs));
+
+						//The pixels must still be this frame's, nothing may have copied into the slot
+						const unsigned char* pixels = slots[slot].data();
+						for (unsigned int y = 0; y < Height; y += 7)
+							for (unsigned int x = 0; x < Width; x += 5)
+								if (pixels[y * RowPitch + x * 4 + 1] != Pattern(frame, x, y, 1))
+								{
+									++failures;
+									y = Height;
+									break;
+								}
+
+						if (owners[slot].exchange(Free) != Encoding)
+							++failures;
+						ring.Release(slot);
+					};
+
+					if (encoders.Submit(frame, image, release))
+						++result.captured;
+					else
+					{
+						owners[slot].store(Free);
+						ring.Release(slot);
+					}
+				}
+			};
+
+			for (uint64_t frame = 0; frame < frames; ++frame)
+			{
+				//Rendering, during which the queue and the encoders make progress
+				std::this_thread::sleep_for(std::chrono::microseconds(500));
+
+				auto begin = std::chrono::high_resolution_clock::now();
+				unsigned int slot = ring.Acquire();
+				if (slot != CaptureRing::NoSlot)
+				{
+					if (owners[slot].exchange(Copying) != Free)
+						++failures;
+					ring.Submit(slot, frame, queue.Copy(slot, frame));
+				}
+				poll();
+				double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - begin).count();
+
+				totalUs += us;
+				result.maxCaptureUs = (std::max)(result.maxCaptureUs, us);
+			}
+
+			//Shutdown: wait for the queue, hand over the last copies and drain the encoders
+			queue.Wait(queue.GetSubmittedValue());
+			while (ring.GetNumCopying() > 0)
+				poll();
+			encoders.Flush();
+
+			if (ring.GetNumFree() != numSlots)
+				++failures;
+
+			result.encoded = encoders.GetNumEncoded();
+			result.droppedNoSlot = ring.GetNumDropped();
+			result.rejected = encoders.GetNumRejected();
+			result.meanCaptureUs = frames > 0 ? totalUs / frames : 0.0;
+			failures += queue.GetNumOverwrites();
+		}
+
+		if (result.captured + result.droppedNoSlot + result.rejected != frames || result.encoded != result.captured)
+			++failures;
+
+		result.failures = failures.load();
+		return result;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t frames = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000;
+	unsigned int numSlots = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 4;
+	unsigned int numThreads = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 2;
+	unsigned int maxLatencyUs = argc > 4 ? static_cast<unsigned int>(std::atoi(argv[4])) : 3000;
+
+	std::printf("%llu frames of %ux%u, %u slots, %u encoder threads, copy latency up to %u us\n", static_cast<unsigned long long>(frames), Width, Height,
+				numSlots, numThreads, maxLatencyUs);
+	std::printf("%-22s %9s %9s %9s %9s %9s %12s %12s\n", "", "captured", "encoded", "no slot", "rejected", "failures", "mean us", "max us");
+
+	struct Scenario
+	{
+		const char* name;
+		unsigned int encodeDelayUs;
+	};
+
+	const Scenario scenarios[] = { { "fast encoders", 0 }, { "saturated encoders", 4000 } };
+	size_t failures = 0;
+	for (const Scenario & scenario : scenarios)
+	{
+		RunResult result = Run(frames, numSlots, numThreads, maxLatencyUs, scenario.encodeDelayUs);
+		std::printf("%-22s %9llu %9llu %9llu %9llu %9zu %12.2f %12.2f\n", scenario.name, static_cast<unsigned long long>(result.captured),
+					static_cast<unsigned long long>(result.encoded), static_cast<unsigned long long>(result.droppedNoSlot),
+					static_cast<unsigned long long>(result.rejected), result.failures, result.meanCaptureUs, result.maxCaptureUs);
+		failures += result.failures;
+	}
+
+	std::printf("%s\n", failures == 0 ? "passed" : "FAILED");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
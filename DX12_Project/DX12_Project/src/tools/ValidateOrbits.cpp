@@ -0,0 +1,140 @@
+//Headless check of the Kustaanheimo-Stiefel regularization. Converts to KS coordinates and
+//back, follows unperturbed Kepler orbits from circular to e = 0.99 for whole periods and
+//compares with where they started, then plants tight binaries in a cluster and checks that
+//the regularized engine captures them and holds the energy where the direct sum at the same
+//step and softening does not, e.g.
+//  ValidateOrbits 1024 64 200
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/ValidateOrbits.cpp src/simulation/*.cpp -pthread
+#include <simulation/CpuNBody.hpp>
+#include <simulation/Diagnostics.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <simulation/KSRegularization.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+namespace
+{
+	const double Pi = 3.14159265358979323846;
+
+	double Distance(const double a[3], const double b[3])
+	{
+		return std::sqrt((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+	}
+
+	size_t CheckRoundTrip()
+	{
+		const double r[3] = { -0.3, 0.2, 0.5 }, v[3] = { 0.1, -2.0, 0.7 };
+		const double mirrored[3] = { -0.3, -0.2, -0.5 };
+		double maxError = 0.0;
+
+		//The negative x half space takes the other branch of the square root
+		for (const double* position : { r, mirrored })
+		{
+			KSState state;
+			ToKS(position, v, 2.0, state);
+			double restored[3], velocity[3];
+			FromKS(state, restored, velocity);
+			maxError = (std::max)(maxError, (std::max)(Distance(restored, position), Distance(velocity, v)));
+		}
+
+		bool passed = maxError < 1e-12;
+		std::printf("  round trip: max error %.2e%s\n", maxError, passed ? "" : "  FAILED");
+		return passed ? 0 : 1;
+	}
+
+	//Starts at pericentre and advances whole periods in chunks of a tenth, the orbit has to
+	//come back to the start within a fraction of the semi-major axis
+	size_t CheckKepler(const double & eccentricity, const unsigned int & periods)
+	{
+		const double mass = 2.0, a = 0.01;
+		const double pericentre = a * (1.0 - eccentricity);
+		const double r[3] = { pericentre, 0.0, 0.0 };
+		const double v[3] = { 0.0, std::sqrt(mass * (1.0 + eccentricity) / pericentre), 0.0 };
+		const double period = 2.0 * Pi * std::sqrt(a * a * a / mass);
+		const double perturbation[3] = { 0.0, 0.0, 0.0 };
+
+		KSState state;
+		ToKS(r, v, mass, state);
+		const double energy = state.energy;
+		for (unsigned int i = 0; i < 10 * periods; ++i)
+			AdvanceKS(state, period / 10.0, perturbation, RegularizationSettings().stepsPerOrbit);
+
+		double position[3], velocity[3];
+		FromKS(state, position, velocity);
+		double error = Distance(position, r) / a;
+		double drift = std::fabs((state.energy - energy) / energy);
+
+		bool passed = error < 1e-2 && drift < 1e-12;
+		std::printf("  e = %.2f, %u periods: position error %.2e of a, energy drift %.2e%s\n", eccentricity, periods, error, drift, passed ? "" : "  FAILED");
+		return passed ? 0 : 1;
+	}
+
+	//Bound pairs a fifth of the capture radius wide, at 80% of the circular velocity
+	BodyArray PlantBinaries(const size_t & numBodies, const size_t & numBinaries)
+	{
+		BodyArray bodies = GenerateShellBodies(numBodies, 1.54f, 1.0f);
+		const float separation = RegularizationSettings().captureRadius / 5.0f;
+		for (size_t i = 0; i < (std::min)(numBinaries, numBodies / 2); ++i)
+		{
+			const Body & primary = bodies[2 * i];
+			Body & secondary = bodies[2 * i + 1];
+			secondary.position = { primary.position.x + separation, primary.position.y, primary.position.z, primary.position.w };
+			secondary.velocity = primary.velocity;
+			secondary.velocity.y += 0.8f * std::sqrt((primary.position.w + secondary.position.w) / separation);
+		}
+		return bodies;
+	}
+
+	size_t CheckPlantedBinaries(const size_t & numBodies, const size_t & numBinaries, const unsigned int & steps)
+	{
+		//Barely any softening and a step far longer than the binary periods
+		SimulationParams params;
+		params.softeningSquared = 1e-8f;
+		params.timestep = 0.0005f;
+
+		const BodyArray bodies = PlantBinaries(numBodies, numBinaries);
+		KernelConfig config;
+		config.precision = KernelPrecision::Double;
+		KSRegularizedNBody regularized(bodies, params);
+		CpuNBody direct(bodies, params, config);
+		for (unsigned int i = 0; i < steps; ++i)
+		{
+			regularized.Step();
+			direct.Step();
+		}
+
+		const double energy = ComputeEnergy(bodies, params.softeningSquared).GetTotal();
+		double regularizedDrift = std::fabs((ComputeEnergy(regularized.GetBodies(), params.softeningSquared).GetTotal() - energy) / energy);
+		double directDrift = std::fabs((ComputeEnergy(direct.GetBodies(), params.softeningSquared).GetTotal() - energy) / energy);
+
+		bool passed = regularized.GetNumCaptures() >= numBinaries && regularizedDrift < 0.1 && regularizedDrift * 10.0 < directDrift;
+		std::printf("  %zu binaries in %zu bodies, %u steps: %zu pairs, %llu captures, %llu dissolves\n", numBinaries, numBodies, steps, regularized.GetNumPairs(),
+					(unsigned long long)regularized.GetNumCaptures(), (unsigned long long)regularized.GetNumDissolves());
+		std::printf("  energy drift: regularized %.2e, direct %.2e%s\n", regularizedDrift, directDrift, passed ? "" : "  FAILED");
+		return passed ? 0 : 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024;
+	size_t numBinaries = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 64;
+	unsigned int steps = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 200;
+
+	size_t failures = 0;
+	std::printf("KS coordinates\n");
+	failures += CheckRoundTrip();
+	std::printf("unperturbed Kepler orbits\n");
+	for (double eccentricity : { 0.0, 0.5, 0.9, 0.99 })
+		failures += CheckKepler(eccentricity, 10);
+	std::printf("planted binaries\n");
+	failures += CheckPlantedBinaries(numBodies, numBinaries, steps);
+
+	std::printf("%s, %zu failures\n", failures ? "FAILED" : "passed", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+//Headless round trip of the rewind history. Records every step of a CPU run, restores a
+//spread of them and compares with the states that were recorded, exactly without
+//quantization and within the dropped mantissa bits with it. Also checks that steps out of
+//order are rejected, that Clear starts over and that eviction drops whole keyframe groups, e.g.
+//  ValidateRewind 4096 200 32
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/ValidateRewind.cpp src/simulation/*.cpp -pthread
+#include <simulation/CpuNBody.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <simulation/RewindBuffer.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+namespace
+{
+	//Largest error relative to the recorded value, over every float of the state
+	double CompareStates(const BodyArray & restored, const BodyArray & recorded)
+	{
+		if (restored.size() != recorded.size())
+			return HUGE_VAL;
+
+		const float* a = reinterpret_cast<const float*>(restored.data());
+		const float* b = reinterpret_cast<const float*>(recorded.data());
+		double maxError = 0.0;
+		for (size_t i = 0; i < recorded.size() * sizeof(Body) / sizeof(float); ++i)
+		{
+			double error = std::fabs(double(a[i]) - b[i]);
+			maxError = (std::max)(maxError, b[i] != 0.0f ? error / std::fabs(b[i]) : error);
+		}
+		return maxError;
+	}
+
+	size_t CheckRoundTrip(const std::vector<BodyArray> & states, const unsigned int & keyframeInterval, const unsigned int & quantizationBits)
+	{
+		RewindSettings settings;
+		settings.keyframeInterval = keyframeInterval;
+		settings.quantizationBits = quantizationBits;
+		RewindBuffer rewind(settings);
+		for (size_t step = 0; step < states.size(); ++step)
+			rewind.Record(step, states[step]);
+		rewind.Flush();
+
+		//Rounding to the retained mantissa bits moves a value by at most half their last unit
+		const double tolerance = quantizationBits == 0 ? 0.0 : std::ldexp(1.0, int(quantizationBits) - 23);
+		const size_t last = states.size() - 1;
+		const size_t steps[] = { 0, 1, keyframeInterval - 1, keyframeInterval, keyframeInterval + 1, last / 2, last - 1, last };
+
+		size_t failures = 0;
+		double maxError = 0.0;
+		BodyArray restored;
+		for (size_t step : steps)
+		{
+			double error = rewind.Restore((std::min)(step, last), restored) ? CompareStates(restored, states[(std::min)(step, last)]) : HUGE_VAL;
+			maxError = (std::max)(maxError, error);
+			failures += error > tolerance ? 1 : 0;
+		}
+
+		//Nothing past the last recorded step
+		failures += rewind.Restore(states.size(), restored) ? 1 : 0;
+
+		std::printf("  keyframe every %2u, %2u bits dropped: %zu frames in %.1f MB, max relative error %.2e%s\n", keyframeInterval, quantizationBits,
+					rewind.GetNumFrames(), rewind.GetMemoryUsage() / 1048576.0, maxError, failures ? "  FAILED" : "");
+		return failures;
+	}
+
+	size_t CheckOrder(const std::vector<BodyArray> & states)
+	{
+		RewindBuffer rewind;
+		size_t failures = 0;
+		failures += rewind.Record(10, states[10]) ? 0 : 1;
+		failures += rewind.Record(10, states[11]) ? 1 : 0;
+		failures += rewind.Record(5, states[5]) ? 1 : 0;
+		failures += rewind.Record(12, states[12]) ? 0 : 1;
+
+		//Clear forgets the history, an earlier step starts a new one
+		rewind.Clear();
+		failures += rewind.GetNumFrames() == 0 ? 0 : 1;
+		failures += rewind.Record(3, states[3]) ? 0 : 1;
+		failures += rewind.Record(4, states[4]) ? 0 : 1;
+		rewind.Flush();
+
+		BodyArray restored;
+		uint64_t first = 0, last = 0;
+		failures += rewind.GetStepRange(first, last) && first == 3 && last == 4 ? 0 : 1;
+		failures += rewind.Restore(4, restored) && CompareStates(restored, states[4]) == 0.0 ? 0 : 1;
+		failures += rewind.Restore(10, restored) ? 1 : 0;
+
+		std::printf("  order and clear: %s\n", failures ? "FAILED" : "passed");
+		return failures;
+	}
+
+	size_t CheckEviction(const std::vector<BodyArray> & states, const unsigned int & keyframeInterval)
+	{
+		//Room for about two keyframes, so older groups have to go
+		RewindSettings settings;
+		settings.keyframeInterval = keyframeInterval;
+		settings.memoryCap = 2 * states[0].size() * sizeof(Body);
+		RewindBuffer rewind(settings);
+		for (size_t step = 0; step < states.size(); ++step)
+			rewind.Record(step, states[step]);
+		rewind.Flush();
+
+		size_t failures = 0;
+		uint64_t first = 0, last = 0;
+		BodyArray restored;
+		failures += rewind.GetStepRange(first, last) && first % keyframeInterval == 0 && last == states.size() - 1 ? 0 : 1;
+		failures += first > 0 && rewind.Restore(first - 1, restored) ? 1 : 0;
+		failures += rewind.Restore(first, restored) && CompareStates(restored, states[first]) == 0.0 ? 0 : 1;
+		failures += rewind.GetMemoryUsage() <= settings.memoryCap || first + keyframeInterval > last ? 0 : 1;
+
+		std::printf("  eviction under %.1f MB: steps %llu to %llu kept in %.1f MB%s\n", settings.memoryCap / 1048576.0, (unsigned long long)first,
+					(unsigned long long)last, rewind.GetMemoryUsage() / 1048576.0, failures ? "  FAILED" : "");
+		return failures;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4096;
+	size_t numSteps = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200;
+	unsigned int keyframeInterval = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 32;
+	numSteps = (std::max)(numSteps, size_t(keyframeInterval) + 2);
+
+	//Every recorded state of the run, in order
+	CpuNBody engine(GenerateShellBodies(numBodies), SimulationParams());
+	std::vector<BodyArray> states;
+	for (size_t step = 0; step < numSteps; ++step)
+	{
+		states.push_back(engine.GetBodies());
+		engine.Step();
+	}
+
+	size_t failures = 0;
+	std::printf("%zu bodies, %zu steps\n", numBodies, numSteps);
+	failures += CheckRoundTrip(states, keyframeInterval, 0);
+	failures += CheckRoundTrip(states, keyframeInterval, 8);
+	failures += CheckRoundTrip(states, 1, 0);
+	failures += CheckOrder(states);
+	failures += CheckEviction(states, keyframeInterval);
+
+	std::printf("%s, %zu failures\n", failures ? "FAILED" : "passed", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+//Headless check of the segmented body storage. Verifies SegmentLayout and the dispatch sizes
+//of its segments at logical sizes past 32 bits, round trips procedurally generated bodies
+//through sparse segment storage at multi-billion indices, and compares StepIntoSegments
+//against StepInto for every backend, e.g.
+//  ValidateSegments 5000000000 1000003
+//Not part of the Windows application, build it next to the simulation sources, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/ValidateSegments.cpp src/simulation/*.cpp -pthread
+#include <simulation/Engine.hpp>
+#include <simulation/InitialConditions.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace dx;
+
+//Checks that the segments tile [0, count) and that Locate agrees with them
+static size_t CheckLayout(const uint64_t & count, const uint32_t & capacity)
+{
+	SegmentLayout layout(count, capacity);
+	size_t failures = 0;
+	uint64_t covered = 0;
+	const uint32_t last = layout.GetNumSegments() - 1;
+
+	for (uint32_t s = 0; s <= last; ++s)
+	{
+		uint32_t size = layout.GetSegmentSize(s);
+		if (layout.GetSegmentBegin(s) != covered || size > capacity || (s < last && size != capacity) || (count > 0 && size == 0))
+			++failures;
+
+		//The blocks of the segment's dispatch cover it, and fit one dispatch dimension
+		//whenever the capacity is one the application may use
+		uint32_t groups = GetDispatchGroups(size);
+		if (uint64_t(groups) * DispatchBlockSize < size || (groups > 0 && uint64_t(groups - 1) * DispatchBlockSize >= size))
+			++failures;
+		if (capacity <= MaxDispatchSegmentCapacity && groups > MaxDispatchGroups)
+			++failures;
+
+		uint32_t segment, local;
+		if (size > 0)
+		{
+			layout.Locate(covered, segment, local);
+			failures += segment != s || local != 0;
+			layout.Locate(covered + size - 1, segment, local);
+			failures += segment != s || local != size - 1;
+		}
+		covered += size;
+	}
+	failures += covered != count;
+
+	//Indices either side of the 32-bit boundaries
+	const uint64_t probes[] = { (1ull << 31) - 1, 1ull << 31, (1ull << 32) - 1, 1ull << 32, (1ull << 32) + 1, count - 1 };
+	for (const uint64_t & index : probes)
+	{
+		if (index >= count)
+			continue;
+
+		uint32_t segment, local;
+		layout.Locate(index, segment, local);
+		failures += segment > last || local >= layout.GetSegmentSize(segment) || layout.GetSegmentBegin(segment) + local != index;
+	}
+
+	std::printf("  %14llu bodies, capacity %10u: %6u segments, last %10u%s\n", static_cast<unsigned long long>(count), capacity, layout.GetNumSegments(),
+				layout.GetSegmentSize(last), failures ? " FAILED" : "");
+	return failures;
+}
+
+//Stand-in for a body source too large to hold: body i carries its 64-bit index in the
+//bits of position.x and position.y
+static Body StandInBody(const uint64_t & index)
+{
+	Body body = {};
+	uint32_t low = static_cast<uint32_t>(index), high = static_cast<uint32_t>(index >> 32);
+	std::memcpy(&body.position.x, &low, sizeof(low));
+	std::memcpy(&body.position.y, &high, sizeof(high));
+	return body;
+}
+
+static uint64_t StandInIndex(const Body & body)
+{
+	uint32_t low, high;
+	std::memcpy(&low, &body.position.x, sizeof(low));
+	std::memcpy(&high, &body.position.y, sizeof(high));
+	return (uint64_t(high) << 32) | low;
+}
+
+//Writes windows of stand-in bodies around the 32-bit boundaries and the end of a
+//multi-billion body layout into sparse segments, only the touched ones are allocated
+static size_t CheckStandIn(const uint64_t & count, const uint32_t & capacity, const uint64_t & window)
+{
+	SegmentLayout layout(count, capacity);
+	std::vector<std::unique_ptr<Body[]>> storage(layout.GetNumSegments());
+	std::vector<Body*> segments(layout.GetNumSegments(), nullptr);
+	size_t failures = 0, allocated = 0;
+
+	const uint64_t centers[] = { 1ull << 31, 1ull << 32, count / 2, count };
+	for (const uint64_t & center : centers)
+	{
+		uint64_t first = (std::min)(center > window / 2 ? center - window / 2 : 0, count - (std::min)(window, count));
+		uint64_t size = (std::min)(window, count - first);
+
+		uint32_t firstSegment, lastSegment, local;
+		layout.Locate(first, firstSegment, local);
+		layout.Locate(first + size - 1, lastSegment, local);
+		for (uint32_t s = firstSegment; s <= lastSegment; ++s)
+		{
+			if (!storage[s])
+			{
+				storage[s].reset(new Body[layout.GetSegmentSize(s)]);
+				segments[s] = storage[s].get();
+				++allocated;
+			}
+		}
+
+		BodyArray bodies(static_cast<size_t>(size));
+		for (uint64_t i = 0; i < size; ++i)
+			bodies[static_cast<size_t>(i)] = StandInBody(first + i);
+		CopyToSegments(bodies.data(), first, size, segments.data(), layout);
+
+		//Each body has to land at its own index, then read back unchanged
+		for (uint64_t i = 0; i < size; ++i)
+		{
+			uint32_t segment;
+			layout.Locate(first + i, segment, local);
+			failures += StandInIndex(segments[segment][local]) != first + i;
+		}
+
+		BodyArray readBack(static_cast<size_t>(size));
+		CopyFromSegments(segments.data(), layout, first, size, readBack.data());
+		for (uint64_t i = 0; i < size; ++i)
+			failures += StandInIndex(readBack[static_cast<size_t>(i)]) != first + i;
+	}
+
+	std::printf("  %llu bodies in %u segments of %u, %zu segments touched: %s\n", static_cast<unsigned long long>(count), layout.GetNumSegments(), capacity,
+				allocated, failures ? "FAILED" : "passed");
+	return failures;
+}
+
+//Segmented output has to match the contiguous output bit for bit
+static size_t CheckEngine(const std::string & name, const BodyArray & initial, const uint32_t & capacity)
+{
+	SimulationParams params;
+	std::unique_ptr<Engine> contiguous = CreateEngine(name, initial, params);
+	std::unique_ptr<Engine> segmented = CreateEngine(name, initial, params);
+
+	SegmentLayout layout(initial.size(), capacity);
+	std::vector<BodyArray> storage(layout.GetNumSegments());
+	std::vector<Body*> segments;
+	for (uint32_t s = 0; s < layout.GetNumSegments(); ++s)
+	{
+		storage[s].resize(layout.GetSegmentSize(s));
+		segments.push_back(storage[s].data());
+	}
+
+	BodyArray expected(initial.size()), actual(initial.size());
+	size_t failures = 0;
+	for (int step = 0; step < 3; ++step)
+	{
+		contiguous->StepInto(expected.data());
+		segmented->StepIntoSegments(segments.data(), layout);
+		CopyFromSegments(segments.data(), layout, 0, actual.size(), actual.data());
+		failures += std::memcmp(expected.data(), actual.data(), sizeof(Body) * expected.size()) != 0;
+	}
+
+	std::printf("  %-16s %u segments: %s\n", name.c_str(), layout.GetNumSegments(), failures ? "FAILED" : "passed");
+	return failures;
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t standInCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 5000000000ull;
+	uint32_t standInCapacity = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 1000003;
+	size_t failures = 0;
+
+	std::printf("layouts\n");
+	const uint64_t counts[] = { 0, 1, 255, (1ull << 32) - 1, 1ull << 32, (1ull << 32) + 1, 3000000007ull, 5000000000ull, (1ull << 40) + 5 };
+	const uint32_t capacities[] = { MaxDispatchSegmentCapacity, 1u << 26, UINT32_MAX, 1000003, 256 };
+	for (const uint64_t & count : counts)
+	{
+		for (const uint32_t & capacity : capacities)
+		{
+			//Keeps the walk over every segment short
+			if (count / capacity <= (1ull << 24))
+				failures += CheckLayout(count, capacity);
+		}
+	}
+
+	std::printf("stand-in bodies\n");
+	failures += CheckStandIn(standInCount, standInCapacity, 3 * uint64_t(standInCapacity) / 2);
+
+	std::printf("engines\n");
+	BodyArray initial = GenerateShellBodies(1000);
+	for (const std::string & name : GetEngineNames())
+	{
+		failures += CheckEngine(name, initial, 96);
+		failures += CheckEngine(name, initial, UINT32_MAX);
+	}
+
+	std::printf("%s, %zu failures\n", failures ? "FAILED" : "passed", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
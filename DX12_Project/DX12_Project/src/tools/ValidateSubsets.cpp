@@ -0,0 +1,141 @@
+//Headless check of the stochastic subset rendering. Accumulates the generated shell the way
+//TemporalAccumulator does, with the CPU sprite model and a constant-stride SubsetSchedule,
+//and checks that k frames after a restart the image equals the full set drawn at once.
+//Also feeds the schedule a render cost that scales with the drawn subset plus a constant
+//update cost and checks the stride settles where the render cost meets the budget, e.g.
+//  ValidateSubsets 20000 64
+//Not part of the Windows application, build it next to the utilities, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/ValidateSubsets.cpp src/simulation/*.cpp src/utils/SpriteRaster.cpp src/utils/SubsetSchedule.cpp -pthread
+#include <simulation/InitialConditions.hpp>
+#include <utils/SpriteRaster.hpp>
+#include <utils/SubsetSchedule.hpp>
+#include <utils/Utility.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace dx;
+
+namespace
+{
+	const float Pi = 3.14159265f;
+
+	//Max difference relative to the brightest pixel of the reference
+	double CompareImages(const SpriteImage & image, const SpriteImage & reference)
+	{
+		double maxError = 0.0, maxValue = 0.0;
+		for (size_t i = 0; i < reference.pixels.size(); ++i)
+		{
+			maxError = (std::max)(maxError, double(std::fabs(image.pixels[i] - reference.pixels[i])));
+			maxValue = (std::max)(maxValue, double(reference.pixels[i]));
+		}
+		return maxError / (std::max)(maxValue, 1e-30);
+	}
+
+	//Frames of a constant stride, restarted after warmup frames so the restart lands mid-cycle
+	size_t CheckConvergence(const BodyArray & bodies, const SpriteSettings & sprites, const SpriteTexture & texture, const SpriteImage & reference,
+							const unsigned int & stride, const unsigned int & warmup)
+	{
+		SubsetSettings settings;
+		settings.minStride = stride;
+		settings.maxStride = stride;
+		SubsetSchedule schedule(settings);
+
+		SpriteImage accumulated, frame;
+		accumulated.Resize(reference.width, reference.height);
+		frame.Resize(reference.width, reference.height);
+
+		double before = 0.0, after = 0.0;
+		const unsigned int frames = warmup + stride;
+		for (unsigned int n = 0; n < frames; ++n)
+		{
+			//Restarts after a few frames of history, like a camera that stopped moving
+			schedule.BeginFrame(0.0, n == warmup);
+
+			BodyArray subset;
+			for (size_t i = schedule.GetPhase(); i < bodies.size(); i += schedule.GetStride())
+				subset.push_back(bodies[i]);
+
+			//Fade by 1 - blend, then add the subset scaled by the subset weight
+			SpriteSettings weighted = sprites;
+			weighted.weight = schedule.GetSubsetWeight();
+			frame.Clear();
+			RasterizeSprites(subset.data(), subset.size(), weighted, texture, frame);
+			for (size_t i = 0; i < accumulated.pixels.size(); ++i)
+				accumulated.pixels[i] = accumulated.pixels[i] * (1.0f - schedule.GetBlend()) + frame.pixels[i];
+
+			if (n + 2 == frames)
+				before = CompareImages(accumulated, reference);
+		}
+		after = CompareImages(accumulated, reference);
+
+		//One frame short a phase is missing, after k frames only rounding is left
+		bool passed = after <= 1e-5 && (stride == 1 || before > 1e-3);
+		std::printf("  stride %3u: %.2e after %u frames, %.2e one frame earlier%s\n", stride, after, stride, before, passed ? "" : "  FAILED");
+		return passed ? 0 : 1;
+	}
+
+	//Render cost proportional to the drawn bodies and an update cost that does not depend
+	//on the stride, the stride has to follow the render cost alone
+	size_t CheckAdaptation(const double & fullRenderMs, const double & updateMs, const double & budgetMs)
+	{
+		SubsetSettings settings;
+		settings.frameBudgetMs = budgetMs;
+		settings.maxStride = 64;
+		SubsetSchedule schedule(settings), wholeFrame(settings);
+
+		for (unsigned int n = 0; n < 2000; ++n)
+		{
+			schedule.BeginFrame(fullRenderMs / schedule.GetStride(), false);
+			wholeFrame.BeginFrame(fullRenderMs / wholeFrame.GetStride() + updateMs, false);
+		}
+
+		//Smallest power of two within budget, or the cap
+		unsigned int expected = 1;
+		while (fullRenderMs / expected > budgetMs && expected < settings.maxStride)
+			expected *= 2;
+
+		//The whole-frame time is only reported, it saturates once the update alone is over budget
+		bool passed = schedule.GetStride() == expected;
+		std::printf("  render %6.1f ms, update %6.1f ms, budget %4.1f ms: stride %2u, expected %2u, from the whole frame %2u%s\n", fullRenderMs, updateMs,
+					budgetMs, schedule.GetStride(), expected, wholeFrame.GetStride(), passed ? "" : "  FAILED");
+		return passed ? 0 : 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t numBodies = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+	unsigned int maxStride = argc > 2 ? static_cast<unsigned int>(std::atoi(argv[2])) : 64;
+
+	const BodyArray bodies = GenerateShellBodies(numBodies);
+	const SpriteTexture texture = GenerateStarTexture();
+
+	//Looking at the shell from outside, same projection as Camera
+	SpriteSettings sprites;
+	float view[16], projection[16];
+	MakeLookAtLH({ 0.0f, 0.0f, -20.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, view);
+	MakePerspectiveFovLH(45.0f * Pi / 180.0f, float(SCREEN_WIDTH) / SCREEN_HEIGHT, 0.1f, 1000.0f, projection);
+	MultiplyMatrices(view, projection, sprites.viewProjection);
+	sprites.pointSize = 0.2f;
+
+	SpriteImage reference;
+	reference.Resize(SCREEN_WIDTH, SCREEN_HEIGHT);
+	RasterizeSprites(bodies.data(), bodies.size(), sprites, texture, reference);
+
+	size_t failures = 0;
+	std::printf("convergence of %zu bodies after a restart\n", numBodies);
+	for (unsigned int stride = 1; stride <= maxStride; stride *= 2)
+		failures += CheckConvergence(bodies, sprites, texture, reference, stride, stride / 2 + 1);
+	failures += CheckConvergence(bodies, sprites, texture, reference, 3, 2);
+
+	std::printf("stride adaptation\n");
+	failures += CheckAdaptation(5.0, 0.0, 8.0);
+	failures += CheckAdaptation(50.0, 0.0, 8.0);
+	failures += CheckAdaptation(50.0, 400.0, 8.0);
+	failures += CheckAdaptation(2000.0, 400.0, 8.0);
+
+	std::printf("%s, %zu failures\n", failures ? "FAILED" : "passed", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+//Headless check of the reserved buffer tile bookkeeping behind GrowableBuffer. Replays a
+//random grow and shrink sequence against a simulated page table and verifies that the
+//requested bytes are always backed, that bound tiles never move and that every range
+//stays inside one allocated heap, e.g.
+//  ValidateTileMap 100000 256
+//Not part of the Windows application, build it next to the utilities, e.g.
+//g++ -std=c++14 -O3 -march=native -Isrc src/tools/ValidateTileMap.cpp src/utils/TileMap.cpp
+#include <utils/TileMap.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace dx;
+
+int main(int argc, char** argv)
+{
+	int iterations = argc > 1 ? std::atoi(argv[1]) : 100000;
+	uint32_t tilesPerHeap = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 256;
+
+	//Same shape as the body buffers: 32 bytes per body, MAX_BODIES of 1 << 20
+	const uint64_t reserved = 32ull << 20;
+	TileMap map(reserved, tilesPerHeap);
+
+	//Simulated page table, what UpdateTileMappings would leave behind
+	std::vector<TileRange> table(map.GetNumTiles(), TileRange{ 0, 1, TileRange::NullHeap, 0 });
+	std::vector<TileRange> updates;
+	std::mt19937_64 random(1);
+
+	uint64_t bytes = 0;
+	size_t failures = 0, numUpdates = 0, numRanges = 0, trimmed = 0;
+	double resizeNs = 0.0;
+
+	for (int i = 0; i < iterations; ++i)
+	{
+		//Mostly small steps around the current size with the occasional jump
+		int64_t step = static_cast<int64_t>(random() % (1 << 20)) - (1 << 19);
+		if (random() % 64 == 0)
+			step *= 32;
+		bytes = static_cast<uint64_t>((std::max)(int64_t(0), (std::min)(static_cast<int64_t>(reserved), static_cast<int64_t>(bytes) + step)));
+
+		updates.clear();
+		auto start = std::chrono::high_resolution_clock::now();
+		bool resized = map.Resize(bytes, updates);
+		auto end = std::chrono::high_resolution_clock::now();
+		resizeNs += std::chrono::duration<double, std::nano>(end - start).count();
+
+		if (!resized)
+		{
+			++failures;
+			continue;
+		}
+
+		numUpdates += !updates.empty();
+		numRanges += updates.size();
+
+		for (const TileRange & range : updates)
+		{
+			bool bind = range.heap != TileRange::NullHeap;
+			if (bind && (range.heap >= map.GetNumHeaps() || range.heapTile + range.count > tilesPerHeap))
+				++failures;
+
+			for (uint32_t t = 0; t < range.count; ++t)
+			{
+				TileRange & entry = table[range.virtualTile + t];
+
+				//Binding over a bound tile would move data the GPU still holds
+				if (bind && entry.heap != TileRange::NullHeap)
+					++failures;
+
+				entry.heap = range.heap;
+				entry.heapTile = bind ? range.heapTile + t : 0;
+			}
+		}
+
+		//Page table must agree with the bookkeeping and cover the requested bytes
+		uint64_t needed = (bytes + map.GetTileSize() - 1) / map.GetTileSize();
+		if (map.GetNumBoundTiles() < needed)
+			++failures;
+
+		for (uint32_t t = 0; t < map.GetNumTiles(); t += 97)
+		{
+			TileRange located = map.Locate(t);
+			if (located.heap != table[t].heap || located.heapTile != table[t].heapTile)
+				++failures;
+		}
+
+		if (random() % 16 == 0)
+			trimmed += map.Trim();
+	}
+
+	std::printf("%d resizes, %zu with tile mapping changes, %zu ranges, %zu heaps released by trims\n", iterations, numUpdates, numRanges, trimmed);
+	std::printf("%.1f ns per resize, final %.1f MB bound in %u heaps of %u tiles\n", resizeNs / iterations, map.GetBoundBytes() / (1024.0 * 1024.0),
+				map.GetNumHeaps(), tilesPerHeap);
+	std::printf("%s, %zu failures\n", failures ? "FAILED" : "passed", failures);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace dx
+{
+	struct AllocationCounters
+	{
+		uint64_t count;
+		uint64_t bytes;
+	};
+
+	//Process-wide tally of the live GPU resources created through Buffer. Resources report
+	//their own release through a destruction callback, so whatever still holds a reference
+	//(e.g. an upload heap nobody frees) shows up as growth.
+	class AllocationTracker
+	{
+	public:
+		static void OnAllocate(const uint64_t & bytes)
+		{
+			GetCount().fetch_add(1, std::memory_order_relaxed);
+			GetBytes().fetch_add(bytes, std::memory_order_relaxed);
+		}
+
+		static void OnRelease(const uint64_t & bytes)
+		{
+			GetCount().fetch_sub(1, std::memory_order_relaxed);
+			GetBytes().fetch_sub(bytes, std::memory_order_relaxed);
+		}
+
+		static AllocationCounters GetLive()
+		{
+			return { GetCount().load(std::memory_order_relaxed), GetBytes().load(std::memory_order_relaxed) };
+		}
+
+	private:
+		static std::atomic<uint64_t> & GetCount()
+		{
+			static std::atomic<uint64_t> count(0);
+			return count;
+		}
+
+		static std::atomic<uint64_t> & GetBytes()
+		{
+			static std::atomic<uint64_t> bytes(0);
+			return bytes;
+		}
+	};
+}
@@ -0,0 +1,661 @@
+#include <utils/AsyncFileWriter.hpp>
+#include <utils/ResourceLimits.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#ifdef _WIN32
+#include <Windows.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace dx
+{
+	//Completion based interface both backends implement, buffers are identified by index
+	class AsyncFileWriter::Backend
+	{
+	public:
+		virtual ~Backend() = default;
+
+	public:
+		//Writes size bytes of the buffer, starting begin bytes into it, at offset in the file
+		virtual void Submit(const unsigned int & buffer, const size_t & begin, const size_t & size, const uint64_t & offset) = 0;
+
+		//Blocks until a write finished, result is the bytes written or a negative error code
+		virtual void Wait(unsigned int & buffer, int64_t & result) = 0;
+		virtual const char* GetName() const = 0;
+	};
+
+	const size_t AsyncFileWriter::Alignment;
+
+	namespace
+	{
+		unsigned char* AllocateAligned(const size_t & size)
+		{
+#ifdef _WIN32
+			return static_cast<unsigned char*>(_aligned_malloc(size, AsyncFileWriter::Alignment));
+#else
+			void* memory = nullptr;
+			return posix_memalign(&memory, AsyncFileWriter::Alignment, size) == 0 ? static_cast<unsigned char*>(memory) : nullptr;
+#endif
+		}
+
+		void FreeAligned(unsigned char* memory)
+		{
+#ifdef _WIN32
+			_aligned_free(memory);
+#else
+			free(memory);
+#endif
+		}
+
+		//Positioned write of the whole range, returns the bytes written or a negative error code
+		int64_t WriteAt(const intptr_t & file, const unsigned char* data, const size_t & size, const uint64_t & offset)
+		{
+#ifdef _WIN32
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+			DWORD written = 0;
+			if (!WriteFile(reinterpret_cast<HANDLE>(file), data, static_cast<DWORD>(size), &written, &overlapped))
+				return -static_cast<int64_t>(GetLastError());
+			return written;
+#else
+			size_t done = 0;
+			while (done < size)
+			{
+				ssize_t written = pwrite(static_cast<int>(file), data + done, size - done, static_cast<off_t>(offset + done));
+				if (written < 0 && errno == EINTR)
+					continue;
+				if (written <= 0)
+					return written < 0 ? -errno : static_cast<int64_t>(done);
+				done += static_cast<size_t>(written);
+			}
+			return static_cast<int64_t>(done);
+#endif
+		}
+
+		//Portable backend, a few threads issuing blocking positioned writes
+		class ThreadPoolBackend : public AsyncFileWriter::Backend
+		{
+		public:
+			ThreadPoolBackend(const intptr_t & file, const std::vector<unsigned char*> & buffers, const unsigned int & numThreads)
+				: m_file(file), m_buffers(buffers)
+			{
+				for (unsigned int i = 0; i < (std::max)(numThreads, 1u); ++i)
+					m_threads.emplace_back(&ThreadPoolBackend::WorkLoop, this);
+			}
+
+			~ThreadPoolBackend()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_stop = true;
+				}
+
+				m_workCondition.notify_all();
+				for (std::thread & thread : m_threads)
+					thread.join();
+			}
+
+		public:
+			void Submit(const unsigned int & buffer, const size_t & begin, const size_t & size, const uint64_t & offset) override
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_requests.push_back({ buffer, begin, size, offset, 0 });
+				}
+
+				m_workCondition.notify_one();
+			}
+
+			void Wait(unsigned int & buffer, int64_t & result) override
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_doneCondition.wait(lock, [this] { return !m_completions.empty(); });
+
+				buffer = m_completions.front().buffer;
+				result = m_completions.front().result;
+				m_completions.pop_front();
+			}
+
+			const char* GetName() const override
+			{
+				return "thread pool";
+			}
+
+		private:
+			struct Request
+			{
+				unsigned int buffer;
+				size_t begin;
+				size_t size;
+				uint64_t offset;
+				int64_t result;
+			};
+
+			void WorkLoop()
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				for (;;)
+				{
+					m_workCondition.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+					if (m_requests.empty())
+						return;
+
+					Request request = m_requests.front();
+					m_requests.pop_front();
+
+					lock.unlock();
+					request.result = WriteAt(m_file, m_buffers[request.buffer] + request.begin, request.size, request.offset);
+					lock.lock();
+
+					m_completions.push_back(request);
+					m_doneCondition.notify_one();
+				}
+			}
+
+		private:
+			intptr_t m_file;
+			std::vector<unsigned char*> m_buffers;
+			std::vector<std::thread> m_threads;
+			std::deque<Request> m_requests;
+			std::deque<Request> m_completions;
+			bool m_stop = false;
+
+			std::mutex m_mutex;
+			std::condition_variable m_workCondition;
+			std::condition_variable m_doneCondition;
+		};
+
+#ifdef __linux__
+		//io_uring through the raw system calls, one submission queue entry per block. The
+		//blocks and the file are registered once, so each write skips pinning the pages and
+		//looking up the descriptor.
+		class UringBackend : public AsyncFileWriter::Backend
+		{
+		public:
+			//nullptr when the kernel has no io_uring or it is blocked (e.g. by seccomp)
+			static std::unique_ptr<AsyncFileWriter::Backend> Create(const int & file, const std::vector<unsigned char*> & buffers, const size_t & blockSize,
+																	const unsigned int & queueDepth)
+			{
+				std::unique_ptr<UringBackend> backend(new UringBackend(file, buffers));
+				if (!backend->Initialize(blockSize, queueDepth))
+					return nullptr;
+				return backend;
+			}
+
+			~UringBackend()
+			{
+				if (m_sqes)
+					munmap(m_sqes, m_sqesSize);
+				if (m_cqRing && m_cqRing != m_sqRing)
+					munmap(m_cqRing, m_cqRingSize);
+				if (m_sqRing)
+					munmap(m_sqRing, m_sqRingSize);
+				if (m_ring >= 0)
+					close(m_ring);
+			}
+
+		public:
+			void Submit(const unsigned int & buffer, const size_t & begin, const size_t & size, const uint64_t & offset) override
+			{
+				//Single producer, only the kernel moves the head
+				unsigned int tail = *m_sqTail;
+				unsigned int index = tail & *m_sqMask;
+
+				io_uring_sqe & sqe = m_sqes[index];
+				std::memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = m_fixedBuffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITEV;
+				sqe.fd = m_fixedFile ? 0 : m_file;
+				sqe.flags = m_fixedFile ? IOSQE_FIXED_FILE : 0;
+				sqe.off = offset;
+				sqe.user_data = buffer;
+
+				if (m_fixedBuffers)
+				{
+					sqe.addr = reinterpret_cast<uint64_t>(m_buffers[buffer] + begin);
+					sqe.len = static_cast<uint32_t>(size);
+					sqe.buf_index = static_cast<uint16_t>(buffer);
+				}
+				else
+				{
+					m_vectors[buffer].iov_base = m_buffers[buffer] + begin;
+					m_vectors[buffer].iov_len = size;
+					sqe.addr = reinterpret_cast<uint64_t>(&m_vectors[buffer]);
+					sqe.len = 1;
+				}
+
+				m_sqArray[index] = index;
+				__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+				int submitted;
+				do
+				{
+					submitted = Enter(1, 0, 0);
+				} while (submitted < 0 && errno == EINTR);
+
+				//A failed enter takes no entry. Take it back so a later enter does not submit it
+				//again after it was reported, then report it like a failed write. If the kernel
+				//did take it, its completion comes through the queue as usual.
+				if (submitted <= 0)
+				{
+					int code = submitted < 0 ? errno : EAGAIN;
+					if (__atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) == tail)
+					{
+						__atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+						m_rejected.push_back({ buffer, -code });
+					}
+				}
+			}
+
+			void Wait(unsigned int & buffer, int64_t & result) override
+			{
+				if (!m_rejected.empty())
+				{
+					buffer = m_rejected.front().first;
+					result = m_rejected.front().second;
+					m_rejected.pop_front();
+					return;
+				}
+
+				for (;;)
+				{
+					unsigned int head = *m_cqHead;
+					if (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+					{
+						const io_uring_cqe & cqe = m_cqes[head & *m_cqMask];
+						buffer = static_cast<unsigned int>(cqe.user_data);
+						result = cqe.res;
+						__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+						return;
+					}
+
+					Enter(0, 1, IORING_ENTER_GETEVENTS);
+				}
+			}
+
+			const char* GetName() const override
+			{
+				return m_fixedBuffers ? "io_uring, registered buffers" : "io_uring";
+			}
+
+		private:
+			UringBackend(const int & file, const std::vector<unsigned char*> & buffers)
+				: m_file(file), m_buffers(buffers), m_vectors(buffers.size())
+			{
+			}
+
+			bool Initialize(const size_t & blockSize, const unsigned int & queueDepth)
+			{
+				io_uring_params params;
+				std::memset(&params, 0, sizeof(params));
+				m_ring = static_cast<int>(syscall(__NR_io_uring_setup, queueDepth, &params));
+				if (m_ring < 0)
+					return false;
+
+				m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+				m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+				if (singleMap)
+					m_sqRingSize = m_cqRingSize = (std::max)(m_sqRingSize, m_cqRingSize);
+
+				m_sqRing = Map(m_sqRingSize, IORING_OFF_SQ_RING);
+				m_cqRing = singleMap ? m_sqRing : Map(m_cqRingSize, IORING_OFF_CQ_RING);
+				m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+				m_sqes = static_cast<io_uring_sqe*>(Map(m_sqesSize, IORING_OFF_SQES));
+				if (!m_sqRing || !m_cqRing || !m_sqes)
+					return false;
+
+				unsigned char* sq = static_cast<unsigned char*>(m_sqRing);
+				m_sqHead = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+				m_sqTail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+				m_sqMask = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+				m_sqArray = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+
+				unsigned char* cq = static_cast<unsigned char*>(m_cqRing);
+				m_cqHead = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+				m_cqTail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+				m_cqMask = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+				m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+				//Registration pins memory against RLIMIT_MEMLOCK, plain writes still work without it
+				std::vector<iovec> vectors(m_buffers.size());
+				for (size_t i = 0; i < m_buffers.size(); ++i)
+				{
+					vectors[i].iov_base = m_buffers[i];
+					vectors[i].iov_len = blockSize;
+				}
+
+				m_fixedBuffers = Register(IORING_REGISTER_BUFFERS, vectors.data(), static_cast<unsigned int>(vectors.size()));
+				m_fixedFile = Register(IORING_REGISTER_FILES, &m_file, 1);
+				return true;
+			}
+
+			void* Map(const size_t & size, const uint64_t & offset)
+			{
+				void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, static_cast<off_t>(offset));
+				return memory == MAP_FAILED ? nullptr : memory;
+			}
+
+			int Enter(const unsigned int & toSubmit, const unsigned int & minComplete, const unsigned int & flags)
+			{
+				return static_cast<int>(syscall(__NR_io_uring_enter, m_ring, toSubmit, minComplete, flags, nullptr, 0));
+			}
+
+			bool Register(const unsigned int & opcode, const void* arguments, const unsigned int & count)
+			{
+				return syscall(__NR_io_uring_register, m_ring, opcode, arguments, count) == 0;
+			}
+
+		private:
+			int m_file;
+			std::vector<unsigned char*> m_buffers;
+			std::vector<iovec> m_vectors;
+			std::deque<std::pair<unsigned int, int64_t>> m_rejected;
+			bool m_fixedBuffers = false;
+			bool m_fixedFile = false;
+
+			int m_ring = -1;
+			void* m_sqRing = nullptr;
+			void* m_cqRing = nullptr;
+			size_t m_sqRingSize = 0;
+			size_t m_cqRingSize = 0;
+			size_t m_sqesSize = 0;
+			io_uring_sqe* m_sqes = nullptr;
+			io_uring_cqe* m_cqes = nullptr;
+			unsigned int* m_sqHead = nullptr;
+			unsigned int* m_sqTail = nullptr;
+			unsigned int* m_sqMask = nullptr;
+			unsigned int* m_sqArray = nullptr;
+			unsigned int* m_cqHead = nullptr;
+			unsigned int* m_cqTail = nullptr;
+			unsigned int* m_cqMask = nullptr;
+		};
+#endif
+	}
+
+	AsyncFileWriter::AsyncFileWriter(const AsyncIOSettings & settings) : m_settings(settings), m_requestedThreads(settings.numThreads)
+	{
+		m_settings.queueDepth = (std::max)(m_settings.queueDepth, 1u);
+		m_settings.blockSize = (std::max)((m_settings.blockSize + Alignment - 1) / Alignment * Alignment, Alignment);
+
+		//No more blocks in flight than fit in an eighth of the memory limit, the writers are
+		//capped by the CPU quota when a file is opened
+		size_t inFlight = FitBufferBytes(m_settings.queueDepth * m_settings.blockSize, 0.125);
+		m_settings.queueDepth = static_cast<unsigned int>((std::max)(inFlight / m_settings.blockSize, size_t(1)));
+	}
+
+	AsyncFileWriter::~AsyncFileWriter()
+	{
+		if (IsOpen())
+		{
+			std::string error;
+			Close(error);
+		}
+
+		for (unsigned char* buffer : m_buffers)
+			FreeAligned(buffer);
+	}
+
+	bool AsyncFileWriter::Open(const std::string & path, std::string & error)
+	{
+		if (IsOpen())
+		{
+			error = m_path + " is still open";
+			return false;
+		}
+
+		//Allocated on first use and kept for the following files
+		if (m_buffers.empty())
+		{
+			for (unsigned int i = 0; i < m_settings.queueDepth; ++i)
+			{
+				unsigned char* buffer = AllocateAligned(m_settings.blockSize);
+				if (!buffer)
+				{
+					error = "out of memory for the I/O blocks";
+					return false;
+				}
+				m_buffers.push_back(buffer);
+			}
+			m_submitted.resize(m_buffers.size());
+			m_written.resize(m_buffers.size());
+			m_blockOffsets.resize(m_buffers.size());
+		}
+
+#ifdef _WIN32
+		DWORD flags = FILE_ATTRIBUTE_NORMAL | (m_settings.directIO ? FILE_FLAG_NO_BUFFERING : 0);
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, flags, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			error = "could not open " + path + " (error " + std::to_string(GetLastError()) + ")";
+			return false;
+		}
+		m_file = reinterpret_cast<intptr_t>(file);
+		m_direct = m_settings.directIO;
+#else
+		int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+		int file = -1;
+		m_direct = false;
+#ifdef O_DIRECT
+		if (m_settings.directIO)
+		{
+			file = open(path.c_str(), flags | O_DIRECT, 0644);
+			m_direct = file >= 0;
+		}
+#endif
+		//File systems without direct I/O (e.g. tmpfs) get buffered writes
+		if (file < 0)
+			file = open(path.c_str(), flags, 0644);
+		if (file < 0)
+		{
+			error = "could not open " + path + ": " + std::strerror(errno);
+			return false;
+		}
+		m_file = file;
+#endif
+
+		m_path = path;
+		m_error.clear();
+		m_fill = 0;
+		m_inFlight = 0;
+		m_offset = 0;
+		m_size = 0;
+
+#ifdef __linux__
+		if (m_settings.useUring)
+			m_backend = UringBackend::Create(static_cast<int>(m_file), m_buffers, m_settings.blockSize, m_settings.queueDepth);
+#endif
+		if (!m_backend)
+		{
+			//The quota may have changed since the last file
+			m_settings.numThreads = (std::max)((std::min)(m_requestedThreads, GetWorkerCount()), 1u);
+			m_backend.reset(new ThreadPoolBackend(m_file, m_buffers, m_settings.numThreads));
+		}
+		m_backendName = m_backend->GetName();
+
+		m_free.clear();
+		for (unsigned int i = 0; i < m_buffers.size(); ++i)
+			m_free.push_back(i);
+		m_current = m_free.back();
+		m_free.pop_back();
+		return true;
+	}
+
+	bool AsyncFileWriter::Write(const void * data, const size_t & size)
+	{
+		if (!IsOpen() || !m_error.empty())
+			return false;
+
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		size_t remaining = size;
+		while (remaining > 0)
+		{
+			size_t count = (std::min)(remaining, m_settings.blockSize - m_fill);
+			std::memcpy(m_buffers[m_current] + m_fill, bytes, count);
+			m_fill += count;
+			m_size += count;
+			bytes += count;
+			remaining -= count;
+
+			if (m_fill == m_settings.blockSize)
+			{
+				Submit(m_fill);
+				if (!m_error.empty())
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool AsyncFileWriter::Close(std::string & error)
+	{
+		if (!IsOpen())
+		{
+			error = "no file is open";
+			return false;
+		}
+
+		//Direct I/O only takes whole sectors, the padding is cut off again below
+		bool padded = false;
+		if (m_fill > 0 && m_error.empty())
+		{
+			size_t bytes = m_fill;
+			if (m_direct)
+			{
+				bytes = (m_fill + Alignment - 1) / Alignment * Alignment;
+				std::memset(m_buffers[m_current] + m_fill, 0, bytes - m_fill);
+				padded = bytes != m_fill;
+			}
+			Submit(bytes);
+		}
+
+		while (m_inFlight > 0)
+			Reclaim();
+		m_backend.reset();
+
+		if (m_error.empty())
+		{
+#ifdef _WIN32
+			HANDLE file = reinterpret_cast<HANDLE>(m_file);
+			if (padded)
+			{
+				FILE_END_OF_FILE_INFO info = {};
+				info.EndOfFile.QuadPart = static_cast<LONGLONG>(m_size);
+				if (!SetFileInformationByHandle(file, FileEndOfFileInfo, &info, sizeof(info)))
+					Fail("could not truncate " + m_path);
+			}
+			if (m_settings.syncOnClose && !FlushFileBuffers(file))
+				Fail("could not flush " + m_path);
+#else
+			int file = static_cast<int>(m_file);
+			if (padded && ftruncate(file, static_cast<off_t>(m_size)) != 0)
+				Fail("could not truncate " + m_path + ": " + std::strerror(errno));
+			if (m_settings.syncOnClose && fdatasync(file) != 0)
+				Fail("could not sync " + m_path + ": " + std::strerror(errno));
+#endif
+		}
+
+		CloseFile();
+		error = m_error;
+		return m_error.empty();
+	}
+
+	bool AsyncFileWriter::IsOpen() const
+	{
+		return m_file != -1;
+	}
+
+	bool AsyncFileWriter::IsDirect() const
+	{
+		return m_direct;
+	}
+
+	const char* AsyncFileWriter::GetBackendName() const
+	{
+		return m_backendName;
+	}
+
+	uint64_t AsyncFileWriter::GetBytesWritten() const
+	{
+		return m_size;
+	}
+
+	void AsyncFileWriter::Submit(const size_t & size)
+	{
+		m_submitted[m_current] = size;
+		m_written[m_current] = 0;
+		m_blockOffsets[m_current] = m_offset;
+		m_backend->Submit(m_current, 0, size, m_offset);
+		m_offset += size;
+		m_fill = 0;
+		++m_inFlight;
+
+		//Back pressure, the caller only waits once every block is in flight
+		if (m_free.empty())
+			Reclaim();
+
+		m_current = m_free.back();
+		m_free.pop_back();
+	}
+
+	void AsyncFileWriter::Reclaim()
+	{
+		//A short write goes out again for its remainder, the block is only free once all of it is written
+		for (;;)
+		{
+			unsigned int buffer;
+			int64_t result;
+			m_backend->Wait(buffer, result);
+
+			if (result > 0 && m_written[buffer] + static_cast<size_t>(result) < m_submitted[buffer])
+			{
+				m_written[buffer] += static_cast<size_t>(result);
+				m_backend->Submit(buffer, m_written[buffer], m_submitted[buffer] - m_written[buffer], m_blockOffsets[buffer] + m_written[buffer]);
+				continue;
+			}
+
+			--m_inFlight;
+			if (result < 0)
+				Fail("write to " + m_path + " failed (error " + std::to_string(-result) + ")");
+			else if (m_written[buffer] + static_cast<size_t>(result) != m_submitted[buffer])
+				Fail("short write to " + m_path);
+
+			m_free.push_back(buffer);
+			return;
+		}
+	}
+
+	void AsyncFileWriter::Fail(const std::string & error)
+	{
+		//Keeps the first error, later ones are usually consequences
+		if (m_error.empty())
+			m_error = error;
+	}
+
+	void AsyncFileWriter::CloseFile()
+	{
+#ifdef _WIN32
+		CloseHandle(reinterpret_cast<HANDLE>(m_file));
+#else
+		close(static_cast<int>(m_file));
+#endif
+		m_file = -1;
+	}
+}
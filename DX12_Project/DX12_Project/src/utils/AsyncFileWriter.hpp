@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dx
+{
+	struct AsyncIOSettings
+	{
+		unsigned int queueDepth = 16;				//Blocks in flight before Write waits for one to finish
+		size_t blockSize = size_t(4) << 20;			//Bytes per write, rounded up to the alignment
+		bool directIO = true;						//O_DIRECT / FILE_FLAG_NO_BUFFERING, skips the page cache
+		bool useUring = false;						//io_uring where it exists, the thread pool measured faster
+		unsigned int numThreads = 4;				//Workers of the portable backend, at most the worker count when a file is opened
+		bool syncOnClose = true;					//fdatasync / FlushFileBuffers before Close returns
+	};
+
+	//Sequential file writer that keeps queueDepth aligned blocks in flight. Write copies
+	//into the current block and hands full blocks to the backend, so the caller only
+	//waits when the device is queueDepth blocks behind. A small thread pool issues positioned
+	//writes; with useUring on Linux the blocks are instead registered with an io_uring and
+	//written with WRITE_FIXED, falling back to the pool where io_uring is not available.
+	//Short writes are resubmitted for their remainder. The file is opened for
+	//direct I/O when the file system allows it; the last block is zero padded to the
+	//alignment and the file truncated to its real size on Close. The pool follows the worker
+	//count of ResourceLimits at every Open, the blocks are sized once from the memory limit.
+	//One thread at a time, meant to be driven from a background thread (see SnapshotWriter).
+	class AsyncFileWriter
+	{
+	public:
+		static const size_t Alignment = 4096;
+
+		AsyncFileWriter(const AsyncIOSettings & settings = AsyncIOSettings());
+		~AsyncFileWriter();
+
+	public:
+		bool Open(const std::string & path, std::string & error);
+		bool Write(const void* data, const size_t & size);
+		bool Close(std::string & error);
+
+		bool IsOpen() const;
+		bool IsDirect() const;
+		const char* GetBackendName() const;		//Of the last opened file
+		uint64_t GetBytesWritten() const;
+
+	public:
+		class Backend;
+
+	private:
+		void Submit(const size_t & size);
+		void Reclaim();
+		void Fail(const std::string & error);
+		void CloseFile();
+
+	private:
+		AsyncIOSettings m_settings;
+		unsigned int m_requestedThreads;
+		std::vector<unsigned char*> m_buffers;
+		std::vector<size_t> m_submitted;		//Bytes of the block per buffer
+		std::vector<size_t> m_written;			//Of which already written
+		std::vector<uint64_t> m_blockOffsets;	//File offset of the block
+		std::vector<unsigned int> m_free;
+		std::unique_ptr<Backend> m_backend;
+		const char* m_backendName = "none";
+
+		intptr_t m_file = -1;
+		bool m_direct = false;
+		unsigned int m_current = 0;
+		size_t m_fill = 0;
+		unsigned int m_inFlight = 0;
+		uint64_t m_offset = 0;
+		uint64_t m_size = 0;
+		std::string m_path;
+		std::string m_error;
+	};
+}
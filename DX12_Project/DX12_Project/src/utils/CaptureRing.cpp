@@ -0,0 +1,99 @@
+#include <utils/CaptureRing.hpp>
+#include <assert.h>
+
+namespace dx
+{
+	const unsigned int CaptureRing::NoSlot;
+
+	CaptureRing::CaptureRing(const unsigned int & numSlots) : m_slots(numSlots)
+	{
+		assert(numSlots > 0);
+	}
+
+	unsigned int CaptureRing::Acquire()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (unsigned int i = 0; i < m_slots.size(); ++i)
+		{
+			if (m_slots[i].state == State::Free)
+			{
+				m_slots[i].state = State::Acquired;
+				return i;
+			}
+		}
+
+		++m_numDropped;
+		return NoSlot;
+	}
+
+	void CaptureRing::Submit(const unsigned int & slot, const uint64_t & frame, const uint64_t & fenceValue)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		assert(slot < m_slots.size() && m_slots[slot].state == State::Acquired);
+		assert(fenceValue > m_lastFenceValue);
+
+		m_slots[slot].state = State::Copying;
+		m_slots[slot].frame = frame;
+		m_slots[slot].fenceValue = fenceValue;
+		m_lastFenceValue = fenceValue;
+		m_copying.push_back(slot);
+	}
+
+	void CaptureRing::Cancel(const unsigned int & slot)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		assert(slot < m_slots.size() && m_slots[slot].state == State::Acquired);
+		m_slots[slot].state = State::Free;
+	}
+
+	size_t CaptureRing::Retire(const uint64_t & completedFenceValue, std::vector<RetiredCapture> & retired)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		//Fence values increase with submission order, so the finished copies are a prefix
+		size_t count = 0;
+		while (!m_copying.empty() && m_slots[m_copying.front()].fenceValue <= completedFenceValue)
+		{
+			Slot & slot = m_slots[m_copying.front()];
+			slot.state = State::Retired;
+			retired.push_back(RetiredCapture{ m_copying.front(), slot.frame });
+			m_copying.pop_front();
+			++count;
+		}
+
+		return count;
+	}
+
+	void CaptureRing::Release(const unsigned int & slot)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		assert(slot < m_slots.size() && m_slots[slot].state == State::Retired);
+		m_slots[slot].state = State::Free;
+	}
+
+	unsigned int CaptureRing::GetNumSlots() const
+	{
+		return static_cast<unsigned int>(m_slots.size());
+	}
+
+	unsigned int CaptureRing::GetNumFree() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		unsigned int free = 0;
+		for (const Slot & slot : m_slots)
+			free += slot.state == State::Free ? 1 : 0;
+		return free;
+	}
+
+	unsigned int CaptureRing::GetNumCopying() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return static_cast<unsigned int>(m_copying.size());
+	}
+
+	uint64_t CaptureRing::GetNumDropped() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_numDropped;
+	}
+}
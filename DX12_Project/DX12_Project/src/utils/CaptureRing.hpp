@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace dx
+{
+	//A capture slot whose copy the queue finished, in submission order
+	struct RetiredCapture
+	{
+		unsigned int slot;
+		uint64_t frame;
+	};
+
+	//Slot and fence bookkeeping for a ring of readback buffers. A slot is acquired by the
+	//render thread, submitted with the fence value signaled after the copy into it, retired
+	//once the queue passed that value and released by whoever consumed its pixels, usually
+	//an encoder thread. Nothing ever waits: Acquire returns NoSlot when every slot is still
+	//copying or encoding, and the frame is dropped. Independent of D3D12 so it can be driven
+	//by a stand-in queue (see tools/ValidateCapture.cpp).
+	class CaptureRing
+	{
+	public:
+		static const unsigned int NoSlot = 0xFFFFFFFFu;
+
+		CaptureRing(const unsigned int & numSlots);
+
+	public:
+		//Free slot for the copy of this frame, NoSlot (and a counted drop) when there is none
+		unsigned int Acquire();
+
+		//The copy into slot was submitted, followed by a signal of fenceValue. Fence values
+		//have to increase from one submission to the next.
+		void Submit(const unsigned int & slot, const uint64_t & frame, const uint64_t & fenceValue);
+
+		//Returns an acquired slot that was never submitted
+		void Cancel(const unsigned int & slot);
+
+		//Appends the slots whose fence value was reached, they stay owned until Release
+		size_t Retire(const uint64_t & completedFenceValue, std::vector<RetiredCapture> & retired);
+
+		//The pixels of a retired slot are no longer read, any thread
+		void Release(const unsigned int & slot);
+
+		unsigned int GetNumSlots() const;
+		unsigned int GetNumFree() const;
+		unsigned int GetNumCopying() const;
+		uint64_t GetNumDropped() const;		//Acquires that found no free slot
+
+	private:
+		enum class State
+		{
+			Free,
+			Acquired,
+			Copying,
+			Retired
+		};
+
+		struct Slot
+		{
+			State state = State::Free;
+			uint64_t frame = 0;
+			uint64_t fenceValue = 0;
+		};
+
+	private:
+		mutable std::mutex m_mutex;
+		std::vector<Slot> m_slots;
+		std::deque<unsigned int> m_copying;		//Submission order
+		uint64_t m_lastFenceValue = 0;
+		uint64_t m_numDropped = 0;
+	};
+}
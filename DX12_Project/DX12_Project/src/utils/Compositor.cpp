@@ -0,0 +1,277 @@
+#include <utils/Compositor.hpp>
+#include <algorithm>
+#include <chrono>
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace dx
+{
+	const unsigned int CompositeTransport::NoRank;
+
+	namespace
+	{
+		//Piece j of k of the pixel range [first, end)
+		void GetPiece(const size_t & first, const size_t & end, const unsigned int & j, const unsigned int & k, size_t & pieceFirst, size_t & pieceEnd)
+		{
+			pieceFirst = first + (end - first) * j / k;
+			pieceEnd = first + (end - first) * (j + 1) / k;
+		}
+	}
+
+#ifndef _WIN32
+	bool SocketTransport::CreateMesh(const unsigned int & size, std::vector<int> & sockets, std::string & error)
+	{
+		sockets.assign(size_t(size) * size, -1);
+		for (unsigned int a = 0; a < size; ++a)
+		{
+			for (unsigned int b = a + 1; b < size; ++b)
+			{
+				int pair[2];
+				if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+				{
+					error = std::string("socketpair failed: ") + std::strerror(errno);
+					for (int socket : sockets)
+						if (socket >= 0)
+							close(socket);
+					sockets.clear();
+					return false;
+				}
+
+				sockets[a * size + b] = pair[0];
+				sockets[b * size + a] = pair[1];
+			}
+		}
+
+		return true;
+	}
+
+	SocketTransport::SocketTransport(const unsigned int & rank, const unsigned int & size, const std::vector<int> & sockets)
+		: m_rank(rank), m_size(size), m_sockets(sockets.begin() + size_t(rank) * size, sockets.begin() + size_t(rank + 1) * size)
+	{
+		for (size_t i = 0; i < sockets.size(); ++i)
+			if (i / size != rank && sockets[i] >= 0)
+				close(sockets[i]);
+	}
+
+	SocketTransport::~SocketTransport()
+	{
+		for (int socket : m_sockets)
+			if (socket >= 0)
+				close(socket);
+	}
+
+	bool SocketTransport::SendReceive(const unsigned int & destination, const void* send, const size_t & sendBytes, const unsigned int & source, void* receive,
+									  const size_t & receiveBytes)
+	{
+		const char* sendData = static_cast<const char*>(send);
+		char* receiveData = static_cast<char*>(receive);
+		size_t sent = destination == NoRank ? sendBytes : 0;
+		size_t received = source == NoRank ? receiveBytes : 0;
+
+		while (sent < sendBytes || received < receiveBytes)
+		{
+			pollfd fds[2];
+			nfds_t count = 0;
+			if (sent < sendBytes)
+				fds[count++] = { m_sockets[destination], POLLOUT, 0 };
+			if (received < receiveBytes)
+				fds[count++] = { m_sockets[source], POLLIN, 0 };
+
+			if (poll(fds, count, -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+
+			for (nfds_t i = 0; i < count; ++i)
+			{
+				if (fds[i].revents == 0)
+					continue;
+
+				if (fds[i].events == POLLOUT)
+				{
+					ssize_t n = ::send(fds[i].fd, sendData + sent, sendBytes - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+					if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+						return false;
+					sent += n > 0 ? size_t(n) : 0;
+				}
+				else
+				{
+					ssize_t n = ::recv(fds[i].fd, receiveData + received, receiveBytes - received, MSG_DONTWAIT);
+					if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+						return false;
+					received += n > 0 ? size_t(n) : 0;
+				}
+			}
+		}
+
+		return true;
+	}
+#else
+	bool SocketTransport::CreateMesh(const unsigned int &, std::vector<int> & sockets, std::string & error)
+	{
+		sockets.clear();
+		error = "socket transport is not available on Windows";
+		return false;
+	}
+
+	SocketTransport::SocketTransport(const unsigned int & rank, const unsigned int & size, const std::vector<int> &) : m_rank(rank), m_size(size)
+	{
+	}
+
+	SocketTransport::~SocketTransport()
+	{
+	}
+
+	bool SocketTransport::SendReceive(const unsigned int &, const void*, const size_t &, const unsigned int &, void*, const size_t &)
+	{
+		return false;
+	}
+#endif
+
+	unsigned int SocketTransport::GetRank() const
+	{
+		return m_rank;
+	}
+
+	unsigned int SocketTransport::GetSize() const
+	{
+		return m_size;
+	}
+
+	std::vector<unsigned int> GetCompositeRounds(const unsigned int & size, const unsigned int & maxRadix)
+	{
+		std::vector<unsigned int> primes;
+		unsigned int rest = size;
+		for (unsigned int p = 2; p * p <= rest; ++p)
+			for (; rest % p == 0; rest /= p)
+				primes.push_back(p);
+		if (rest > 1)
+			primes.push_back(rest);
+
+		//Ascending primes merged while the group stays within maxRadix
+		std::vector<unsigned int> rounds;
+		unsigned int group = 1;
+		for (unsigned int p : primes)
+		{
+			if (group * p <= maxRadix)
+				group *= p;
+			else
+			{
+				if (group > 1)
+					rounds.push_back(group);
+				group = p;
+			}
+		}
+		if (group > 1)
+			rounds.push_back(group);
+
+		return rounds;
+	}
+
+	void GetCompositeRange(const unsigned int & rank, const std::vector<unsigned int> & rounds, const size_t & numPixels, size_t & first, size_t & end)
+	{
+		first = 0;
+		end = numPixels;
+		unsigned int stride = 1;
+		for (unsigned int k : rounds)
+		{
+			size_t pieceFirst, pieceEnd;
+			GetPiece(first, end, (rank / stride) % k, k, pieceFirst, pieceEnd);
+			first = pieceFirst;
+			end = pieceEnd;
+			stride *= k;
+		}
+	}
+
+	CompositeReport CompositeImage(CompositeTransport & transport, SpriteImage & image, const CompositeSettings & settings)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		const unsigned int rank = transport.GetRank();
+		const unsigned int size = transport.GetSize();
+		const size_t numPixels = size_t(image.width) * image.height;
+
+		CompositeReport report;
+		report.rounds = GetCompositeRounds(size, (std::max)(settings.maxRadix, 2u));
+
+		size_t first = 0, end = numPixels;
+		unsigned int stride = 1;
+		std::vector<float> incoming;
+
+		for (unsigned int k : report.rounds)
+		{
+			//Members of this rank's group are stride apart, it keeps piece d
+			unsigned int d = (rank / stride) % k;
+			unsigned int base = rank - d * stride;
+
+			size_t keepFirst, keepEnd;
+			GetPiece(first, end, d, k, keepFirst, keepEnd);
+			incoming.resize((keepEnd - keepFirst) * 3);
+			float* keep = image.pixels.data() + keepFirst * 3;
+
+			//Step t sends the piece of the member t ahead and receives from the one t behind,
+			//so every pair of the group exchanges exactly once
+			for (unsigned int t = 1; t < k && report.succeeded; ++t)
+			{
+				unsigned int to = (d + t) % k;
+				unsigned int from = (d + k - t) % k;
+
+				size_t sendFirst, sendEnd;
+				GetPiece(first, end, to, k, sendFirst, sendEnd);
+				size_t sendBytes = (sendEnd - sendFirst) * 3 * sizeof(float);
+				size_t receiveBytes = incoming.size() * sizeof(float);
+
+				report.succeeded = transport.SendReceive(base + to * stride, image.pixels.data() + sendFirst * 3, sendBytes, base + from * stride, incoming.data(),
+														 receiveBytes);
+				report.bytesSent += sendBytes;
+				report.bytesReceived += receiveBytes;
+
+				for (size_t i = 0; i < incoming.size(); ++i)
+					keep[i] += incoming[i];
+			}
+
+			first = keepFirst;
+			end = keepEnd;
+			stride *= k;
+		}
+
+		report.firstPixel = first;
+		report.endPixel = end;
+
+		//Every other rank's part straight into place on the root
+		if (settings.gather && report.succeeded)
+		{
+			if (rank == settings.root)
+			{
+				for (unsigned int other = 0; other < size && report.succeeded; ++other)
+				{
+					if (other == rank)
+						continue;
+
+					size_t otherFirst, otherEnd;
+					GetCompositeRange(other, report.rounds, numPixels, otherFirst, otherEnd);
+					size_t bytes = (otherEnd - otherFirst) * 3 * sizeof(float);
+					report.succeeded = transport.SendReceive(CompositeTransport::NoRank, nullptr, 0, other, image.pixels.data() + otherFirst * 3, bytes);
+					report.bytesReceived += bytes;
+					report.gatherBytes += bytes;
+				}
+			}
+			else
+			{
+				size_t bytes = (end - first) * 3 * sizeof(float);
+				report.succeeded = transport.SendReceive(settings.root, image.pixels.data() + first * 3, bytes, CompositeTransport::NoRank, nullptr, 0);
+				report.bytesSent += bytes;
+				report.gatherBytes += bytes;
+			}
+		}
+
+		report.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+		return report;
+	}
+}
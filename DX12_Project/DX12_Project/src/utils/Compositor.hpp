@@ -0,0 +1,85 @@
+#pragma once
+#include <utils/SpriteRaster.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dx
+{
+	//Point-to-point messages between the ranks of one compositing group
+	class CompositeTransport
+	{
+	public:
+		static const unsigned int NoRank = 0xFFFFFFFFu;
+
+		virtual ~CompositeTransport() {}
+
+		virtual unsigned int GetRank() const = 0;
+		virtual unsigned int GetSize() const = 0;
+
+		//Sends sendBytes to destination while receiving receiveBytes from source, and returns
+		//once both are done. Either side may be NoRank. Both directions progress together,
+		//so a ring of ranks that all send to the next one does not deadlock.
+		virtual bool SendReceive(const unsigned int & destination, const void* send, const size_t & sendBytes, const unsigned int & source, void* receive,
+								 const size_t & receiveBytes) = 0;
+	};
+
+	//Full mesh of Unix stream socket pairs between the processes of one machine. The mesh
+	//is created before forking, every process then keeps its own ends by constructing its
+	//transport from it. Not available on Windows, where Create fails.
+	class SocketTransport : public CompositeTransport
+	{
+	public:
+		//sockets[a * size + b] is a's end of the pair between a and b
+		static bool CreateMesh(const unsigned int & size, std::vector<int> & sockets, std::string & error);
+
+		//Closes the ends of the other ranks in this process
+		SocketTransport(const unsigned int & rank, const unsigned int & size, const std::vector<int> & sockets);
+		~SocketTransport();
+
+	public:
+		unsigned int GetRank() const override;
+		unsigned int GetSize() const override;
+		bool SendReceive(const unsigned int & destination, const void* send, const size_t & sendBytes, const unsigned int & source, void* receive,
+						 const size_t & receiveBytes) override;
+
+	private:
+		unsigned int m_rank;
+		unsigned int m_size;
+		std::vector<int> m_sockets;		//Own end per peer, -1 for the own rank
+	};
+
+	struct CompositeSettings
+	{
+		unsigned int maxRadix = 2;			//Largest group of a round, 2 is binary swap where the rank count allows it
+		unsigned int root = 0;				//Rank that gathers the final image
+		bool gather = true;					//False to leave each rank with only its own part
+	};
+
+	struct CompositeReport
+	{
+		std::vector<unsigned int> rounds;	//Group size of every round
+		size_t firstPixel = 0;				//Part of the image this rank composited
+		size_t endPixel = 0;
+		uint64_t bytesSent = 0;
+		uint64_t bytesReceived = 0;
+		uint64_t gatherBytes = 0;			//Of the sent or received bytes, the ones of the final gather
+		double seconds = 0.0;
+		bool succeeded = true;
+	};
+
+	//Factors the rank count into rounds of at most maxRadix ranks per group, larger prime
+	//factors become a round of their own. 8 ranks with maxRadix 2 is binary swap, 2 2 2.
+	std::vector<unsigned int> GetCompositeRounds(const unsigned int & size, const unsigned int & maxRadix);
+
+	//Part of the image in pixels that rank ends up with after the rounds
+	void GetCompositeRange(const unsigned int & rank, const std::vector<unsigned int> & rounds, const size_t & numPixels, size_t & first, size_t & end);
+
+	//Sort-last compositing of additive images with radix-k (binary swap when every round
+	//has two groups). In each round the ranks form groups of k, the current part of the
+	//image is split into k pieces and every member sums one piece from all k, so after the
+	//last round every rank holds the complete sum of 1 / size of the image. A rank sends
+	//less than one image in total however many ranks there are, all ranks send at the same
+	//time and only the optional gather to the root scales with the image.
+	CompositeReport CompositeImage(CompositeTransport & transport, SpriteImage & image, const CompositeSettings & settings = CompositeSettings());
+}
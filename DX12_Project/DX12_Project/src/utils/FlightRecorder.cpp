@@ -0,0 +1,280 @@
+#include <utils/FlightRecorder.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace dx
+{
+	//The ratio rule needs a settled median first
+	static const unsigned int MIN_RATIO_FRAMES = 30;
+	static const uint64_t CALIBRATION_NANOSECONDS = 2000000;
+
+	FlightRecorder::FlightRecorder(const FlightRecorderSettings & settings) : m_settings(settings), m_writeIndex(0), m_frame(0)
+	{
+		size_t capacity = 1;
+		while (capacity < settings.eventCapacity)
+			capacity *= 2;
+
+		m_events.assign(capacity, Event());
+		m_mask = capacity - 1;
+		m_frameTimes.reserve(settings.historyFrames);
+
+		//Short spin so the tick rate is usable before the first dump refines it
+		m_originTicks = Now();
+		m_originNanoseconds = GetSteadyNanoseconds();
+		while (GetSteadyNanoseconds() - m_originNanoseconds < CALIBRATION_NANOSECONDS)
+			std::this_thread::yield();
+
+		m_writer = std::thread(&FlightRecorder::WriterLoop, this);
+	}
+
+	FlightRecorder::~FlightRecorder()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+
+		m_condition.notify_all();
+		m_writer.join();
+	}
+
+	uint16_t FlightRecorder::AssignThreadIndex()
+	{
+		static std::atomic<uint16_t> nextIndex(0);
+		return nextIndex.fetch_add(1);
+	}
+
+	double FlightRecorder::GetTicksPerNanosecond() const
+	{
+#ifdef FLIGHT_RECORDER_TSC
+		return static_cast<double>(Now() - m_originTicks) / static_cast<double>(GetSteadyNanoseconds() - m_originNanoseconds);
+#else
+		return 1.0;
+#endif
+	}
+
+	uint64_t FlightRecorder::FromSteadyNanoseconds(const uint64_t & nanoseconds) const
+	{
+		double offset = static_cast<double>(nanoseconds) - static_cast<double>(m_originNanoseconds);
+		return m_originTicks + static_cast<uint64_t>(offset * GetTicksPerNanosecond());
+	}
+
+	void FlightRecorder::RecordCounter(const char* name, const double & value)
+	{
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		Push(EventType::Counter, name, Now(), bits);
+	}
+
+	void FlightRecorder::RecordQueueState(const char* name, const uint64_t & submitted, const uint64_t & completed)
+	{
+		//Stored as the completed value and the outstanding amount, both fit 32 bits in practice
+		uint64_t packed = (completed << 32) | ((submitted - completed) & 0xFFFFFFFFull);
+		Push(EventType::QueueState, name, Now(), packed);
+	}
+
+	void FlightRecorder::BeginFrame()
+	{
+		m_frameBegin = GetSteadyNanoseconds();
+	}
+
+	bool FlightRecorder::EndFrame()
+	{
+		return EndFrame((GetSteadyNanoseconds() - m_frameBegin) / 1e6);
+	}
+
+	bool FlightRecorder::EndFrame(const double & frameMs)
+	{
+		m_lastFrameMs = frameMs;
+		uint32_t frame = m_frame.load(std::memory_order_relaxed);
+		std::string reason;
+
+		if (m_settings.spikeThresholdMs > 0.0 && frameMs > m_settings.spikeThresholdMs)
+			reason = "frame time over threshold";
+
+		if (reason.empty() && m_settings.spikeRatio > 0.0 && m_frameTimes.size() >= MIN_RATIO_FRAMES)
+		{
+			m_sortScratch.assign(m_frameTimes.begin(), m_frameTimes.end());
+			std::nth_element(m_sortScratch.begin(), m_sortScratch.begin() + m_sortScratch.size() / 2, m_sortScratch.end());
+			if (frameMs > m_settings.spikeRatio * m_sortScratch[m_sortScratch.size() / 2])
+				reason = "frame time over median ratio";
+		}
+
+		//History ring, until it is full the next slot is the end
+		if (m_frameTimes.size() < m_settings.historyFrames)
+			m_frameTimes.push_back(frameMs);
+		else if (!m_frameTimes.empty())
+			m_frameTimes[m_nextFrameTime] = frameMs;
+		if (m_settings.historyFrames > 0)
+			m_nextFrameTime = (m_nextFrameTime + 1) % m_settings.historyFrames;
+
+		bool triggered = !reason.empty() && (m_numDumps == 0 || frame - m_lastDumpFrame >= m_settings.cooldownFrames);
+		if (triggered)
+			DumpNow(reason);
+
+		m_frame.store(frame + 1, std::memory_order_relaxed);
+		return triggered;
+	}
+
+	void FlightRecorder::DumpNow(const std::string & reason)
+	{
+		const uint32_t frame = m_frame.load(std::memory_order_relaxed);
+		const uint32_t firstFrame = frame > m_settings.historyFrames ? frame - m_settings.historyFrames : 0;
+
+		//Copy the ring oldest first, events still being written by other threads may be torn
+		Dump dump;
+		uint64_t end = m_writeIndex.load(std::memory_order_acquire);
+		uint64_t begin = end > m_events.size() ? end - m_events.size() : 0;
+		dump.events.reserve(static_cast<size_t>(end - begin));
+		for (uint64_t i = begin; i < end; ++i)
+		{
+			const Event & event = m_events[i & m_mask];
+			if (event.name && event.frame >= firstFrame && event.frame <= frame)
+				dump.events.push_back(event);
+		}
+
+		//Oldest first, also between two EndFrame calls
+		size_t numFrames = m_frameTimes.size();
+		for (size_t i = 0; i < numFrames; ++i)
+			dump.frameTimes.push_back(m_frameTimes[(m_nextFrameTime + i) % numFrames]);
+
+		dump.frame = frame;
+		dump.reason = reason;
+		dump.ticksPerNanosecond = GetTicksPerNanosecond();
+
+		m_lastDumpFrame = frame;
+		++m_numDumps;
+		m_lastDumpPath = m_settings.outputPrefix + "_" + std::to_string(frame) + ".json";
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.push_back(std::move(dump));
+		}
+
+		m_condition.notify_one();
+	}
+
+	void FlightRecorder::Flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idleCondition.wait(lock, [this] { return m_pending.empty() && !m_writing; });
+	}
+
+	void FlightRecorder::WriterLoop()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_condition.wait(lock, [this] { return m_stop || !m_pending.empty(); });
+			if (m_pending.empty() && m_stop)
+				return;
+
+			Dump dump = std::move(m_pending.front());
+			m_pending.erase(m_pending.begin());
+			m_writing = true;
+
+			lock.unlock();
+			Write(dump);
+			lock.lock();
+
+			m_writing = false;
+			m_idleCondition.notify_all();
+		}
+	}
+
+	//Quoted JSON string, with quotes, backslashes and control characters escaped
+	static void WriteString(FILE* file, const char* text)
+	{
+		std::fputc('"', file);
+		for (const char* c = text; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				std::fputc('\\', file);
+				std::fputc(*c, file);
+			}
+			else if (static_cast<unsigned char>(*c) < 0x20)
+				std::fprintf(file, "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(*c)));
+			else
+				std::fputc(*c, file);
+		}
+		std::fputc('"', file);
+	}
+
+	void FlightRecorder::Write(const Dump & dump)
+	{
+		const std::vector<Event> & events = dump.events;
+		const std::vector<double> & frameTimes = dump.frameTimes;
+		const double microsecondsPerTick = 1e-3 / dump.ticksPerNanosecond;
+
+		std::string path = m_settings.outputPrefix + "_" + std::to_string(dump.frame) + ".json";
+		FILE* file = std::fopen(path.c_str(), "w");
+		if (!file)
+			return;
+
+		uint64_t origin = UINT64_MAX;
+		for (const Event & event : events)
+			origin = (std::min)(origin, event.begin);
+
+		//Chrome trace format, CPU scopes in process 0, GPU scopes in process 1
+		std::fprintf(file, "{\"otherData\":{\"reason\":");
+		WriteString(file, dump.reason.c_str());
+		std::fprintf(file, ",\"frame\":%u,\"frameTimesMs\":[", dump.frame);
+		for (size_t i = 0; i < frameTimes.size(); ++i)
+			std::fprintf(file, "%s%.3f", i > 0 ? "," : "", frameTimes[i]);
+		std::fprintf(file, "]},\n\"traceEvents\":[\n");
+		std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n");
+		std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}");
+
+		for (const Event & event : events)
+		{
+			double timestamp = (event.begin - origin) * microsecondsPerTick;
+			std::fprintf(file, ",\n{\"name\":");
+			WriteString(file, event.name);
+
+			switch (event.type)
+			{
+			case EventType::CpuScope:
+			case EventType::GpuScope:
+				std::fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"frame\":%u}}", timestamp,
+							 (event.end > event.begin ? event.end - event.begin : 0) * microsecondsPerTick, event.type == EventType::GpuScope ? 1 : 0, event.thread, event.frame);
+				break;
+			case EventType::Counter:
+			{
+				double value;
+				std::memcpy(&value, &event.end, sizeof(value));
+				std::fprintf(file, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":0,\"args\":{\"value\":%.9g}}", timestamp, value);
+				break;
+			}
+			case EventType::QueueState:
+				std::fprintf(file, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":0,\"args\":{\"completed\":%llu,\"pending\":%llu}}", timestamp,
+							 static_cast<unsigned long long>(event.end >> 32), static_cast<unsigned long long>(event.end & 0xFFFFFFFFull));
+				break;
+			}
+		}
+
+		std::fprintf(file, "\n]}\n");
+		std::fclose(file);
+	}
+
+	uint32_t FlightRecorder::GetFrame() const
+	{
+		return m_frame.load(std::memory_order_relaxed);
+	}
+
+	double FlightRecorder::GetLastFrameMs() const
+	{
+		return m_lastFrameMs;
+	}
+
+	uint64_t FlightRecorder::GetNumDumps() const
+	{
+		return m_numDumps;
+	}
+
+	const std::string & FlightRecorder::GetLastDumpPath() const
+	{
+		return m_lastDumpPath;
+	}
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define FLIGHT_RECORDER_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FLIGHT_RECORDER_TSC 1
+#endif
+
+namespace dx
+{
+	struct FlightRecorderSettings
+	{
+		size_t eventCapacity = size_t(1) << 16;		//Rounded up to a power of two
+		unsigned int historyFrames = 240;			//Frames written to a dump
+		double spikeThresholdMs = 50.0;				//Absolute rule, 0 disables it
+		double spikeRatio = 3.0;					//Frame time over the median of the history, 0 disables it
+		unsigned int cooldownFrames = 600;			//Minimum distance between two dumps
+		std::string outputPrefix = "hitch";			//Dumps go to <prefix>_<frame>.json
+	};
+
+	//Always-on recorder for rare frame hitches. Scoped CPU and GPU timings, counters and
+	//queue states go into a fixed ring of plain records, one atomic increment and a few
+	//stores per event. EndFrame checks the frame time against the spike rules and, when
+	//one fires, copies the last frames out of the ring and writes them as a Chrome trace
+	//(chrome://tracing, Perfetto) on a background thread.
+	class FlightRecorder
+	{
+	public:
+		enum class EventType : uint16_t
+		{
+			CpuScope,
+			GpuScope,
+			Counter,
+			QueueState
+		};
+
+		struct Event
+		{
+			uint64_t begin;			//Now() ticks
+			uint64_t end;			//End of a scope, value bits for counters and queues
+			const char* name;		//Must outlive the recorder, string literals in practice
+			uint32_t frame;
+			EventType type;
+			uint16_t thread;
+		};
+
+		//Records the enclosing block as a CPU scope
+		class Scope
+		{
+		public:
+			Scope(FlightRecorder* recorder, const char* name) : m_recorder(recorder), m_name(name), m_begin(Now())
+			{
+			}
+
+			~Scope()
+			{
+				if (m_recorder)
+					m_recorder->RecordScope(m_name, m_begin, Now());
+			}
+
+		private:
+			FlightRecorder* m_recorder;
+			const char* m_name;
+			uint64_t m_begin;
+		};
+
+	public:
+		FlightRecorder(const FlightRecorderSettings & settings = FlightRecorderSettings());
+		~FlightRecorder();
+
+	public:
+		//Raw time stamp counter where available, a clock read through the OS costs several times more
+		static uint64_t Now()
+		{
+#ifdef FLIGHT_RECORDER_TSC
+			return __rdtsc();
+#else
+			return GetSteadyNanoseconds();
+#endif
+		}
+
+		static uint64_t GetSteadyNanoseconds()
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		//Maps a steady_clock time (QueryPerformanceCounter on Windows) to Now() ticks
+		uint64_t FromSteadyNanoseconds(const uint64_t & nanoseconds) const;
+
+		void RecordScope(const char* name, const uint64_t & begin, const uint64_t & end)
+		{
+			Push(EventType::CpuScope, name, begin, end);
+		}
+
+		//GPU timestamps already calibrated to the steady clock
+		void RecordGpuScope(const char* name, const uint64_t & beginNanoseconds, const uint64_t & endNanoseconds)
+		{
+			Push(EventType::GpuScope, name, FromSteadyNanoseconds(beginNanoseconds), FromSteadyNanoseconds(endNanoseconds));
+		}
+
+		void RecordCounter(const char* name, const double & value);
+
+		//Work submitted to a queue against work it has completed, e.g. fence values
+		void RecordQueueState(const char* name, const uint64_t & submitted, const uint64_t & completed);
+
+		//Frames are timed from BeginFrame to EndFrame() on the steady clock, unclamped, so a
+		//hitch is blamed on the frame whose scopes caused it
+		void BeginFrame();
+		bool EndFrame();
+
+		//Closes the current frame with a time measured elsewhere, returns true when it triggered a dump
+		bool EndFrame(const double & frameMs);
+		void DumpNow(const std::string & reason);
+		void Flush();
+
+	public:
+		uint32_t GetFrame() const;
+		double GetLastFrameMs() const;
+		uint64_t GetNumDumps() const;
+		const std::string & GetLastDumpPath() const;
+
+	private:
+		void Push(const EventType & type, const char* name, const uint64_t & begin, const uint64_t & end)
+		{
+			uint64_t index = m_writeIndex.fetch_add(1, std::memory_order_relaxed);
+			Event & event = m_events[index & m_mask];
+			event.begin = begin;
+			event.end = end;
+			event.name = name;
+			event.frame = m_frame.load(std::memory_order_relaxed);
+			event.type = type;
+			event.thread = GetThreadIndex();
+		}
+
+		//Constant initialized, so the fast path is a plain thread local load
+		static uint16_t GetThreadIndex()
+		{
+			static thread_local uint16_t index = UINT16_MAX;
+			if (index == UINT16_MAX)
+				index = AssignThreadIndex();
+			return index;
+		}
+
+		static uint16_t AssignThreadIndex();
+		double GetTicksPerNanosecond() const;
+		void WriterLoop();
+
+	private:
+		FlightRecorderSettings m_settings;
+		std::vector<Event> m_events;
+		size_t m_mask;
+		std::atomic<uint64_t> m_writeIndex;
+		std::atomic<uint32_t> m_frame;
+
+		//Reference point between Now() ticks and steady nanoseconds
+		uint64_t m_originTicks;
+		uint64_t m_originNanoseconds;
+
+		//Frame times of the history window, a ring as well, the next one replaces the oldest
+		std::vector<double> m_frameTimes;
+		size_t m_nextFrameTime = 0;
+		uint64_t m_frameBegin = 0;
+		double m_lastFrameMs = 0.0;
+		std::vector<double> m_sortScratch;
+		uint32_t m_lastDumpFrame = 0;
+		uint64_t m_numDumps = 0;
+		std::string m_lastDumpPath;
+
+		//Pending dump for the writer thread
+		struct Dump
+		{
+			std::vector<Event> events;
+			std::vector<double> frameTimes;
+			uint32_t frame;
+			std::string reason;
+			double ticksPerNanosecond;
+		};
+
+		void Write(const Dump & dump);
+
+		std::vector<Dump> m_pending;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::condition_variable m_idleCondition;
+		bool m_writing = false;
+		bool m_stop = false;
+		std::thread m_writer;
+	};
+}
+
+#define FLIGHT_SCOPE_CONCAT_(a, b) a##b
+#define FLIGHT_SCOPE_CONCAT(a, b) FLIGHT_SCOPE_CONCAT_(a, b)
+#define FLIGHT_SCOPE(recorder, name) dx::FlightRecorder::Scope FLIGHT_SCOPE_CONCAT(flightScope, __LINE__)(recorder, name)
@@ -0,0 +1,374 @@
+#include <utils/FrameEncoder.hpp>
+#include <utils/ResourceLimits.hpp>
+#include <utils/ThreadPriority.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace dx
+{
+	namespace
+	{
+		const uint32_t* GetCrcTable()
+		{
+			static const std::vector<uint32_t> table = []
+			{
+				std::vector<uint32_t> t(256);
+				for (uint32_t n = 0; n < 256; ++n)
+				{
+					uint32_t c = n;
+					for (int k = 0; k < 8; ++k)
+						c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					t[n] = c;
+				}
+				return t;
+			}();
+			return table.data();
+		}
+
+		uint32_t UpdateCrc(uint32_t crc, const unsigned char* data, const size_t & size)
+		{
+			const uint32_t* table = GetCrcTable();
+			for (size_t i = 0; i < size; ++i)
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			return crc;
+		}
+
+		void PutBigEndian(std::vector<unsigned char> & out, const uint32_t & value)
+		{
+			out.push_back(static_cast<unsigned char>(value >> 24));
+			out.push_back(static_cast<unsigned char>(value >> 16));
+			out.push_back(static_cast<unsigned char>(value >> 8));
+			out.push_back(static_cast<unsigned char>(value));
+		}
+
+		//Length placeholder and type, returns where the chunk starts
+		size_t BeginChunk(std::vector<unsigned char> & out, const char* type)
+		{
+			size_t start = out.size();
+			PutBigEndian(out, 0);
+			out.insert(out.end(), type, type + 4);
+			return start;
+		}
+
+		//Fills in the length and appends the CRC over type and data
+		void EndChunk(std::vector<unsigned char> & out, const size_t & start)
+		{
+			uint32_t length = static_cast<uint32_t>(out.size() - start - 8);
+			for (int i = 0; i < 4; ++i)
+				out[start + i] = static_cast<unsigned char>(length >> (24 - 8 * i));
+
+			uint32_t crc = UpdateCrc(0xFFFFFFFFu, out.data() + start + 4, length + 4) ^ 0xFFFFFFFFu;
+			PutBigEndian(out, crc);
+		}
+
+		//zlib stream of stored deflate blocks, fed in arbitrary pieces
+		class StoredDeflate
+		{
+		public:
+			StoredDeflate(std::vector<unsigned char> & out, const size_t & total) : m_out(out), m_remaining(total)
+			{
+				//Deflate with a 32K window, no dictionary, 0x7801 is a multiple of 31
+				m_out.push_back(0x78);
+				m_out.push_back(0x01);
+			}
+
+			void Append(const unsigned char* data, size_t size)
+			{
+				UpdateAdler(data, size);
+				while (size > 0)
+				{
+					if (m_blockLeft == 0)
+						BeginBlock();
+
+					size_t count = (std::min)(size, m_blockLeft);
+					m_out.insert(m_out.end(), data, data + count);
+					data += count;
+					size -= count;
+					m_blockLeft -= count;
+				}
+			}
+
+			void Finish()
+			{
+				//An empty image still needs its final block
+				if (m_remaining == 0 && !m_begun)
+					BeginBlock();
+				PutBigEndian(m_out, (m_b << 16) | m_a);
+			}
+
+		private:
+			void BeginBlock()
+			{
+				uint16_t length = static_cast<uint16_t>((std::min)(m_remaining, size_t(0xFFFF)));
+				m_remaining -= length;
+				m_blockLeft = length;
+				m_begun = true;
+
+				m_out.push_back(m_remaining == 0 ? 1 : 0);
+				m_out.push_back(static_cast<unsigned char>(length));
+				m_out.push_back(static_cast<unsigned char>(length >> 8));
+				m_out.push_back(static_cast<unsigned char>(~length));
+				m_out.push_back(static_cast<unsigned char>(~length >> 8));
+			}
+
+			void UpdateAdler(const unsigned char* data, size_t size)
+			{
+				//5552 bytes is the most that cannot overflow the sums before the modulo
+				while (size > 0)
+				{
+					size_t count = (std::min)(size, size_t(5552));
+					for (size_t i = 0; i < count; ++i)
+					{
+						m_a += data[i];
+						m_b += m_a;
+					}
+
+					m_a %= 65521;
+					m_b %= 65521;
+					data += count;
+					size -= count;
+				}
+			}
+
+		private:
+			std::vector<unsigned char> & m_out;
+			size_t m_remaining;
+			size_t m_blockLeft = 0;
+			bool m_begun = false;
+			uint32_t m_a = 1;
+			uint32_t m_b = 0;
+		};
+
+		void ConvertRow(const CaptureImage & image, const unsigned int & y, unsigned char* out)
+		{
+			const unsigned char* in = image.pixels + y * image.rowPitch;
+			for (unsigned int x = 0; x < image.width; ++x)
+			{
+				out[3 * x + 0] = in[4 * x + 0];
+				out[3 * x + 1] = in[4 * x + 1];
+				out[3 * x + 2] = in[4 * x + 2];
+			}
+		}
+	}
+
+	void EncodePng(const CaptureImage & image, std::vector<unsigned char> & png)
+	{
+		static const unsigned char Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+		//Every row starts with its filter type, 0 for none
+		const size_t rowBytes = 1 + size_t(image.width) * 3;
+		const size_t dataBytes = rowBytes * image.height;
+
+		png.clear();
+		png.reserve(dataBytes + (dataBytes / 0xFFFF + 1) * 5 + 64);
+		png.insert(png.end(), Signature, Signature + 8);
+
+		//Width, height, bit depth 8, color type 2 (RGB), deflate, adaptive filters, no interlace
+		size_t chunk = BeginChunk(png, "IHDR");
+		PutBigEndian(png, image.width);
+		PutBigEndian(png, image.height);
+		const unsigned char format[5] = { 8, 2, 0, 0, 0 };
+		png.insert(png.end(), format, format + 5);
+		EndChunk(png, chunk);
+
+		chunk = BeginChunk(png, "IDAT");
+		StoredDeflate deflate(png, dataBytes);
+		std::vector<unsigned char> row(rowBytes, 0);
+		for (unsigned int y = 0; y < image.height; ++y)
+		{
+			ConvertRow(image, y, row.data() + 1);
+			deflate.Append(row.data(), row.size());
+		}
+		deflate.Finish();
+		EndChunk(png, chunk);
+
+		EndChunk(png, BeginChunk(png, "IEND"));
+	}
+
+	void EncodeRawFrame(const CaptureImage & image, std::vector<unsigned char> & frame)
+	{
+		const size_t rowBytes = size_t(image.width) * 3;
+		frame.resize(rowBytes * image.height);
+		for (unsigned int y = 0; y < image.height; ++y)
+			ConvertRow(image, y, frame.data() + y * rowBytes);
+	}
+
+	FrameEncoderPool::FrameEncoderPool(const EncoderSettings & settings)
+		: m_settings(settings), m_video(settings.io), m_numEncoded(0), m_numRejected(0), m_numFailed(0), m_bytesEncoded(0)
+	{
+		unsigned int numThreads = m_settings.numThreads > 0 ? m_settings.numThreads : (std::max)(1u, GetResourceLimits().hostCpus / 2);
+		m_maxQueued = m_settings.maxQueued > 0 ? m_settings.maxQueued : (std::min)(numThreads, (std::max)(1u, GetWorkerCount() / 2));
+
+		if (m_settings.format == CaptureFormat::RawVideo && !m_settings.path.empty())
+			m_video.Open(m_settings.path, m_lastError);
+
+		for (unsigned int i = 0; i < numThreads; ++i)
+			m_threads.emplace_back(&FrameEncoderPool::EncodeLoop, this, i);
+	}
+
+	FrameEncoderPool::~FrameEncoderPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+
+		//The threads drain the queue before they return
+		m_workCondition.notify_all();
+		for (std::thread & thread : m_threads)
+			thread.join();
+
+		if (m_video.IsOpen())
+			m_video.Close(m_lastError);
+	}
+
+	bool FrameEncoderPool::Submit(const uint64_t & frame, const CaptureImage & image, ReleaseFunc release)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_jobs.size() >= m_maxQueued)
+			{
+				++m_numRejected;
+				return false;
+			}
+
+			m_jobs.push_back({ frame, m_nextSequence++, image, std::move(release) });
+		}
+
+		//Threads over the active count ignore the wakeup, so all of them get it
+		m_workCondition.notify_all();
+		return true;
+	}
+
+	void FrameEncoderPool::Flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idleCondition.wait(lock, [this] { return m_jobs.empty() && m_busy == 0; });
+	}
+
+	unsigned int FrameEncoderPool::GetNumThreads() const
+	{
+		return GetActiveThreads();
+	}
+
+	unsigned int FrameEncoderPool::GetActiveThreads() const
+	{
+		unsigned int numThreads = static_cast<unsigned int>(m_threads.size());
+		if (m_settings.numThreads > 0)
+			return numThreads;
+		return (std::min)((std::max)(1u, GetWorkerCount() / 2), numThreads);
+	}
+
+	uint64_t FrameEncoderPool::GetNumEncoded() const
+	{
+		return m_numEncoded.load();
+	}
+
+	uint64_t FrameEncoderPool::GetNumRejected() const
+	{
+		return m_numRejected.load();
+	}
+
+	uint64_t FrameEncoderPool::GetNumFailed() const
+	{
+		return m_numFailed.load();
+	}
+
+	uint64_t FrameEncoderPool::GetBytesEncoded() const
+	{
+		return m_bytesEncoded.load();
+	}
+
+	std::string FrameEncoderPool::GetLastError() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_lastError;
+	}
+
+	void FrameEncoderPool::EncodeLoop(const unsigned int & index)
+	{
+		//Encoding competes with the render thread for cores, it only gets idle ones
+		LowerCurrentThreadPriority();
+
+		std::vector<unsigned char> data;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			//Parked while the worker count leaves this thread out, the active ones drain the queue
+			m_workCondition.wait(lock, [this, index] { return m_stop || (!m_jobs.empty() && index < GetActiveThreads()); });
+			if (m_jobs.empty() || index >= GetActiveThreads())
+				return;
+
+			Job job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			++m_busy;
+			lock.unlock();
+
+			if (m_settings.format == CaptureFormat::Png)
+				EncodePng(job.image, data);
+			else
+				EncodeRawFrame(job.image, data);
+
+			//The slot can take the next copy while the file is written
+			job.release();
+			job.release = nullptr;
+
+			std::string error;
+			if (Write(job, data, error))
+			{
+				++m_numEncoded;
+				m_bytesEncoded += data.size();
+			}
+			else
+				++m_numFailed;
+
+			lock.lock();
+			if (!error.empty())
+				m_lastError = error;
+			--m_busy;
+			m_idleCondition.notify_all();
+		}
+	}
+
+	bool FrameEncoderPool::Write(const Job & job, const std::vector<unsigned char> & data, std::string & error)
+	{
+		if (m_settings.format == CaptureFormat::Png)
+		{
+			if (m_settings.path.empty())
+				return true;
+
+			char suffix[32];
+			std::snprintf(suffix, sizeof(suffix), "_%06llu.png", static_cast<unsigned long long>(job.frame));
+			std::string path = m_settings.path + suffix;
+
+			FILE* file = std::fopen(path.c_str(), "wb");
+			bool written = file && std::fwrite(data.data(), 1, data.size(), file) == data.size();
+			if (file && std::fclose(file) != 0)
+				written = false;
+			if (!written)
+				error = "could not write " + path;
+			return written;
+		}
+
+		//Frames are taken in submission order, so the one whose turn it is has been taken
+		//already and waiting for it cannot deadlock. Only the thread whose turn it is
+		//touches the stream, it is written outside the lock.
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_appendCondition.wait(lock, [&] { return m_nextAppend == job.sequence; });
+		}
+
+		bool written = m_settings.path.empty() || (m_video.IsOpen() && m_video.Write(data.data(), data.size()));
+		if (!written)
+			error = "could not append to " + m_settings.path;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_nextAppend;
+		}
+
+		m_appendCondition.notify_all();
+		return written;
+	}
+}
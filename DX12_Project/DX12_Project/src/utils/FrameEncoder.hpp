@@ -0,0 +1,111 @@
+#pragma once
+#include <utils/AsyncFileWriter.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dx
+{
+	enum class CaptureFormat
+	{
+		Png,		//One <path>_<frame>.png per frame
+		RawVideo	//Packed rgb24 frames appended to <path> in capture order, e.g. for
+					//ffmpeg -f rawvideo -pixel_format rgb24 -video_size 800x600 -i <path>
+	};
+
+	struct EncoderSettings
+	{
+		CaptureFormat format = CaptureFormat::Png;
+		std::string path = "capture";		//Empty to encode without writing anything
+		unsigned int numThreads = 0;		//0 for half the workers, at least one, following RefreshResourceLimits
+		size_t maxQueued = 0;				//Frames waiting for a thread before Submit drops, 0 for numThreads
+		AsyncIOSettings io;					//Raw video stream
+	};
+
+	//8-bit RGBA pixels, rows rowPitch bytes apart, e.g. a mapped readback footprint
+	struct CaptureImage
+	{
+		const unsigned char* pixels;
+		unsigned int width;
+		unsigned int height;
+		size_t rowPitch;
+	};
+
+	//8-bit RGB PNG, alpha dropped. The image data goes into stored deflate blocks, which
+	//any decoder reads and costs no more than a copy; compress offline if size matters.
+	void EncodePng(const CaptureImage & image, std::vector<unsigned char> & png);
+
+	//Packed RGB rows of one raw video frame
+	void EncodeRawFrame(const CaptureImage & image, std::vector<unsigned char> & frame);
+
+	//Encodes captured frames on a pool of background threads. Submit only queues, a frame
+	//is rejected rather than queued when maxQueued frames already wait for a thread, so a
+	//slow disk costs frames, never frame time. Each job calls its release as soon as the
+	//pixels were read, before the file is written, so the capture slot returns to the ring
+	//early. Raw video frames are encoded concurrently but appended in submission order.
+	//Without a fixed numThreads threads for half the host's cores are started and only half
+	//the current worker count of them take jobs, so the pool follows a changed CPU quota. The
+	//raw video stream keeps the writers it was opened with.
+	class FrameEncoderPool
+	{
+	public:
+		typedef std::function<void()> ReleaseFunc;
+
+		FrameEncoderPool(const EncoderSettings & settings = EncoderSettings());
+		~FrameEncoderPool();
+
+	public:
+		//False, without calling release, when the frame was rejected
+		bool Submit(const uint64_t & frame, const CaptureImage & image, ReleaseFunc release);
+
+		//Waits until every submitted frame is written
+		void Flush();
+
+		unsigned int GetNumThreads() const;
+		uint64_t GetNumEncoded() const;
+		uint64_t GetNumRejected() const;
+		uint64_t GetNumFailed() const;
+		uint64_t GetBytesEncoded() const;
+		std::string GetLastError() const;
+
+	private:
+		struct Job
+		{
+			uint64_t frame;
+			uint64_t sequence;
+			CaptureImage image;
+			ReleaseFunc release;
+		};
+
+		void EncodeLoop(const unsigned int & index);
+		unsigned int GetActiveThreads() const;
+		bool Write(const Job & job, const std::vector<unsigned char> & data, std::string & error);
+
+	private:
+		EncoderSettings m_settings;
+		size_t m_maxQueued;
+		std::deque<Job> m_jobs;
+		unsigned int m_busy = 0;
+		bool m_stop = false;
+		uint64_t m_nextSequence = 0;
+		uint64_t m_nextAppend = 0;			//Sequence whose raw frame goes into the stream next
+
+		AsyncFileWriter m_video;
+		std::string m_lastError;
+		std::atomic<uint64_t> m_numEncoded;
+		std::atomic<uint64_t> m_numRejected;
+		std::atomic<uint64_t> m_numFailed;
+		std::atomic<uint64_t> m_bytesEncoded;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_workCondition;
+		std::condition_variable m_idleCondition;
+		std::condition_variable m_appendCondition;
+		std::vector<std::thread> m_threads;
+	};
+}
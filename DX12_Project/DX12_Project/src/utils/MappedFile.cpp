@@ -0,0 +1,118 @@
+#include <utils/MappedFile.hpp>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dx
+{
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const std::string & path, std::string & error)
+	{
+		Close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			error = "could not open " + path + " (error " + std::to_string(GetLastError()) + ")";
+			return false;
+		}
+		m_file = reinterpret_cast<intptr_t>(file);
+
+		LARGE_INTEGER size;
+		GetFileSizeEx(file, &size);
+		m_size = static_cast<uint64_t>(size.QuadPart);
+
+		//Empty files cannot be mapped, they just have no data
+		if (m_size > 0)
+		{
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (!view)
+			{
+				if (mapping)
+					CloseHandle(mapping);
+				error = "could not map " + path + " (error " + std::to_string(GetLastError()) + ")";
+				Close();
+				return false;
+			}
+
+			m_mapping = reinterpret_cast<intptr_t>(mapping);
+			m_data = static_cast<const unsigned char*>(view);
+		}
+#else
+		int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file < 0)
+		{
+			error = "could not open " + path + ": " + std::strerror(errno);
+			return false;
+		}
+		m_file = file;
+
+		struct stat status;
+		fstat(file, &status);
+		m_size = static_cast<uint64_t>(status.st_size);
+
+		if (m_size > 0)
+		{
+			void* view = mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, MAP_SHARED, file, 0);
+			if (view == MAP_FAILED)
+			{
+				error = "could not map " + path + ": " + std::strerror(errno);
+				Close();
+				return false;
+			}
+
+			m_data = static_cast<const unsigned char*>(view);
+		}
+#endif
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (m_data)
+			UnmapViewOfFile(m_data);
+		if (m_mapping)
+			CloseHandle(reinterpret_cast<HANDLE>(m_mapping));
+		if (m_file != -1)
+			CloseHandle(reinterpret_cast<HANDLE>(m_file));
+#else
+		if (m_data)
+			munmap(const_cast<unsigned char*>(m_data), static_cast<size_t>(m_size));
+		if (m_file != -1)
+			close(static_cast<int>(m_file));
+#endif
+		m_data = nullptr;
+		m_size = 0;
+		m_file = -1;
+		m_mapping = 0;
+	}
+
+	const unsigned char* MappedFile::GetData() const
+	{
+		return m_data;
+	}
+
+	uint64_t MappedFile::GetSize() const
+	{
+		return m_size;
+	}
+
+	bool MappedFile::IsOpen() const
+	{
+		return m_file != -1;
+	}
+}
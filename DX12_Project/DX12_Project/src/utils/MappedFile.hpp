@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace dx
+{
+	//Read-only memory mapping of a whole file. Only the pages that are touched get read,
+	//so a large file can be mapped to pick a few ranges out of it.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator=(const MappedFile &) = delete;
+
+	public:
+		bool Open(const std::string & path, std::string & error);
+		void Close();
+
+		const unsigned char* GetData() const;
+		uint64_t GetSize() const;
+		bool IsOpen() const;
+
+	private:
+		const unsigned char* m_data = nullptr;
+		uint64_t m_size = 0;
+		intptr_t m_file = -1;
+		intptr_t m_mapping = 0;		//Windows file mapping object
+	};
+}
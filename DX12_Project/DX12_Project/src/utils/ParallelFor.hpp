@@ -0,0 +1,76 @@
+#pragma once
+#include <utils/ResourceLimits.hpp>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace dx
+{
+	//Caps the workers of the ParallelFor calls made on this thread, 0 for no cap. An outer level
+	//of parallelism (e.g. Parareal time slices) sets it so the engines it runs do not each
+	//start a full set of threads.
+	inline unsigned int & GetThreadWorkerLimit()
+	{
+		thread_local unsigned int limit = 0;
+		return limit;
+	}
+
+	class ScopedWorkerLimit
+	{
+	public:
+		ScopedWorkerLimit(const unsigned int & limit) : m_previous(GetThreadWorkerLimit())
+		{
+			GetThreadWorkerLimit() = limit;
+		}
+
+		~ScopedWorkerLimit()
+		{
+			GetThreadWorkerLimit() = m_previous;
+		}
+
+	private:
+		unsigned int m_previous;
+	};
+
+	//Splits [begin, end) into one contiguous range per worker and calls func(rangeBegin, rangeEnd).
+	//The calling thread handles the first range itself.
+	template<typename Func>
+	inline void ParallelForRange(const size_t & begin, const size_t & end, Func func, unsigned int numThreads = 0)
+	{
+		if (end <= begin)
+			return;
+
+		size_t count = end - begin;
+		unsigned int limit = GetThreadWorkerLimit();
+		size_t workers = numThreads > 0 ? numThreads : GetWorkerCount();
+		if (limit > 0)
+			workers = (std::min)(workers, static_cast<size_t>(limit));
+		workers = (std::min)(workers, count);
+		size_t chunk = (count + workers - 1) / workers;
+
+		std::vector<std::thread> threads;
+		threads.reserve(workers);
+		for (size_t i = 1; i < workers; ++i)
+		{
+			size_t rangeBegin = begin + i * chunk;
+			size_t rangeEnd = (std::min)(end, rangeBegin + chunk);
+			if (rangeBegin < rangeEnd)
+				threads.emplace_back(func, rangeBegin, rangeEnd);
+		}
+
+		func(begin, (std::min)(end, begin + chunk));
+
+		for (auto & thread : threads)
+			thread.join();
+	}
+
+	template<typename Func>
+	inline void ParallelFor(const size_t & begin, const size_t & end, Func func, unsigned int numThreads = 0)
+	{
+		ParallelForRange(begin, end, [&func](size_t rangeBegin, size_t rangeEnd)
+		{
+			for (size_t i = rangeBegin; i < rangeEnd; ++i)
+				func(i);
+		}, numThreads);
+	}
+}
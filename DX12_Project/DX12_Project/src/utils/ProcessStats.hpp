@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <dirent.h>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#endif
+
+namespace dx
+{
+	struct ProcessStats
+	{
+		uint64_t residentBytes;
+		uint64_t handles;		//Kernel handles on Windows, open file descriptors elsewhere
+	};
+
+	inline ProcessStats GetProcessStats()
+	{
+		ProcessStats stats = { 0, 0 };
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters = { 0 };
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			stats.residentBytes = counters.WorkingSetSize;
+
+		DWORD handles = 0;
+		if (GetProcessHandleCount(GetCurrentProcess(), &handles))
+			stats.handles = handles;
+#else
+		//Second field of statm is the resident set in pages
+		if (FILE* file = std::fopen("/proc/self/statm", "r"))
+		{
+			unsigned long long size = 0, resident = 0;
+			if (std::fscanf(file, "%llu %llu", &size, &resident) == 2)
+				stats.residentBytes = resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+			std::fclose(file);
+		}
+
+		if (DIR* directory = opendir("/proc/self/fd"))
+		{
+			while (dirent* entry = readdir(directory))
+			{
+				if (entry->d_name[0] != '.')
+					++stats.handles;
+			}
+			closedir(directory);
+
+			//Not counting the descriptor opendir itself holds
+			if (stats.handles > 0)
+				--stats.handles;
+		}
+#endif
+		return stats;
+	}
+
+	//CPU time the calling thread has used, user and kernel
+	inline double GetThreadCpuSeconds()
+	{
+#ifdef _WIN32
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+			return 0.0;
+
+		//100 ns units
+		auto toSeconds = [](const FILETIME & time) { return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 1e-7; };
+		return toSeconds(kernel) + toSeconds(user);
+#else
+		timespec time;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+			return 0.0;
+
+		return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+	}
+}
@@ -0,0 +1,348 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fstream>
+#include <sched.h>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+#endif
+
+namespace dx
+{
+	//What the process may actually use, as opposed to what the host has. Inside a container
+	//hardware_concurrency reports the host's cores, so pools sized from it get throttled by
+	//the CPU quota.
+	struct ResourceLimits
+	{
+		unsigned int hostCpus = 1;
+		unsigned int cpusetCpus = 1;		//cpuset / affinity mask
+		double cpuQuota = 0.0;				//Cores per period, 0 without a quota
+		uint64_t physicalMemory = 0;
+		uint64_t memoryLimit = 0;			//Bytes, 0 without a limit below physical memory
+		const char* source = "none";		//What imposed the tightest limit: cgroup v1/v2 or a job object
+		unsigned int workers = 1;			//Derived from the above
+	};
+
+#ifndef _WIN32
+	//Number of CPUs in a cpuset list such as "0-3,8,10-11"
+	inline unsigned int CountCpuList(const std::string & list)
+	{
+		unsigned int count = 0;
+		std::stringstream stream(list);
+		std::string range;
+		while (std::getline(stream, range, ','))
+		{
+			unsigned int first, last;
+			int fields = std::sscanf(range.c_str(), "%u-%u", &first, &last);
+			if (fields == 2 && last >= first)
+				count += last - first + 1;
+			else if (fields == 1)
+				++count;
+		}
+		return count;
+	}
+
+	inline bool ReadFirstLine(const std::string & path, std::string & line)
+	{
+		std::ifstream file(path);
+		return file && std::getline(file, line) && !line.empty();
+	}
+
+	//Directory of the controller's cgroup and the mount it lives under, v1 hierarchies are
+	//preferred so hybrid setups read the controllers where they are actually attached
+	inline int FindCgroupDirectory(const std::string & controller, std::string & directory, std::string & mountPoint)
+	{
+		//hierarchy-ID:controller-list:cgroup-path
+		std::string v1Path, v2Path;
+		bool hasV2 = false;
+		std::ifstream cgroups("/proc/self/cgroup");
+		for (std::string line; std::getline(cgroups, line);)
+		{
+			size_t first = line.find(':'), second = line.find(':', first + 1);
+			if (first == std::string::npos || second == std::string::npos)
+				continue;
+
+			std::string controllers = "," + line.substr(first + 1, second - first - 1) + ",";
+			if (controllers == ",,")
+			{
+				hasV2 = true;
+				v2Path = line.substr(second + 1);
+			}
+			else if (controllers.find("," + controller + ",") != std::string::npos)
+				v1Path = line.substr(second + 1);
+		}
+
+		//id parent major:minor root mount-point options ... - fstype source super-options
+		std::ifstream mounts("/proc/self/mountinfo");
+		for (std::string line; std::getline(mounts, line);)
+		{
+			size_t separator = line.find(" - ");
+			if (separator == std::string::npos)
+				continue;
+
+			std::string id, parent, device, root, mount, type, source, options;
+			std::istringstream(line.substr(0, separator)) >> id >> parent >> device >> root >> mount;
+			std::istringstream(line.substr(separator + 3)) >> type >> source >> options;
+
+			const std::string * path = nullptr;
+			int version = 0;
+			if (type == "cgroup" && !v1Path.empty() && ("," + options + ",").find("," + controller + ",") != std::string::npos)
+			{
+				path = &v1Path;
+				version = 1;
+			}
+			else if (type == "cgroup2" && hasV2 && v1Path.empty())
+			{
+				path = &v2Path;
+				version = 2;
+			}
+			if (!path)
+				continue;
+
+			//Inside a cgroup namespace the mount root is the container's own cgroup
+			mountPoint = mount;
+			directory = mount;
+			if (root != "/" && path->compare(0, root.size(), root) == 0)
+				directory += path->substr(root.size());
+			else if (root == "/" && *path != "/")
+				directory += *path;
+			return version;
+		}
+
+		return 0;
+	}
+
+	//Calls read(file) in the cgroup directory and every ancestor up to the mount, a parent's
+	//limit applies to its children too
+	template<typename Func>
+	inline void ForEachCgroupLevel(std::string directory, const std::string & mountPoint, Func read)
+	{
+		for (;;)
+		{
+			read(directory);
+			if (directory.size() <= mountPoint.size())
+				break;
+
+			size_t slash = directory.find_last_of('/');
+			if (slash == std::string::npos || slash < mountPoint.size())
+				break;
+			directory.resize((std::max)(slash, mountPoint.size()));
+		}
+	}
+#endif
+
+	inline ResourceLimits DetectResourceLimits()
+	{
+		ResourceLimits limits;
+		limits.hostCpus = (std::max)(std::thread::hardware_concurrency(), 1u);
+		limits.cpusetCpus = limits.hostCpus;
+
+#ifdef _WIN32
+		DWORD_PTR processMask = 0, systemMask = 0;
+		if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) && processMask)
+		{
+			unsigned int count = 0;
+			for (; processMask; processMask &= processMask - 1)
+				++count;
+			limits.cpusetCpus = count;
+		}
+
+		MEMORYSTATUSEX status = { sizeof(status) };
+		if (GlobalMemoryStatusEx(&status))
+			limits.physicalMemory = status.ullTotalPhys;
+
+		//Containers and sandboxes on Windows cap the process through its job object
+		JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate = {};
+		if (QueryInformationJobObject(nullptr, JobObjectCpuRateControlInformation, &rate, sizeof(rate), nullptr) &&
+			(rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_ENABLE) && (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP))
+		{
+			//Hundredths of a percent of the whole machine
+			limits.cpuQuota = rate.CpuRate / 10000.0 * limits.hostCpus;
+			limits.source = "job object";
+		}
+
+		JOBOBJECT_EXTENDED_LIMIT_INFORMATION extended = {};
+		if (QueryInformationJobObject(nullptr, JobObjectExtendedLimitInformation, &extended, sizeof(extended), nullptr))
+		{
+			const DWORD flags = extended.BasicLimitInformation.LimitFlags;
+			if (flags & JOB_OBJECT_LIMIT_JOB_MEMORY)
+				limits.memoryLimit = extended.JobMemoryLimit;
+			if ((flags & JOB_OBJECT_LIMIT_PROCESS_MEMORY) && (!limits.memoryLimit || extended.ProcessMemoryLimit < limits.memoryLimit))
+				limits.memoryLimit = extended.ProcessMemoryLimit;
+			if (limits.memoryLimit)
+				limits.source = "job object";
+		}
+#else
+		cpu_set_t affinity;
+		CPU_ZERO(&affinity);
+		if (sched_getaffinity(0, sizeof(affinity), &affinity) == 0 && CPU_COUNT(&affinity) > 0)
+			limits.cpusetCpus = static_cast<unsigned int>(CPU_COUNT(&affinity));
+
+		long pages = sysconf(_SC_PHYS_PAGES), pageSize = sysconf(_SC_PAGESIZE);
+		if (pages > 0 && pageSize > 0)
+			limits.physicalMemory = static_cast<uint64_t>(pages) * static_cast<uint64_t>(pageSize);
+
+		std::string directory, mountPoint, line;
+		if (int version = FindCgroupDirectory("cpu", directory, mountPoint))
+		{
+			//v2 cpu.max is "max 100000" or "<quota> <period>", v1 splits them and uses -1
+			ForEachCgroupLevel(directory, mountPoint, [&](const std::string & level)
+			{
+				double quota = 0.0, period = 0.0;
+				if (version == 2 && ReadFirstLine(level + "/cpu.max", line))
+				{
+					if (line.compare(0, 3, "max") != 0)
+						std::sscanf(line.c_str(), "%lf %lf", &quota, &period);
+				}
+				else if (version == 1 && ReadFirstLine(level + "/cpu.cfs_quota_us", line))
+				{
+					quota = std::atof(line.c_str());
+					if (ReadFirstLine(level + "/cpu.cfs_period_us", line))
+						period = std::atof(line.c_str());
+				}
+
+				if (quota > 0.0 && period > 0.0 && (limits.cpuQuota == 0.0 || quota / period < limits.cpuQuota))
+					limits.cpuQuota = quota / period;
+			});
+			if (limits.cpuQuota > 0.0)
+				limits.source = version == 2 ? "cgroup v2" : "cgroup v1";
+		}
+
+		if (int version = FindCgroupDirectory("cpuset", directory, mountPoint))
+		{
+			//The affinity mask normally reflects the cpuset already, this catches the rest
+			if (ReadFirstLine(directory + (version == 2 ? "/cpuset.cpus.effective" : "/cpuset.effective_cpus"), line) ||
+				ReadFirstLine(directory + "/cpuset.cpus", line))
+			{
+				unsigned int count = CountCpuList(line);
+				if (count > 0 && count < limits.cpusetCpus)
+				{
+					limits.cpusetCpus = count;
+					limits.source = version == 2 ? "cgroup v2" : "cgroup v1";
+				}
+			}
+		}
+
+		if (int version = FindCgroupDirectory("memory", directory, mountPoint))
+		{
+			ForEachCgroupLevel(directory, mountPoint, [&](const std::string & level)
+			{
+				if (ReadFirstLine(level + (version == 2 ? "/memory.max" : "/memory.limit_in_bytes"), line) && line != "max")
+				{
+					uint64_t bytes = std::strtoull(line.c_str(), nullptr, 10);
+					if (bytes > 0 && (limits.memoryLimit == 0 || bytes < limits.memoryLimit))
+						limits.memoryLimit = bytes;
+				}
+			});
+
+			//v1 reports "no limit" as a huge page aligned number
+			if (limits.physicalMemory && limits.memoryLimit >= limits.physicalMemory)
+				limits.memoryLimit = 0;
+			if (limits.memoryLimit)
+				limits.source = version == 2 ? "cgroup v2" : "cgroup v1";
+		}
+#endif
+
+		//A fractional quota rounds down, one extra thread would spend part of every period throttled
+		limits.workers = (std::min)(limits.hostCpus, limits.cpusetCpus);
+		if (limits.cpuQuota > 0.0)
+			limits.workers = (std::min)(limits.workers, static_cast<unsigned int>(std::floor(limits.cpuQuota + 1e-6)));
+		limits.workers = (std::max)(limits.workers, 1u);
+
+		return limits;
+	}
+
+	//Process wide copy of the limits, detected on first use and replaced by RefreshResourceLimits
+	struct ResourceLimitState
+	{
+		ResourceLimitState() : limits(DetectResourceLimits()), workers(limits.workers) {}
+
+		std::mutex mutex;
+		ResourceLimits limits;
+		std::atomic<unsigned int> workers;
+	};
+
+	inline ResourceLimitState & GetResourceLimitState()
+	{
+		static ResourceLimitState state;
+		return state;
+	}
+
+	inline ResourceLimits GetResourceLimits()
+	{
+		ResourceLimitState & state = GetResourceLimitState();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		return state.limits;
+	}
+
+	//Threads a parallel loop or pool should use, cheap enough to call per loop
+	inline unsigned int GetWorkerCount()
+	{
+		return GetResourceLimitState().workers.load(std::memory_order_relaxed);
+	}
+
+	//Re-reads the limits, e.g. after a pod resize. Returns true when the worker count or the
+	//memory limit changed; ParallelFor picks up the new count on its next call, fixed size
+	//pools and buffers have to be resized by their owners.
+	inline bool RefreshResourceLimits()
+	{
+		ResourceLimits limits = DetectResourceLimits();
+		ResourceLimitState & state = GetResourceLimitState();
+		std::lock_guard<std::mutex> lock(state.mutex);
+
+		bool changed = limits.workers != state.limits.workers || limits.memoryLimit != state.limits.memoryLimit;
+		state.limits = limits;
+		state.workers.store(limits.workers, std::memory_order_relaxed);
+		return changed;
+	}
+
+	//Bytes the process may use, the memory limit when there is one
+	inline uint64_t GetUsableMemory(const ResourceLimits & limits)
+	{
+		return limits.memoryLimit ? limits.memoryLimit : limits.physicalMemory;
+	}
+
+	//Largest body count whose bytesPerBody fit in the given share of usable memory
+	inline size_t GetBodyBudget(const size_t & bytesPerBody, const double & memoryShare = 0.5)
+	{
+		uint64_t memory = GetUsableMemory(GetResourceLimits());
+		if (memory == 0 || bytesPerBody == 0)
+			return SIZE_MAX;
+
+		return static_cast<size_t>((std::min)(static_cast<double>(memory) * memoryShare / bytesPerBody, static_cast<double>(SIZE_MAX)));
+	}
+
+	//Caps a preferred buffer size at the given share of usable memory
+	inline size_t FitBufferBytes(const size_t & preferred, const double & memoryShare)
+	{
+		uint64_t memory = GetUsableMemory(GetResourceLimits());
+		if (memory == 0)
+			return preferred;
+
+		return static_cast<size_t>((std::min)(static_cast<double>(preferred), static_cast<double>(memory) * memoryShare));
+	}
+
+	inline std::string FormatResourceLimits(const ResourceLimits & limits)
+	{
+		char line[256];
+		char quota[32] = "none";
+		if (limits.cpuQuota > 0.0)
+			std::snprintf(quota, sizeof(quota), "%.2f", limits.cpuQuota);
+
+		std::snprintf(line, sizeof(line), "resources: %u workers (host %u, cpuset %u, quota %s), memory %.0f MB%s, limited by %s\n",
+					  limits.workers, limits.hostCpus, limits.cpusetCpus, quota, GetUsableMemory(limits) / (1024.0 * 1024.0),
+					  limits.memoryLimit ? " limit" : "", limits.source);
+		return line;
+	}
+}
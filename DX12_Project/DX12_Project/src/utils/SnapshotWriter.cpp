@@ -0,0 +1,193 @@
+#include <utils/SnapshotWriter.hpp>
+#include <utils/ThreadPriority.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace dx
+{
+	namespace
+	{
+		//Bodies converted per chunk, the staging stays small however large the snapshot
+		const size_t ChunkBodies = 64 * 1024;
+
+		bool WriteMarker(AsyncFileWriter & file, const uint64_t & size)
+		{
+			uint32_t marker = static_cast<uint32_t>(size);
+			return file.Write(&marker, sizeof(marker));
+		}
+
+		//One Fortran record of components values per body, filled chunk by chunk
+		template<typename T, typename Func>
+		bool WriteBlock(AsyncFileWriter & file, const BodyArray & bodies, const size_t & components, std::vector<T> & staging, Func func)
+		{
+			uint64_t size = uint64_t(bodies.size()) * components * sizeof(T);
+			if (!WriteMarker(file, size))
+				return false;
+
+			for (size_t first = 0; first < bodies.size(); first += ChunkBodies)
+			{
+				size_t count = (std::min)(ChunkBodies, bodies.size() - first);
+				staging.resize(count * components);
+				for (size_t i = 0; i < count; ++i)
+					func(first + i, bodies[first + i], &staging[i * components]);
+
+				if (!file.Write(staging.data(), staging.size() * sizeof(T)))
+					return false;
+			}
+
+			return WriteMarker(file, size);
+		}
+	}
+
+	bool WriteGadgetSnapshot(AsyncFileWriter & file, const std::string & path, const BodyArray & bodies, const double & time, std::string & error)
+	{
+		//Record markers are 32 bit, the position block is the largest
+		if (uint64_t(bodies.size()) * 3 * sizeof(float) > 0xFFFFFFFFull)
+		{
+			error = "too many bodies for a single-file Gadget snapshot";
+			return false;
+		}
+
+		if (!file.Open(path, error))
+			return false;
+
+		//npart[6], mass[6], time, redshift, ..., npartTotal[6] at 96, num_files at 124
+		unsigned char header[256] = {};
+		uint32_t count = static_cast<uint32_t>(bodies.size());
+		uint32_t numFiles = 1;
+		std::memcpy(header + 4, &count, sizeof(count));
+		std::memcpy(header + 72, &time, sizeof(time));
+		std::memcpy(header + 96 + 4, &count, sizeof(count));
+		std::memcpy(header + 124, &numFiles, sizeof(numFiles));
+
+		std::vector<float> floats;
+		std::vector<uint32_t> ids;
+		bool written = WriteMarker(file, sizeof(header)) && file.Write(header, sizeof(header)) && WriteMarker(file, sizeof(header)) &&
+			WriteBlock(file, bodies, 3, floats, [](size_t, const Body & body, float* out) { out[0] = body.position.x; out[1] = body.position.y; out[2] = body.position.z; }) &&
+			WriteBlock(file, bodies, 3, floats, [](size_t, const Body & body, float* out) { out[0] = body.velocity.x; out[1] = body.velocity.y; out[2] = body.velocity.z; }) &&
+			WriteBlock(file, bodies, 1, ids, [](size_t index, const Body &, uint32_t* out) { out[0] = static_cast<uint32_t>(index); }) &&
+			WriteBlock(file, bodies, 1, floats, [](size_t, const Body & body, float* out) { out[0] = body.position.w; });
+
+		//Close also reports the errors of the writes still in flight
+		std::string closeError;
+		bool closed = file.Close(closeError);
+		if (!written || !closed)
+		{
+			error = closeError.empty() ? "could not write " + path : closeError;
+			return false;
+		}
+
+		return true;
+	}
+
+	SnapshotWriter::SnapshotWriter(const AsyncIOSettings & settings, const size_t & maxQueued)
+		: m_file(settings), m_maxQueued((std::max)(maxQueued, size_t(1))), m_numSkipped(0)
+	{
+		m_thread = std::thread(&SnapshotWriter::WriteLoop, this);
+	}
+
+	SnapshotWriter::~SnapshotWriter()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+
+		m_workCondition.notify_one();
+		m_thread.join();
+	}
+
+	bool SnapshotWriter::Submit(const std::string & path, const BodyArray & bodies, const double & time)
+	{
+		//Checked before copying so a skipped snapshot costs nothing
+		if (!HasRoom())
+			return false;
+
+		Enqueue({ path, bodies, time });
+		return true;
+	}
+
+	bool SnapshotWriter::Submit(const std::string & path, BodyArray && bodies, const double & time)
+	{
+		if (!HasRoom())
+			return false;
+
+		Enqueue({ path, std::move(bodies), time });
+		return true;
+	}
+
+	void SnapshotWriter::Flush()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idleCondition.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+	}
+
+	bool SnapshotWriter::GetLastResult(SnapshotResult & result) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		result = m_result;
+		return m_hasResult;
+	}
+
+	uint64_t SnapshotWriter::GetNumSkipped() const
+	{
+		return m_numSkipped.load();
+	}
+
+	bool SnapshotWriter::HasRoom()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_jobs.size() < m_maxQueued)
+			return true;
+
+		++m_numSkipped;
+		return false;
+	}
+
+	void SnapshotWriter::Enqueue(Job && job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(std::move(job));
+		}
+
+		m_workCondition.notify_one();
+	}
+
+	void SnapshotWriter::WriteLoop()
+	{
+		//Mostly waits on the device, it should never take a core from the simulation
+		LowerCurrentThreadPriority();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_workCondition.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+			if (m_jobs.empty())
+				return;
+
+			Job job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			m_busy = true;
+			lock.unlock();
+
+			SnapshotResult result;
+			result.path = job.path;
+			auto start = std::chrono::steady_clock::now();
+			result.succeeded = WriteGadgetSnapshot(m_file, job.path, job.bodies, job.time, result.error);
+			result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			result.bytes = m_file.GetBytesWritten();
+			result.backend = m_file.GetBackendName();
+
+			//Releases the bodies before the next job is taken
+			job.bodies = BodyArray();
+
+			lock.lock();
+			m_result = result;
+			m_hasResult = true;
+			m_busy = false;
+			m_idleCondition.notify_all();
+		}
+	}
+}
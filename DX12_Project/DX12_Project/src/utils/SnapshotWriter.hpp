@@ -0,0 +1,75 @@
+#pragma once
+#include <simulation/Body.hpp>
+#include <utils/AsyncFileWriter.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace dx
+{
+	//Writes the bodies as a single-file Gadget format 1 snapshot (little endian floats, all
+	//bodies as type 1 with a MASS block), so ImportBodies can read it back as a checkpoint
+	bool WriteGadgetSnapshot(AsyncFileWriter & file, const std::string & path, const BodyArray & bodies, const double & time, std::string & error);
+
+	struct SnapshotResult
+	{
+		std::string path;
+		uint64_t bytes = 0;
+		double seconds = 0.0;
+		bool succeeded = false;
+		std::string error;
+		std::string backend;
+	};
+
+	//Background snapshot and checkpoint output. Submit hands the bodies to a writer thread
+	//and returns, the file goes out through AsyncFileWriter with direct I/O, so neither the
+	//simulation threads nor the page cache see the write. A submission is skipped rather
+	//than queued when maxQueued snapshots are already waiting.
+	class SnapshotWriter
+	{
+	public:
+		SnapshotWriter(const AsyncIOSettings & settings = AsyncIOSettings(), const size_t & maxQueued = 2);
+		~SnapshotWriter();
+
+	public:
+		//The first overload copies the bodies, the second takes them over
+		bool Submit(const std::string & path, const BodyArray & bodies, const double & time);
+		bool Submit(const std::string & path, BodyArray && bodies, const double & time);
+
+		//Waits until every submitted snapshot is on disk
+		void Flush();
+		bool GetLastResult(SnapshotResult & result) const;
+		uint64_t GetNumSkipped() const;
+
+	private:
+		struct Job
+		{
+			std::string path;
+			BodyArray bodies;
+			double time;
+		};
+
+		bool HasRoom();
+		void Enqueue(Job && job);
+		void WriteLoop();
+
+	private:
+		AsyncFileWriter m_file;
+		size_t m_maxQueued;
+		std::deque<Job> m_jobs;
+		bool m_busy = false;
+		bool m_stop = false;
+
+		SnapshotResult m_result;
+		bool m_hasResult = false;
+		std::atomic<uint64_t> m_numSkipped;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_workCondition;
+		std::condition_variable m_idleCondition;
+		std::thread m_thread;
+	};
+}
@@ -0,0 +1,199 @@
+#include <utils/SoakMonitor.hpp>
+#include <utils/AllocationTracker.hpp>
+#include <utils/ProcessStats.hpp>
+#include <algorithm>
+#include <cstdio>
+
+namespace dx
+{
+	namespace
+	{
+		struct Line
+		{
+			double slope;
+			double intercept;
+		};
+
+		//Least squares fit of y over x
+		Line FitLine(const std::vector<double> & x, const std::vector<double> & y)
+		{
+			const double n = static_cast<double>(x.size());
+			double meanX = 0.0, meanY = 0.0;
+			for (size_t i = 0; i < x.size(); ++i)
+			{
+				meanX += x[i];
+				meanY += y[i];
+			}
+			meanX /= n;
+			meanY /= n;
+
+			double covariance = 0.0, variance = 0.0;
+			for (size_t i = 0; i < x.size(); ++i)
+			{
+				covariance += (x[i] - meanX) * (y[i] - meanY);
+				variance += (x[i] - meanX) * (x[i] - meanX);
+			}
+
+			double slope = variance > 0.0 ? covariance / variance : 0.0;
+			return { slope, meanY - slope * meanX };
+		}
+
+		double Percentile(std::vector<double> & values, const double & fraction)
+		{
+			size_t index = (std::min)(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+			std::nth_element(values.begin(), values.begin() + index, values.end());
+			return values[index];
+		}
+	}
+
+	SoakMonitor::SoakMonitor(const SoakSettings & settings)
+		: m_settings(settings), m_start(std::chrono::steady_clock::now()), m_nextSample(settings.sampleIntervalSeconds)
+	{
+	}
+
+	void SoakMonitor::RecordStep(const double & seconds)
+	{
+		m_intervalStepMs.push_back(seconds * 1000.0);
+		++m_steps;
+	}
+
+	bool SoakMonitor::Update()
+	{
+		if (GetElapsedSeconds() < m_nextSample)
+			return false;
+
+		Sample();
+		return true;
+	}
+
+	void SoakMonitor::Sample()
+	{
+		SoakSample sample = {};
+		sample.elapsedSeconds = GetElapsedSeconds();
+		sample.steps = m_steps;
+		sample.intervalSteps = m_intervalStepMs.size();
+
+		ProcessStats stats = GetProcessStats();
+		sample.residentBytes = stats.residentBytes;
+		sample.handles = stats.handles;
+
+		AllocationCounters gpu = AllocationTracker::GetLive();
+		sample.gpuAllocations = gpu.count;
+		sample.gpuBytes = gpu.bytes;
+
+		if (!m_intervalStepMs.empty())
+		{
+			sample.stepMsP50 = Percentile(m_intervalStepMs, 0.5);
+			sample.stepMsP90 = Percentile(m_intervalStepMs, 0.9);
+			sample.stepMsP99 = Percentile(m_intervalStepMs, 0.99);
+		}
+
+		//Keeps the capacity, the interval buffer is reused for the whole run
+		m_intervalStepMs.clear();
+		m_samples.push_back(sample);
+
+		//Catch up without a burst of samples if Update was not called for a while
+		while (m_nextSample <= sample.elapsedSeconds)
+			m_nextSample += m_settings.sampleIntervalSeconds;
+	}
+
+	SoakVerdict SoakMonitor::Evaluate() const
+	{
+		SoakVerdict verdict;
+		if (m_samples.size() <= m_settings.warmupSamples)
+			return verdict;
+
+		std::vector<const SoakSample*> fitted;
+		for (size_t i = m_settings.warmupSamples; i < m_samples.size(); ++i)
+			fitted.push_back(&m_samples[i]);
+		verdict.numFitted = fitted.size();
+
+		auto addTrend = [&](const char* metric, double limit, bool relative, double (*value)(const SoakSample &), bool stepTime)
+		{
+			std::vector<double> hours, values;
+			for (size_t i = 0; i < fitted.size(); ++i)
+			{
+				//Intervals without a step carry no step time
+				if (stepTime && fitted[i]->intervalSteps == 0)
+					continue;
+
+				hours.push_back(fitted[i]->elapsedSeconds / 3600.0);
+				values.push_back(value(*fitted[i]));
+			}
+
+			if (hours.size() < (std::max)(m_settings.minFitSamples, size_t(2)))
+				return;
+
+			Line line = FitLine(hours, values);
+			SoakTrend trend = { metric, line.slope, limit, false };
+			if (relative)
+			{
+				double baseline = line.intercept + line.slope * hours.front();
+				trend.slopePerHour = baseline > 0.0 ? line.slope / baseline : 0.0;
+			}
+
+			trend.failed = limit > 0.0 && trend.slopePerHour > limit && hours.back() - hours.front() >= m_settings.minFitHours;
+			verdict.passed = verdict.passed && !trend.failed;
+			verdict.trends.push_back(trend);
+		};
+
+		addTrend("resident bytes", m_settings.maxResidentGrowthPerHour, false, [](const SoakSample & s) { return static_cast<double>(s.residentBytes); }, false);
+		addTrend("gpu bytes", m_settings.maxGpuGrowthPerHour, false, [](const SoakSample & s) { return static_cast<double>(s.gpuBytes); }, false);
+		addTrend("handles", m_settings.maxHandleGrowthPerHour, false, [](const SoakSample & s) { return static_cast<double>(s.handles); }, false);
+		addTrend("step ms p50", m_settings.maxStepTimeGrowthPerHour, true, [](const SoakSample & s) { return s.stepMsP50; }, true);
+		addTrend("step ms p99", m_settings.maxTailStepTimeGrowthPerHour, true, [](const SoakSample & s) { return s.stepMsP99; }, true);
+
+		return verdict;
+	}
+
+	const std::vector<SoakSample> & SoakMonitor::GetSamples() const
+	{
+		return m_samples;
+	}
+
+	const SoakSettings & SoakMonitor::GetSettings() const
+	{
+		return m_settings;
+	}
+
+	bool SoakMonitor::WriteCsv(const std::string & path) const
+	{
+		FILE* file = std::fopen(path.c_str(), "w");
+		if (!file)
+			return false;
+
+		std::fprintf(file, "seconds,steps,resident_bytes,handles,gpu_allocations,gpu_bytes,step_ms_p50,step_ms_p90,step_ms_p99\n");
+		for (const SoakSample & s : m_samples)
+		{
+			std::fprintf(file, "%.3f,%llu,%llu,%llu,%llu,%llu,%.6f,%.6f,%.6f\n", s.elapsedSeconds, static_cast<unsigned long long>(s.steps),
+						 static_cast<unsigned long long>(s.residentBytes), static_cast<unsigned long long>(s.handles),
+						 static_cast<unsigned long long>(s.gpuAllocations), static_cast<unsigned long long>(s.gpuBytes),
+						 s.stepMsP50, s.stepMsP90, s.stepMsP99);
+		}
+
+		return std::fclose(file) == 0;
+	}
+
+	double SoakMonitor::GetElapsedSeconds() const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+	}
+
+	std::string FormatSoakVerdict(const SoakVerdict & verdict)
+	{
+		char line[256];
+		std::snprintf(line, sizeof(line), "soak %s, %zu samples fitted\n", verdict.passed ? "passed" : "FAILED", verdict.numFitted);
+		std::string text = line;
+
+		for (const SoakTrend & trend : verdict.trends)
+		{
+			if (trend.limitPerHour > 0.0)
+				std::snprintf(line, sizeof(line), "  %-16s %+14.4g /h (limit %.4g)%s\n", trend.metric.c_str(), trend.slopePerHour, trend.limitPerHour, trend.failed ? " FAILED" : "");
+			else
+				std::snprintf(line, sizeof(line), "  %-16s %+14.4g /h\n", trend.metric.c_str(), trend.slopePerHour);
+			text += line;
+		}
+
+		return text;
+	}
+}
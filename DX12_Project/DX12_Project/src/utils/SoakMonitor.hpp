@@ -0,0 +1,90 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dx
+{
+	//Limits are growth per hour of the least squares trend over the samples after warmup,
+	//a limit of zero or less only reports the trend
+	struct SoakSettings
+	{
+		double sampleIntervalSeconds = 60.0;
+		size_t warmupSamples = 5;						//Skipped by the fits, caches and pools settle first
+		size_t minFitSamples = 10;						//Fewer samples after warmup always pass
+		double minFitHours = 1.0;						//Shorter spans report their trends but never fail, slopes are noise
+		double maxResidentGrowthPerHour = 16.0 * 1024.0 * 1024.0;
+		double maxGpuGrowthPerHour = 16.0 * 1024.0 * 1024.0;
+		double maxHandleGrowthPerHour = 16.0;
+		double maxStepTimeGrowthPerHour = 0.05;			//Fraction of the trend's median step time at the first fitted sample
+		double maxTailStepTimeGrowthPerHour = 0.0;		//Same for p99, off by default as it is noisy
+	};
+
+	struct SoakSample
+	{
+		double elapsedSeconds;
+		uint64_t steps;
+		uint64_t intervalSteps;
+		uint64_t residentBytes;
+		uint64_t handles;
+		uint64_t gpuAllocations;
+		uint64_t gpuBytes;
+		double stepMsP50;
+		double stepMsP90;
+		double stepMsP99;
+	};
+
+	struct SoakTrend
+	{
+		std::string metric;
+		double slopePerHour;		//Metric units, or a fraction of the baseline for step times
+		double limitPerHour;
+		bool failed;
+	};
+
+	struct SoakVerdict
+	{
+		bool passed = true;
+		size_t numFitted = 0;
+		std::vector<SoakTrend> trends;
+	};
+
+	//Long running drift and leak detector. The owner reports the duration of every step
+	//and calls Update once per frame or step; at every interval the monitor samples the
+	//resident set, open handles, the GPU allocations tracked by AllocationTracker and the
+	//step time percentiles of the interval. Evaluate fits a line to each series and fails
+	//the ones whose slope exceeds the configured growth, so a slow leak or a throughput
+	//regression that never trips a single frame still shows up after a few hours.
+	class SoakMonitor
+	{
+	public:
+		SoakMonitor(const SoakSettings & settings = SoakSettings());
+
+	public:
+		void RecordStep(const double & seconds);
+
+		//Takes a sample when the interval has elapsed, returns true if it did
+		bool Update();
+		void Sample();
+
+		SoakVerdict Evaluate() const;
+		const std::vector<SoakSample> & GetSamples() const;
+		const SoakSettings & GetSettings() const;
+		bool WriteCsv(const std::string & path) const;
+
+	private:
+		double GetElapsedSeconds() const;
+
+	private:
+		SoakSettings m_settings;
+		std::chrono::steady_clock::time_point m_start;
+		double m_nextSample;
+		uint64_t m_steps = 0;
+		std::vector<double> m_intervalStepMs;
+		std::vector<SoakSample> m_samples;
+	};
+
+	//Human readable summary of a verdict, one trend per line
+	std::string FormatSoakVerdict(const SoakVerdict & verdict);
+}
@@ -0,0 +1,158 @@
+#include <utils/SpriteRaster.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace dx
+{
+	namespace
+	{
+		Float3 Subtract(const Float3 & a, const Float3 & b)
+		{
+			return { a.x - b.x, a.y - b.y, a.z - b.z };
+		}
+
+		Float3 Cross(const Float3 & a, const Float3 & b)
+		{
+			return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+		}
+
+		float Dot(const Float3 & a, const Float3 & b)
+		{
+			return a.x * b.x + a.y * b.y + a.z * b.z;
+		}
+
+		Float3 Normalize(const Float3 & a)
+		{
+			float length = std::sqrt(Dot(a, a));
+			return { a.x / length, a.y / length, a.z / length };
+		}
+	}
+
+	void SpriteImage::Resize(const unsigned int & width, const unsigned int & height)
+	{
+		this->width = width;
+		this->height = height;
+		pixels.assign(size_t(width) * height * 3, 0.0f);
+	}
+
+	void SpriteImage::Clear()
+	{
+		std::fill(pixels.begin(), pixels.end(), 0.0f);
+	}
+
+	void MakeLookAtLH(const Float3 & eye, const Float3 & target, const Float3 & up, float* matrix)
+	{
+		Float3 z = Normalize(Subtract(target, eye));
+		Float3 x = Normalize(Cross(up, z));
+		Float3 y = Cross(z, x);
+
+		const float m[16] =
+		{
+			x.x, y.x, z.x, 0.0f,
+			x.y, y.y, z.y, 0.0f,
+			x.z, y.z, z.z, 0.0f,
+			-Dot(x, eye), -Dot(y, eye), -Dot(z, eye), 1.0f
+		};
+		std::copy(m, m + 16, matrix);
+	}
+
+	void MakePerspectiveFovLH(const float & fovRadians, const float & aspect, const float & nearZ, const float & farZ, float* matrix)
+	{
+		float h = 1.0f / std::tan(0.5f * fovRadians);
+		float r = farZ / (farZ - nearZ);
+
+		const float m[16] =
+		{
+			h / aspect, 0.0f, 0.0f, 0.0f,
+			0.0f, h, 0.0f, 0.0f,
+			0.0f, 0.0f, r, 1.0f,
+			0.0f, 0.0f, -r * nearZ, 0.0f
+		};
+		std::copy(m, m + 16, matrix);
+	}
+
+	void MultiplyMatrices(const float* a, const float* b, float* product)
+	{
+		float m[16];
+		for (int i = 0; i < 4; ++i)
+			for (int j = 0; j < 4; ++j)
+				m[i * 4 + j] = a[i * 4] * b[j] + a[i * 4 + 1] * b[4 + j] + a[i * 4 + 2] * b[8 + j] + a[i * 4 + 3] * b[12 + j];
+		std::copy(m, m + 16, product);
+	}
+
+	SpriteTexture GenerateStarTexture(const unsigned int & size)
+	{
+		SpriteTexture texture;
+		texture.size = size;
+		texture.texels.resize(size_t(size) * size);
+
+		for (unsigned int y = 0; y < size; ++y)
+		{
+			for (unsigned int x = 0; x < size; ++x)
+			{
+				float dx = (x + 0.5f) / size * 2.0f - 1.0f;
+				float dy = (y + 0.5f) / size * 2.0f - 1.0f;
+				texture.texels[y * size + x] = std::exp(-8.0f * (dx * dx + dy * dy));
+			}
+		}
+
+		return texture;
+	}
+
+	void RasterizeSprites(const Body* bodies, const size_t & count, const SpriteSettings & settings, const SpriteTexture & texture, SpriteImage & image)
+	{
+		const float* m = settings.viewProjection;
+		const float width = static_cast<float>(image.width);
+		const float height = static_cast<float>(image.height);
+		const float color[3] = { settings.color[0] * settings.weight, settings.color[1] * settings.weight, settings.color[2] * settings.weight };
+
+		for (size_t b = 0; b < count; ++b)
+		{
+			const Float4 & p = bodies[b].position;
+			float cx = p.x * m[0] + p.y * m[4] + p.z * m[8] + p.w * m[12];
+			float cy = p.x * m[1] + p.y * m[5] + p.z * m[9] + p.w * m[13];
+			float cz = p.x * m[2] + p.y * m[6] + p.z * m[10] + p.w * m[14];
+			float cw = p.x * m[3] + p.y * m[7] + p.z * m[11] + p.w * m[15];
+
+			//All four corners share z and w, so the quad is either clipped whole or not at all
+			if (cw <= 0.0f || cz < 0.0f || cz > cw)
+				continue;
+
+			float nx = cx / cw;
+			float ny = cy / cw;
+			float half = 0.5f * settings.pointSize / cw;
+
+			//Screen rectangle, y down, covering the pixels whose centers it contains
+			float x0 = (nx - half + 1.0f) * 0.5f * width;
+			float x1 = (nx + half + 1.0f) * 0.5f * width;
+			float y0 = (1.0f - (ny + half)) * 0.5f * height;
+			float y1 = (1.0f - (ny - half)) * 0.5f * height;
+
+			int first = (std::max)(0, static_cast<int>(std::ceil(x0 - 0.5f)));
+			int last = (std::min)(static_cast<int>(image.width), static_cast<int>(std::ceil(x1 - 0.5f)));
+			int top = (std::max)(0, static_cast<int>(std::ceil(y0 - 0.5f)));
+			int bottom = (std::min)(static_cast<int>(image.height), static_cast<int>(std::ceil(y1 - 0.5f)));
+
+			for (int y = top; y < bottom; ++y)
+			{
+				//The top corners have v = 1
+				float v = (y1 - (y + 0.5f)) / (y1 - y0);
+				unsigned int ty = (std::min)(static_cast<unsigned int>(v * texture.size), texture.size - 1);
+				float* row = image.pixels.data() + size_t(y) * image.width * 3;
+
+				for (int x = first; x < last; ++x)
+				{
+					float u = ((x + 0.5f) - x0) / (x1 - x0);
+					unsigned int tx = (std::min)(static_cast<unsigned int>(u * texture.size), texture.size - 1);
+					float tex = texture.texels[ty * texture.size + tx];
+					if (tex < settings.discardBelow)
+						continue;
+
+					row[x * 3 + 0] += tex * color[0];
+					row[x * 3 + 1] += tex * color[1];
+					row[x * 3 + 2] += tex * color[2];
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <simulation/Body.hpp>
+#include <vector>
+
+namespace dx
+{
+	//Additive RGB float image, what the sprite pass adds to its target before it is clamped
+	struct SpriteImage
+	{
+		unsigned int width = 0;
+		unsigned int height = 0;
+		std::vector<float> pixels;		//3 per pixel, rows top to bottom
+
+		void Resize(const unsigned int & width, const unsigned int & height);
+		void Clear();
+	};
+
+	//Square luminance texture, point sampled with a transparent black border like star.png
+	struct SpriteTexture
+	{
+		unsigned int size = 0;
+		std::vector<float> texels;
+	};
+
+	struct SpriteSettings
+	{
+		float viewProjection[16];				//Row-major, positions multiply from the left as in mul(pos, g_mWorldViewProjection)
+		float pointSize = 1.0f;					//g_pointSize, clip-space extent of the quad before the divide
+		float color[3] = { 0.3f, 1.0f, 0.2f };	//Tint of RenderParticles.hlsl PS_MAIN
+		float weight = 1.0f;					//Blend factor, the subset weight
+		float discardBelow = 0.05f;				//Texels below are discarded
+	};
+
+	//Row-major matrices matching XMMatrixLookAtLH, XMMatrixPerspectiveFovLH and their product
+	void MakeLookAtLH(const Float3 & eye, const Float3 & target, const Float3 & up, float* matrix);
+	void MakePerspectiveFovLH(const float & fovRadians, const float & aspect, const float & nearZ, const float & farZ, float* matrix);
+	void MultiplyMatrices(const float* a, const float* b, float* product);
+
+	//Stand-in for star.png, which has no portable decoder: a radial falloff of the same
+	//footprint, bright at the center and below the discard threshold towards the edge
+	SpriteTexture GenerateStarTexture(const unsigned int & size = 64);
+
+	//CPU version of the RenderParticles.hlsl sprite pass: every body is transformed with
+	//the bodies' w as is, expanded to a screen-aligned quad of pointSize in clip space,
+	//clipped, point sampled and added to the image. Unlike the GPU pass there is no depth
+	//test, so up to rounding the image does not depend on the order of the bodies and the
+	//images of disjoint body sets add up to the image of their union (see CompositeImage).
+	void RasterizeSprites(const Body* bodies, const size_t & count, const SpriteSettings & settings, const SpriteTexture & texture, SpriteImage & image);
+}
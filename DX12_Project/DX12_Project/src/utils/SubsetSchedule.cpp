@@ -0,0 +1,62 @@
+#include <utils/SubsetSchedule.hpp>
+#include <algorithm>
+
+namespace dx
+{
+	SubsetSchedule::SubsetSchedule(const SubsetSettings & settings) : m_settings(settings)
+	{
+		m_settings.maxStride = (std::max)(m_settings.maxStride, 1u);
+		m_settings.minStride = (std::min)((std::max)(m_settings.minStride, 1u), m_settings.maxStride);
+		m_settings.historyScale = (std::max)(m_settings.historyScale, 1.0f);
+		m_stride = m_settings.minStride;
+	}
+
+	void SubsetSchedule::BeginFrame(const double & lastRenderMs, const bool & viewChanged)
+	{
+		//Judge a stride over a whole cycle of phases (at least a few frames) so one slow
+		//frame does not flip it, the accumulated history stays valid across a change
+		m_costSum += lastRenderMs;
+		if (++m_costSamples >= (std::max)(m_stride, 4u))
+		{
+			double average = m_costSum / m_costSamples;
+			if (average > m_settings.frameBudgetMs && m_stride < m_settings.maxStride)
+				m_stride = (std::min)(m_stride * 2, m_settings.maxStride);
+			else if (average < m_settings.frameBudgetMs * 0.4 && m_stride > m_settings.minStride)
+				m_stride = (std::max)(m_stride / 2, m_settings.minStride);
+
+			m_costSum = 0.0;
+			m_costSamples = 0;
+		}
+
+		if (viewChanged)
+			m_framesSinceRestart = 0;
+
+		m_phase = (m_phase + 1) % m_stride;
+
+		//Running mean until the steady window is reached. With every body drawn each frame
+		//there is nothing to accumulate and the history is replaced.
+		float steady = m_stride == 1 ? 1.0f : 1.0f / (m_stride * m_settings.historyScale);
+		m_blend = (std::max)(1.0f / (m_framesSinceRestart + 1), steady);
+		++m_framesSinceRestart;
+	}
+
+	unsigned int SubsetSchedule::GetStride() const
+	{
+		return m_stride;
+	}
+
+	unsigned int SubsetSchedule::GetPhase() const
+	{
+		return m_phase;
+	}
+
+	float SubsetSchedule::GetBlend() const
+	{
+		return m_blend;
+	}
+
+	float SubsetSchedule::GetSubsetWeight() const
+	{
+		return m_stride * m_blend;
+	}
+}
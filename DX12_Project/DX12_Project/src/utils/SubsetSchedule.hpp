@@ -0,0 +1,46 @@
+#pragma once
+
+namespace dx
+{
+	struct SubsetSettings
+	{
+		double frameBudgetMs = 8.0;			//GPU render time per frame the stride is adapted to
+		unsigned int minStride = 1;			//Equal to maxStride for a constant stride
+		unsigned int maxStride = 64;
+		float historyScale = 2.0f;			//Steady blend window in multiples of the stride
+	};
+
+	//Picks which 1/k of the bodies a frame draws and how the result is blended into the
+	//accumulated image. Frame n draws the bodies with index % k == phase(n), weighted by k so
+	//every frame is an unbiased estimate of the full image. After a restart (the view moved)
+	//the frames are averaged with 1/(n+1), so after k frames every body was drawn once and the
+	//image equals the full set; from then on it blends exponentially with about
+	//historyScale * k frames of history. k doubles while the frame is over budget and halves
+	//once it is comfortably below, so the render cost follows the budget.
+	class SubsetSchedule
+	{
+	public:
+		SubsetSchedule(const SubsetSettings & settings = SubsetSettings());
+
+	public:
+		//Call once per frame before drawing, with the GPU time the last frame spent drawing
+		//and accumulating the subset. Other passes do not change with the stride and would
+		//only push it to maxStride.
+		void BeginFrame(const double & lastRenderMs, const bool & viewChanged);
+
+		unsigned int GetStride() const;
+		unsigned int GetPhase() const;
+		float GetBlend() const;				//Weight of this frame in the accumulated image
+		float GetSubsetWeight() const;		//Scale of each drawn body, stride * blend
+
+	private:
+		SubsetSettings m_settings;
+		unsigned int m_stride = 1;
+		unsigned int m_phase = 0;
+		unsigned int m_framesSinceRestart = 0;
+		float m_blend = 1.0f;
+
+		double m_costSum = 0.0;
+		unsigned int m_costSamples = 0;
+	};
+}
@@ -0,0 +1,22 @@
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace dx
+{
+	//Drops the calling thread below the simulation and render threads so background
+	//work only soaks up otherwise idle cores
+	inline void LowerCurrentThreadPriority()
+	{
+#ifdef _WIN32
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+		setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+	}
+}
@@ -0,0 +1,116 @@
+#include <utils/TileMap.hpp>
+#include <algorithm>
+
+namespace dx
+{
+	const uint32_t TileRange::NullHeap;
+	const uint64_t TileMap::DefaultTileSize;
+
+	TileMap::TileMap(const uint64_t & reservedBytes, const uint32_t & tilesPerHeap, const uint32_t & shrinkSlackTiles, const uint64_t & tileSize)
+		: m_tileSize(tileSize), m_numTiles(static_cast<uint32_t>((reservedBytes + tileSize - 1) / tileSize)),
+		  m_tilesPerHeap((std::max)(tilesPerHeap, 1u)), m_shrinkSlackTiles(shrinkSlackTiles)
+	{
+	}
+
+	bool TileMap::Resize(const uint64_t & bytes, std::vector<TileRange> & updates)
+	{
+		uint64_t needed = (bytes + m_tileSize - 1) / m_tileSize;
+		if (needed > m_numTiles)
+			return false;
+
+		uint32_t tiles = static_cast<uint32_t>(needed);
+		if (tiles > m_boundTiles)
+		{
+			AppendRanges(m_boundTiles, tiles, true, updates);
+			m_boundTiles = tiles;
+			m_numHeaps = (std::max)(m_numHeaps, GetNumRequiredHeaps());
+		}
+		else if (tiles + m_shrinkSlackTiles < m_boundTiles)
+		{
+			//Keep the slack bound so a population oscillating around a tile edge does not remap every frame
+			uint32_t keep = (std::min)(m_boundTiles, tiles + m_shrinkSlackTiles / 2);
+			AppendRanges(keep, m_boundTiles, false, updates);
+			m_boundTiles = keep;
+		}
+
+		return true;
+	}
+
+	uint32_t TileMap::Trim()
+	{
+		uint32_t released = m_numHeaps - GetNumRequiredHeaps();
+		m_numHeaps -= released;
+		return released;
+	}
+
+	uint32_t TileMap::GetNumTiles() const
+	{
+		return m_numTiles;
+	}
+
+	uint32_t TileMap::GetNumBoundTiles() const
+	{
+		return m_boundTiles;
+	}
+
+	uint32_t TileMap::GetNumHeaps() const
+	{
+		return m_numHeaps;
+	}
+
+	uint32_t TileMap::GetNumRequiredHeaps() const
+	{
+		return (m_boundTiles + m_tilesPerHeap - 1) / m_tilesPerHeap;
+	}
+
+	uint32_t TileMap::GetTilesPerHeap() const
+	{
+		return m_tilesPerHeap;
+	}
+
+	uint64_t TileMap::GetTileSize() const
+	{
+		return m_tileSize;
+	}
+
+	uint64_t TileMap::GetBoundBytes() const
+	{
+		return m_boundTiles * m_tileSize;
+	}
+
+	uint64_t TileMap::GetReservedBytes() const
+	{
+		return m_numTiles * m_tileSize;
+	}
+
+	TileRange TileMap::Locate(const uint32_t & virtualTile) const
+	{
+		if (virtualTile >= m_boundTiles)
+			return { virtualTile, 1, TileRange::NullHeap, 0 };
+
+		return { virtualTile, 1, virtualTile / m_tilesPerHeap, virtualTile % m_tilesPerHeap };
+	}
+
+	void TileMap::AppendRanges(const uint32_t & first, const uint32_t & end, const bool & bind, std::vector<TileRange> & updates) const
+	{
+		//Unbinding needs no heap, so the whole tail is one range
+		if (!bind)
+		{
+			if (first < end)
+				updates.push_back({ first, end - first, TileRange::NullHeap, 0 });
+			return;
+		}
+
+		//Split at heap boundaries, a range can only reference one heap
+		uint32_t tile = first;
+		while (tile < end)
+		{
+			uint32_t heap = tile / m_tilesPerHeap;
+			uint32_t heapEnd = (std::min)(end, (heap + 1) * m_tilesPerHeap);
+
+			TileRange range = { tile, heapEnd - tile, heap, tile % m_tilesPerHeap };
+			updates.push_back(range);
+			tile = heapEnd;
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace dx
+{
+	//One contiguous run of virtual tiles bound to consecutive tiles of one heap, or
+	//unbound when heap is NullHeap
+	struct TileRange
+	{
+		static const uint32_t NullHeap = 0xFFFFFFFFu;
+
+		uint32_t virtualTile;
+		uint32_t count;
+		uint32_t heap;
+		uint32_t heapTile;
+	};
+
+	//Bookkeeping for a reserved (tiled) buffer that only ever grows or shrinks at its end.
+	//Virtual tile v lives in heap v / tilesPerHeap at tile v % tilesPerHeap, so the live
+	//tiles always fill whole heaps from the front. Growing binds the new tail tiles,
+	//shrinking unbinds tiles beyond the slack, and nothing already bound ever moves,
+	//so existing data and views stay valid. Resize reports the ranges to pass to
+	//UpdateTileMappings, at most one per heap touched. Independent of D3D12 so it can be
+	//exercised on the CPU (see tools/ValidateTileMap.cpp).
+	class TileMap
+	{
+	public:
+		static const uint64_t DefaultTileSize = 64 * 1024;
+
+		TileMap(const uint64_t & reservedBytes, const uint32_t & tilesPerHeap = 256, const uint32_t & shrinkSlackTiles = 16,
+				const uint64_t & tileSize = DefaultTileSize);
+
+	public:
+		//Binds or unbinds tail tiles so that the first bytes are backed. Returns false when
+		//bytes exceed the reserved range, in which case nothing changes.
+		bool Resize(const uint64_t & bytes, std::vector<TileRange> & updates);
+
+		//Drops heaps that hold no bound tile, returns how many to release from the back.
+		//Only call when the GPU no longer uses tiles that were unbound from them.
+		uint32_t Trim();
+
+		uint32_t GetNumTiles() const;			//Tiles in the reserved range
+		uint32_t GetNumBoundTiles() const;
+		uint32_t GetNumHeaps() const;			//Heaps allocated, including empty ones kept for regrowth
+		uint32_t GetNumRequiredHeaps() const;	//Heaps holding bound tiles
+		uint32_t GetTilesPerHeap() const;
+		uint64_t GetTileSize() const;
+		uint64_t GetBoundBytes() const;
+		uint64_t GetReservedBytes() const;
+
+		//Heap and tile a virtual tile is bound to, heap is NullHeap when unbound
+		TileRange Locate(const uint32_t & virtualTile) const;
+
+	private:
+		void AppendRanges(const uint32_t & first, const uint32_t & end, const bool & bind, std::vector<TileRange> & updates) const;
+
+	private:
+		uint64_t m_tileSize;
+		uint32_t m_numTiles;
+		uint32_t m_tilesPerHeap;
+		uint32_t m_shrinkSlackTiles;
+		uint32_t m_boundTiles = 0;
+		uint32_t m_numHeaps = 0;
+	};
+}
@@ -0,0 +1,523 @@
+#include <utils/Trajectory.hpp>
+#include <utils/ResourceLimits.hpp>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace dx
+{
+	namespace
+	{
+		const char TrajectoryMagic[4] = { 'N', 'B', 'T', 'J' };
+		const uint32_t TrajectoryVersion = 1;
+
+		struct IndexHeader
+		{
+			char magic[4];
+			uint32_t version;
+			uint32_t binsPerAxis;
+			uint32_t reserved;
+			uint64_t numChunks;
+			uint64_t tableOffset;
+		};
+
+		//Bin of a coordinate along one axis of the chunk grid
+		inline unsigned int BinOf(const float & value, const float & min, const float & scale, const unsigned int & bins)
+		{
+			float bin = (value - min) * scale;
+			if (bin <= 0.0f)
+				return 0;
+
+			return (std::min)(static_cast<unsigned int>(bin), bins - 1);
+		}
+
+		inline float BinScale(const float & min, const float & max, const unsigned int & bins)
+		{
+			return max > min ? bins / (max - min) : 0.0f;
+		}
+
+		inline bool Inside(const float* p, const float min[3], const float max[3])
+		{
+			return p[0] >= min[0] && p[0] <= max[0] && p[1] >= min[1] && p[1] <= max[1] && p[2] >= min[2] && p[2] <= max[2];
+		}
+	}
+
+	TrajectoryWriter::TrajectoryWriter(const TrajectorySettings & settings) :
+		m_settings(settings),
+		m_data(settings.io)
+	{
+		m_settings.maxChunkFrames = (std::max)(m_settings.maxChunkFrames, 1u);
+		m_settings.binsPerAxis = (std::max)(m_settings.binsPerAxis, 1u);
+	}
+
+	TrajectoryWriter::~TrajectoryWriter()
+	{
+		std::string error;
+		Close(error);
+	}
+
+	bool TrajectoryWriter::Open(const std::string & path, std::string & error)
+	{
+		if (!Close(error))
+			return false;
+
+		if (!m_data.Open(path, error))
+			return false;
+
+		m_index = std::fopen((path + ".idx").c_str(), "wb");
+		if (!m_index)
+		{
+			error = "could not create " + path + ".idx";
+			std::string closeError;
+			m_data.Close(closeError);
+			return false;
+		}
+
+		//Rewritten with the chunk count on Close, a file that was never closed reads as empty
+		IndexHeader header = {};
+		std::memcpy(header.magic, TrajectoryMagic, sizeof(header.magic));
+		header.version = TrajectoryVersion;
+		header.binsPerAxis = m_settings.binsPerAxis;
+		std::fwrite(&header, sizeof(header), 1, m_index);
+		m_indexSize = sizeof(header);
+
+		m_chunks.clear();
+		m_steps.clear();
+		m_hasStep = false;
+		m_error.clear();
+		return true;
+	}
+
+	bool TrajectoryWriter::AppendFrame(const uint64_t & step, const BodyArray & bodies, const uint64_t* ids)
+	{
+		if (!m_index || !m_error.empty())
+			return false;
+
+		if (m_hasStep && step <= m_lastStep)
+		{
+			m_error = "trajectory steps must increase";
+			return false;
+		}
+
+		if (bodies.empty() || bodies.size() > UINT32_MAX)
+		{
+			m_error = "invalid body count";
+			return false;
+		}
+
+		uint32_t numBodies = static_cast<uint32_t>(bodies.size());
+		if (!m_steps.empty())
+		{
+			bool sameIds = ids ? m_ids.size() == numBodies && std::memcmp(ids, m_ids.data(), sizeof(uint64_t) * numBodies) == 0 : m_ids.empty();
+			if (numBodies != m_numBodies || !sameIds)
+			{
+				if (!FlushChunk())
+					return false;
+			}
+		}
+
+		if (m_steps.empty())
+		{
+			m_numBodies = numBodies;
+			uint64_t frameBytes = uint64_t(numBodies) * 3 * sizeof(float);
+			uint64_t chunkBytes = FitBufferBytes(m_settings.chunkBytes, 0.125);
+			m_chunkFrames = static_cast<uint32_t>((std::min)(uint64_t(m_settings.maxChunkFrames), (std::max)(uint64_t(1), chunkBytes / frameBytes)));
+			m_positions.resize(size_t(numBodies) * m_chunkFrames * 3);
+
+			m_ids.clear();
+			m_denseIds = true;
+			if (ids)
+			{
+				m_ids.assign(ids, ids + numBodies);
+				for (uint32_t i = 0; i < numBodies && m_denseIds; i++)
+					m_denseIds = ids[i] == i;
+			}
+		}
+
+		//Body major, frame f of slot i at (i * m_chunkFrames + f)
+		size_t frame = m_steps.size();
+		for (uint32_t i = 0; i < numBodies; i++)
+		{
+			float* destination = &m_positions[(size_t(i) * m_chunkFrames + frame) * 3];
+			destination[0] = bodies[i].position.x;
+			destination[1] = bodies[i].position.y;
+			destination[2] = bodies[i].position.z;
+		}
+
+		m_steps.push_back(step);
+		m_hasStep = true;
+		m_lastStep = step;
+
+		if (m_steps.size() == m_chunkFrames)
+			return FlushChunk();
+
+		return true;
+	}
+
+	bool TrajectoryWriter::Close(std::string & error)
+	{
+		if (!m_index)
+			return true;
+
+		FlushChunk();
+
+		uint64_t tableOffset = 0;
+		if (!m_chunks.empty())
+			WriteIndex(m_chunks.data(), sizeof(TrajectoryChunk) * m_chunks.size(), tableOffset);
+
+		IndexHeader header = {};
+		std::memcpy(header.magic, TrajectoryMagic, sizeof(header.magic));
+		header.version = TrajectoryVersion;
+		header.binsPerAxis = m_settings.binsPerAxis;
+		header.numChunks = m_chunks.size();
+		header.tableOffset = tableOffset;
+
+		if (std::fseek(m_index, 0, SEEK_SET) != 0 || std::fwrite(&header, sizeof(header), 1, m_index) != 1)
+			m_error = "could not write the trajectory index";
+		if (std::fclose(m_index) != 0 && m_error.empty())
+			m_error = "could not write the trajectory index";
+		m_index = nullptr;
+
+		std::string dataError;
+		if (!m_data.Close(dataError) && m_error.empty())
+			m_error = dataError;
+
+		m_positions.clear();
+		m_positions.shrink_to_fit();
+		m_steps.clear();
+		error = m_error;
+		return m_error.empty();
+	}
+
+	uint64_t TrajectoryWriter::GetNumChunks() const
+	{
+		return m_chunks.size();
+	}
+
+	bool TrajectoryWriter::FlushChunk()
+	{
+		uint32_t numFrames = static_cast<uint32_t>(m_steps.size());
+		if (numFrames == 0 || !m_error.empty())
+			return m_error.empty();
+
+		//A chunk that ended early is packed to its real frame count, rows only move down
+		if (numFrames < m_chunkFrames)
+		{
+			for (uint32_t i = 1; i < m_numBodies; i++)
+				std::memmove(&m_positions[size_t(i) * numFrames * 3], &m_positions[size_t(i) * m_chunkFrames * 3], sizeof(float) * 3 * numFrames);
+		}
+
+		TrajectoryChunk chunk = {};
+		chunk.firstStep = m_steps.front();
+		chunk.lastStep = m_steps.back();
+		chunk.numFrames = numFrames;
+		chunk.numBodies = m_numBodies;
+		chunk.dataOffset = m_data.GetBytesWritten();
+
+		if (!m_data.Write(m_positions.data(), sizeof(float) * 3 * numFrames * size_t(m_numBodies)))
+		{
+			m_error = "could not write the trajectory data";
+			return false;
+		}
+
+		std::vector<uint32_t> binOffsets;
+		std::vector<uint32_t> binSlots;
+		BuildBins(chunk, binOffsets, binSlots);
+
+		bool written = WriteIndex(m_steps.data(), sizeof(uint64_t) * numFrames, chunk.stepsOffset);
+		if (!m_denseIds)
+		{
+			std::vector<uint32_t> sorted(m_numBodies);
+			std::iota(sorted.begin(), sorted.end(), 0u);
+			std::sort(sorted.begin(), sorted.end(), [this](const uint32_t & a, const uint32_t & b) { return m_ids[a] < m_ids[b]; });
+
+			written = written && WriteIndex(m_ids.data(), sizeof(uint64_t) * m_numBodies, chunk.idsOffset);
+			written = written && WriteIndex(sorted.data(), sizeof(uint32_t) * m_numBodies, chunk.sortedOffset);
+		}
+		written = written && WriteIndex(binOffsets.data(), sizeof(uint32_t) * binOffsets.size(), chunk.binOffsetsOffset);
+		written = written && WriteIndex(binSlots.data(), sizeof(uint32_t) * binSlots.size(), chunk.binSlotsOffset);
+		if (!written)
+		{
+			m_error = "could not write the trajectory index";
+			return false;
+		}
+
+		m_chunks.push_back(chunk);
+		m_steps.clear();
+		return true;
+	}
+
+	bool TrajectoryWriter::WriteIndex(const void* data, const size_t & size, uint64_t & offset)
+	{
+		//Every section starts 8 byte aligned so the reader can use the mapping in place
+		static const char padding[8] = {};
+		size_t pad = static_cast<size_t>((8 - m_indexSize % 8) % 8);
+		if (pad && std::fwrite(padding, 1, pad, m_index) != pad)
+			return false;
+
+		offset = m_indexSize + pad;
+		m_indexSize = offset + size;
+		return size == 0 || std::fwrite(data, 1, size, m_index) == size;
+	}
+
+	void TrajectoryWriter::BuildBins(TrajectoryChunk & chunk, std::vector<uint32_t> & binOffsets, std::vector<uint32_t> & binSlots) const
+	{
+		size_t numPoints = size_t(chunk.numBodies) * chunk.numFrames;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			chunk.min[axis] = m_positions[axis];
+			chunk.max[axis] = m_positions[axis];
+		}
+		for (size_t p = 1; p < numPoints; p++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				chunk.min[axis] = (std::min)(chunk.min[axis], m_positions[p * 3 + axis]);
+				chunk.max[axis] = (std::max)(chunk.max[axis], m_positions[p * 3 + axis]);
+			}
+		}
+
+		unsigned int bins = m_settings.binsPerAxis;
+		float scale[3];
+		for (int axis = 0; axis < 3; axis++)
+			scale[axis] = BinScale(chunk.min[axis], chunk.max[axis], bins);
+
+		//Distinct bins per slot, collected in slot order so every bin lists its slots sorted
+		std::vector<uint32_t> visitBins;
+		std::vector<uint32_t> visitSlots;
+		std::vector<uint32_t> slotBins;
+		binOffsets.assign(size_t(bins) * bins * bins + 1, 0);
+		for (uint32_t slot = 0; slot < chunk.numBodies; slot++)
+		{
+			slotBins.clear();
+			const float* p = &m_positions[size_t(slot) * chunk.numFrames * 3];
+			for (uint32_t frame = 0; frame < chunk.numFrames; frame++, p += 3)
+			{
+				uint32_t bin = (BinOf(p[2], chunk.min[2], scale[2], bins) * bins + BinOf(p[1], chunk.min[1], scale[1], bins)) * bins + BinOf(p[0], chunk.min[0], scale[0], bins);
+				if (slotBins.empty() || slotBins.back() != bin)
+					slotBins.push_back(bin);
+			}
+
+			std::sort(slotBins.begin(), slotBins.end());
+			slotBins.erase(std::unique(slotBins.begin(), slotBins.end()), slotBins.end());
+			for (uint32_t bin : slotBins)
+			{
+				visitBins.push_back(bin);
+				visitSlots.push_back(slot);
+				binOffsets[bin + 1]++;
+			}
+		}
+
+		std::partial_sum(binOffsets.begin(), binOffsets.end(), binOffsets.begin());
+		binSlots.resize(visitSlots.size());
+		std::vector<uint32_t> fill(binOffsets.begin(), binOffsets.end() - 1);
+		for (size_t v = 0; v < visitSlots.size(); v++)
+			binSlots[fill[visitBins[v]]++] = visitSlots[v];
+	}
+
+	bool TrajectoryReader::Open(const std::string & path, std::string & error)
+	{
+		Close();
+		if (!m_data.Open(path, error) || !m_index.Open(path + ".idx", error))
+		{
+			Close();
+			return false;
+		}
+
+		IndexHeader header;
+		if (m_index.GetSize() < sizeof(header))
+		{
+			error = path + ".idx is not a trajectory index";
+			Close();
+			return false;
+		}
+		std::memcpy(&header, m_index.GetData(), sizeof(header));
+
+		uint64_t indexSize = m_index.GetSize();
+		uint64_t dataSize = m_data.GetSize();
+		bool valid = std::memcmp(header.magic, TrajectoryMagic, sizeof(header.magic)) == 0 && header.version == TrajectoryVersion && header.binsPerAxis > 0;
+		valid = valid && header.numChunks <= indexSize / sizeof(TrajectoryChunk) && header.tableOffset <= indexSize - header.numChunks * sizeof(TrajectoryChunk);
+		if (valid)
+		{
+			m_binsPerAxis = header.binsPerAxis;
+			m_chunks.resize(static_cast<size_t>(header.numChunks));
+			if (!m_chunks.empty())
+				std::memcpy(m_chunks.data(), m_index.GetData() + header.tableOffset, sizeof(TrajectoryChunk) * m_chunks.size());
+		}
+
+		//Every section a query may touch has to lie inside the files
+		uint64_t numBins = uint64_t(m_binsPerAxis) * m_binsPerAxis * m_binsPerAxis;
+		auto fits = [](const uint64_t & offset, const uint64_t & bytes, const uint64_t & size) { return offset % 8 == 0 && offset <= size && bytes <= size - offset; };
+		for (size_t c = 0; c < m_chunks.size() && valid; c++)
+		{
+			const TrajectoryChunk & chunk = m_chunks[c];
+			valid = chunk.numFrames > 0 && chunk.numBodies > 0 && (c == 0 || chunk.firstStep > m_chunks[c - 1].lastStep);
+			valid = valid && chunk.dataOffset % 4 == 0 && chunk.dataOffset <= dataSize && uint64_t(chunk.numBodies) * chunk.numFrames * 3 * sizeof(float) <= dataSize - chunk.dataOffset;
+			valid = valid && fits(chunk.stepsOffset, sizeof(uint64_t) * chunk.numFrames, indexSize);
+			valid = valid && (chunk.idsOffset == 0 || (fits(chunk.idsOffset, sizeof(uint64_t) * chunk.numBodies, indexSize) && fits(chunk.sortedOffset, sizeof(uint32_t) * chunk.numBodies, indexSize)));
+			valid = valid && fits(chunk.binOffsetsOffset, sizeof(uint32_t) * (numBins + 1), indexSize);
+			valid = valid && fits(chunk.binSlotsOffset, sizeof(uint32_t) * uint64_t(IndexAt<uint32_t>(chunk.binOffsetsOffset)[numBins]), indexSize);
+		}
+
+		if (!valid)
+		{
+			error = path + ".idx is damaged or not a trajectory index";
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void TrajectoryReader::Close()
+	{
+		m_data.Close();
+		m_index.Close();
+		m_chunks.clear();
+		m_binsPerAxis = 0;
+	}
+
+	const std::vector<TrajectoryChunk> & TrajectoryReader::GetChunks() const
+	{
+		return m_chunks;
+	}
+
+	bool TrajectoryReader::GetTrajectory(const uint64_t & id, const uint64_t & firstStep, const uint64_t & lastStep, std::vector<TrajectoryPoint> & points) const
+	{
+		points.clear();
+		bool found = false;
+
+		auto chunk = std::lower_bound(m_chunks.begin(), m_chunks.end(), firstStep, [](const TrajectoryChunk & c, const uint64_t & step) { return c.lastStep < step; });
+		for (; chunk != m_chunks.end() && chunk->firstStep <= lastStep; ++chunk)
+		{
+			uint32_t slot;
+			if (!FindSlot(*chunk, id, slot))
+				continue;
+
+			uint32_t begin, end;
+			GetFrameRange(*chunk, firstStep, lastStep, begin, end);
+
+			const uint64_t* steps = IndexAt<uint64_t>(chunk->stepsOffset);
+			const float* p = DataAt(*chunk, slot) + begin * 3;
+			for (uint32_t frame = begin; frame < end; frame++, p += 3)
+				points.push_back({ steps[frame], p[0], p[1], p[2] });
+			found = true;
+		}
+
+		return found;
+	}
+
+	void TrajectoryReader::FindBodiesInRegion(const float min[3], const float max[3], const uint64_t & firstStep, const uint64_t & lastStep, std::vector<uint64_t> & ids) const
+	{
+		ids.clear();
+		unsigned int bins = m_binsPerAxis;
+		std::vector<uint32_t> candidates;
+
+		auto chunk = std::lower_bound(m_chunks.begin(), m_chunks.end(), firstStep, [](const TrajectoryChunk & c, const uint64_t & step) { return c.lastStep < step; });
+		for (; chunk != m_chunks.end() && chunk->firstStep <= lastStep; ++chunk)
+		{
+			bool overlaps = true;
+			for (int axis = 0; axis < 3; axis++)
+				overlaps = overlaps && min[axis] <= chunk->max[axis] && max[axis] >= chunk->min[axis];
+			if (!overlaps)
+				continue;
+
+			uint32_t begin, end;
+			GetFrameRange(*chunk, firstStep, lastStep, begin, end);
+			if (begin == end)
+				continue;
+			bool allFrames = begin == 0 && end == chunk->numFrames;
+
+			unsigned int binMin[3], binMax[3];
+			float scale[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				scale[axis] = BinScale(chunk->min[axis], chunk->max[axis], bins);
+				binMin[axis] = BinOf(min[axis], chunk->min[axis], scale[axis], bins);
+				binMax[axis] = BinOf(max[axis], chunk->min[axis], scale[axis], bins);
+			}
+
+			//Slots from bins that lie wholly inside the box were in it for some frame of the
+			//chunk, the rest are candidates checked against their positions
+			const uint32_t* binOffsets = IndexAt<uint32_t>(chunk->binOffsetsOffset);
+			const uint32_t* binSlots = IndexAt<uint32_t>(chunk->binSlotsOffset);
+			candidates.clear();
+			for (unsigned int z = binMin[2]; z <= binMax[2]; z++)
+			{
+				for (unsigned int y = binMin[1]; y <= binMax[1]; y++)
+				{
+					for (unsigned int x = binMin[0]; x <= binMax[0]; x++)
+					{
+						//Shrunk by a margin so rounding in BinOf cannot put a point just outside
+						unsigned int cell[3] = { x, y, z };
+						bool contained = allFrames;
+						for (int axis = 0; axis < 3 && contained; axis++)
+						{
+							float margin = (chunk->max[axis] - chunk->min[axis]) * 1e-5f;
+							float binLow = scale[axis] > 0.0f ? chunk->min[axis] + cell[axis] / scale[axis] : chunk->min[axis];
+							float binHigh = scale[axis] > 0.0f ? chunk->min[axis] + (cell[axis] + 1) / scale[axis] : chunk->max[axis];
+							contained = binLow - margin >= min[axis] && binHigh + margin <= max[axis];
+						}
+
+						uint32_t bin = (z * bins + y) * bins + x;
+						for (uint32_t s = binOffsets[bin]; s < binOffsets[bin + 1]; s++)
+						{
+							if (contained)
+								ids.push_back(GetId(*chunk, binSlots[s]));
+							else
+								candidates.push_back(binSlots[s]);
+						}
+					}
+				}
+			}
+
+			std::sort(candidates.begin(), candidates.end());
+			candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+			for (uint32_t slot : candidates)
+			{
+				const float* p = DataAt(*chunk, slot) + begin * 3;
+				for (uint32_t frame = begin; frame < end; frame++, p += 3)
+				{
+					if (Inside(p, min, max))
+					{
+						ids.push_back(GetId(*chunk, slot));
+						break;
+					}
+				}
+			}
+		}
+
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	}
+
+	bool TrajectoryReader::FindSlot(const TrajectoryChunk & chunk, const uint64_t & id, uint32_t & slot) const
+	{
+		if (chunk.idsOffset == 0)
+		{
+			slot = static_cast<uint32_t>(id);
+			return id < chunk.numBodies;
+		}
+
+		const uint64_t* ids = IndexAt<uint64_t>(chunk.idsOffset);
+		const uint32_t* sorted = IndexAt<uint32_t>(chunk.sortedOffset);
+		const uint32_t* found = std::lower_bound(sorted, sorted + chunk.numBodies, id, [ids](const uint32_t & s, const uint64_t & value) { return ids[s] < value; });
+		if (found == sorted + chunk.numBodies || ids[*found] != id)
+			return false;
+
+		slot = *found;
+		return true;
+	}
+
+	uint64_t TrajectoryReader::GetId(const TrajectoryChunk & chunk, const uint32_t & slot) const
+	{
+		return chunk.idsOffset == 0 ? slot : IndexAt<uint64_t>(chunk.idsOffset)[slot];
+	}
+
+	void TrajectoryReader::GetFrameRange(const TrajectoryChunk & chunk, const uint64_t & firstStep, const uint64_t & lastStep, uint32_t & begin, uint32_t & end) const
+	{
+		const uint64_t* steps = IndexAt<uint64_t>(chunk.stepsOffset);
+		begin = static_cast<uint32_t>(std::lower_bound(steps, steps + chunk.numFrames, firstStep) - steps);
+		end = static_cast<uint32_t>(std::upper_bound(steps, steps + chunk.numFrames, lastStep) - steps);
+	}
+}
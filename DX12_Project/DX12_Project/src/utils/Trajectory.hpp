@@ -0,0 +1,123 @@
+#pragma once
+#include <simulation/Body.hpp>
+#include <utils/AsyncFileWriter.hpp>
+#include <utils/MappedFile.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Recorded trajectories with an index that is built while they are written. Frames are
+//grouped into chunks of consecutive steps stored body major, so one body's path through a
+//chunk is a single contiguous run. Next to the data file (<path>) an index file
+//(<path>.idx) keeps per chunk the step numbers, the body ID -> slot map, the bounding box
+//and a coarse grid of which bodies passed through which bin. Queries map both files and
+//only touch the chunks (and inside them the bodies) they need.
+namespace dx
+{
+	struct TrajectorySettings
+	{
+		size_t chunkBytes = size_t(32) << 20;		//Target data bytes per chunk
+		unsigned int maxChunkFrames = 256;
+		unsigned int binsPerAxis = 16;				//Spatial grid over each chunk's bounding box
+		AsyncIOSettings io;
+	};
+
+	//Summary of one chunk, also the on-disk table entry of the index file
+	struct TrajectoryChunk
+	{
+		uint64_t firstStep;
+		uint64_t lastStep;
+		uint64_t dataOffset;			//Data file, numBodies * numFrames float3 body major
+		uint64_t stepsOffset;			//Index file, uint64 step per frame
+		uint64_t idsOffset;				//Index file, uint64 ID per slot, 0 when ID == slot
+		uint64_t sortedOffset;			//Index file, uint32 slots ordered by ID
+		uint64_t binOffsetsOffset;		//Index file, uint32 per bin + 1 into the bin slots
+		uint64_t binSlotsOffset;		//Index file, uint32 slots that visited each bin
+		uint32_t numFrames;
+		uint32_t numBodies;
+		float min[3];
+		float max[3];
+	};
+
+	struct TrajectoryPoint
+	{
+		uint64_t step;
+		float x, y, z;
+	};
+
+	class TrajectoryWriter
+	{
+	public:
+		TrajectoryWriter(const TrajectorySettings & settings = TrajectorySettings());
+		~TrajectoryWriter();
+
+	public:
+		bool Open(const std::string & path, std::string & error);
+
+		//Steps must increase. ids, when given, holds one ID per body; without them the body
+		//index is its ID. A chunk ends early when the body count or the IDs change.
+		bool AppendFrame(const uint64_t & step, const BodyArray & bodies, const uint64_t* ids = nullptr);
+		bool Close(std::string & error);
+
+		uint64_t GetNumChunks() const;
+
+	private:
+		bool FlushChunk();
+		bool WriteIndex(const void* data, const size_t & size, uint64_t & offset);
+		void BuildBins(TrajectoryChunk & chunk, std::vector<uint32_t> & binOffsets, std::vector<uint32_t> & binSlots) const;
+
+	private:
+		TrajectorySettings m_settings;
+		AsyncFileWriter m_data;
+		FILE* m_index = nullptr;
+		uint64_t m_indexSize = 0;
+		std::vector<TrajectoryChunk> m_chunks;
+
+		std::vector<float> m_positions;			//Current chunk, body major
+		std::vector<uint64_t> m_steps;
+		std::vector<uint64_t> m_ids;
+		bool m_denseIds = true;
+		uint32_t m_numBodies = 0;
+		uint32_t m_chunkFrames = 0;
+		bool m_hasStep = false;
+		uint64_t m_lastStep = 0;
+		std::string m_error;
+	};
+
+	class TrajectoryReader
+	{
+	public:
+		bool Open(const std::string & path, std::string & error);
+		void Close();
+
+		const std::vector<TrajectoryChunk> & GetChunks() const;
+
+		//Positions of one body for every recorded step in [firstStep, lastStep]
+		bool GetTrajectory(const uint64_t & id, const uint64_t & firstStep, const uint64_t & lastStep, std::vector<TrajectoryPoint> & points) const;
+
+		//IDs of the bodies that were inside the box at some recorded step in [firstStep, lastStep], sorted
+		void FindBodiesInRegion(const float min[3], const float max[3], const uint64_t & firstStep, const uint64_t & lastStep, std::vector<uint64_t> & ids) const;
+
+	private:
+		bool FindSlot(const TrajectoryChunk & chunk, const uint64_t & id, uint32_t & slot) const;
+		uint64_t GetId(const TrajectoryChunk & chunk, const uint32_t & slot) const;
+		void GetFrameRange(const TrajectoryChunk & chunk, const uint64_t & firstStep, const uint64_t & lastStep, uint32_t & begin, uint32_t & end) const;
+
+		template <typename T>
+		const T* IndexAt(const uint64_t & offset) const
+		{
+			return reinterpret_cast<const T*>(m_index.GetData() + offset);
+		}
+
+		const float* DataAt(const TrajectoryChunk & chunk, const uint32_t & slot) const
+		{
+			return reinterpret_cast<const float*>(m_data.GetData() + chunk.dataOffset) + uint64_t(slot) * chunk.numFrames * 3;
+		}
+
+	private:
+		MappedFile m_data;
+		MappedFile m_index;
+		std::vector<TrajectoryChunk> m_chunks;
+		unsigned int m_binsPerAxis = 0;
+	};
+}